@@ -4,7 +4,7 @@
 #include "include/StBridge.h"
 #include "include/lvdocview.h"
 
-class CreBridge : public StBridge
+class CreBridge : public StBridge, public LVRendCallback
 {
 private:
     LVDocView* doc_view_;
@@ -16,6 +16,8 @@ public:
     void process(CmdRequest& request, CmdResponse& response);
 
 protected:
+    bool idle();
+    bool OnRenderProgress(int percent, int pages);
     void processFonts(CmdRequest& request, CmdResponse& response);
     void processConfig(CmdRequest& request, CmdResponse& response);
     void processOpen(CmdRequest& request, CmdResponse& response);
@@ -24,11 +26,12 @@ protected:
     void processPage(CmdRequest& request, CmdResponse& response);
     void processPageLinks(CmdRequest& request, CmdResponse& response);
     void processPageRender(CmdRequest& request, CmdResponse& response);
+    void processSearch(CmdRequest& request, CmdResponse& response);
     void processPageByXPath(CmdRequest& request, CmdResponse& response);
     void processPageXPath(CmdRequest& request, CmdResponse& response);
     void processMetadata(CmdRequest& request, CmdResponse& response);
+    void processCacheStats(CmdRequest& request, CmdResponse& response);
     void responseAddString(CmdResponse& response, lString16 str16);
-    void convertBitmap(LVColorDrawBuf* bitmap);
     void responseAddLinkUnknown(CmdResponse& response, lString16 href,
                                 float l, float t, float r, float b);
 };
@@ -38,8 +38,48 @@ public:
     bool open();
 };
 
+class EmbeddedFontStyleParser;
+
+/// EPUB import split into steps, so that a part of the book can be shown while the rest is parsed.
+/// Every XHTML spine item becomes DocFragment, either parsed or an empty placeholder
+/// which keeps numbering (and so xpaths) of the following fragments.
+class EpubImporter
+{
+    CrDom* _doc;
+    LVContainerRef _arc;
+    lString16 _ncxHref;
+    lString16Collection _names;
+    lString16Collection _ids;
+    LVEmbeddedFontList _fontList;
+    EmbeddedFontStyleParser* _styleParser;
+    LvDomWriter* _writer;
+    LvDocFragmentWriter* _appender;
+    int _next;
+    int _parsed;
+    bool _started;
+    bool _encrypted;
+public:
+    EpubImporter(CrDom* doc);
+    ~EpubImporter();
+    /// reads package and opens document body, false if stream is not EPUB
+    bool open(LVStreamRef stream);
+    /// number of XHTML spine items
+    int getFragmentCount() { return _names.length(); }
+    /// index of fragment parsed by next parseNext() call
+    int getNextFragment() { return _next; }
+    bool hasNext() { return _next < _names.length(); }
+    /// parses next fragment, or writes its placeholder, returns size of parsed source
+    lvsize_t parseNext(bool placeholder = false);
+    /// closes document body, reads TOC and registers embedded fonts,
+    /// false if no fragment was parsed
+    bool finish();
+};
+
 bool DetectEpubFormat(LVStreamRef stream);
 bool ImportEpubDocument(LVStreamRef stream, CrDom * doc);
 lString16 EpubGetRootFilePath(LVContainerRef m_arc);
+/// opens EPUB archive with decryption of obfuscated items, as ImportEpubDocument() does,
+/// returns NULL ref for non-EPUB archives and for unsupported encryption (DRM)
+LVContainerRef EpubOpenContainer(LVStreamRef stream);
 
 #endif // EPUBFMT_H
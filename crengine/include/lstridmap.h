@@ -101,6 +101,11 @@ public:
 
     // debug dump of all unknown entities
     void dumpUnknownItems(FILE * f, int start_id);
+
+    /// writes items with id >= start_id, i.e. the ones added while parsing the document
+    void serialize(SerialBuf & buf, int start_id);
+    /// adds items written by serialize()
+    bool deserialize(SerialBuf & buf);
 };
 
 #endif
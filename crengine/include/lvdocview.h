@@ -60,6 +60,8 @@ public:
     void SelectWord(int x, int y);
 };
 
+class EpubImporter;
+
 class LVDocView
 {
 private:
@@ -87,12 +89,28 @@ private:
     lvRect margins_;
     bool show_cover_;
     bool background_tiled_;
+    ldomCacheKey doc_key_; // identifies source document and parsing options in cache file
+    bool doc_cacheable_;
+    lString16 start_xpath_;
+    EpubImporter* loader_; // imports the whole book while partial document is shown
+    CrDom* loader_dom_;
+    LVRendCallback* render_callback_;
 
     void UpdateScrollInfo();
     /// load document from stream
     bool LoadDoc(int doc_format, LVStreamRef stream);
+    /// replace document with parsed and rendered one from cache file, if there is one
+    bool LoadDocFromCache(int doc_format, LVStreamRef stream);
+    /// cache file name for current document
+    lString16 GetCacheFileName();
     /// create empty document with specified message (to show errors)
     void CreateEmptyDom();
+    /// create new document object, keeping loaded document properties and container
+    void InitDom();
+    /// new empty document with current settings
+    CrDom* CreateDom(CRPropRef props);
+    /// import EPUB fragments around start xpath only, the rest is loaded by ContinueLoading()
+    bool LoadEpubPartially();
     /// ensure current position is set to current bookmark value
     void CheckPos();
     /// set properties before rendering
@@ -113,6 +131,12 @@ public:
     bool config_embeded_fonts_;
     bool config_enable_footnotes_;
     bool config_txt_smart_format_;
+    lString16 config_cache_dir_;
+    bool config_lazy_loading_;
+    int config_layout_threads_;
+    /// unpacked storage budget in bytes, 0 for default
+    int config_storage_memory_;
+    int config_storage_codec_;
 
     inline bool IsPagesMode() { return viewport_mode_ == MODE_PAGES; }
     inline bool IsScrollMode() { return viewport_mode_ == MODE_SCROLL; }
@@ -213,8 +237,19 @@ public:
     int GetPagesCount();
     /// clear view
     void Clear();
-    /// load document from file
-    bool LoadDoc(int doc_format, const char* crengine_uri);
+    /// load document from file, start xpath is where reading continues (used in lazy loading mode)
+    bool LoadDoc(int doc_format, const char* crengine_uri, const char* start_xpath = NULL);
+    /// true while partial document is shown and the whole one is being loaded
+    bool IsLoading() { return loader_ != NULL; }
+    /// one step of background loading, returns false when there is nothing left to do;
+    /// the last step replaces partial document with the whole one and paginates it
+    bool ContinueLoading();
+    void CancelLoading();
+    /// write document to cache file if it was parsed or rendered since it was loaded,
+    /// returns true if cache file was written
+    bool SaveDocToCache();
+    /// set receiver of pagination progress, it may abort rendering
+    void SetRenderCallback(LVRendCallback* callback) { render_callback_ = callback; }
     LVDocView();
     ~LVDocView();
 };
@@ -91,6 +91,8 @@ public:
     virtual int  GetHeight() = 0;
     /// get buffer bits per pixel
     virtual int  GetBitsPerPixel() = 0;
+    /// returns true if 32-bit pixels are stored in Android RGBA byte order
+    virtual bool IsAndroidRGBA() { return false; }
     /// fills buffer with specified color
     virtual int  GetRowSize() = 0;
     /// fills buffer with specified color
@@ -323,6 +325,12 @@ inline lUInt16 rgb888to565(lUInt32 cl)
     return (lUInt16)(((cl>>8)& 0xF800) | ((cl>>5 )& 0x07E0) | ((cl>>3 )& 0x001F));
 }
 
+/// converts 0xAARRGGBB color (alpha 0 is opaque) to Android RGBA pixel, and back
+inline lUInt32 rgbToAndroidRGBA(lUInt32 cl)
+{
+    return ((cl>>16)&255) | ((cl<<16)&0xFF0000) | (cl&0x00FF00) | (~cl&0xFF000000);
+}
+
 /// 32-bit RGB buffer
 class LVColorDrawBuf : public LVBaseDrawBuf
 {
@@ -333,6 +341,9 @@ private:
 #endif
     int _bpp;
     bool _ownData;
+    bool _rgba;
+    /// converts color to value stored in buffer, and stored value back to color
+    lUInt32 ToPixel( lUInt32 color ) { return _rgba ? rgbToAndroidRGBA(color) : color; }
 public:
     /// returns white pixel value
     virtual lUInt32 GetWhiteColor();
@@ -352,6 +363,8 @@ public:
     virtual void  Invert();
     /// get buffer bits per pixel
     virtual int  GetBitsPerPixel();
+    /// returns true if 32-bit pixels are stored in Android RGBA byte order
+    virtual bool IsAndroidRGBA() { return _rgba; }
     /// fills buffer with specified color
     virtual void Clear( lUInt32 color );
     /// get pixel value
@@ -373,8 +386,8 @@ public:
 
     /// create own draw buffer
     LVColorDrawBuf(int dx, int dy, int bpp=32);
-    /// creates wrapper around external RGBA buffer
-    LVColorDrawBuf(int dx, int dy, lUInt8 * externalBuffer, int bpp=32 );
+    /// creates wrapper around external RGBA buffer, rgba stores 32-bit pixels as Android expects them
+    LVColorDrawBuf(int dx, int dy, lUInt8 * externalBuffer, int bpp=32, bool rgba=false );
     /// destructor
     virtual ~LVColorDrawBuf();
     /// convert to 1-bit bitmap
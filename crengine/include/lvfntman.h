@@ -25,59 +25,106 @@
 class LVDrawBuf;
 
 struct LVFontGlyphCacheItem;
+class LVFontLocalGlyphCache;
 
+/// block of memory glyph items are packed into, evicted as a whole
+struct LVFontGlyphAtlasPage
+{
+    LVFontGlyphAtlasPage * next;
+    int size;
+    int used;
+    /// clock value of the last hit or allocation in this page
+    lUInt32 touched;
+    lUInt8 * data;
+};
+
+/// glyph bitmaps shared by all faces, kept within byte budget
 class LVFontGlobalGlyphCache
 {
 private:
-    LVFontGlyphCacheItem * head;
-    LVFontGlyphCacheItem * tail;
+    /// oldest page
+    LVFontGlyphAtlasPage * head;
+    /// page new items are placed in
+    LVFontGlyphAtlasPage * tail;
     int size;
     int max_size;
-    void removeNoLock( LVFontGlyphCacheItem * item );
-    void putNoLock( LVFontGlyphCacheItem * item );
+    lUInt32 hits;
+    lUInt32 misses;
+    lUInt32 evictions;
+    lUInt32 clock;
+    void evictPage();
+    void dropPage( LVFontGlyphAtlasPage * prev, LVFontGlyphAtlasPage * page );
 public:
     LVFontGlobalGlyphCache( int maxSize )
-        : head(NULL), tail(NULL), size(0), max_size(maxSize )
+        : head(NULL), tail(NULL), size(0), max_size(maxSize ), hits(0), misses(0), evictions(0), clock(0)
     {
     }
     ~LVFontGlobalGlyphCache()
     {
         clear();
     }
+    /// allocates item in atlas page, never evicts so that items returned before stay valid
+    LVFontGlyphCacheItem * alloc( LVFontLocalGlyphCache * local_cache, lChar16 ch, int w, int h );
+    /// called when allocated item is filled, evicts least recently touched pages above budget
     void put( LVFontGlyphCacheItem * item );
-    void remove( LVFontGlyphCacheItem * item );
-    void refresh( LVFontGlyphCacheItem * item );
     void clear();
+    /// counts a hit and keeps the page of the item from eviction
+    void touch( LVFontGlyphCacheItem * item );
+    void addMiss() { misses++; }
+    lUInt32 getHits() const { return hits; }
+    lUInt32 getMisses() const { return misses; }
+    /// atlas pages dropped to stay within budget
+    lUInt32 getEvictions() const { return evictions; }
+    /// bytes taken by atlas pages
+    int getSize() const { return size; }
+    int getMaxSize() const { return max_size; }
 };
 
+#define GLYPH_TABLE_BLOCKS 256
+#define GLYPH_TABLE_BLOCK_SIZE 256
+
+/// glyphs of single face, direct-indexed by character
 class LVFontLocalGlyphCache
 {
 private:
-    LVFontGlyphCacheItem * head;
-    LVFontGlyphCacheItem * tail;
+    LVFontGlyphCacheItem ** table[GLYPH_TABLE_BLOCKS];
     LVFontGlobalGlyphCache * global_cache;
-    int size;
 public:
     LVFontLocalGlyphCache( LVFontGlobalGlyphCache * globalCache )
-        : head(NULL), tail(NULL), global_cache( globalCache )
-    { }
+        : global_cache( globalCache )
+    {
+        memset( table, 0, sizeof(table) );
+    }
     ~LVFontLocalGlyphCache()
     {
         clear();
     }
     void clear();
-    LVFontGlyphCacheItem * get( lUInt16 ch );
+    LVFontGlyphCacheItem * get( lUInt16 ch )
+    {
+        LVFontGlyphCacheItem ** block = table[ch >> 8];
+        LVFontGlyphCacheItem * item = block ? block[ch & 0xFF] : NULL;
+        if ( item )
+            global_cache->touch( item );
+        else
+            global_cache->addMiss();
+        return item;
+    }
+    /// allocates new item, to be filled and passed to put()
+    LVFontGlyphCacheItem * newItem( lChar16 ch, int w, int h )
+    {
+        return global_cache->alloc( this, ch, w, h );
+    }
     void put( LVFontGlyphCacheItem * item );
+    /// remove from table, but don't delete
     void remove( LVFontGlyphCacheItem * item );
 };
 
 struct LVFontGlyphCacheItem
 {
-    LVFontGlyphCacheItem * prev_global;
-    LVFontGlyphCacheItem * next_global;
-    LVFontGlyphCacheItem * prev_local;
-    LVFontGlyphCacheItem * next_local;
+    /// NULL once removed from local cache, space is reclaimed with atlas page
     LVFontLocalGlyphCache * local_cache;
+    LVFontGlyphAtlasPage * page;
     lChar16 ch;
     lUInt8 bmp_width;
     lUInt8 bmp_height;
@@ -88,29 +135,13 @@ struct LVFontGlyphCacheItem
 
     int getSize()
     {
-        return sizeof(LVFontGlyphCacheItem)
-            + (bmp_width * bmp_height - 1) * sizeof(lUInt8);
-    }
-    static LVFontGlyphCacheItem * newItem( LVFontLocalGlyphCache * local_cache, lChar16 ch, int w, int h )
-    {
-        LVFontGlyphCacheItem * item = (LVFontGlyphCacheItem *)malloc( sizeof(LVFontGlyphCacheItem)
-            + (w*h - 1)*sizeof(lUInt8) );
-        item->ch = ch;
-        item->bmp_width = (lUInt8)w;
-        item->bmp_height = (lUInt8)h;
-        item->origin_x =   0;
-        item->origin_y =   0;
-        item->advance =    0;
-        item->prev_global = NULL;
-        item->next_global = NULL;
-        item->prev_local = NULL;
-        item->next_local = NULL;
-        item->local_cache = local_cache;
-        return item;
+        return getSize( bmp_width, bmp_height );
     }
-    static void freeItem( LVFontGlyphCacheItem * item )
+    /// size of item in atlas page, aligned for next item
+    static int getSize( int w, int h )
     {
-        free( item );
+        int sz = sizeof(LVFontGlyphCacheItem) + (w * h - 1) * sizeof(lUInt8);
+        return (sz + 7) & ~7;
     }
 };
 
@@ -318,6 +349,8 @@ public:
     virtual lUInt32 GetFontListHash(int /*documentId*/) { return 0; }
     /// clear glyph cache
     virtual void clearGlyphCache() { }
+    /// returns glyph cache shared by all faces, NULL if font engine has none
+    virtual LVFontGlobalGlyphCache * getGlyphCache() { return NULL; }
 
     /// get antialiasing mode
     virtual int GetAntialiasMode() { return _antialiasMode; }
@@ -32,6 +32,8 @@ public:
     virtual void OnStartDecode( LVImageSource * obj ) = 0;
     virtual bool OnLineDecoded( LVImageSource * obj, int y, lUInt32 * data ) = 0;
     virtual void OnEndDecode( LVImageSource * obj, bool errors ) = 0;
+    /// called by DecodeScaled() before the first line when rows are smaller than GetWidth() x GetHeight()
+    virtual void OnDecodeSize( LVImageSource * obj, int dx, int dy ) { CR_UNUSED3(obj, dx, dy); }
 };
 
 struct CR9PatchInfo {
@@ -59,6 +61,9 @@ public:
     virtual int    GetWidth() = 0;
     virtual int    GetHeight() = 0;
     virtual bool   Decode( LVImageDecoderCallback * callback ) = 0;
+    /// decodes image reduced as much as decoder can afford while staying not smaller than dx x dy,
+    /// reduced size is reported via OnDecodeSize(); default implementation decodes at full size
+    virtual bool   DecodeScaled( LVImageDecoderCallback * callback, int dx, int dy ) { CR_UNUSED2(dx, dy); return Decode( callback ); }
     LVImageSource() : _ninePatch(NULL) {}
     virtual ~LVImageSource();
 };
@@ -102,6 +107,8 @@ LVImageSourceRef LVCreateUnpackedImageSource(LVImageSourceRef srcImage,
 LVImageSourceRef LVCreateUnpackedImageSource(LVImageSourceRef srcImage, int maxSize, int bpp);
 /// creates image source based on draw buffer
 LVImageSourceRef LVCreateDrawBufImageSource(LVColorDrawBuf* buf, bool own);
+/// creates decoded memory copy of image resized to dx x dy, decoding at reduced size when possible
+LVImageSourceRef LVCreateScaledImageSource(LVImageSourceRef srcImage, int dx, int dy);
 
 #define COLOR_TRANSFORM_BRIGHTNESS_NONE 0x808080
 #define COLOR_TRANSFORM_CONTRAST_NONE 0x404040
@@ -303,11 +303,24 @@ public:
     void clear() { lines.clear(); }
 };
 
+/// receives progress of document pagination
+class LVRendCallback
+{
+public:
+    /// called every few percent of rendered final blocks, pages is estimated from the height
+    /// laid out so far; returning true aborts rendering
+    virtual bool OnRenderProgress( int percent, int pages ) = 0;
+    virtual ~LVRendCallback() { }
+};
+
 class LVRendPageContext
 {
     LVPtrVector<LVRendLineInfo> lines;
     int totalFinalBlocks;
     int renderedFinalBlocks;
+    LVRendCallback * callback;
+    int lastPercent;
+    bool aborted;
 
     // page start line
     //LVRendLineInfoBase pagestart;
@@ -340,11 +353,14 @@ class LVRendPageContext
 public:
 
 
-    void setCallback(int _totalFinalBlocks)
+    void setCallback(int _totalFinalBlocks, LVRendCallback * _callback = NULL)
     {
         totalFinalBlocks=_totalFinalBlocks;
+        callback=_callback;
     }
+    /// returns true if callback asked to abort rendering
     bool updateRenderProgress( int numFinalBlocksRendered );
+    bool isAborted() { return aborted; }
 
     /// append footnote link to last added line
     void addLink( lString16 id );
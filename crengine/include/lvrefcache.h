@@ -17,6 +17,7 @@
 
 #include "lvref.h"
 #include "lvarray.h"
+#include "lvhashtable.h"
 
 /*
     Object cache
@@ -408,6 +409,17 @@ public:
     }
 };
 
+/*
+    LRU cache map
+
+    Items are found by hash of key and kept in list ordered by last access,
+    least recently used items are dropped when total size of items exceeds
+    maxSize. Size of item is passed to set(), by default every item counts as 1
+    and maxSize is just a number of items.
+
+    Requirements:
+       lUInt32 getHash( keyT ) should be defined
+*/
 template <typename keyT, class dataT> class LVCacheMap
 {
 private:
@@ -415,28 +427,89 @@ private:
     public: 
         keyT key;
         dataT data;
-        int lastAccess;
+        int size;
+        /// more recently used item
+        Pair * prev;
+        /// less recently used item
+        Pair * next;
+        Pair * nextInBucket;
     };
-    Pair * buf;
-    int size;
+    Pair ** table;
+    int tableSize;
+    /// most recently used item
+    Pair * head;
+    /// least recently used item, evicted first
+    Pair * tail;
+    int maxSize;
+    int usedSize;
     int numitems;
-    int lastAccess;
-    void checkOverflow( int oldestAccessTime )
-    {
-        int i;
-        if ( oldestAccessTime==-1 ) {
-            for ( i=0; i<size; i++ )
-                if ( oldestAccessTime==-1 || buf[i].lastAccess>oldestAccessTime )
-                    oldestAccessTime = buf[i].lastAccess;
+    lUInt32 hits;
+    lUInt32 misses;
+    lUInt32 evictions;
+
+    /// folds high bits of hash down, keys like pointers differ in upper bits only
+    static lUInt32 bucket( const keyT & key, int size )
+    {
+        lUInt32 h = getHash( key );
+        return (h ^ (h >> 16)) & (size - 1);
+    }
+    Pair ** findSlot( const keyT & key )
+    {
+        Pair ** slot = &table[ bucket( key, tableSize ) ];
+        while ( *slot && !((*slot)->key == key) )
+            slot = &(*slot)->nextInBucket;
+        return slot;
+    }
+    void unlink( Pair * p )
+    {
+        if ( p->prev )
+            p->prev->next = p->next;
+        else
+            head = p->next;
+        if ( p->next )
+            p->next->prev = p->prev;
+        else
+            tail = p->prev;
+        p->prev = p->next = NULL;
+    }
+    void pushFront( Pair * p )
+    {
+        p->prev = NULL;
+        p->next = head;
+        if ( head )
+            head->prev = p;
+        else
+            tail = p;
+        head = p;
+    }
+    void removeSlot( Pair ** slot )
+    {
+        Pair * p = *slot;
+        *slot = p->nextInBucket;
+        unlink( p );
+        usedSize -= p->size;
+        numitems--;
+        delete p;
+    }
+    void resize( int newSize )
+    {
+        Pair ** newTable = new Pair * [ newSize ];
+        memset( newTable, 0, sizeof(Pair *) * newSize );
+        for ( Pair * p = head; p; p = p->next ) {
+            Pair ** slot = &newTable[ bucket( p->key, newSize ) ];
+            p->nextInBucket = *slot;
+            *slot = p;
         }
-        if ( oldestAccessTime>1000000000 ) {
-            int maxLastAccess = 0;
-            for ( i=0; i<size; i++ ) {
-                buf[i].lastAccess -= 1000000000;
-                if ( maxLastAccess==0 || buf[i].lastAccess>maxLastAccess )
-                    maxLastAccess = buf[i].lastAccess;
-            }
-            lastAccess = maxLastAccess+1;
+        delete[] table;
+        table = newTable;
+        tableSize = newSize;
+    }
+    /// drops least recently used items above size limit, keeping at least one item
+    void shrink()
+    {
+        while ( usedSize > maxSize && tail && tail != head ) {
+            removeSlot( findSlot( tail->key ) );
+            evictions++;
         }
     }
 public:
@@ -445,74 +518,85 @@ public:
         return numitems;
     }
     LVCacheMap( int maxSize )
-    : size(maxSize), numitems(0), lastAccess(1)
+    : tableSize(16), head(NULL), tail(NULL), maxSize(maxSize), usedSize(0), numitems(0)
+    , hits(0), misses(0), evictions(0)
     {
-        buf = new Pair[ size ];
-        clear();
+        table = new Pair * [ tableSize ];
+        memset( table, 0, sizeof(Pair *) * tableSize );
     }
     void clear()
     {
-        for ( int i=0; i<size; i++ )
-        {
-            buf[i].key = keyT();
-            buf[i].data = dataT();
-            buf[i].lastAccess = 0;
+        while ( head ) {
+            Pair * p = head;
+            head = p->next;
+            delete p;
         }
+        tail = NULL;
+        memset( table, 0, sizeof(Pair *) * tableSize );
+        usedSize = 0;
         numitems = 0;
     }
     bool get( keyT key, dataT & data )
     {
-        for ( int i=0; i<size; i++ ) {
-            if ( buf[i].key == key ) {
-                data = buf[i].data;
-                buf[i].lastAccess = ++lastAccess;
-                if ( lastAccess>1000000000 )
-                    checkOverflow(-1);
-                return true;
-            }
+        Pair * p = *findSlot( key );
+        if ( !p ) {
+            misses++;
+            return false;
         }
-        return false;
+        hits++;
+        data = p->data;
+        if ( p != head ) {
+            unlink( p );
+            pushFront( p );
+        }
+        return true;
     }
     bool remove( keyT key )
     {
-        for ( int i=0; i<size; i++ ) {
-            if ( buf[i].key == key ) {
-                buf[i].key = keyT();
-                buf[i].data = dataT();
-                buf[i].lastAccess = 0;
-                numitems--;
-                return true;
-            }
-        }
-        return false;
+        Pair ** slot = findSlot( key );
+        if ( !*slot )
+            return false;
+        removeSlot( slot );
+        return true;
     }
-    void set( keyT key, dataT data )
+    /// puts item to cache, size is in the same units as maxSize
+    void set( keyT key, dataT data, int size = 1 )
     {
-        int oldestAccessTime = -1;
-        int oldestIndex = 0;
-        for ( int i=0; i<size; i++ ) {
-            if ( buf[i].key == key ) {
-                buf[i].data = data;
-                buf[i].lastAccess = ++lastAccess;
-                return;
-            }
-            int at = buf[i].lastAccess;
-            if ( at < oldestAccessTime || oldestAccessTime==-1 ) {
-                oldestAccessTime = at;
-                oldestIndex = i;
-            }
-        }
-        checkOverflow(oldestAccessTime);
-        if ( buf[oldestIndex].key==keyT() )
+        Pair ** slot = findSlot( key );
+        Pair * p = *slot;
+        if ( p ) {
+            unlink( p );
+            usedSize -= p->size;
+        } else {
+            p = new Pair();
+            p->key = key;
+            p->nextInBucket = NULL;
+            *slot = p;
             numitems++;
-        buf[oldestIndex].key = key;
-        buf[oldestIndex].data = data;
-        buf[oldestIndex].lastAccess = ++lastAccess;
-        return;
+            if ( numitems > tableSize * 2 )
+                resize( tableSize * 4 );
+        }
+        p->data = data;
+        p->size = size;
+        usedSize += size;
+        pushFront( p );
+        shrink();
+    }
+    /// total size of items
+    int getSize() { return usedSize; }
+    int getMaxSize() { return maxSize; }
+    void setMaxSize( int size )
+    {
+        maxSize = size;
+        shrink();
     }
+    lUInt32 getHits() { return hits; }
+    lUInt32 getMisses() { return misses; }
+    lUInt32 getEvictions() { return evictions; }
     ~LVCacheMap()
     {
-        delete[] buf;
+        clear();
+        delete[] table;
     }
 };
 
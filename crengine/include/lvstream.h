@@ -728,6 +728,10 @@ public:
     {
         lvsize_t bytesRead = 0;
         lvpos_t p;
+        if ( m_pos >= m_size )
+            size = 0;
+        else if ( size > m_size - m_pos )
+            size = m_size - m_pos;
         lverror_t res = m_stream->Seek( m_pos+m_start, LVSEEK_SET, &p );
         if ( res!=LVERR_OK )
             return res;
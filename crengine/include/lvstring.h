@@ -1059,6 +1059,12 @@ public:
     /// add contents of another buffer
     SerialBuf & operator << ( const SerialBuf & v );
 
+    /// add raw bytes
+    void putBytes( const lUInt8 * data, int size );
+
+    /// read raw bytes, returns false if less than size bytes are left
+    bool getBytes( lUInt8 * data, int size );
+
 	SerialBuf & operator << ( lUInt8 n );
 
     SerialBuf & operator << ( char n );
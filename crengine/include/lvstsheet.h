@@ -15,6 +15,7 @@
 
 #include "cssdef.h"
 #include "lvstyles.h"
+#include "lvhashtable.h"
 
 class CrDomXml;
 class ldomNode;
@@ -90,6 +91,7 @@ public:
     LVCssSelectorRuleType getType() { return _type; };
     void setType(LVCssSelectorRuleType type) { _type = type; };
     void setId(lUInt16 id) { _id = id; }
+    lUInt16 getId() { return _id; }
     lUInt16 getAttrId() { return _attrid; }
     lString16 getValue() { return _value; }
     void setAttr(lUInt16 attr_id, lString16 value) { _attrid = attr_id; _value = value; }
@@ -131,6 +133,7 @@ public:
     }
     bool parse(const char* &str, CrDomXml* doc);
     lUInt16 getElementNameId() { return _id; }
+    LVCssSelectorRule* getRules() { return _rules; }
     bool check(const ldomNode* node ) const;
     void applyCss(const ldomNode* node, css_style_rec_t* style) const
     {
@@ -145,14 +148,59 @@ public:
     lString16 ToString(CrDomXml* dom) const;
 };
 
+/// selector placed into one of index buckets of LVStyleSheet
+struct LVCssIndexItem {
+    /// position in the cascade: specificity, then element chain before universal one, then chain position
+    lUInt64 order;
+    /// bloom bits of element ids and classes required from ancestors of matching node
+    lUInt64 ancestors;
+    LVCssSelector* selector;
+    LVCssIndexItem() : order(0), ancestors(0), selector(NULL) { }
+};
+
+/// ancestor of nodes being styled, pushed by the recursive style update
+struct LVCssAncestor {
+    lUInt32 dataIndex;
+    /// bloom bits of this element and all its ancestors
+    lUInt64 filter;
+    /// last styled child, next sibling with the same key may share its style
+    lUInt16 childId;
+    lString16 childClass;
+    lString16 childIdAttr;
+    css_style_ref_t childStyle;
+    css_style_ref_t childParentStyle;
+    int childGeneration;
+    LVCssAncestor() : dataIndex(0), filter(0), childId(0), childGeneration(-1) { }
+};
+
 /**
    Can parse stylesheet and apply compiled rules. Supports only subset of CSS features.
+
+   Selectors are matched through an index built on first use after the rules change:
+   selectors whose subject has an #id or a .class only go to the buckets of that value,
+   others to the bucket of their element name, so applyCss() checks a handful of candidates
+   per node instead of every rule of the sheet.
 */
 class LVStyleSheet {
 private:
     CrDomXml* _doc;
     LVPtrVector <LVCssSelector> _selectors;
     LVPtrVector <LVPtrVector <LVCssSelector> > _stack;
+    /// incremented on every change of rules, invalidates the index and shared styles
+    int _generation;
+    int _indexGeneration;
+    LVPtrVector <LVArray<LVCssIndexItem> > _buckets;
+    LVArray<int> _elementBuckets;
+    LVHashTable<lString16, int> _classBuckets;
+    LVHashTable<lString16, int> _idBuckets;
+    /// per element id, 1 if the style may depend on siblings or on attributes other than class and id
+    LVArray<lUInt8> _siblingSensitive;
+    LVArray<LVCssAncestor> _ancestors;
+    int _ancestorDepth;
+
+    void updateIndex();
+    int addToBucket(int bucket, LVCssIndexItem& item);
+    LVCssAncestor* getParentEntry(const ldomNode* node);
 
     LVPtrVector<LVCssSelector>* dup()
     {
@@ -188,17 +236,28 @@ public:
     {
         _selectors.clear();
         _stack.clear();
+        _generation++;
+        _ancestorDepth = 0;
     }
     /// set document to retrieve ID values from
     void setDocument(CrDomXml* doc) { _doc = doc; }
     /// constructor
-    LVStyleSheet(CrDomXml* doc = NULL ) : _doc(doc) { }
+    LVStyleSheet(CrDomXml* doc = NULL )
+    : _doc(doc), _generation(0), _indexGeneration(-1), _classBuckets(32), _idBuckets(32), _ancestorDepth(0) { }
     /// copy constructor
     LVStyleSheet(LVStyleSheet& sheet);
     /// parse stylesheet, compile and add found rules to sheet
     bool parse(const char* str );
     /// apply stylesheet to node style
     void applyCss(const ldomNode* node, css_style_rec_t* style );
+    /// enter children of node: enables ancestor filtering and sibling style sharing for them
+    void pushAncestor(const ldomNode* node);
+    /// leave children of node pushed last
+    void popAncestor();
+    /// returns style of previous sibling if node is certain to get the same one, null ref otherwise
+    css_style_ref_t getSharedStyle(const ldomNode* node, css_style_ref_t& parent_style);
+    /// remember computed style of node for its next siblings
+    void setSharedStyle(const ldomNode* node, css_style_ref_t& parent_style, css_style_ref_t& style);
     /// calculate hash
     lUInt32 getHash();
 };
@@ -80,6 +80,10 @@ typedef struct css_style_rec_tag {
     void AddRef() { refCount++; }
     int Release() { return --refCount; }
     int getRefCount() { return refCount; }
+    /// write style properties to buffer
+    bool serialize( SerialBuf & buf );
+    /// read style properties written by serialize()
+    bool deserialize( SerialBuf & buf );
 } css_style_rec_t;
 
 /// style record reference type
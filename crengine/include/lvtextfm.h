@@ -300,6 +300,9 @@ public:
 
     lUInt32 Format(lUInt16 width, lUInt16 page_height);
 
+    /// returns approximate memory taken by source and formatted lines, bytes
+    int GetMemorySize();
+
     int GetSrcCount()
     {
         return m_pbuffer->srctextlen;
@@ -310,6 +313,12 @@ public:
         return m_pbuffer->width;
     }
 
+    /// returns height of text formatted by the last Format() call
+    int GetHeight()
+    {
+        return m_pbuffer->height;
+    }
+
     const src_text_fragment_t * GetSrcInfo(int index)
     {
         return &m_pbuffer->srctext[index];
@@ -46,6 +46,13 @@
 /// docFlag mask, enable document embedded fonts (EPUB)
 #define DOC_FLAG_EMBEDDED_FONTS         8
 
+/// page size changed, text is formatted and paginated again
+#define RENDER_CONTEXT_LAYOUT           1
+/// default font or interline space changed, node styles and fonts are computed again
+#define RENDER_CONTEXT_FONTS            2
+/// stylesheet, doc flags or node styles changed, render methods are initialized too
+#define RENDER_CONTEXT_STYLES           4
+
 #define LXML_NS_NONE 0       ///< no namespace specified
 #define LXML_NS_ANY  0xFFFF  ///< any namespace can be specified
 #define LXML_ATTR_VALUE_NONE  0xFFFF  ///< attribute not found
@@ -85,6 +92,8 @@ typedef enum {
 /// final block cache
 typedef LVRef<LFormattedText> LFormattedTextRef;
 typedef LVCacheMap<ldomNode*, LFormattedTextRef> CVRendBlockCache;
+/// images decoded at displayed size, keyed by node data index and size
+typedef LVCacheMap<lUInt64, LVImageSourceRef> CVScaledImageCache;
 
 /// XPath step kind
 typedef enum {
@@ -164,6 +173,27 @@ public:
     ldomBlobCache();
     bool addBlob( const lUInt8 * data, int size, lString16 name );
     LVStreamRef getBlob( lString16 name );
+    bool serialize( SerialBuf & buf );
+    bool deserialize( SerialBuf & buf );
+};
+
+/// compression of storage chunks pushed out of the unpacked space budget
+enum ldomChunkCodecId {
+    CHUNK_CODEC_ZLIB = 0, ///< deflate with DOC_DATA_COMPRESSION_LEVEL, smaller
+    CHUNK_CODEC_FAST = 1  ///< LZ4 block format, several times faster to pack and unpack
+};
+
+/// counters of chunk packing, per storage
+struct ldomChunkCodecStats
+{
+    lUInt32 packCount;
+    lUInt32 unpackCount;
+    lUInt64 packTime;        /// microseconds
+    lUInt64 unpackTime;      /// microseconds
+    lUInt64 packedBytes;     /// uncompressed bytes of packed chunks
+    lUInt64 compressedBytes; /// compressed bytes of packed chunks
+    ldomChunkCodecStats()
+        : packCount(0), unpackCount(0), packTime(0), unpackTime(0), packedBytes(0), compressedBytes(0) { }
 };
 
 class ldomDataStorageManager
@@ -178,11 +208,28 @@ protected:
     int _maxUncompressedSize;
     int _chunkSize;
     char _type;       /// type, to show in log
+    int _codec;       /// ldomChunkCodecId of chunks packed from now on
+    ldomChunkCodecStats _stats;
+    /// returns chunk moved to the head of recently used list, unpacked
     ldomTextStorageChunk * getChunk( lUInt32 address );
 public:
+    /// writes chunk table to buf, chunk data is placed starting from offset; returns offset after last chunk
+    lUInt32 serializeChunks( SerialBuf & buf, lUInt32 offset );
+    /// writes chunk data in the order of serializeChunks()
+    bool writeChunks( LVStreamRef stream );
+    /// replaces chunks with data of mapped cache file, using chunk table written by serializeChunks()
+    bool deserializeChunks( SerialBuf & buf, lUInt8 * data, lUInt32 size );
+    /// removes all chunks
+    void clearChunks();
     /// checks buffer sizes, compacts most unused chunks
     void compact( int reservedSpace );
     int getUncompressedSize() { return _uncompressedSize; }
+    /// sets unpacked space budget, packing least recently used chunks above it
+    void setMaxUncompressedSize( int size );
+    int getMaxUncompressedSize() { return _maxUncompressedSize; }
+    /// selects ldomChunkCodecId for chunks packed from now on, packed ones keep their codec
+    void setCodec( int codec ) { _codec = codec; }
+    const ldomChunkCodecStats & getStats() { return _stats; }
     /// allocates new text node, return its address inside storage
     lUInt32 allocText( lUInt32 dataIndex, lUInt32 parentIndex, const lString8 & text );
     /// allocates storage for new element, returns address address inside storage
@@ -230,8 +277,18 @@ class ldomTextStorageChunk
     lUInt32 _bufpos;  /// _buf (uncompressed) data write position (for appending of new data)
     lUInt16 _index;  /// ? index of chunk in storage
     char _type;       /// type, to show in log
+    bool _mapped;     /// _buf points into memory mapped cache file, not owned
+    lUInt8 * _compbuf; /// _bufpos bytes of data packed by _codec while _buf is released
+    lUInt32 _compsize; /// _compbuf size, bytes
+    lUInt8 _codec;    /// ldomChunkCodecId _compbuf is packed with
 
     void setunpacked( const lUInt8 * buf, int bufsize );
+    /// packs data to _compbuf and releases _buf, returns false if chunk stays unpacked
+    bool pack();
+    /// restores _buf from _compbuf
+    void unpack();
+    /// use data of memory mapped cache file, it is copied on write by the mapping itself
+    void setmapped( lUInt8 * buf, int bufsize );
     /// free data item
     void freeNode( int offset );
 
@@ -294,9 +351,14 @@ private:
 protected:
     /// final block cache
     CVRendBlockCache _renderedBlockCache;
+    /// decoded images, see ldomNode::getScaledObjectImageSource()
+    CVScaledImageCache _scaledImageCache;
     bool _mapped;
     bool _maperror;
     int  _mapSavingStage;
+    /// cache file mapping, storage chunks point into it after CrDom::openCacheFile()
+    lUInt8 * _mapBuf;
+    lUInt32 _mapSize;
     img_scaling_options_t _imgScalingOptions;
     int  _minSpaceCondensingPercent;
     // Persistent text node data storage
@@ -316,6 +378,10 @@ protected:
     ldomBlobCache _blobCache;
 
     int calcFinalBlocks();
+    /// destroys all nodes, leaving node tables empty
+    void freeNodes();
+    /// reads node table parts written by CrDom::saveCacheFile(), binding nodes to document docIndex
+    static bool deserializeNodeParts(SerialBuf& buf, ldomNode** list, int count, int docIndex);
     void dropStyles();
     bool updateLoadedStyles(bool enabled);
     lUInt32 calcStyleHash();
@@ -365,6 +431,14 @@ public:
     bool validateDocument();
     /// dumps memory usage statistics to debug log
     void dumpStatistics();
+    /// logs packing counters of storage, if it was ever packed
+    static void dumpStorageStatistics(const char * name, ldomDataStorageManager & storage);
+    /// splits unpacked space budget of all storages, DOC_BUFFER_SIZE by default
+    void setStorageBufferSize( int size );
+    /// selects ldomChunkCodecId for all storages
+    void setStorageCodec( int codec );
+    /// packing counters of text, element, rect and style storages, index 0..3 in that order
+    const ldomChunkCodecStats & getStorageStats( int index );
 };
 
 class CrDom;
@@ -645,6 +719,8 @@ public:
     LVStreamRef createBase64Stream();
     /// returns object image source
     LVImageSourceRef getObjectImageSource();
+    /// returns object image resized to dx x dy, decoded close to that size and cached
+    LVImageSourceRef getScaledObjectImageSource( int dx, int dy );
     /// returns object image ref name
     lString16 getObjectImageRefName();
     /// returns object image stream
@@ -1535,6 +1611,10 @@ public:
         return item;
     }
     void clear() { _children.clear(); }
+    /// write node with its children to buffer
+    bool serialize( SerialBuf & buf );
+    /// read node with its children written by serialize()
+    bool deserialize( SerialBuf & buf );
     // root node constructor
     LvTocItem( CrDom * doc ) : _parent(NULL), _doc(doc), _level(0), _index(0), _page(0) {}
     ~LvTocItem() { clear(); }
@@ -1549,6 +1629,29 @@ public:
 };
 typedef LVRef<ListNumberingProps> ListNumberingPropsRef;
 
+/// identifies source document and parsing options of a cache file, all fields are checked on load
+struct ldomCacheKey
+{
+    lUInt64 docSize;
+    lUInt32 docCrc;
+    lUInt32 options; /// document format and settings changing the parsed tree
+    ldomCacheKey() : docSize(0), docCrc(0), options(0) { }
+    ldomCacheKey(lUInt64 size, lUInt32 crc, lUInt32 opts) : docSize(size), docCrc(crc), options(opts) { }
+    bool operator == (const ldomCacheKey & v) const
+    {
+        return docSize == v.docSize && docCrc == v.docCrc && options == v.options;
+    }
+    /// short mix of all fields for cache file name, never 0
+    lUInt32 hash() const
+    {
+        lUInt32 h = (lUInt32) docSize;
+        h = h * 31 + (lUInt32) (docSize >> 32);
+        h = h * 31 + docCrc;
+        h = h * 31 + options;
+        return h ? h : 1;
+    }
+};
+
 class CrDom : public CrDomXml
 {
     friend class LvDomWriter;
@@ -1566,8 +1669,15 @@ private:
     LVContainerRef _container;
     LVHashTable<lUInt32, ListNumberingPropsRef> lists;
     LVEmbeddedFontList _fontList;
+    bool _cacheChanged;
+    int _layoutThreads;
+    /// stylesheet hash render methods were initialized for, 0 if unknown
+    lUInt32 _renderStylesheetHash;
+    LVRendCallback * _renderCallback;
 protected:
     void applyDocStylesheet();
+    /// moves mutable nodes to persistent storage, returns false if some node cannot be moved
+    bool persistNodes();
 public:
     CrDom();
     virtual ~CrDom();
@@ -1595,6 +1705,15 @@ public:
     /// check document formatting parameters before render,
     /// whether we need to reformat; returns false if render is necessary
     bool checkRenderContext();
+    /// returns RENDER_CONTEXT_* flags of formatting parameters changed since updateRenderContext()
+    int getRenderContextChanges();
+    /// writes parsed and rendered document to cache file, key is stored in the file header
+    bool saveCacheFile( const lString16 & fileName, const ldomCacheKey & key );
+    /// replaces contents of the empty document with cache file written by saveCacheFile() for the same key,
+    /// storage chunks are mapped; on failure the document is unusable and should be deleted
+    bool openCacheFile( const lString16 & fileName, const ldomCacheKey & key );
+    /// true if document was parsed or rendered since the last saveCacheFile()/openCacheFile()
+    bool isCacheChanged() { return _cacheChanged; }
     LVContainerRef getDocParentContainer() { return _container; }
     void setDocParentContainer( LVContainerRef cont ) { _container = cont; }
     void clearRendBlockCache() { _renderedBlockCache.clear(); }
@@ -1605,6 +1724,8 @@ public:
     int getFullHeight();
     /// returns page height setting
     int getPageHeight() { return _page_height; }
+    /// false if formatting parameters changed or the last render was aborted
+    bool isRendered() { return _rendered; }
     /// saves document contents as XML to stream with specified encoding
     bool saveToStream( LVStreamRef stream, const char * codepage, bool treeLayout=false );
     /// get default font reference
@@ -1640,6 +1761,11 @@ public:
     ldomXPointer createXPointer( lvPoint pt, int direction=0 );
     /// get rendered block cache object
     CVRendBlockCache & getRendBlockCache() { return _renderedBlockCache; }
+    /// number of threads formatting final blocks during render, 1 formats them on the calling thread
+    int getLayoutThreads() { return _layoutThreads; }
+    void setLayoutThreads( int threads ) { _layoutThreads = threads; }
+    /// set receiver of render progress, NULL to disable
+    void setRenderCallback( LVRendCallback * callback ) { _renderCallback = callback; }
     bool findText(lString16 pattern, bool caseInsensitive, bool reverse, int minY, int maxY,
                   LVArray<ldomWord>& words, int maxCount, int maxHeight);
 };
@@ -306,6 +306,9 @@ public:
     }
 };
 
+// scratch buffers of text measuring are per thread, final blocks may be formatted in parallel
+#define CR_THREAD_LOCAL __thread
+
 // MACROS to avoid UNUSED PARAM warning
 #define CR_UNUSED(x) (void)x;
 #define CR_UNUSED2(x,x2) (void)x;(void)x2;
@@ -5,6 +5,9 @@
 #include "include/StSocket.h"
 #include "include/CreBridge.h"
 
+// Limits hits collected from a single page, search for a single letter would flood the client otherwise
+#define SEARCH_MAX_PAGE_HITS 1000
+
 static inline int CeilToEvenInt(int n)
 {
     return (n + 1) & ~1;
@@ -99,22 +102,6 @@ void CreBridge::responseAddString(CmdResponse& response, lString16 str16)
     response.addData(cmd_data);
 }
 
-void CreBridge::convertBitmap(LVColorDrawBuf* bitmap)
-{
-    if (bitmap->GetBitsPerPixel() == 32) {
-        // Convert Cre colors to Android
-        int size = bitmap->GetWidth() * bitmap->GetHeight();
-        for (lUInt8* p = bitmap->GetData(); --size >= 0; p+=4) {
-            // Invert A
-            p[3] ^= 0xFF;
-            // Swap R and B
-            lUInt8 temp = p[0];
-            p[0] = p[2];
-            p[2] = temp;
-        }
-    }
-}
-
 void CreBridge::processFonts(CmdRequest& request, CmdResponse& response)
 {
     response.cmd = CMD_RES_PDF_FONTS;
@@ -274,14 +261,59 @@ void CreBridge::processConfig(CmdRequest& request, CmdResponse& response)
             doc_view_->config_enable_footnotes_ = bool_val;
             doc_view_->GetCrDom()->setDocFlag(DOC_FLAG_ENABLE_FOOTNOTES, bool_val);
             doc_view_->RequestRender();
+        } else if (key == CONFIG_CRE_CACHE_DIR) {
+            doc_view_->config_cache_dir_ = lString16(val);
+        } else if (key == CONFIG_CRE_LAZY_LOADING) {
+            int int_val = atoi(val);
+            if (int_val < 0 || int_val > 1) {
+                response.result = RES_BAD_REQ_DATA;
+                return;
+            }
+            doc_view_->config_lazy_loading_ = (bool) int_val;
+        } else if (key == CONFIG_CRE_LAYOUT_THREADS) {
+            int int_val = atoi(val);
+            if (int_val < 1 || int_val > 9) {
+                response.result = RES_BAD_REQ_DATA;
+                return;
+            }
+            doc_view_->config_layout_threads_ = int_val;
+        } else if (key == CONFIG_CRE_STORAGE_MEMORY) {
+            int int_val = atoi(val);
+            if (int_val < 1 || int_val > 256) {
+                response.result = RES_BAD_REQ_DATA;
+                return;
+            }
+            doc_view_->config_storage_memory_ = int_val * 1024 * 1024;
+            doc_view_->GetCrDom()->setStorageBufferSize(doc_view_->config_storage_memory_);
+        } else if (key == CONFIG_CRE_STORAGE_CODEC) {
+            int int_val = atoi(val);
+            if (int_val != CHUNK_CODEC_ZLIB && int_val != CHUNK_CODEC_FAST) {
+                response.result = RES_BAD_REQ_DATA;
+                return;
+            }
+            doc_view_->config_storage_codec_ = int_val;
+            doc_view_->GetCrDom()->setStorageCodec(int_val);
         } else {
             CRLog::warn("processConfig unknown key: key=%d, val=%s", key, val);
         }
     }
+    // Version 1 clients take exactly one response, reflow progress is streamed to version 2 only
+    doc_view_->SetRenderCallback(isTagged() ? this : NULL);
     doc_view_->RenderIfDirty();
+    doc_view_->SetRenderCallback(NULL);
     response.addInt(ExportPagesCount(doc_view_->GetColumns(), doc_view_->GetPagesCount()));
 }
 
+bool CreBridge::OnRenderProgress(int percent, int pages)
+{
+    // SET_CONFIG changes the document for good, so it is never cancelled
+    CmdResponse partial(CMD_RES_SET_CONFIG);
+    partial.addInt(ExportPagesCount(doc_view_->GetColumns(), pages));
+    partial.addInt(percent);
+    sendPartial(partial);
+    return false;
+}
+
 void CreBridge::processOpen(CmdRequest& request, CmdResponse& response)
 {
     response.cmd = CMD_RES_OPEN;
@@ -289,7 +321,12 @@ void CreBridge::processOpen(CmdRequest& request, CmdResponse& response)
     uint32_t doc_format = 0;
     uint8_t* socket_name = NULL;
     uint8_t* file_name = NULL;
+    uint8_t* start_xpath = NULL;
     iter.getInt(&doc_format).getByteArray(&socket_name).getByteArray(&file_name);
+    if (iter.isValid() && iter.hasNext()) {
+        // Optional position to show first, lets lazy loading start with the right chapter
+        iter.getByteArray(&start_xpath);
+    }
     if (!iter.isValid() || !socket_name || !file_name) {
         response.result = RES_BAD_REQ_DATA;
         return;
@@ -305,9 +342,21 @@ void CreBridge::processOpen(CmdRequest& request, CmdResponse& response)
         response.result = RES_BAD_REQ_DATA;
         return;
     }
-    if (doc_view_->LoadDoc(doc_format, reinterpret_cast<const char*>(file_name))) {
+    // Version 1 clients can not take CMD_NOTIF_PAGE_COUNT, the whole book is imported at once
+    bool lazy_loading = doc_view_->config_lazy_loading_;
+    if (!isTagged()) {
+        doc_view_->config_lazy_loading_ = false;
+    }
+    bool loaded = doc_view_->LoadDoc(doc_format, reinterpret_cast<const char*>(file_name),
+                                     reinterpret_cast<const char*>(start_xpath));
+    doc_view_->config_lazy_loading_ = lazy_loading;
+    if (loaded) {
         doc_view_->RenderIfDirty();
         response.addInt(ExportPagesCount(doc_view_->GetColumns(), doc_view_->GetPagesCount()));
+        if (doc_view_->IsLoading()) {
+            // Page count is provisional, the final one comes with CMD_NOTIF_PAGE_COUNT
+            response.addInt(1);
+        }
     }
 }
 
@@ -335,14 +384,19 @@ void CreBridge::processPageRender(CmdRequest& request, CmdResponse& response)
         response.result = RES_BAD_REQ_DATA;
         return;
     }
+    StRenderTarget target;
+    unsigned char* pixels = target.allocate(shared, iter, width, height);
+    if (pixels == NULL) {
+        CRLog::error("processPageRender bad render target");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
     doc_view_->GoToPage(ImportPage(page, doc_view_->GetColumns()));
-    CmdData* resp = new CmdData();
-    unsigned char* pixels = resp->newByteArray(width * height * 4);
-    LVColorDrawBuf* buf = new LVColorDrawBuf(width, height, pixels, 32);
+    // Pixels are written in Android byte order right away
+    LVColorDrawBuf* buf = new LVColorDrawBuf(width, height, pixels, 32, true);
     doc_view_->Draw(*buf);
-    convertBitmap(buf);
     delete buf;
-    response.addData(resp);
+    target.commit(response);
     //CRLog::trace("processPageRender END");
 }
 
@@ -443,6 +497,90 @@ void CreBridge::processPageLinks(CmdRequest& request, CmdResponse& response)
 #undef DEBUG_LINKS
 }
 
+void CreBridge::processSearch(CmdRequest& request, CmdResponse& response)
+{
+    response.cmd = CMD_RES_SEARCH;
+    CmdDataIterator iter(request.first);
+    uint8_t* pattern = NULL;
+    uint32_t external_start = 0;
+    iter.getByteArray(&pattern);
+    if (iter.isValid() && iter.hasNext()) {
+        iter.getInt(&external_start);
+    }
+    if (!iter.isValid()) {
+        CRLog::error("processSearch bad request data");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+    lString16 pattern16 = Utf8ToUnicode((const char*) pattern);
+    pattern16.trim();
+    if (pattern16.empty()) {
+        response.addInt(0);
+        return;
+    }
+    // The text is already in the DOM, so pages are scanned directly instead of being indexed
+    int columns = doc_view_->GetColumns();
+    int pages_count = doc_view_->GetPagesCount();
+    uint32_t external_count = ExportPagesCount(columns, pages_count);
+    if (external_start >= external_count) {
+        external_start = 0;
+    }
+    float page_width = doc_view_->GetWidth();
+    float page_height = doc_view_->GetHeight();
+    // Hit rectangles are taken from the view, the reading position is restored afterwards
+    int saved_offset = doc_view_->GetOffset();
+    uint32_t total = 0;
+    LVArray<ldomWord> words;
+    LVArray<float> rects;
+    uint32_t i = 0;
+    for (; i < external_count && !cancelled; i++) {
+        uint32_t external_page = (external_start + i) % external_count;
+        int first_page = ImportPage(external_page, columns);
+        bool positioned = false;
+        rects.clear();
+        for (int page = first_page; page < first_page + columns && page < pages_count; page++) {
+            LVRef<ldomXRange> range = doc_view_->GetPageDocRange(page);
+            if (range.isNull()
+                || !range->findText(pattern16, true, false, words, SEARCH_MAX_PAGE_HITS, -1)) {
+                continue;
+            }
+            if (!positioned) {
+                doc_view_->GoToPage(first_page, false);
+                positioned = true;
+            }
+            for (int w = 0; w < words.length(); w++) {
+                lvRect rect;
+                ldomXRange(words[w]).getRect(rect);
+                if (!doc_view_->DocToWindowRect(rect)) {
+                    continue;
+                }
+                rects.add(rect.left / page_width);
+                rects.add(rect.top / page_height);
+                rects.add(rect.right / page_width);
+                rects.add(rect.bottom / page_height);
+            }
+        }
+        if (rects.empty()) {
+            continue;
+        }
+        total += rects.length() / 4;
+        CmdResponse partial(CMD_RES_SEARCH);
+        partial.addInt(external_page);
+        partial.addFloatArray(rects.length(), rects.get(), true);
+        if (!sendPartial(partial)) {
+            response.addInt(external_page);
+            response.addFloatArray(rects.length(), rects.get(), true);
+        }
+    }
+    doc_view_->GoToOffset(saved_offset, false);
+    if (i < external_count) {
+        // Stopped by CMD_REQ_CANCEL before all pages were searched
+        response.result = RES_CANCELLED;
+        return;
+    }
+    response.addInt(total);
+}
+
 void CreBridge::processPageByXPath(CmdRequest& request, CmdResponse& response)
 {
     response.cmd = CMD_RES_CRE_PAGE_BY_XPATH;
@@ -504,6 +642,46 @@ void CreBridge::processOutline(CmdRequest& request, CmdResponse& response)
     }
 }
 
+void CreBridge::processCacheStats(CmdRequest& request, CmdResponse& response)
+{
+    response.cmd = CMD_RES_CACHE_STATS;
+
+    // Layout shared with the other bridges, the rendered block cache stands for the page cache
+    CrDom* dom = doc_view_ ? doc_view_->GetCrDom() : NULL;
+    if (dom) {
+        CVRendBlockCache& blocks = dom->getRendBlockCache();
+        response.addInt(blocks.length());
+        response.addInt(blocks.getSize());
+        response.addInt(blocks.getMaxSize());
+        response.addInt(blocks.getHits());
+        response.addInt(blocks.getMisses());
+        response.addInt(blocks.getEvictions());
+    } else {
+        for (int i = 0; i < 6; i++) {
+            response.addInt(0);
+        }
+    }
+    // Glyph atlas stands for the bitmap cache: used bytes, hits, misses, evictions, then budget
+    LVFontGlobalGlyphCache* cache = fontMan->getGlyphCache();
+    response.addInt(cache ? cache->getSize() : 0);
+    response.addInt(cache ? cache->getHits() : 0);
+    response.addInt(cache ? cache->getMisses() : 0);
+    response.addInt(cache ? cache->getEvictions() : 0);
+    response.addInt(cache ? cache->getMaxSize() : 0);
+    // Text, element, rect and style storages: packed chunks, kB before and after packing,
+    // pack ms, unpacked chunks, unpack ms
+    for (int i = 0; i < 4; i++) {
+        ldomChunkCodecStats empty;
+        const ldomChunkCodecStats& stats = dom ? dom->getStorageStats(i) : empty;
+        response.addInt(stats.packCount);
+        response.addInt((uint32_t) (stats.packedBytes / 1024));
+        response.addInt((uint32_t) (stats.compressedBytes / 1024));
+        response.addInt((uint32_t) (stats.packTime / 1000));
+        response.addInt(stats.unpackCount);
+        response.addInt((uint32_t) (stats.unpackTime / 1000));
+    }
+}
+
 void CreBridge::processQuit(CmdRequest& request, CmdResponse& response)
 {
     response.cmd = CMD_RES_QUIT;
@@ -533,6 +711,24 @@ CreBridge::~CreBridge()
     ShutdownFontManager();
 }
 
+bool CreBridge::idle()
+{
+    if (!doc_view_) {
+        return false;
+    }
+    if (doc_view_->IsLoading()) {
+        if (!doc_view_->ContinueLoading()) {
+            CmdResponse notification(CMD_NOTIF_PAGE_COUNT);
+            notification.addInt(ExportPagesCount(doc_view_->GetColumns(), doc_view_->GetPagesCount()));
+            sendNotification(notification);
+        }
+        return true;
+    }
+    // Parsing and rendering results are written out once the client is done with requests
+    doc_view_->SaveDocToCache();
+    return false;
+}
+
 void CreBridge::process(CmdRequest& request, CmdResponse& response)
 {
     response.reset();
@@ -568,6 +764,15 @@ void CreBridge::process(CmdRequest& request, CmdResponse& response)
     case CMD_REQ_CRE_METADATA:
         processMetadata(request, response);
         break;
+    case CMD_REQ_SEARCH:
+        processSearch(request, response);
+        break;
+    case CMD_REQ_CACHE_STATS:
+        processCacheStats(request, response);
+        break;
+    case CMD_REQ_SHARED_MEMORY:
+        processSharedMemory(request, response);
+        break;
     case CMD_REQ_ALIVE:
         response.cmd = CMD_RES_ALIVE;
         break;
@@ -586,7 +586,33 @@ public:
     }
 };
 
-bool ImportEpubDocument(LVStreamRef stream, CrDom* m_doc)
+LVContainerRef EpubOpenContainer(LVStreamRef stream)
+{
+    LVContainerRef arc = LVOpenArchieve(stream);
+    if (arc.isNull() || EpubGetRootFilePath(arc).empty())
+        return LVContainerRef();
+    EncryptedDataContainer * decryptor = new EncryptedDataContainer(arc);
+    LVContainerRef res = LVContainerRef(decryptor);
+    decryptor->open();
+    if (decryptor->hasUnsupportedEncryption())
+        return LVContainerRef();
+    return res;
+}
+
+EpubImporter::EpubImporter(CrDom* doc)
+    : _doc(doc), _styleParser(NULL), _writer(NULL), _appender(NULL),
+      _next(0), _parsed(0), _started(false), _encrypted(false)
+{
+}
+
+EpubImporter::~EpubImporter()
+{
+    delete _appender;
+    delete _writer;
+    delete _styleParser;
+}
+
+bool EpubImporter::open(LVStreamRef stream)
 {
     LVContainerRef arc = LVOpenArchieve( stream );
     if (arc.isNull())
@@ -606,11 +632,13 @@ bool ImportEpubDocument(LVStreamRef stream, CrDom* m_doc)
 
     if (decryptor->hasUnsupportedEncryption()) {
         // DRM!!!
-        createEncryptedEpubWarningDocument(m_doc);
+        createEncryptedEpubWarningDocument(_doc);
+        _encrypted = true;
         return true;
     }
 
-    m_doc->setDocParentContainer(m_arc);
+    _doc->setDocParentContainer(m_arc);
+    _arc = m_arc;
 
     // read content.opf
     EpubItems epubItems;
@@ -628,11 +656,9 @@ bool ImportEpubDocument(LVStreamRef stream, CrDom* m_doc)
         return false;
 
 
-    lString16 ncxHref;
     lString16 coverId;
 
-    LVEmbeddedFontList fontList;
-    EmbeddedFontStyleParser styleParser(fontList);
+    _styleParser = new EmbeddedFontStyleParser(_fontList);
 
     // reading content stream
     {
@@ -646,7 +672,7 @@ bool ImportEpubDocument(LVStreamRef stream, CrDom* m_doc)
 //            doc->saveToStream(out, NULL, true);
 //        }
 
-        CRPropRef m_doc_props = m_doc->getProps();
+        CRPropRef m_doc_props = _doc->getProps();
 
         for (int i=1; i < 50; i++) {
             ldomNode * item = doc->nodeFromXPath(
@@ -725,7 +751,7 @@ bool ImportEpubDocument(LVStreamRef stream, CrDom* m_doc)
                     lString16 base = name;
                     LVExtractLastPathElement(base);
                     //CRLog::trace("style: %s", cssFile.c_str());
-                    styleParser.parse(base, cssFile);
+                    _styleParser->parse(base, cssFile);
                 }
             }
         }
@@ -736,7 +762,7 @@ bool ImportEpubDocument(LVStreamRef stream, CrDom* m_doc)
                 EpubItem * ncx = epubItems.findById( spine->getAttributeValue("toc") ); //TODO
                 //EpubItem * ncx = epubItems.findById(cs16("ncx"));
                 if (ncx != NULL) {
-                    ncxHref = codeBase + ncx->href;
+                    _ncxHref = codeBase + ncx->href;
                 }
                 for ( int i=1; i<50000; i++ ) {
                     ldomNode * item = doc->nodeFromXPath(
@@ -758,11 +784,11 @@ bool ImportEpubDocument(LVStreamRef stream, CrDom* m_doc)
         return false;
     }
 
-    lUInt32 saveFlags = m_doc->getDocFlags();
-    m_doc->setDocFlags( saveFlags );
-    m_doc->setDocParentContainer( m_arc );
+    lUInt32 saveFlags = _doc->getDocFlags();
+    _doc->setDocFlags( saveFlags );
+    _doc->setDocParentContainer( m_arc );
 
-    LvDomWriter writer(m_doc);
+    _writer = new LvDomWriter(_doc);
 #if 0
     m_doc->setNodeTypes( fb2_elem_table );
     m_doc->setAttributeTypes( fb2_attr_table );
@@ -770,78 +796,100 @@ bool ImportEpubDocument(LVStreamRef stream, CrDom* m_doc)
 #endif
     //m_doc->setCodeBase( codeBase );
 
-    LvDocFragmentWriter appender(
-            &writer,
+    _appender = new LvDocFragmentWriter(
+            _writer,
             cs16("body"),
             cs16("DocFragment"),
             lString16::empty_str);
-    writer.OnStart(NULL);
-    writer.OnTagOpenNoAttr(L"", L"body");
-    int fragmentCount = 0;
+    _writer->OnStart(NULL);
+    _writer->OnTagOpenNoAttr(L"", L"body");
+    _started = true;
     for ( int i=0; i<spineItems.length(); i++ ) {
         if (spineItems[i]->mediaType == "application/xhtml+xml") {
             lString16 name = codeBase + spineItems[i]->href;
             lString16 subst = cs16("_doc_fragment_") + fmt::decimal(i);
-            appender.addPathSubstitution( name, subst );
+            _appender->addPathSubstitution( name, subst );
+            _names.add(name);
+            _ids.add(subst);
             //CRLog::trace("subst: %s => %s", LCSTR(name), LCSTR(subst));
         }
     }
-    for ( int i=0; i<spineItems.length(); i++ ) {
-        if (spineItems[i]->mediaType == "application/xhtml+xml") {
-            lString16 name = codeBase + spineItems[i]->href;
-            {
-                //CRLog::debug("Checking fragment: %s", LCSTR(name));
-                LVStreamRef stream = m_arc->OpenStream(name.c_str(), LVOM_READ);
-                if ( !stream.isNull() ) {
-                    appender.setCodeBase( name );
-                    lString16 base = name;
-                    LVExtractLastPathElement(base);
-                    //CRLog::trace("base: %s", LCSTR(base));
-                    //LvXmlParser
-                    LvHtmlParser parser(stream, &appender);
-                    if ( parser.CheckFormat() && parser.Parse() ) {
-                        // valid
-                        fragmentCount++;
-                        lString8 headCss = appender.getHeadStyleText();
-                        //CRLog::trace("style: %s", headCss.c_str());
-                        styleParser.parse(base, headCss);
-                    } else {
-                        CRLog::error("Document type is not XML/XHTML for fragment %s",
-                                LCSTR(name));
-                    }
-                }
-            }
-        }
+    return true;
+}
+
+lvsize_t EpubImporter::parseNext(bool placeholder)
+{
+    if (!hasNext())
+        return 0;
+    lString16 name = _names[_next];
+    lString16 id = _ids[_next];
+    _next++;
+    if (placeholder) {
+        _writer->OnTagOpen(L"", L"DocFragment");
+        _writer->OnAttribute(L"", L"id", id.c_str());
+        _writer->OnTagBody();
+        _writer->OnTagClose(L"", L"DocFragment");
+        return 0;
     }
+    //CRLog::debug("Checking fragment: %s", LCSTR(name));
+    LVStreamRef stream = _arc->OpenStream(name.c_str(), LVOM_READ);
+    if ( stream.isNull() )
+        return 0;
+    _appender->setCodeBase( name );
+    lString16 base = name;
+    LVExtractLastPathElement(base);
+    //CRLog::trace("base: %s", LCSTR(base));
+    //LvXmlParser
+    LvHtmlParser parser(stream, _appender);
+    if ( parser.CheckFormat() && parser.Parse() ) {
+        // valid
+        _parsed++;
+        lString8 headCss = _appender->getHeadStyleText();
+        //CRLog::trace("style: %s", headCss.c_str());
+        _styleParser->parse(base, headCss);
+    } else {
+        CRLog::error("Document type is not XML/XHTML for fragment %s",
+                LCSTR(name));
+    }
+    return stream->GetSize();
+}
 
-    if ( !ncxHref.empty() ) {
-        LVStreamRef stream = m_arc->OpenStream(ncxHref.c_str(), LVOM_READ);
-        lString16 codeBase = LVExtractPath( ncxHref );
+bool EpubImporter::finish()
+{
+    if (_encrypted)
+        return true;
+    if (!_started)
+        return false;
+    _started = false;
+
+    if ( !_ncxHref.empty() ) {
+        LVStreamRef stream = _arc->OpenStream(_ncxHref.c_str(), LVOM_READ);
+        lString16 codeBase = LVExtractPath( _ncxHref );
         if ( codeBase.length()>0 && codeBase.lastChar()!='/' )
             codeBase.append(1, L'/');
-        appender.setCodeBase(codeBase);
+        _appender->setCodeBase(codeBase);
         if ( !stream.isNull() ) {
             CrDom * ncxdoc = LVParseXMLStream( stream );
             if ( ncxdoc!=NULL ) {
                 ldomNode * navMap = ncxdoc->nodeFromXPath( cs16("ncx/navMap"));
                 if ( navMap!=NULL )
-                    ReadEpubToc( m_doc, navMap, m_doc->getToc(), appender );
+                    ReadEpubToc( _doc, navMap, _doc->getToc(), *_appender );
                 delete ncxdoc;
             }
         }
     }
 
-    writer.OnTagClose(L"", L"body");
-    writer.OnStop();
-    CRLog::debug("EPUB: %d documents merged", fragmentCount);
+    _writer->OnTagClose(L"", L"body");
+    _writer->OnStop();
+    CRLog::debug("EPUB: %d documents merged", _parsed);
 
-    if (!fontList.empty()) {
+    if (!_fontList.empty()) {
         // set document font list, and register fonts
-        m_doc->getEmbeddedFontList().set(fontList);
-        m_doc->registerEmbeddedFonts();
-        m_doc->forceReinitStyles();
+        _doc->getEmbeddedFontList().set(_fontList);
+        _doc->registerEmbeddedFonts();
+        _doc->forceReinitStyles();
     }
-    if (fragmentCount == 0) {
+    if (_parsed == 0) {
         return false;
     }
 #if 0 // set stylesheet
@@ -866,3 +914,13 @@ bool ImportEpubDocument(LVStreamRef stream, CrDom* m_doc)
 #endif
     return true;
 }
+
+bool ImportEpubDocument(LVStreamRef stream, CrDom* m_doc)
+{
+    EpubImporter importer(m_doc);
+    if (!importer.open(stream))
+        return false;
+    while (importer.hasNext())
+        importer.parseNext();
+    return importer.finish();
+}
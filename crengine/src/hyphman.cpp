@@ -23,9 +23,11 @@
 #endif
 
 #include <stdlib.h>
+#include <pthread.h>
 #include "include/lvxml.h"
 #include "include/hyphman.h"
 #include "include/lvfnt.h"
+#include "include/lvrefcache.h"
 
 #define _16(x) lString16(x)
 
@@ -35,13 +37,41 @@ HyphDictionaryList * HyphMan::_dictList = NULL;
 
 #define MAX_PATTERN_SIZE  9
 #define PATTERN_HASH_SIZE 16384
+// words hyphenated recently, masks of longer words are not cached
+#define HYPH_CACHE_SIZE 4096
+#define HYPH_CACHE_MAX_WORD 62
+
+/// node of compiled pattern trie, edges of a node are contiguous and sorted by char
+struct HyphTrieNode {
+    lUInt32 firstEdge;
+    /// offset+1 of pattern digits in attribute pool, 0 if no pattern ends here
+    lUInt32 attr;
+    lUInt32 edgeCount;
+};
+
+struct HyphTrieEdge {
+    lChar16 ch;
+    lUInt32 node;
+};
+
 class TexPattern;
 class TexHyph : public HyphMethod
 {
     TexPattern * table[PATTERN_HASH_SIZE];
     lUInt32 _hash;
-public:
+    // Patterns are loaded into the hash table, then compiled into flat trie arrays
+    LVArray<HyphTrieNode> _nodes;
+    LVArray<HyphTrieEdge> _edges;
+    LVArray<char> _attrs;
+    // Hyphenation points of a word don't depend on layout, remember them for reformatting
+    LVCacheMap<lString16, lUInt64> _cache;
+    pthread_mutex_t _cacheMutex;
+    void compile();
+    void freePatterns();
+    int findChild( int node, lChar16 ch );
     bool match( const lChar16 * str, char * mask );
+    lUInt64 getBreaks( const lChar16 * word, int len );
+public:
     virtual bool hyphenate( const lChar16 * str, int len, lUInt16 * widths, lUInt8 * flags, lUInt16 hyphCharWidth, lUInt16 maxWidth );
     void addPattern( TexPattern * pattern );
     TexHyph();
@@ -264,60 +294,14 @@ public:
         return lStr_cmp( word, v->word );
     }
 
-    static int hash( const lChar16 * s )
-    {
-        return ((lUInt32)(((s[0] *31 + s[1])*31 + s[2]) * 31 + s[3])) % PATTERN_HASH_SIZE;
-    }
-
-    static int hash3( const lChar16 * s )
-    {
-        return ((lUInt32)(((s[0] *31 + s[1])*31 + s[2]) * 31 + 0)) % PATTERN_HASH_SIZE;
-    }
-
-    static int hash2( const lChar16 * s )
-    {
-        return ((lUInt32)(((s[0] *31 + s[1])*31 + 0) * 31 + 0)) % PATTERN_HASH_SIZE;
-    }
-
-    static int hash1( const lChar16 * s )
-    {
-        return ((lUInt32)(((s[0] *31 + 0)*31 + 0) * 31 + 0)) % PATTERN_HASH_SIZE;
-    }
-
     int hash()
     {
         return ((lUInt32)(((word[0] *31 + word[1])*31 + word[2]) * 31 + word[3])) % PATTERN_HASH_SIZE;
     }
 
-    bool match( const lChar16 * s, char * mask )
+    static void apply( const char * attr, char * mask )
     {
-        TexPattern * p = this;
-        bool found = false;
-        while ( p ) {
-            bool res = true;
-            for ( int i=2; p->word[i]; i++ )
-                if ( p->word[i]!=s[i] ) {
-                    res = false;
-                    break;
-                }
-            if ( res ) {
-                if ( p->word[0]==s[0] && (p->word[1]==0 || p->word[1]==s[1]) ) {
-#if DUMP_PATTERNS==1
-                    CRLog::debug("Pattern matched: %s %s on %s %s", LCSTR(lString16(p->word)), p->attr, LCSTR(lString16(s)), mask);
-#endif
-                    p->apply(mask);
-                    found = true;
-                }
-            }
-            p = p->next;
-        }
-        return found;
-    }
-
-    void apply( char * mask )
-    {
-        ;
-        for ( char * p = attr; *p && *mask; p++, mask++ ) {
+        for ( const char * p = attr; *p && *mask; p++, mask++ ) {
             if ( *mask < *p )
                 *mask = *p;
         }
@@ -404,13 +388,20 @@ public:
 
 };
 
-TexHyph::TexHyph()
+TexHyph::TexHyph() : _cache( HYPH_CACHE_SIZE )
 {
     memset( table, 0, sizeof(table) );
     _hash = 123456;
+    pthread_mutex_init( &_cacheMutex, NULL );
 }
 
 TexHyph::~TexHyph()
+{
+    freePatterns();
+    pthread_mutex_destroy( &_cacheMutex );
+}
+
+void TexHyph::freePatterns()
 {
     for ( int i=0; i<PATTERN_HASH_SIZE; i++ ) {
         TexPattern * p = table[i];
@@ -419,7 +410,97 @@ TexHyph::~TexHyph()
             p = p->next;
             delete tmp;
         }
+        table[i] = NULL;
+    }
+}
+
+/// builds trie of all loaded patterns and releases the hash table
+void TexHyph::compile()
+{
+    // Builder trie: children are linked lists, attributes are pattern digits
+    LVArray<lChar16> chars;
+    LVArray<int> firstChild;
+    LVArray<int> nextSibling;
+    LVArray<int> attrIndex;
+    lString8Collection attrs;
+    chars.add( 0 );
+    firstChild.add( -1 );
+    nextSibling.add( -1 );
+    attrIndex.add( -1 );
+    for ( int i=0; i<PATTERN_HASH_SIZE; i++ ) {
+        for ( TexPattern * p = table[i]; p; p = p->next ) {
+            int node = 0;
+            for ( int k=0; k<MAX_PATTERN_SIZE && p->word[k]; k++ ) {
+                int child = firstChild[node];
+                while ( child>=0 && chars[child]!=p->word[k] )
+                    child = nextSibling[child];
+                if ( child<0 ) {
+                    child = chars.length();
+                    chars.add( p->word[k] );
+                    firstChild.add( -1 );
+                    nextSibling.add( firstChild[node] );
+                    attrIndex.add( -1 );
+                    firstChild[node] = child;
+                }
+                node = child;
+            }
+            if ( node==0 )
+                continue;
+            lString8 attr( p->attr );
+            if ( attrIndex[node]<0 ) {
+                attrIndex[node] = attrs.length();
+                attrs.add( attr );
+            } else {
+                // duplicate pattern: both would have been applied, keep the greater digits
+                lString8 merged = attrs[attrIndex[node]];
+                for ( int k=0; k<attr.length(); k++ ) {
+                    if ( k>=merged.length() )
+                        merged << attr[k];
+                    else if ( merged[k]<attr[k] )
+                        merged[k] = attr[k];
+                }
+                attrs[attrIndex[node]] = merged;
+            }
+        }
+    }
+    freePatterns();
+
+    // Pack breadth first, edges of every node sorted for binary search
+    _nodes.clear();
+    _edges.clear();
+    _attrs.clear();
+    LVArray<int> order;
+    LVArray<int> children;
+    order.add( 0 );
+    for ( int k=0; k<order.length(); k++ ) {
+        int b = order[k];
+        children.reset();
+        for ( int child = firstChild[b]; child>=0; child = nextSibling[child] ) {
+            int pos = children.length();
+            while ( pos>0 && chars[children[pos-1]]>chars[child] )
+                pos--;
+            children.insert( pos, child );
+        }
+        HyphTrieNode node;
+        node.firstEdge = _edges.length();
+        node.edgeCount = children.length();
+        node.attr = 0;
+        if ( attrIndex[b]>=0 ) {
+            node.attr = _attrs.length() + 1;
+            lString8 attr = attrs[attrIndex[b]];
+            _attrs.add( attr.c_str(), attr.length() + 1 );
+        }
+        for ( int i=0; i<children.length(); i++ ) {
+            HyphTrieEdge edge;
+            edge.ch = chars[children[i]];
+            edge.node = order.length();
+            order.add( children[i] );
+            _edges.add( edge );
+        }
+        _nodes.add( node );
     }
+    _cache.clear();
+    CRLog::debug("Hyphenation patterns compiled: %d trie nodes", _nodes.length());
 }
 
 void TexHyph::addPattern( TexPattern * pattern )
@@ -514,6 +595,8 @@ bool TexHyph::load( LVStreamRef stream )
             }
         }
 
+        if ( patternCount>0 )
+            compile();
         return patternCount>0;
     } else {
         // tex xml format as for FBReader
@@ -535,6 +618,8 @@ bool TexHyph::load( LVStreamRef stream )
             addPattern( pattern );
             patternCount++;
         }
+        if ( patternCount>0 )
+            compile();
         return patternCount>0;
     }
 }
@@ -548,26 +633,63 @@ bool TexHyph::load( lString16 fileName )
 }
 
 
+int TexHyph::findChild( int node, lChar16 ch )
+{
+    const HyphTrieNode & n = _nodes[node];
+    int a = n.firstEdge;
+    int b = n.firstEdge + n.edgeCount;
+    while ( a<b ) {
+        int c = (a + b) >> 1;
+        lChar16 ech = _edges[c].ch;
+        if ( ech==ch )
+            return _edges[c].node;
+        if ( ech<ch )
+            a = c + 1;
+        else
+            b = c;
+    }
+    return -1;
+}
+
+/// applies all patterns starting at str to mask
 bool TexHyph::match( const lChar16 * str, char * mask )
 {
     bool found = false;
-    TexPattern * res = table[ TexPattern::hash( str ) ];
-    if ( res ) {
-        found = res->match( str, mask ) || found;
-    }
-    res = table[ TexPattern::hash3( str ) ];
-    if ( res ) {
-        found = res->match( str, mask ) || found;
+    int node = 0;
+    for ( int k=0; k<MAX_PATTERN_SIZE && str[k]; k++ ) {
+        node = findChild( node, str[k] );
+        if ( node<0 )
+            break;
+        lUInt32 attr = _nodes[node].attr;
+        if ( attr ) {
+#if DUMP_PATTERNS==1
+            CRLog::debug("Pattern matched: %s on %s %s", &_attrs[attr - 1], LCSTR(lString16(str)), mask);
+#endif
+            TexPattern::apply( &_attrs[attr - 1], mask );
+            found = true;
+        }
     }
-    res = table[ TexPattern::hash2( str ) ];
-    if ( res ) {
-        found = res->match( str, mask ) || found;
+    return found;
+}
+
+/// returns bit p set when word may be broken after char p, word is lowercased and framed by spaces
+lUInt64 TexHyph::getBreaks( const lChar16 * word, int len )
+{
+    char mask[HYPH_CACHE_MAX_WORD+4];
+    memset( mask, '0', len+3 );
+    mask[len+3] = 0;
+    bool found = false;
+    for ( int i=0; i<len; i++ ) {
+        found = match( word + i, mask + i ) || found;
     }
-    res = table[ TexPattern::hash1( str ) ];
-    if ( res ) {
-        found = res->match( str, mask ) || found;
+    lUInt64 breaks = 0;
+    if ( found ) {
+        for ( int p=1; p<=len-3; p++ ) {
+            if ( mask[p+2]&1 )
+                breaks |= (lUInt64)1 << p;
+        }
     }
-    return found;
+    return breaks;
 }
 
 //TODO: do we need it?
@@ -611,6 +733,35 @@ bool TexHyph::hyphenate( const lChar16 * str, int len, lUInt16 * widths, lUInt8
     CRLog::trace("word to hyphenate: '%s'", LCSTR(lString16(word)));
 #endif
 
+    if ( len<=HYPH_CACHE_MAX_WORD ) {
+        // Short words: break points come from the cache, patterns are matched once per word
+        lUInt64 breaks = 0;
+        bool cached;
+        pthread_mutex_lock( &_cacheMutex );
+        {
+            lString16 key( word+1, len );
+            cached = _cache.get( key, breaks );
+        }
+        pthread_mutex_unlock( &_cacheMutex );
+        if ( !cached ) {
+            breaks = getBreaks( word, len );
+            pthread_mutex_lock( &_cacheMutex );
+            {
+                lString16 key( word+1, len );
+                _cache.set( key, breaks );
+            }
+            pthread_mutex_unlock( &_cacheMutex );
+        }
+        bool res = false;
+        for ( int p=len-3; p>=1 && breaks; p-- ) {
+            if ( (breaks>>p)&1 && widths[p]+hyphCharWidth <= maxWidth ) {
+                flags[p] |= LCHAR_ALLOW_HYPH_WRAP_AFTER;
+                res = true;
+            }
+        }
+        return res;
+    }
+
     memset( mask, '0', len+3 );
     mask[len+3] = 0;
     bool found = false;
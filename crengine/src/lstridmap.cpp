@@ -210,4 +210,47 @@ void LvDomNameIdMap::dumpUnknownItems( FILE * f, int start_id )
             fprintf( f, "%d %s\n", m_by_id[i]->id, s8.c_str() );
         }
     }
-}
\ No newline at end of file
+}
+static const char * id_map_magic = "IDMP";
+
+void LvDomNameIdMap::serialize( SerialBuf & buf, int start_id )
+{
+    if ( buf.error() )
+        return;
+    int pos = buf.pos();
+    buf.putMagic( id_map_magic );
+    lUInt16 count = 0;
+    for (int i=start_id; i<m_size; i++)
+    {
+        if (m_by_id[i] != NULL)
+            count++;
+    }
+    buf << count;
+    for (int i=start_id; i<m_size; i++)
+    {
+        if (m_by_id[i] != NULL)
+            buf << m_by_id[i]->id << m_by_id[i]->value;
+    }
+    buf.putCRC( buf.pos() - pos );
+}
+
+bool LvDomNameIdMap::deserialize( SerialBuf & buf )
+{
+    if ( buf.error() )
+        return false;
+    int pos = buf.pos();
+    if ( !buf.checkMagic( id_map_magic ) )
+        return false;
+    lUInt16 count = 0;
+    buf >> count;
+    for (int i=0; i<count && !buf.error(); i++)
+    {
+        lUInt16 id = 0;
+        lString16 value;
+        buf >> id >> value;
+        if ( !buf.error() )
+            AddItem( id, value, NULL );
+    }
+    buf.checkCRC( buf.pos() - pos );
+    return !buf.error();
+}
@@ -38,6 +38,8 @@
 #endif
 
 static const css_font_family_t DEF_FONT_FAMILY = css_ff_sans_serif;
+/// EPUB source bytes parsed in lazy mode before the partial document is shown
+#define EPUB_PARTIAL_LOAD_SIZE (256 * 1024)
 
 LVDocView::LVDocView()
 		: stream_(NULL),
@@ -50,6 +52,10 @@ LVDocView::LVDocView()
 		  margins_(),
 		  show_cover_(false),
           background_tiled_(true),
+          doc_cacheable_(false),
+          loader_(NULL),
+          loader_dom_(NULL),
+          render_callback_(NULL),
 		  position_is_set_(false),
 		  doc_format_(DOC_FORMAT_NULL),
 		  width_(200),
@@ -63,7 +69,11 @@ LVDocView::LVDocView()
           config_embeded_styles_(false),
           config_embeded_fonts_(false),
           config_enable_footnotes_(true),
-          config_txt_smart_format_(false)
+          config_txt_smart_format_(false),
+          config_lazy_loading_(false),
+          config_layout_threads_(1),
+          config_storage_memory_(0),
+          config_storage_codec_(CHUNK_CODEC_ZLIB)
 {
 	config_font_face_ = lString8("Arial, Roboto");
 	base_font_ = fontMan->GetFont(
@@ -83,6 +93,7 @@ LVDocView::~LVDocView()
 
 void LVDocView::Clear()
 {
+	CancelLoading();
 	if (cr_dom_) {
 		delete cr_dom_;
 		cr_dom_ = NULL;
@@ -92,6 +103,7 @@ void LVDocView::Clear()
 	position_is_set_ = false;
 	show_cover_ = false;
 	is_rendered_ = false;
+	doc_cacheable_ = false;
 	bookmark_ = ldomXPointer();
 	bookmark_.clear();
 	doc_props_->clear();
@@ -109,21 +121,34 @@ void LVDocView::Clear()
 void LVDocView::CreateEmptyDom()
 {
 	Clear();
-	cr_dom_ = new CrDom();
 	doc_format_ = DOC_FORMAT_NULL;
-	cr_dom_->setProps(doc_props_);
-	cr_dom_->setDocFlags(0);
-	cr_dom_->setDocFlag(DOC_FLAG_ENABLE_FOOTNOTES, config_enable_footnotes_);
-	cr_dom_->setDocFlag(DOC_FLAG_EMBEDDED_STYLES, config_embeded_styles_);
-	cr_dom_->setDocFlag(DOC_FLAG_EMBEDDED_FONTS, config_embeded_fonts_);
-	cr_dom_->setDocParentContainer(container_);
-	cr_dom_->setNodeTypes(fb2_elem_table);
-	cr_dom_->setAttributeTypes(fb2_attr_table);
-	cr_dom_->setNameSpaceTypes(fb2_ns_table);
+	InitDom();
+}
+
+void LVDocView::InitDom()
+{
+	cr_dom_ = CreateDom(doc_props_);
 	marked_ranges_.clear();
     bookmark_ranges_.clear();
+}
+
+CrDom* LVDocView::CreateDom(CRPropRef props)
+{
+	CrDom* dom = new CrDom();
+	dom->setProps(props);
+	dom->setDocFlags(0);
+	dom->setDocFlag(DOC_FLAG_ENABLE_FOOTNOTES, config_enable_footnotes_);
+	dom->setDocFlag(DOC_FLAG_EMBEDDED_STYLES, config_embeded_styles_);
+	dom->setDocFlag(DOC_FLAG_EMBEDDED_FONTS, config_embeded_fonts_);
+	dom->setDocParentContainer(container_);
+	dom->setStorageBufferSize(config_storage_memory_);
+	dom->setStorageCodec(config_storage_codec_);
+	dom->setNodeTypes(fb2_elem_table);
+	dom->setAttributeTypes(fb2_attr_table);
+	dom->setNameSpaceTypes(fb2_ns_table);
     // SHOULD BE CALLED ONLY AFTER setNodeTypes
-    cr_dom_->setStylesheet(CR_CSS, true);
+    dom->setStylesheet(CR_CSS, true);
+    return dom;
 }
 
 void LVDocView::RenderIfDirty()
@@ -142,9 +167,13 @@ void LVDocView::RenderIfDirty()
             return;
         }
         int y0 = show_cover_ ? dy + margins_.bottom * 4 : 0;
+        cr_dom_->setLayoutThreads(config_layout_threads_);
+        cr_dom_->setRenderCallback(render_callback_);
         cr_dom_->render(&pages_list_, dx, dy, show_cover_, y0, base_font_, config_interline_space_);
+        cr_dom_->setRenderCallback(NULL);
         fontMan->gc();
-        is_rendered_ = true;
+        // Aborted render is done again on the next access
+        is_rendered_ = cr_dom_->isRendered();
         UpdateSelections();
         UpdateBookmarksRanges();
     }
@@ -235,8 +264,9 @@ void LVDocView::Resize(int width, int height)
     }
 }
 
-bool LVDocView::LoadDoc(int doc_format, const char* cr_uri_chars)
+bool LVDocView::LoadDoc(int doc_format, const char* cr_uri_chars, const char* start_xpath)
 {
+    start_xpath_ = lString16(start_xpath);
     LVStreamRef stream;
     lString16 cre_uri(cr_uri_chars);
     lString16 to_archive_path;
@@ -277,6 +307,10 @@ bool LVDocView::LoadDoc(int doc_format, const char* cr_uri_chars)
         doc_props_->setString(DOC_PROP_FILE_PATH, path_to_doc);
         doc_props_->setString(DOC_PROP_FILE_NAME, doc_file_name);
     }
+    if (LoadDocFromCache(doc_format, stream)) {
+        stream_.Clear();
+        return true;
+    }
     if (LoadDoc(doc_format, stream)) {
         stream_.Clear();
         return true;
@@ -287,6 +321,193 @@ bool LVDocView::LoadDoc(int doc_format, const char* cr_uri_chars)
     }
 }
 
+static bool IsCacheableFormat(int doc_format)
+{
+    // MOBI, CHM and DOC get parent container from their own readers, and it can't be restored
+    return doc_format == DOC_FORMAT_FB2
+           || doc_format == DOC_FORMAT_EPUB
+           || doc_format == DOC_FORMAT_RTF
+           || doc_format == DOC_FORMAT_TXT
+           || doc_format == DOC_FORMAT_HTML;
+}
+
+lString16 LVDocView::GetCacheFileName()
+{
+    lString16 file_name = config_cache_dir_;
+    if (file_name.lastChar() != '/') {
+        file_name << '/';
+    }
+    file_name << "dom-" << fmt::hex(doc_key_.hash()) << ".cache";
+    return file_name;
+}
+
+bool LVDocView::LoadDocFromCache(int doc_format, LVStreamRef stream)
+{
+    doc_cacheable_ = false;
+    if (config_cache_dir_.empty() || !IsCacheableFormat(doc_format)) {
+        return false;
+    }
+    lUInt32 crc = 0;
+    if (stream->getcrc32(crc) != LVERR_OK) {
+        return false;
+    }
+    stream->SetPos(0);
+    // Every setting read while parsing, the rest is checked by CrDom::checkRenderContext()
+    lUInt32 options = (lUInt32) doc_format;
+    options |= (config_txt_smart_format_ ? 1 : 0) << 8;
+    options |= (config_embeded_styles_ ? 1 : 0) << 9;
+    options |= (config_embeded_fonts_ ? 1 : 0) << 10;
+    options |= (config_enable_footnotes_ ? 1 : 0) << 11;
+    doc_key_ = ldomCacheKey((lUInt64) stream->GetSize(), crc, options);
+    doc_cacheable_ = true;
+    lString16 file_name = GetCacheFileName();
+    if (!LVFileExists(file_name)) {
+        return false;
+    }
+    LVContainerRef container;
+    if (doc_format == DOC_FORMAT_EPUB) {
+        container = EpubOpenContainer(stream);
+        if (container.isNull()) {
+            return false;
+        }
+        cr_dom_->setDocParentContainer(container);
+    }
+    if (!cr_dom_->openCacheFile(file_name, doc_key_)) {
+        CRLog::error("Cannot open cache file %s, parsing document", LCSTR(file_name));
+        // Failed document may be partially replaced
+        delete cr_dom_;
+        InitDom();
+        LVDeleteFile(file_name);
+        return false;
+    }
+    stream_ = stream;
+    doc_format_ = doc_format;
+    if (!container.isNull()) {
+        container_ = container;
+        archive_container_ = container;
+    }
+    doc_props_ = cr_dom_->getProps();
+    offset_ = 0;
+    page_ = 0;
+    CheckRenderProps(0, 0);
+    REQUEST_RENDER("LoadDocFromCache")
+    return true;
+}
+
+// Index of DocFragment addressed by xpath, as /body/DocFragment[12]/body/p[3]
+static int GetXPathFragment(const lString16& xpath)
+{
+    int pos = xpath.pos("DocFragment[");
+    if (pos < 0) {
+        return 0;
+    }
+    int n = 0;
+    for (int i = pos + 12; i < xpath.length() && xpath[i] >= '0' && xpath[i] <= '9'; i++) {
+        n = n * 10 + (xpath[i] - '0');
+    }
+    return n > 0 ? n - 1 : 0;
+}
+
+bool LVDocView::LoadEpubPartially()
+{
+    EpubImporter importer(cr_dom_);
+    if (!importer.open(stream_)) {
+        return false;
+    }
+    // Fragments before the requested one are kept as placeholders, so that xpaths stay valid
+    int fragment = GetXPathFragment(start_xpath_);
+    if (fragment >= importer.getFragmentCount()) {
+        fragment = importer.getFragmentCount() - 1;
+    }
+    lvsize_t parsed = 0;
+    while (importer.hasNext() && parsed < EPUB_PARTIAL_LOAD_SIZE) {
+        bool placeholder = importer.getNextFragment() < fragment;
+        parsed += importer.parseNext(placeholder);
+    }
+    if (!importer.finish()) {
+        return false;
+    }
+    if (!importer.hasNext()) {
+        return true;
+    }
+    // The whole book is imported again into a separate document, which replaces this one when done
+    loader_dom_ = CreateDom(LVClonePropsContainer(doc_props_));
+    loader_ = new EpubImporter(loader_dom_);
+    if (!loader_->open(stream_)) {
+        CancelLoading();
+    }
+    return true;
+}
+
+bool LVDocView::ContinueLoading()
+{
+    if (!loader_) {
+        return false;
+    }
+    if (loader_->hasNext()) {
+        loader_->parseNext();
+        return true;
+    }
+    bool loaded = loader_->finish();
+    delete loader_;
+    loader_ = NULL;
+    if (!loaded) {
+        CRLog::error("EPUB background loading failed, keeping partial document");
+        CancelLoading();
+        return false;
+    }
+    lString16 xpath = bookmark_.isNull() ? lString16::empty_str : bookmark_.toString();
+    delete cr_dom_;
+    cr_dom_ = loader_dom_;
+    loader_dom_ = NULL;
+    // Flags might be changed by config while loading
+    cr_dom_->setDocFlag(DOC_FLAG_ENABLE_FOOTNOTES, config_enable_footnotes_);
+    cr_dom_->setDocFlag(DOC_FLAG_EMBEDDED_STYLES, config_embeded_styles_);
+    cr_dom_->setDocFlag(DOC_FLAG_EMBEDDED_FONTS, config_embeded_fonts_);
+    cr_dom_->setStorageBufferSize(config_storage_memory_);
+    cr_dom_->setStorageCodec(config_storage_codec_);
+    container_ = cr_dom_->getDocParentContainer();
+    archive_container_ = cr_dom_->getDocParentContainer();
+    doc_props_ = cr_dom_->getProps();
+    marked_ranges_.clear();
+    bookmark_ranges_.clear();
+    bookmark_ = xpath.empty() ? ldomXPointer() : cr_dom_->createXPointer(xpath);
+    CheckRenderProps(0, 0);
+    REQUEST_RENDER("ContinueLoading")
+    CheckPos();
+    return false;
+}
+
+void LVDocView::CancelLoading()
+{
+    if (loader_) {
+        delete loader_;
+        loader_ = NULL;
+    }
+    if (loader_dom_) {
+        delete loader_dom_;
+        loader_dom_ = NULL;
+    }
+}
+
+bool LVDocView::SaveDocToCache()
+{
+    if (loader_) {
+        // Partial document is never cached
+        return false;
+    }
+    if (!doc_cacheable_ || config_cache_dir_.empty() || !cr_dom_ || !cr_dom_->isCacheChanged()) {
+        return false;
+    }
+    LVCreateDirectory(config_cache_dir_);
+    if (!cr_dom_->saveCacheFile(GetCacheFileName(), doc_key_)) {
+        // Don't retry on every idle pass
+        doc_cacheable_ = false;
+        return false;
+    }
+    return true;
+}
+
 bool LVDocView::LoadDoc(int doc_format, LVStreamRef stream)
 {
     stream_ = stream;
@@ -301,7 +522,11 @@ bool LVDocView::LoadDoc(int doc_format, LVStreamRef stream)
             return false;
         }
         cr_dom_->setProps(doc_props_);
-        if (!ImportEpubDocument(stream_, cr_dom_)) {
+        if (config_lazy_loading_) {
+            if (!LoadEpubPartially()) {
+                return false;
+            }
+        } else if (!ImportEpubDocument(stream_, cr_dom_)) {
             return false;
         }
         container_ = cr_dom_->getDocParentContainer();
@@ -1918,9 +2143,8 @@ void CreBridge::processMetadata(CmdRequest& request, CmdResponse& response)
             thumb_width = thumb_image->GetWidth();
             thumb_height = thumb_image->GetHeight();
             unsigned char* pixels = doc_thumb->newByteArray(thumb_width * thumb_height * 4);
-            LVColorDrawBuf* buf = new LVColorDrawBuf(thumb_width, thumb_height, pixels, 32);
+            LVColorDrawBuf* buf = new LVColorDrawBuf(thumb_width, thumb_height, pixels, 32, true);
             buf->Draw(thumb_image, 0, 0, thumb_width, thumb_height, false);
-            convertBitmap(buf);
             delete buf;
             thumb_image.Clear();
         }
@@ -17,6 +17,14 @@
 #include <string.h>
 #include "include/lvdrawbuf.h"
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define DRAWBUF_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define DRAWBUF_SSE2 1
+#endif
+
 #define GRAY_INVERSE 0
 #define GUARD_BYTE 0xa5
 #define CHECK_GUARD_BYTE \
@@ -105,6 +113,119 @@ static void ApplyAlphaRGB565( lUInt16 &dst, lUInt16 src, lUInt32 alpha )
     }
 }
 
+/// blends all four channels of pixel over dst, weight is 0..256
+inline static lUInt32 BlendPixel( lUInt32 dst, lUInt32 pixel, lUInt32 weight )
+{
+    lUInt32 inv = 256 - weight;
+    lUInt32 n1 = (((dst & 0xFF00FF) * inv + (pixel & 0xFF00FF) * weight) >> 8) & 0xFF00FF;
+    lUInt32 n2 = (((dst >> 8) & 0xFF00FF) * inv + ((pixel >> 8) & 0xFF00FF) * weight) & 0xFF00FF00;
+    return n1 | n2;
+}
+
+#if (DRAWBUF_SSE2==1)
+/// blends two pixels of each half of d with c, w holds per channel weights 0..256
+inline static __m128i BlendPixelsSSE2( __m128i d, __m128i c, __m128i wlo, __m128i whi )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i full = _mm_set1_epi16(256);
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), _mm_sub_epi16(full, wlo)),
+                               _mm_mullo_epi16(_mm_unpacklo_epi8(c, zero), wlo));
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), _mm_sub_epi16(full, whi)),
+                               _mm_mullo_epi16(_mm_unpackhi_epi8(c, zero), whi));
+    return _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+}
+#endif
+
+/// fills count pixels with value
+static void FillRow32( lUInt32 * dst, int count, lUInt32 pixel )
+{
+    int i = 0;
+#if (DRAWBUF_NEON==1)
+    uint32x4_t v = vdupq_n_u32(pixel);
+    for ( ; i + 4 <= count; i += 4 )
+        vst1q_u32(dst + i, v);
+#elif (DRAWBUF_SSE2==1)
+    __m128i v = _mm_set1_epi32((int)pixel);
+    for ( ; i + 4 <= count; i += 4 )
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+#endif
+    for ( ; i < count; i++ )
+        dst[i] = pixel;
+}
+
+/// blends count pixels with value of the same weight 0..256
+static void BlendRow32( lUInt32 * dst, int count, lUInt32 pixel, lUInt32 weight )
+{
+    int i = 0;
+#if (DRAWBUF_NEON==1)
+    uint8x8x4_t c;
+    for ( int k=0; k<4; k++ )
+        c.val[k] = vdup_n_u8((lUInt8)(pixel >> (k * 8)));
+    uint16x8_t w = vdupq_n_u16((lUInt16)weight);
+    uint16x8_t inv = vdupq_n_u16((lUInt16)(256 - weight));
+    for ( ; i + 8 <= count; i += 8 ) {
+        uint8x8x4_t d = vld4_u8((const lUInt8 *)(dst + i));
+        for ( int k=0; k<4; k++ )
+            d.val[k] = vshrn_n_u16(vaddq_u16(vmulq_u16(vmovl_u8(d.val[k]), inv), vmulq_u16(vmovl_u8(c.val[k]), w)), 8);
+        vst4_u8((lUInt8 *)(dst + i), d);
+    }
+#elif (DRAWBUF_SSE2==1)
+    __m128i c = _mm_set1_epi32((int)pixel);
+    __m128i w = _mm_set1_epi16((short)weight);
+    for ( ; i + 4 <= count; i += 4 ) {
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        d = BlendPixelsSSE2(d, c, w, w);
+        _mm_storeu_si128((__m128i *)(dst + i), d);
+    }
+#endif
+    for ( ; i < count; i++ )
+        dst[i] = BlendPixel(dst[i], pixel, weight);
+}
+
+/// blends count pixels with value using 8-bit glyph coverage
+static void BlendGlyphRow32( lUInt32 * dst, const lUInt8 * src, int count, lUInt32 pixel )
+{
+    int i = 0;
+#if (DRAWBUF_NEON==1)
+    uint8x8x4_t c;
+    for ( int k=0; k<4; k++ )
+        c.val[k] = vdup_n_u8((lUInt8)(pixel >> (k * 8)));
+    uint16x8_t full = vdupq_n_u16(256);
+    for ( ; i + 8 <= count; i += 8 ) {
+        uint8x8_t cov = vld1_u8(src + i);
+        if ( vget_lane_u64(vreinterpret_u64_u8(cov), 0) == 0 )
+            continue;
+        uint16x8_t w = vmovl_u8(cov);
+        w = vaddq_u16(w, vshrq_n_u16(w, 7));
+        uint16x8_t inv = vsubq_u16(full, w);
+        uint8x8x4_t d = vld4_u8((const lUInt8 *)(dst + i));
+        for ( int k=0; k<4; k++ )
+            d.val[k] = vshrn_n_u16(vaddq_u16(vmulq_u16(vmovl_u8(d.val[k]), inv), vmulq_u16(vmovl_u8(c.val[k]), w)), 8);
+        vst4_u8((lUInt8 *)(dst + i), d);
+    }
+#elif (DRAWBUF_SSE2==1)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i c = _mm_set1_epi32((int)pixel);
+    for ( ; i + 4 <= count; i += 4 ) {
+        lUInt32 cov4;
+        memcpy(&cov4, src + i, 4);
+        if ( cov4 == 0 )
+            continue;
+        __m128i w = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)cov4), zero);
+        w = _mm_add_epi16(w, _mm_srli_epi16(w, 7));
+        w = _mm_unpacklo_epi16(w, w);
+        __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+        d = BlendPixelsSSE2(d, c, _mm_unpacklo_epi32(w, w), _mm_unpackhi_epi32(w, w));
+        _mm_storeu_si128((__m128i *)(dst + i), d);
+    }
+#endif
+    for ( ; i < count; i++ ) {
+        lUInt32 cov = src[i];
+        if ( cov )
+            dst[i] = BlendPixel(dst[i], pixel, cov + (cov >> 7));
+    }
+}
+
 static void ApplyAlphaGray( lUInt8 &dst, lUInt8 src, lUInt32 alpha, int bpp )
 {
     if ( alpha==0 )
@@ -339,6 +460,7 @@ public:
             {
                 lUInt32 * row = (lUInt32 *)dst->GetScanLine( yy + dst_y );
                 row += dst_x;
+                bool rgba = dst->IsAndroidRGBA();
                 for (int x=0; x<dst_dx; x++)
                 {
                     lUInt32 cl = data[xmap ? xmap[x] : x];
@@ -346,14 +468,16 @@ public:
                     lUInt32 alpha = (cl >> 24)&0xFF;
                     if ( xx<clip.left || xx>=clip.right || alpha==0xFF )
                         continue;
+                    lUInt32 pixel = rgba ? rgbToAndroidRGBA(row[x]) : row[x];
                     if ( !alpha )
-                        row[ x ] = cl;
+                        pixel = cl;
                     else {
-                    	if ((row[x] & 0xFF000000) == 0xFF000000)
-                            row[ x ] = cl; // copy as is if buffer pixel is transparent
+                    	if ((pixel & 0xFF000000) == 0xFF000000)
+                            pixel = cl; // copy as is if buffer pixel is transparent
                     	else
-                    		ApplyAlphaRGB( row[x], cl, alpha );
+                    		ApplyAlphaRGB( pixel, cl, alpha );
                     }
+                    row[ x ] = rgba ? rgbToAndroidRGBA(pixel) : pixel;
                 }
             }
             else if ( bpp == 16 )
@@ -1081,14 +1205,9 @@ void LVColorDrawBuf::Clear( lUInt32 color )
             }
         }
     } else {
+        lUInt32 pixel = ToPixel(color);
         for (int y=0; y<_dy; y++)
-        {
-            lUInt32 * line = (lUInt32 *)GetScanLine(y);
-            for (int x=0; x<_dx; x++)
-            {
-                line[x] = color;
-            }
-        }
+            FillRow32((lUInt32 *)GetScanLine(y), _dx, pixel);
     }
 }
 
@@ -1100,7 +1219,7 @@ lUInt32 LVColorDrawBuf::GetPixel( int x, int y )
         return 0;
     if ( _bpp==16 )
         return rgb565to888(((lUInt16*)GetScanLine(y))[x]);
-    return ((lUInt32*)GetScanLine(y))[x];
+    return ToPixel(((lUInt32*)GetScanLine(y))[x]);
 }
 
 inline static lUInt32 AA(lUInt32 color) {
@@ -1257,17 +1376,15 @@ void LVColorDrawBuf::FillRect( int x0, int y0, int x1, int y1, lUInt32 color )
                     line[x] = cl16;
             }
         }
-    } else {
+    } else if (alpha < 255) {
+        lUInt32 pixel = ToPixel(color & 0xFFFFFF);
         for (int y=y0; y<y1; y++)
         {
-            lUInt32 * line = (lUInt32 *)GetScanLine(y);
-            for (int x=x0; x<x1; x++)
-            {
-                if (alpha)
-                    ApplyAlphaRGB(line[x], color, alpha);
-                else
-                    line[x] = color;
-            }
+            lUInt32 * line = (lUInt32 *)GetScanLine(y) + x0;
+            if (alpha)
+                BlendRow32(line, x1 - x0, pixel, 256 - alpha);
+            else
+                FillRow32(line, x1 - x0, pixel);
         }
     }
 }
@@ -1299,6 +1416,8 @@ void LVColorDrawBuf::FillRectPattern( int x0, int y0, int x1, int y1, lUInt32 co
             }
         }
     } else {
+        color0 = ToPixel(color0);
+        color1 = ToPixel(color1);
         for (int y=y0; y<y1; y++)
         {
             lUInt8 patternMask = pattern[y & 3];
@@ -1467,30 +1586,11 @@ void LVColorDrawBuf::Draw( int x, int y, const lUInt8 * bitmap, int width, int h
     } else {
 
 
-        lUInt32 * dst;
-        lUInt32 * dstline;
-
+        lUInt32 pixel = ToPixel(bmpcl & 0xFFFFFF);
 
         for (;height;height--)
         {
-            src = bitmap;
-            dstline = ((lUInt32*)GetScanLine(y++)) + x;
-            dst = dstline;
-
-            for (xx = width; xx>0; --xx)
-            {
-                lUInt32 opaque = ((*(src++))>>1)&0x7F;
-                if ( opaque>=0x78 )
-                    *dst = bmpcl;
-                else if ( opaque>0 ) {
-                    lUInt32 alpha = 0x7F-opaque;
-                    lUInt32 cl1 = ((alpha*((*dst)&0xFF00FF) + opaque*(bmpcl&0xFF00FF))>>7) & 0xFF00FF;
-                    lUInt32 cl2 = ((alpha*((*dst)&0x00FF00) + opaque*(bmpcl&0x00FF00))>>7) & 0x00FF00;
-                    *dst = cl1 | cl2;
-                }
-                /* next pixel */
-                dst++;
-            }
+            BlendGlyphRow32(((lUInt32*)GetScanLine(y++)) + x, bitmap, width, pixel);
             /* new dest line */
             bitmap += bmp_width;
         }
@@ -1798,6 +1898,7 @@ void LVColorDrawBuf::DrawTo( LVDrawBuf * buf, int x, int y, int options, lUInt32
     lvRect clip;
     buf->GetClipRect(&clip);
     int bpp = buf->GetBitsPerPixel();
+    bool rgba = buf->IsAndroidRGBA();
     for (int yy=0; yy<_dy; yy++) {
         if (y+yy >= clip.top && y+yy < clip.bottom) {
             if ( _bpp==16 ) {
@@ -1859,7 +1960,7 @@ void LVColorDrawBuf::DrawTo( LVDrawBuf * buf, int x, int y, int options, lUInt32
                     lUInt32 * dst = ((lUInt32 *)buf->GetScanLine(y + yy)) + x;
                     for (int xx=0; xx<_dx; xx++) {
                         if ( x+xx >= clip.left && x+xx < clip.right ) {
-                            *dst = rgb565to888( *src );
+                            *dst = rgba ? rgbToAndroidRGBA( rgb565to888( *src ) ) : rgb565to888( *src );
                         }
                         dst++;
                         src++;
@@ -1915,7 +2016,7 @@ void LVColorDrawBuf::DrawTo( LVDrawBuf * buf, int x, int y, int options, lUInt32
                     lUInt32 * dst = ((lUInt32 *)buf->GetScanLine(y + yy)) + x;
                     for (int xx = 0; xx < _dx; xx++) {
                         if (x+xx >= clip.left && x + xx < clip.right) {
-                            *dst = *src;
+                            *dst = rgba != _rgba ? rgbToAndroidRGBA( *src ) : *src;
                         }
                         dst++;
                         src++;
@@ -2079,7 +2180,7 @@ void LVColorDrawBuf::DrawRescaled(LVDrawBuf * src, int x, int y, int dx, int dy,
 							dst[x + xx] = rgb888to565(cl);
 						} else {
 							lUInt32 * dst = (lUInt32 *)GetScanLine(y + yy);
-							dst[x + xx] = cl;
+							dst[x + xx] = ToPixel(cl);
 						}
 					}
 				}
@@ -2098,7 +2199,7 @@ void LVColorDrawBuf::DrawRescaled(LVDrawBuf * src, int x, int y, int dx, int dy,
 							dst[x + xx] = rgb888to565(cl);
 						} else {
 							lUInt32 * dst = (lUInt32 *)GetScanLine(y + yy);
-							dst[x + xx] = cl;
+							dst[x + xx] = ToPixel(cl);
 						}
 					}
 				}
@@ -2140,13 +2241,14 @@ LVColorDrawBuf::LVColorDrawBuf(int dx, int dy, int bpp)
 #endif
     ,_bpp(bpp)
     ,_ownData(true)
+    ,_rgba(false)
 {
     _rowsize = dx*(_bpp>>3);
     Resize( dx, dy );
 }
 
 /// creates wrapper around external RGBA buffer
-LVColorDrawBuf::LVColorDrawBuf(int dx, int dy, lUInt8 * externalBuffer, int bpp )
+LVColorDrawBuf::LVColorDrawBuf(int dx, int dy, lUInt8 * externalBuffer, int bpp, bool rgba )
 :     LVBaseDrawBuf()
 #if defined(_WIN32) && !defined(QT_GL)
     ,_drawdc(NULL)
@@ -2154,6 +2256,7 @@ LVColorDrawBuf::LVColorDrawBuf(int dx, int dy, lUInt8 * externalBuffer, int bpp
 #endif
     ,_bpp(bpp)
     ,_ownData(false)
+    ,_rgba(rgba && bpp == 32)
 {
     _dx = dx;
     _dy = dy;
@@ -12,6 +12,7 @@
 */
 #include <stdlib.h>
 #include <stdio.h>
+#include <pthread.h>
 
 #include "include/lvfntman.h"
 #include "include/lvstyles.h"
@@ -24,7 +25,9 @@
 #define MAX_LINE_CHARS 2048
 // freetype font glyph buffer size, in bytes
 // 0x20000 (_WIN32, LBOOK), 0x40000 (LINUX)
-#define GLYPH_CACHE_SIZE 0x40000
+#define GLYPH_CACHE_SIZE 0x100000
+// glyph atlas page size, in bytes, fits largest 255x255 glyph
+#define GLYPH_ATLAS_PAGE_SIZE 0x10000
 
 inline int myabs(int n) { return n < 0 ? -n : n; }
 
@@ -33,6 +36,19 @@ LVFontManager* fontMan = NULL;
 static double gammaLevel = 1.0;
 static int gammaIndex = GAMMA_LEVELS/2;
 
+/// FT_Load_Glyph shares hinter state between all faces of the library, so glyph loading
+/// and fallback font lookup are serialized; faces are guarded by their own mutex
+static pthread_mutex_t _ftMutex = PTHREAD_MUTEX_INITIALIZER;
+
+class LVFontLock {
+    pthread_mutex_t * _mutex;
+public:
+    LVFontLock( pthread_mutex_t * mutex ) : _mutex(mutex) { pthread_mutex_lock( _mutex ); }
+    ~LVFontLock() { pthread_mutex_unlock( _mutex ); }
+};
+
+#define FONT_GUARD LVFontLock _guard( &_mutex );
+
 /// returns first found face from passed list, or return face for font found by family only
 lString8 LVFontManager::findFontFace(lString8 commaSeparatedFaceList, css_font_family_t fallbackByFamily) {
 	// faces we want
@@ -492,7 +508,7 @@ static LVFontGlyphCacheItem * newItem( LVFontLocalGlyphCache * local_cache, lCha
     FT_Bitmap*  bitmap = &slot->bitmap;
     lUInt8 w = (lUInt8)(bitmap->width);
     lUInt8 h = (lUInt8)(bitmap->rows);
-    LVFontGlyphCacheItem * item = LVFontGlyphCacheItem::newItem(local_cache, ch, w, h );
+    LVFontGlyphCacheItem * item = local_cache->newItem( ch, w, h );
     if ( bitmap->pixel_mode==FT_PIXEL_MODE_MONO ) { //drawMonochrome
         lUInt8 mask = 0x80;
         const lUInt8 * ptr = (const lUInt8 *)bitmap->buffer;
@@ -543,120 +559,126 @@ static LVFontGlyphCacheItem * newItem( LVFontLocalGlyphCache * local_cache, lCha
 
 void LVFontLocalGlyphCache::clear()
 {
-    while ( head ) {
-        LVFontGlyphCacheItem * ptr = head;
-        remove( ptr );
-        global_cache->remove( ptr );
-        LVFontGlyphCacheItem::freeItem( ptr );
-    }
-}
-
-LVFontGlyphCacheItem * LVFontLocalGlyphCache::get( lUInt16 ch )
-{
-    LVFontGlyphCacheItem * ptr = head;
-    for ( ; ptr; ptr = ptr->next_local ) {
-        if ( ptr->ch == ch ) {
-            global_cache->refresh( ptr );
-            return ptr;
+    for ( int i=0; i<GLYPH_TABLE_BLOCKS; i++ ) {
+        LVFontGlyphCacheItem ** block = table[i];
+        if ( !block )
+            continue;
+        for ( int j=0; j<GLYPH_TABLE_BLOCK_SIZE; j++ ) {
+            if ( block[j] )
+                block[j]->local_cache = NULL;
         }
+        free( block );
+        table[i] = NULL;
     }
-    return NULL;
 }
 
 void LVFontLocalGlyphCache::put( LVFontGlyphCacheItem * item )
 {
+    LVFontGlyphCacheItem ** & block = table[item->ch >> 8];
+    if ( !block )
+        block = (LVFontGlyphCacheItem **)calloc( GLYPH_TABLE_BLOCK_SIZE, sizeof(LVFontGlyphCacheItem *) );
+    LVFontGlyphCacheItem * & entry = block[item->ch & 0xFF];
+    if ( entry )
+        entry->local_cache = NULL;
+    entry = item;
     global_cache->put( item );
-    item->next_local = head;
-    if ( head )
-        head->prev_local = item;
-    if ( !tail )
-        tail = item;
-    head = item;
 }
 
-/// remove from list, but don't delete
+/// remove from table, but don't delete
 void LVFontLocalGlyphCache::remove( LVFontGlyphCacheItem * item )
 {
-    if ( item==head )
-        head = item->next_local;
-    if ( item==tail )
-        tail = item->prev_local;
-    if ( !head || !tail )
-        return;
-    if ( item->prev_local )
-        item->prev_local->next_local = item->next_local;
-    if ( item->next_local )
-        item->next_local->prev_local = item->prev_local;
-    item->next_local = NULL;
-    item->prev_local = NULL;
+    LVFontGlyphCacheItem ** block = table[item->ch >> 8];
+    if ( block && block[item->ch & 0xFF]==item )
+        block[item->ch & 0xFF] = NULL;
+    item->local_cache = NULL;
 }
 
-void LVFontGlobalGlyphCache::refresh( LVFontGlyphCacheItem * item )
+LVFontGlyphCacheItem * LVFontGlobalGlyphCache::alloc( LVFontLocalGlyphCache * local_cache, lChar16 ch, int w, int h )
 {
-    if ( tail!=item ) {
-        //move to head
-        removeNoLock( item );
-        putNoLock( item );
-    }
+    int sz = LVFontGlyphCacheItem::getSize( w, h );
+    if ( !tail || tail->used + sz > tail->size ) {
+        int pageSize = sz > GLYPH_ATLAS_PAGE_SIZE ? sz : GLYPH_ATLAS_PAGE_SIZE;
+        LVFontGlyphAtlasPage * page = (LVFontGlyphAtlasPage *)malloc( sizeof(LVFontGlyphAtlasPage) + pageSize );
+        page->next = NULL;
+        page->size = pageSize;
+        page->used = 0;
+        page->touched = 0;
+        page->data = (lUInt8 *)(page + 1);
+        if ( tail )
+            tail->next = page;
+        else
+            head = page;
+        tail = page;
+        size += pageSize;
+    }
+    LVFontGlyphCacheItem * item = (LVFontGlyphCacheItem *)(tail->data + tail->used);
+    tail->used += sz;
+    tail->touched = ++clock;
+    item->local_cache = local_cache;
+    item->page = tail;
+    item->ch = ch;
+    item->bmp_width = (lUInt8)w;
+    item->bmp_height = (lUInt8)h;
+    item->origin_x = 0;
+    item->origin_y = 0;
+    item->advance = 0;
+    return item;
 }
 
 void LVFontGlobalGlyphCache::put( LVFontGlyphCacheItem * item )
 {
-    putNoLock(item);
+    CR_UNUSED(item);
+    // page being filled is kept, it holds the item just put
+    while ( size > max_size && head!=tail )
+        evictPage();
 }
 
-void LVFontGlobalGlyphCache::putNoLock( LVFontGlyphCacheItem * item )
+void LVFontGlobalGlyphCache::touch( LVFontGlyphCacheItem * item )
 {
-    int sz = item->getSize();
-    // remove extra items from tail
-    while ( sz + size > max_size ) {
-        LVFontGlyphCacheItem * removed_item = tail;
-        if ( !removed_item )
-            break;
-        removeNoLock( removed_item );
-        removed_item->local_cache->remove( removed_item );
-        LVFontGlyphCacheItem::freeItem( removed_item );
-    }
-    // add new item to head
-    item->next_global = head;
-    if ( head )
-        head->prev_global = item;
-    head = item;
-    if ( !tail )
-        tail = item;
-    size += sz;
+    hits++;
+    item->page->touched = ++clock;
 }
 
-void LVFontGlobalGlyphCache::remove( LVFontGlyphCacheItem * item )
+/// drops least recently touched page but the one being filled, glyphs of running text stay
+void LVFontGlobalGlyphCache::evictPage()
 {
-    removeNoLock(item);
+    LVFontGlyphAtlasPage * victim = head;
+    LVFontGlyphAtlasPage * victimPrev = NULL;
+    LVFontGlyphAtlasPage * prev = head;
+    for ( LVFontGlyphAtlasPage * page = head->next; page && page != tail; prev = page, page = page->next ) {
+        // clock differences stay correct across wrap around
+        if ( (lInt32)(page->touched - victim->touched) < 0 ) {
+            victim = page;
+            victimPrev = prev;
+        }
+    }
+    dropPage( victimPrev, victim );
+    evictions++;
 }
 
-void LVFontGlobalGlyphCache::removeNoLock( LVFontGlyphCacheItem * item )
+/// drops page with all items still referenced from local caches
+void LVFontGlobalGlyphCache::dropPage( LVFontGlyphAtlasPage * prev, LVFontGlyphAtlasPage * page )
 {
-    if ( item==head )
-        head = item->next_global;
-    if ( item==tail )
-        tail = item->prev_global;
-    if ( !head || !tail )
-        return;
-    if ( item->prev_global )
-        item->prev_global->next_global = item->next_global;
-    if ( item->next_global )
-        item->next_global->prev_global = item->prev_global;
-    item->next_global = NULL;
-    item->prev_global = NULL;
-    size -= item->getSize();
+    for ( int offset = 0; offset < page->used; ) {
+        LVFontGlyphCacheItem * item = (LVFontGlyphCacheItem *)(page->data + offset);
+        if ( item->local_cache )
+            item->local_cache->remove( item );
+        offset += item->getSize();
+    }
+    if ( prev )
+        prev->next = page->next;
+    else
+        head = page->next;
+    if ( tail == page )
+        tail = prev;
+    size -= page->size;
+    free( page );
 }
 
 void LVFontGlobalGlyphCache::clear()
 {
-    while ( head ) {
-        LVFontGlyphCacheItem * ptr = head;
-        remove( ptr );
-        ptr->local_cache->remove( ptr );
-        LVFontGlyphCacheItem::freeItem( ptr );
-    }
+    while ( head )
+        dropPage( NULL, head );
 }
 
 lString8 familyName( FT_Face face )
@@ -707,6 +729,7 @@ protected:
     hinting_mode_t _hintingMode;
     bool          _fallbackFontIsSet;
     LVFontRef     _fallbackFont;
+    pthread_mutex_t _mutex; // recursive, see FONT_GUARD
 
 public:
 
@@ -721,6 +744,7 @@ public:
     LVFont * getFallbackFont() {
         if ( _fallbackFontIsSet )
             return _fallbackFont.get();
+        LVFontLock lock( &_ftMutex );
         if ( fontMan->GetFallbackFontFace()!=_faceName ) // to avoid circular link, disable fallback for fallback font
             _fallbackFont = fontMan->GetFallbackFont(_size);
         _fallbackFontIsSet = true;
@@ -755,11 +779,17 @@ public:
         _matrix.xy = 0;
         _matrix.yx = 0;
         _hintingMode = fontMan->GetHintingMode();
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init( &attr );
+        pthread_mutexattr_settype( &attr, PTHREAD_MUTEX_RECURSIVE );
+        pthread_mutex_init( &_mutex, &attr );
+        pthread_mutexattr_destroy( &attr );
     }
 
     virtual ~LVFreeTypeFace()
     {
         Clear();
+        pthread_mutex_destroy( &_mutex );
     }
 
     virtual int getHyphenWidth()
@@ -957,7 +987,7 @@ public:
     */
     virtual bool getGlyphInfo(lUInt16 code, glyph_info_t * glyph, lChar16 def_char=0)
     {
-        //FONT_GUARD
+        FONT_GUARD
         int glyph_index = getCharIndex( code, 0 );
         if ( glyph_index==0 ) {
             LVFont * fallback = getFallbackFont();
@@ -978,10 +1008,12 @@ public:
         else if (_hintingMode == HINTING_MODE_DISABLED)
             flags |= FT_LOAD_NO_AUTOHINT | FT_LOAD_NO_HINTING;
         updateTransform();
+        pthread_mutex_lock( &_ftMutex );
         int error = FT_Load_Glyph(
             _face,          /* handle to face object */
             glyph_index,   /* glyph index           */
             flags );  /* load flags, see below */
+        pthread_mutex_unlock( &_ftMutex );
         if ( error )
             return false;
         glyph->blackBoxX = (lUInt8)(_slot->metrics.width >> 6);
@@ -1027,6 +1059,7 @@ public:
     {
         if ( len <= 0 || _face==NULL )
             return 0;
+        FONT_GUARD
         int error;
 
 #if (ALLOW_KERNING==1)
@@ -1133,8 +1166,8 @@ public:
                         const lChar16 * text, int len
         )
     {
-        static lUInt16 widths[MAX_LINE_CHARS+1];
-        static lUInt8 flags[MAX_LINE_CHARS+1];
+        static CR_THREAD_LOCAL lUInt16 widths[MAX_LINE_CHARS+1];
+        static CR_THREAD_LOCAL lUInt8 flags[MAX_LINE_CHARS+1];
         if ( len>MAX_LINE_CHARS )
             len = MAX_LINE_CHARS;
         if ( len<=0 )
@@ -1165,7 +1198,7 @@ public:
         \return glyph pointer if glyph was found, NULL otherwise
     */
     virtual LVFontGlyphCacheItem * getGlyph(lUInt16 ch, lChar16 def_char=0) {
-        //FONT_GUARD
+        FONT_GUARD
         FT_UInt ch_glyph_index = getCharIndex( ch, 0 );
         if ( ch_glyph_index==0 ) {
             LVFont * fallback = getFallbackFont();
@@ -1190,9 +1223,11 @@ public:
             /* load glyph image into the slot (erase previous one) */
 
             updateTransform();
+            pthread_mutex_lock( &_ftMutex );
             int error = FT_Load_Glyph( _face,          /* handle to face object */
                     ch_glyph_index,                /* glyph index           */
                     rend_flags );             /* load flags, see below */
+            pthread_mutex_unlock( &_ftMutex );
             if ( error ) {
                 return NULL;  /* ignore errors */
             }
@@ -1236,6 +1271,7 @@ public:
     /// returns char width
     virtual int getCharWidth( lChar16 ch, lChar16 def_char='?' )
     {
+        FONT_GUARD
         int w = _wcache.get(ch);
         if ( w==0xFF ) {
             glyph_info_t glyph;
@@ -1351,7 +1387,6 @@ public:
 
 
             LVFontGlyphCacheItem * item = getGlyph(ch, def_char);
-                    _glyph_cache.get( ch );
             if ( !item )
                 continue;
             if ( (item && !isHyphen) || i>=len-1 ) { // avoid soft hyphens inside text string
@@ -1513,8 +1548,8 @@ public:
                         const lChar16 * text, int len
         )
     {
-        static lUInt16 widths[MAX_LINE_CHARS+1];
-        static lUInt8 flags[MAX_LINE_CHARS+1];
+        static CR_THREAD_LOCAL lUInt16 widths[MAX_LINE_CHARS+1];
+        static CR_THREAD_LOCAL lUInt8 flags[MAX_LINE_CHARS+1];
         if ( len>MAX_LINE_CHARS )
             len = MAX_LINE_CHARS;
         if ( len<=0 )
@@ -1551,7 +1586,7 @@ public:
         int dx = oldx ? oldx + _hShift : 0;
         int dy = oldy ? oldy + _vShift : 0;
 
-        item = LVFontGlyphCacheItem::newItem( &_glyph_cache, ch, dx, dy ); //, _drawMonochrome
+        item = _glyph_cache.newItem( ch, dx, dy ); //, _drawMonochrome
         item->advance = olditem->advance + _hShift;
         item->origin_x = olditem->origin_x;
         item->origin_y = olditem->origin_y;
@@ -1918,6 +1953,8 @@ public:
     {
         _globalCache.clear();
     }
+    /// returns glyph cache shared by all faces
+    virtual LVFontGlobalGlyphCache * getGlyphCache() { return &_globalCache; }
 
     virtual int GetFontCount()
     {
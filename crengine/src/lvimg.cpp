@@ -493,6 +493,7 @@ public:
     virtual ~LVPngImageSource();
     virtual void   Compact();
     virtual bool   Decode( LVImageDecoderCallback * callback );
+    virtual bool   DecodeScaled( LVImageDecoderCallback * callback, int dx, int dy );
     static bool CheckPattern( const lUInt8 * buf, int len );
 };
 
@@ -699,6 +700,20 @@ public:
     virtual ~LVJpegImageSource() {}
     virtual void   Compact() { }
     virtual bool   Decode( LVImageDecoderCallback * callback )
+    {
+        return DecodeScaled( callback, 0, 0 );
+    }
+    /// largest IDCT scaling denominator (1, 2, 4 or 8) keeping image not smaller than dx x dy
+    static int ScaleDenom( int width, int height, int dx, int dy )
+    {
+        if ( dx<=0 || dy<=0 )
+            return 1;
+        int denom = 1;
+        while ( denom<8 && (width + denom*2 - 1) / (denom*2) >= dx && (height + denom*2 - 1) / (denom*2) >= dy )
+            denom *= 2;
+        return denom;
+    }
+    virtual bool   DecodeScaled( LVImageDecoderCallback * callback, int dx, int dy )
     {
     	//CRLog::trace("LVJpegImageSource::decode called");
         memset(&cinfo, 0, sizeof(jpeg_decompress_struct));
@@ -759,6 +774,9 @@ public:
                  * jpeg_read_header(), so we do nothing here.
                  */
                 cinfo.out_color_space = JCS_RGB;
+                // let IDCT produce reduced image instead of decoding full size and throwing pixels away
+                cinfo.scale_num = 1;
+                cinfo.scale_denom = ScaleDenom( _width, _height, dx, dy );
 
                 /* Step 5: Start decompressor */
 
@@ -766,6 +784,8 @@ public:
                 /* We can ignore the return value since suspension is not possible
                  * with the stdio data source.
                  */
+                if ( (int)cinfo.output_width!=_width || (int)cinfo.output_height!=_height )
+                    callback->OnDecodeSize( this, cinfo.output_width, cinfo.output_height );
                 buffer = new lUInt8 [ cinfo.output_width * cinfo.output_components ];
                 row = new lUInt32 [ cinfo.output_width ];
                 /* Step 6: while (scan lines remain to be read) */
@@ -820,6 +840,10 @@ LVPngImageSource::LVPngImageSource( ldomNode * node, LVStreamRef stream )
 LVPngImageSource::~LVPngImageSource() {}
 void LVPngImageSource::Compact() { }
 bool LVPngImageSource::Decode( LVImageDecoderCallback * callback )
+{
+    return DecodeScaled( callback, 0, 0 );
+}
+bool LVPngImageSource::DecodeScaled( LVImageDecoderCallback * callback, int dx, int dy )
 {
     png_structp png_ptr = NULL;
     png_infop info_ptr = NULL;
@@ -905,7 +929,18 @@ bool LVPngImageSource::Decode( LVImageDecoderCallback * callback )
             color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
                 png_set_gray_to_rgb(png_ptr);
 
-        int number_passes = png_set_interlace_handling(png_ptr);
+        // integer reduction which keeps image not smaller than dx x dy
+        int factor = 1;
+        if ( dx>0 && dy>0 ) {
+            factor = (int)width / dx;
+            if ( (int)height / dy < factor )
+                factor = (int)height / dy;
+            if ( factor<1 )
+                factor = 1;
+        }
+        bool firstPassOnly = interlace_type==PNG_INTERLACE_ADAM7 && factor>=8;
+
+        int number_passes = firstPassOnly ? 1 : png_set_interlace_handling(png_ptr);
         //if (color_type == PNG_COLOR_TYPE_RGB_ALPHA ||
         //    color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
 
@@ -913,16 +948,46 @@ bool LVPngImageSource::Decode( LVImageDecoderCallback * callback )
         //    color_type == PNG_COLOR_TYPE_RGB_ALPHA)
         png_set_bgr(png_ptr);
 
-            for (int pass = 0; pass < number_passes; pass++)
-        {
-                for (lUInt32 y = 0; y < height; y++)
+        if ( firstPassOnly ) {
+            // without interlace handling libpng returns rows of the first Adam7 pass,
+            // every 8th pixel of every 8th row, the rest of the stream is never inflated
+            int pdx = (width + 7) >> 3;
+            int pdy = (height + 7) >> 3;
+            callback->OnDecodeSize( this, pdx, pdy );
+            for (int y = 0; y < pdy; y++)
             {
                 png_read_rows(png_ptr, (unsigned char **)&row, NULL, 1);
                 callback->OnLineDecoded( this, y, row );
             }
+        } else if ( factor>1 && interlace_type==PNG_INTERLACE_NONE ) {
+            // rows still have to be inflated as filters refer to previous row,
+            // but only every factor-th one is decimated and passed on
+            int sdx = (width + factor - 1) / factor;
+            int sdy = (height + factor - 1) / factor;
+            callback->OnDecodeSize( this, sdx, sdy );
+            for (lUInt32 y = 0; y < height; y++)
+            {
+                png_read_rows(png_ptr, (unsigned char **)&row, NULL, 1);
+                if ( y % factor )
+                    continue;
+                for (int x = 1; x < sdx; x++)
+                    row[x] = row[x * factor];
+                callback->OnLineDecoded( this, y / factor, row );
+            }
+        } else {
+            for (int pass = 0; pass < number_passes; pass++)
+            {
+                for (lUInt32 y = 0; y < height; y++)
+                {
+                    png_read_rows(png_ptr, (unsigned char **)&row, NULL, 1);
+                    callback->OnLineDecoded( this, y, row );
+                }
+            }
         }
 
-        png_read_end(png_ptr, info_ptr);
+        // remaining passes were not read, there is no end of image to check
+        if ( !firstPassOnly )
+            png_read_end(png_ptr, info_ptr);
 
         callback->OnEndDecode(this, false);
     }
@@ -2149,6 +2214,87 @@ public:
     }
 };
 
+/// decoded copy of image resized to fixed size, source is asked to decode close to that size
+class LVScaledImgSource : public LVImageSource, public LVImageDecoderCallback
+{
+protected:
+    lUInt32 * _image;
+    int * _xmap;
+    int _dx;
+    int _dy;
+    int _srcdx;
+    int _srcdy;
+public:
+    LVScaledImgSource( LVImageSourceRef src, int dx, int dy )
+        : _image(NULL)
+        , _xmap(NULL)
+        , _dx(dx)
+        , _dy(dy)
+        , _srcdx( src->GetWidth() )
+        , _srcdy( src->GetHeight() )
+    {
+        _image = (lUInt32*)malloc( _dx * _dy * sizeof(lUInt32) );
+        // rows decoder failed to deliver stay transparent
+        for ( int i=0; i<_dx * _dy; i++ )
+            _image[i] = 0xFF000000;
+        src->DecodeScaled( this, _dx, _dy );
+        if ( _xmap )
+            delete[] _xmap;
+        _xmap = NULL;
+    }
+    virtual void OnStartDecode( LVImageSource * )
+    {
+    }
+    virtual void OnDecodeSize( LVImageSource *, int dx, int dy )
+    {
+        _srcdx = dx;
+        _srcdy = dy;
+    }
+    virtual bool OnLineDecoded( LVImageSource *, int y, lUInt32 * data )
+    {
+        if ( y<0 || y>=_srcdy )
+            return false;
+        if ( !_xmap ) {
+            _xmap = new int[ _dx ];
+            for ( int x=0; x<_dx; x++ )
+                _xmap[x] = x * _srcdx / _dx;
+        }
+        // destination rows yy with yy * srcdy / dy == y, same sampling as scaled drawing
+        int y0 = (y * _dy + _srcdy - 1) / _srcdy;
+        int y1 = ((y + 1) * _dy + _srcdy - 1) / _srcdy;
+        if ( y1>_dy )
+            y1 = _dy;
+        for ( int yy=y0; yy<y1; yy++ ) {
+            lUInt32 * dst = _image + _dx * yy;
+            for ( int x=0; x<_dx; x++ )
+                dst[x] = data[ _xmap[x] ];
+        }
+        return true;
+    }
+    virtual void OnEndDecode( LVImageSource *, bool )
+    {
+    }
+    virtual ldomNode * GetSourceNode() { return NULL; }
+    virtual LVStream * GetSourceStream() { return NULL; }
+    virtual void   Compact() { }
+    virtual int    GetWidth() { return _dx; }
+    virtual int    GetHeight() { return _dy; }
+    virtual bool   Decode( LVImageDecoderCallback * callback )
+    {
+        callback->OnStartDecode( this );
+        for ( int y=0; y<_dy; y++ ) {
+            callback->OnLineDecoded( this, y, _image + _dx * y );
+        }
+        callback->OnEndDecode( this, false );
+        return true;
+    }
+    virtual ~LVScaledImgSource()
+    {
+        if ( _image )
+            free( _image );
+    }
+};
+
 class LVDrawBufImgSource : public LVImageSource
 {
 protected:
@@ -14,6 +14,8 @@
 #include "../include/lvtinydom.h"
 #include <time.h>
 
+// percent of rendered final blocks between render progress callbacks
+#define RENDER_PROGRESS_STEP 5
 
 int LVRendPageList::FindNearestPage( int y, int direction )
 {
@@ -42,6 +44,9 @@ int LVRendPageList::FindNearestPage( int y, int direction )
 LVRendPageContext::LVRendPageContext(LVRendPageList * pageList, int pageHeight)
     	: totalFinalBlocks(0),
     	  renderedFinalBlocks(0),
+    	  callback(NULL),
+    	  lastPercent(0),
+    	  aborted(false),
     	  page_list(pageList),
     	  page_h(pageHeight),
     	  footNotes(64),
@@ -56,7 +61,14 @@ bool LVRendPageContext::updateRenderProgress( int numFinalBlocksRendered )
         percent = 0;
     if ( percent>100 )
         percent = 100;
-    return false;
+    if ( callback && page_list && percent >= lastPercent + RENDER_PROGRESS_STEP ) {
+        lastPercent = percent;
+        int pages = 0;
+        if ( !lines.empty() && page_h > 0 )
+            pages = lines.last()->getEnd() / page_h + 1;
+        aborted = callback->OnRenderProgress( percent, pages );
+    }
+    return aborted;
 }
 
 /// append footnote link to last added line
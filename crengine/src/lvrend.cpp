@@ -11,6 +11,8 @@
 
 *******************************************************/
 
+#include <pthread.h>
+
 #include "include/lvtinydom.h"
 #include "include/fb2def.h"
 #include "include/lvrend.h"
@@ -1381,6 +1383,207 @@ void getPageBreakStyle( ldomNode * el, css_page_break_t &before, css_page_break_
     }
 }
 
+//=======================================================================
+// Parallel formatting of final blocks
+//=======================================================================
+
+#define MAX_LAYOUT_THREADS 8
+// number of final children of one block element sources are built for before formatting them
+#define LAYOUT_WINDOW_SIZE 64
+
+/// persistent worker threads running LFormattedText::Format(), the calling thread takes part too
+class LVLayoutPool {
+    pthread_mutex_t _mutex;
+    pthread_cond_t _start;
+    pthread_cond_t _done;
+    pthread_t _threads[MAX_LAYOUT_THREADS];
+    int _threadCount;
+    int _activeCount;
+    int _generation;
+    int _busy;
+    bool _stop;
+    LFormattedTextRef * _texts;
+    const lUInt16 * _widths;
+    int _count;
+    lUInt16 _pageHeight;
+    volatile int _next;
+
+    struct Worker {
+        LVLayoutPool * pool;
+        int index;
+    } _workers[MAX_LAYOUT_THREADS];
+
+    static void * workerThread( void * arg )
+    {
+        Worker * worker = (Worker*)arg;
+        worker->pool->run( worker->index );
+        return NULL;
+    }
+
+    void formatJobs()
+    {
+        for (;;) {
+            int i = __sync_fetch_and_add( &_next, 1 );
+            if ( i >= _count )
+                break;
+            _texts[i]->Format( _widths[i], _pageHeight );
+        }
+    }
+
+    void run( int index )
+    {
+        int generation = 0;
+        pthread_mutex_lock( &_mutex );
+        for (;;) {
+            while ( generation == _generation && !_stop )
+                pthread_cond_wait( &_start, &_mutex );
+            if ( _stop )
+                break;
+            generation = _generation;
+            bool active = index < _activeCount;
+            pthread_mutex_unlock( &_mutex );
+            if ( active )
+                formatJobs();
+            pthread_mutex_lock( &_mutex );
+            if ( --_busy == 0 )
+                pthread_cond_signal( &_done );
+        }
+        pthread_mutex_unlock( &_mutex );
+    }
+
+public:
+    LVLayoutPool() : _threadCount(0), _activeCount(0), _generation(0), _busy(0), _stop(false),
+        _texts(NULL), _widths(NULL), _count(0), _pageHeight(0), _next(0)
+    {
+        pthread_mutex_init( &_mutex, NULL );
+        pthread_cond_init( &_start, NULL );
+        pthread_cond_init( &_done, NULL );
+    }
+
+    ~LVLayoutPool()
+    {
+        pthread_mutex_lock( &_mutex );
+        _stop = true;
+        pthread_cond_broadcast( &_start );
+        pthread_mutex_unlock( &_mutex );
+        for ( int i=0; i<_threadCount; i++ )
+            pthread_join( _threads[i], NULL );
+        pthread_cond_destroy( &_done );
+        pthread_cond_destroy( &_start );
+        pthread_mutex_destroy( &_mutex );
+    }
+
+    /// formats texts with corresponding widths using up to threads threads, returns when all are done
+    void format( LFormattedTextRef * texts, const lUInt16 * widths, int count, int pageHeight, int threads )
+    {
+        if ( threads > MAX_LAYOUT_THREADS + 1 )
+            threads = MAX_LAYOUT_THREADS + 1;
+        while ( _threadCount < threads - 1 ) {
+            Worker & worker = _workers[_threadCount];
+            worker.pool = this;
+            worker.index = _threadCount;
+            if ( pthread_create( &_threads[_threadCount], NULL, workerThread, &worker ) != 0 ) {
+                CRLog::error("Layout thread cannot be started");
+                break;
+            }
+            _threadCount++;
+        }
+        pthread_mutex_lock( &_mutex );
+        _texts = texts;
+        _widths = widths;
+        _count = count;
+        _pageHeight = (lUInt16)pageHeight;
+        _next = 0;
+        _activeCount = threads - 1;
+        _busy = _threadCount;
+        _generation++;
+        pthread_cond_broadcast( &_start );
+        pthread_mutex_unlock( &_mutex );
+
+        formatJobs();
+
+        pthread_mutex_lock( &_mutex );
+        while ( _busy > 0 )
+            pthread_cond_wait( &_done, &_mutex );
+        pthread_mutex_unlock( &_mutex );
+    }
+};
+
+static LVLayoutPool _layoutPool;
+
+/// Final children of a block element, formatted ahead of renderBlockElement() calls.
+/// Text sources are built here on the calling thread since they read the DOM,
+/// only line breaking runs on the pool; results are handed over through the rendered
+/// block cache right before the child is rendered, so page splitting stays sequential.
+class LVLayoutWindow {
+    int _threads;
+    int _end;
+    int _count;
+    int _taken;
+    ldomNode * _nodes[LAYOUT_WINDOW_SIZE];
+    LFormattedTextRef _texts[LAYOUT_WINDOW_SIZE];
+    lUInt16 _widths[LAYOUT_WINDOW_SIZE];
+public:
+    LVLayoutWindow( int threads ) : _threads(threads), _end(0), _count(0), _taken(0) { }
+
+    /// returns index of the first child not covered by the window
+    int end() { return _end; }
+
+    /// builds and formats children starting from index start, width is the one passed to renderBlockElement()
+    void prepare( ldomNode * parent, int start, int width )
+    {
+        _count = 0;
+        _taken = 0;
+        _end = parent->getChildCount();
+        if ( _threads <= 1 )
+            return;
+        CrDom * dom = parent->getCrDom();
+        int i;
+        for ( i=start; i<_end && _count<LAYOUT_WINDOW_SIZE; i++ ) {
+            ldomNode * child = parent->getChildNode( i );
+            if ( !child->isElement() )
+                continue;
+            int rm = child->getRendMethod();
+            if ( rm != erm_final && rm != erm_list_item )
+                continue;
+            // same box as renderBlockElement() gives to the child
+            int em = child->getFont()->getSize();
+            css_style_rec_t * style = child->getStyle().get();
+            int margin_left = lengthToPx( style->margin[0], width, em ) + DEBUG_TREE_DRAW;
+            int margin_right = lengthToPx( style->margin[1], width, em ) + DEBUG_TREE_DRAW;
+            int padding_left = lengthToPx( style->padding[0], width, em ) + DEBUG_TREE_DRAW;
+            int padding_right = lengthToPx( style->padding[1], width, em ) + DEBUG_TREE_DRAW;
+            int w = width - margin_left - margin_right;
+            RenderRectAccessor fmt( child );
+            fmt.setWidth( w );
+            fmt.push();
+            LFormattedTextRef txform( dom->createFormattedText() );
+            int flags = styleToTextFmtFlags( child->getStyle(), 0 );
+            ::renderFinalBlock( child, txform.get(), &fmt, flags, 0, 16 );
+            _nodes[_count] = child;
+            _texts[_count] = txform;
+            _widths[_count] = (lUInt16)(w - padding_left - padding_right);
+            _count++;
+        }
+        _end = i;
+        if ( _count > 1 )
+            _layoutPool.format( _texts, _widths, _count, dom->getPageHeight(), _threads );
+        else if ( _count == 1 )
+            _texts[0]->Format( _widths[0], (lUInt16)dom->getPageHeight() );
+    }
+
+    /// passes formatted text of the child, if prepared, to ldomNode::renderFinalBlock()
+    void take( ldomNode * child )
+    {
+        if ( _taken >= _count || _nodes[_taken] != child )
+            return;
+        LFormattedTextRef txform = _texts[_taken];
+        child->getCrDom()->getRendBlockCache().set( child, txform, txform->GetMemorySize() );
+        _texts[_taken].Clear();
+        _taken++;
+    }
+};
+
 int renderBlockElement( LVRendPageContext & context, ldomNode * enode, int x, int y, int width )
 {
     if ( enode->isElement() )
@@ -1468,9 +1671,13 @@ int renderBlockElement( LVRendPageContext & context, ldomNode * enode, int x, in
                     // recurse all sub-blocks for blocks
                     int y = padding_top;
                     int cnt = enode->getChildCount();
-                    for (int i=0; i<cnt; i++)
+                    LVLayoutWindow window( enode->getCrDom()->getLayoutThreads() );
+                    for (int i=0; i<cnt && !context.isAborted(); i++)
                     {
                         ldomNode * child = enode->getChildNode( i );
+                        if ( i == window.end() )
+                            window.prepare( enode, i, width - padding_left - padding_right );
+                        window.take( child );
                         //fmt.push();
                         int h = renderBlockElement( context, child, padding_left, y,
                             width - padding_left - padding_right );
@@ -1784,6 +1991,18 @@ inline void spreadParent(css_length_t& val, css_length_t& parent_val, bool inher
 void setNodeStyleRend(ldomNode* enode, css_style_ref_t parent_style, LVFontRef parent_font)
 {
     //lvdomElementFormatRec * fmt = node->getRenderData();
+    LVStyleSheet* sheet = enode->getCrDom()->getStylesheet();
+    // Sibling with the same name, class and id already got the style this node would compute
+    bool shareable = !(enode->getCrDom()->getDocFlag(DOC_FLAG_EMBEDDED_STYLES)
+            && enode->hasAttribute(LXML_NS_ANY, attr_style));
+    if (shareable) {
+        css_style_ref_t shared = sheet->getSharedStyle(enode, parent_style);
+        if (!shared.isNull()) {
+            enode->setStyle(shared);
+            enode->initNodeFont();
+            return;
+        }
+    }
     css_style_ref_t style(new css_style_rec_t);
     css_style_rec_t* pstyle = style.get();
 #ifdef AXYDEBUG
@@ -1799,7 +2018,7 @@ void setNodeStyleRend(ldomNode* enode, css_style_ref_t parent_style, LVFontRef p
     }
     int baseFontSize = enode->getCrDom()->getDefaultFont()->getSize();
     // Apply style sheet
-    enode->getCrDom()->getStylesheet()->applyCss(enode, pstyle);
+    sheet->applyCss(enode, pstyle);
     if (enode->getCrDom()->getDocFlag(DOC_FLAG_EMBEDDED_STYLES)
             && enode->hasAttribute(LXML_NS_ANY, attr_style)) {
         lString16 nodeStyle = enode->getAttributeValue(LXML_NS_ANY, attr_style);
@@ -1943,6 +2162,9 @@ void setNodeStyleRend(ldomNode* enode, css_style_ref_t parent_style, LVFontRef p
         CRLog::error("NULL style set!!!");
         enode->setStyle(style);
     }
+    if (shareable) {
+        sheet->setSharedStyle(enode, parent_style, style);
+    }
     // set font
     enode->initNodeFont();
 }
@@ -26,6 +26,7 @@
 
 #include "include/lvstream.h"
 #include "include/crtxtenc.h"
+#include "include/lvhashtable.h"
 
 //#define USE_UNRAR 1
 #include <zlib.h>
@@ -69,6 +70,8 @@ extern "C" {
 // document stream buffer size
 // 0x40000 (_WIN32, LBOOK), 0x20000 (LINUX)
 #define FILE_STREAM_BUFFER_SIZE 0x40000
+// deflated ZIP entries up to this size are inflated in one call when opened
+#define ZIP_INFLATE_WHOLE_MAX_SIZE 0x1000000
 
 static LVAssetContainerFactory * _assetContainerFactory = NULL;
 
@@ -2467,28 +2470,298 @@ public:
     }
 };
 
+/// ZIP entry fully available in memory: slice of mapped archive or whole inflated data
+class LVZipEntryStream : public LVNamedStream
+{
+private:
+    LVStreamBufferRef m_mapped;
+    const lUInt8 * m_data;
+    lUInt8 * m_own;
+    lvsize_t m_size;
+    lvpos_t m_pos;
+    lUInt32 m_crc;
+public:
+    /// zero copy slice, mapping is kept alive by buffer reference
+    LVZipEntryStream( LVStreamBufferRef mapped, const lUInt8 * data, lvsize_t size, lUInt32 crc )
+        : m_mapped(mapped), m_data(data), m_own(NULL), m_size(size), m_pos(0), m_crc(crc)
+    {
+    }
+    /// takes ownership of malloc'ed buffer
+    LVZipEntryStream( lUInt8 * own, lvsize_t size, lUInt32 crc )
+        : m_data(own), m_own(own), m_size(size), m_pos(0), m_crc(crc)
+    {
+    }
+    virtual ~LVZipEntryStream()
+    {
+        if ( m_own )
+            free( m_own );
+    }
+    virtual lvopen_mode_t GetMode()
+    {
+        return LVOM_READ;
+    }
+    virtual lverror_t getcrc32( lUInt32 & dst )
+    {
+        dst = m_crc;
+        return LVERR_OK;
+    }
+    virtual bool Eof()
+    {
+        return m_pos >= m_size;
+    }
+    virtual lvsize_t GetSize()
+    {
+        return m_size;
+    }
+    virtual lverror_t Seek( lvoffset_t offset, lvseek_origin_t origin, lvpos_t * newPos )
+    {
+        lvpos_t npos = m_pos;
+        switch ( origin ) {
+        case LVSEEK_SET:
+            npos = offset;
+            break;
+        case LVSEEK_CUR:
+            npos += offset;
+            break;
+        case LVSEEK_END:
+            npos = m_size + offset;
+            break;
+        }
+        if ( npos > m_size )
+            return LVERR_FAIL;
+        m_pos = npos;
+        if ( newPos )
+            *newPos = m_pos;
+        return LVERR_OK;
+    }
+    virtual lverror_t Read( void * buf, lvsize_t count, lvsize_t * bytesRead )
+    {
+        lvsize_t n = m_size - m_pos;
+        if ( n > count )
+            n = count;
+        if ( n > 0 )
+            memcpy( buf, m_data + m_pos, n );
+        m_pos += n;
+        if ( bytesRead )
+            *bytesRead = n;
+        return LVERR_OK;
+    }
+    virtual lverror_t Write( const void *, lvsize_t, lvsize_t * )
+    {
+        return LVERR_NOTIMPL;
+    }
+    virtual lverror_t SetSize( lvsize_t )
+    {
+        return LVERR_NOTIMPL;
+    }
+};
+
+static inline lUInt16 zipGet16( const lUInt8 * p )
+{
+    return (lUInt16)( p[0] | (p[1] << 8) );
+}
+
+static inline lUInt32 zipGet32( const lUInt8 * p )
+{
+    return (lUInt32)p[0] | ((lUInt32)p[1] << 8) | ((lUInt32)p[2] << 16) | ((lUInt32)p[3] << 24);
+}
+
 class LVZipArc : public LVArcContainerBase
 {
+    /// whole archive file when it could be mapped to memory
+    LVStreamBufferRef m_mapped;
+    const lUInt8 * m_map;
+    lvsize_t m_mapSize;
+    /// entry name -> index in m_list
+    LVHashTable<lString16, int> m_index;
+    LVArray<lUInt32> m_crc;
+
+    /// replaces source file stream with memory mapped one
+    void mapArchive()
+    {
+#if defined(_LINUX) || defined(_WIN32)
+        const lChar16 * name = m_stream->GetName();
+        if ( !name || name[0]!='/' )
+            return;
+        lvsize_t size = m_stream->GetSize();
+        if ( size==0 || size==(lvsize_t)-1 )
+            return;
+        LVStreamRef mapped = LVMapFileStream( name, LVOM_READ, 0 );
+        if ( mapped.isNull() || mapped->GetSize()!=size )
+            return;
+        LVStreamBufferRef buf = mapped->GetReadBuffer( 0, size );
+        if ( buf.isNull() || !buf->getReadOnly() )
+            return;
+        m_mapped = buf;
+        m_map = buf->getReadOnly();
+        m_mapSize = size;
+        m_stream = mapped;
+#endif
+    }
+
+    /// reads entries from central directory in one pass, returns -1 if it's unusable
+    int readCentralDirectory( lUInt32 cdOffset, lUInt32 cdSize )
+    {
+        if ( cdSize==0 || (lvsize_t)cdOffset + cdSize > m_stream->GetSize() )
+            return -1;
+        const lUInt8 * cd;
+        LVArray<lUInt8> buf;
+        if ( m_map ) {
+            cd = m_map + cdOffset;
+        } else {
+            buf.addSpace( cdSize );
+            lvsize_t bytesRead = 0;
+            if ( m_stream->Seek( cdOffset, LVSEEK_SET, NULL )!=LVERR_OK
+                    || m_stream->Read( buf.get(), cdSize, &bytesRead )!=LVERR_OK || bytesRead!=cdSize )
+                return -1;
+            cd = buf.get();
+        }
+        const lChar16 * cp866 = GetCharsetByte2UnicodeTable( L"cp866" );
+        const lChar16 * cp1251 = GetCharsetByte2UnicodeTable( L"cp1251" );
+        lUInt32 pos = 0;
+        while ( pos + 0x2E <= cdSize && zipGet32( cd + pos )==0x02014b50 ) {
+            const lUInt8 * hdr = cd + pos;
+            lUInt16 nameLen = zipGet16( hdr + 0x1C );
+            lUInt32 recSize = 0x2E + nameLen + zipGet16( hdr + 0x1E ) + zipGet16( hdr + 0x20 );
+            if ( pos + recSize > cdSize )
+                return -1;
+            lString8 name8( (const char *)hdr + 0x2E, nameLen );
+            lString16 fName = ByteToUnicode( name8, hdr[5]==0 ? cp866 : cp1251 );
+            LVCommonContainerItemInfo * item = new LVCommonContainerItemInfo();
+            item->SetItemInfo( fName.c_str(), zipGet32( hdr + 0x18 ), (zipGet32( hdr + 0x26 ) & 0x3f) );
+            item->SetSrc( zipGet32( hdr + 0x2A ), zipGet32( hdr + 0x14 ), zipGet16( hdr + 0x0A ) );
+            m_list.add( item );
+            m_crc.add( zipGet32( hdr + 0x10 ) );
+            pos += recSize;
+        }
+        return m_list.length();
+    }
+
+    void buildIndex()
+    {
+        m_index.clear();
+        for ( int i=0; i<m_list.length(); i++ ) {
+            const lChar16 * name = m_list[i]->GetName();
+            if ( !name )
+                continue;
+            int existing;
+            lString16 key( name );
+            // duplicate names: the first one wins, as with linear search
+            if ( !m_index.get( key, existing ) )
+                m_index.set( key, i );
+        }
+    }
+
+    /// returns data offset of entry, reading its local header
+    bool getDataPos( LVCommonContainerItemInfo * item, lvpos_t & pos )
+    {
+        lvpos_t hdrPos = item->GetSrcPos();
+        lUInt8 hdr[0x1E];
+        if ( m_map ) {
+            if ( hdrPos + 0x1E > m_mapSize )
+                return false;
+            memcpy( hdr, m_map + hdrPos, 0x1E );
+        } else {
+            lvsize_t bytesRead = 0;
+            if ( m_stream->Seek( hdrPos, LVSEEK_SET, NULL )!=LVERR_OK
+                    || m_stream->Read( hdr, 0x1E, &bytesRead )!=LVERR_OK || bytesRead!=0x1E )
+                return false;
+        }
+        if ( zipGet32( hdr )!=0x04034b50 )
+            return false;
+        pos = hdrPos + 0x1E + zipGet16( hdr + 0x1A ) + zipGet16( hdr + 0x1C );
+        return pos + item->GetSrcSize() <= m_stream->GetSize();
+    }
+
+    /// opens stored entry as slice of mapping, or inflates small deflated entry in one call
+    LVStreamRef openWhole( LVCommonContainerItemInfo * item, lUInt32 crc )
+    {
+        LVStreamRef res;
+        lUInt32 method = item->GetSrcFlags();
+        lvsize_t packSize = item->GetSrcSize();
+        lvsize_t unpSize = item->GetSize();
+        if ( method==0 && !m_map )
+            return res;
+        if ( method==8 && (unpSize==0 || unpSize > ZIP_INFLATE_WHOLE_MAX_SIZE) )
+            return res;
+        if ( method!=0 && method!=8 )
+            return res;
+        lvpos_t pos;
+        if ( !getDataPos( item, pos ) )
+            return res;
+        if ( method==0 ) {
+            if ( packSize!=unpSize )
+                return res;
+            return LVStreamRef( new LVZipEntryStream( m_mapped, m_map + pos, unpSize, crc ) );
+        }
+        LVArray<lUInt8> packed;
+        const lUInt8 * src;
+        if ( m_map ) {
+            src = m_map + pos;
+        } else {
+            packed.addSpace( packSize );
+            lvsize_t bytesRead = 0;
+            if ( m_stream->Seek( pos, LVSEEK_SET, NULL )!=LVERR_OK
+                    || m_stream->Read( packed.get(), packSize, &bytesRead )!=LVERR_OK || bytesRead!=packSize )
+                return res;
+            src = packed.get();
+        }
+        lUInt8 * dst = (lUInt8 *)malloc( unpSize );
+        if ( !dst )
+            return res;
+        z_stream zs;
+        memset( &zs, 0, sizeof(zs) );
+        if ( inflateInit2( &zs, -15 )!=Z_OK ) {
+            free( dst );
+            return res;
+        }
+        zs.next_in = (Bytef *)src;
+        zs.avail_in = (uInt)packSize;
+        zs.next_out = dst;
+        zs.avail_out = (uInt)unpSize;
+        int zres = inflate( &zs, Z_FINISH );
+        bool ok = (zres==Z_STREAM_END || zres==Z_BUF_ERROR || zres==Z_OK) && zs.total_out==unpSize;
+        inflateEnd( &zs );
+        if ( !ok ) {
+            // let streaming decoder deal with it
+            free( dst );
+            return res;
+        }
+        if ( (lUInt32)crc32( 0L, dst, (uInt)unpSize )!=crc )
+            CRLog::error("ZIP stream '%s': CRC doesn't match", LCSTR(lString16(item->GetName())));
+        return LVStreamRef( new LVZipEntryStream( dst, unpSize, crc ) );
+    }
+
 public:
+    virtual const LVContainerItemInfo * GetObjectInfo(int index)
+    {
+        return LVArcContainerBase::GetObjectInfo( index );
+    }
+    virtual const LVContainerItemInfo * GetObjectInfo(lString16 name)
+    {
+        int index;
+        if ( m_index.get( name, index ) )
+            return m_list[index];
+        return NULL;
+    }
     virtual LVStreamRef OpenStream( const wchar_t * fname, lvopen_mode_t /*mode*/ )
     {
         if ( fname[0]=='/' )
             fname++;
         int found_index = -1;
-        for (int i=0; i<m_list.length(); i++) {
-            if ( !lStr_cmp( fname, m_list[i]->GetName() ) ) {
-                if ( m_list[i]->IsContainer() ) {
-                    // found directory with same name!!!
-                    return LVStreamRef();
-                }
-                found_index = i;
-                break;
-            }
-        }
-        if (found_index<0)
+        if ( !m_index.get( lString16( fname ), found_index ) )
             return LVStreamRef(); // not found
+        if ( m_list[found_index]->IsContainer() ) {
+            // found directory with same name!!!
+            return LVStreamRef();
+        }
         // make filename
         lString16 fn = fname;
+        LVStreamRef whole = openWhole( m_list[found_index], m_crc[found_index] );
+        if ( !whole.isNull() ) {
+            whole->SetName( m_list[found_index]->GetName() );
+            return whole;
+        }
         LVStreamRef strm = m_stream; // fix strange arm-linux-g++ bug
         LVStreamRef stream(
 		LVZipDecodeStream::Create(
@@ -2507,9 +2780,10 @@ public:
         }
         return stream;
     }
-    LVZipArc( LVStreamRef stream ) : LVArcContainerBase(stream)
+    LVZipArc( LVStreamRef stream ) : LVArcContainerBase(stream), m_map(NULL), m_mapSize(0), m_index(256)
     {
         SetName(stream->GetName());
+        mapArchive();
     }
     virtual ~LVZipArc()
     {
@@ -2521,6 +2795,8 @@ public:
         bool truncated = false;
 
         m_list.clear();
+        m_crc.clear();
+        m_index.clear();
         if (!m_stream || m_stream->Seek(0, LVSEEK_SET, NULL)!=LVERR_OK)
             return 0;
 
@@ -2534,6 +2810,7 @@ public:
 
         char ReadBuf[1024];
         lUInt32 NextPosition;
+        lUInt32 CentralDirSize = 0;
         lvpos_t CurPos;
         lvsize_t ReadSize;
         int Buf;
@@ -2555,8 +2832,10 @@ public:
                 if (ReadBuf[I]==0x50 && ReadBuf[I+1]==0x4b && ReadBuf[I+2]==0x05 &&
                     ReadBuf[I+3]==0x06)
                 {
-                    m_stream->Seek( CurPos+I+16, LVSEEK_SET, NULL );
+                    m_stream->Seek( CurPos+I+12, LVSEEK_SET, NULL );
+                    m_stream->Read( &CentralDirSize, sizeof(CentralDirSize), &ReadSize);
                     m_stream->Read( &NextPosition, sizeof(NextPosition), &ReadSize);
+                    cnv.lsf( &CentralDirSize );
 		    		cnv.lsf( &NextPosition );
                     found=true;
                     break;
@@ -2574,6 +2853,17 @@ public:
         if (truncated)
             NextPosition=0;
 
+        if (!truncated) {
+            // whole central directory at once, walking headers one by one is the fallback
+            int count = readCentralDirectory( NextPosition, CentralDirSize );
+            if ( count > 0 ) {
+                buildIndex();
+                return count;
+            }
+            m_list.clear();
+            m_crc.clear();
+        }
+
         //================================================================
         // get files
 
@@ -2598,9 +2888,9 @@ public:
                 if (ReadSize != ZipHd1_size) {
                         //fclose(f);
                     if (ReadSize==0 && NextPosition==m_FileSize)
-                        return m_list.length();
+                        break;
                     if ( ReadSize==0 )
-                        return m_list.length();
+                        break;
                     return 0;
                 }
 
@@ -2615,6 +2905,7 @@ public:
                 ZipHeader.NameLen=ZipHd1.getNameLen();
                 ZipHeader.AddLen=ZipHd1.getAddLen();
                 ZipHeader.Method=ZipHd1.getMethod();
+                ZipHeader.CRC=ZipHd1.getCRC();
             } else {
 
                 m_stream->Read( &ZipHeader, ZipHeader_size, &ReadSize);
@@ -2685,7 +2976,9 @@ public:
 #endif
 
             m_list.add(item);
+            m_crc.add(ZipHeader.CRC);
         }
+        buildIndex();
         int sz2 = m_list.length();
         return sz2;
     }
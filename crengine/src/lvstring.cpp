@@ -1365,7 +1365,8 @@ bool lString16HashedCollection::deserialize( SerialBuf & buf )
         return false;
     clear();
     int start = buf.pos();
-    buf.putMagic( str_hash_magic );
+    if ( !buf.checkMagic( str_hash_magic ) )
+        return false;
     lInt32 count = 0;
     buf >> count;
     for ( int i=0; i<count; i++ ) {
@@ -4281,6 +4282,27 @@ SerialBuf & SerialBuf::operator << ( const SerialBuf & v )
 	return *this;
 }
 
+void SerialBuf::putBytes( const lUInt8 * data, int size )
+{
+    if ( size<=0 || check(size) )
+        return;
+    memcpy( _buf + _pos, data, size );
+    _pos += size;
+}
+
+bool SerialBuf::getBytes( lUInt8 * data, int size )
+{
+    if ( _error )
+        return false;
+    if ( size<0 || space()<size ) {
+        seterror();
+        return false;
+    }
+    memcpy( data, _buf + _pos, size );
+    _pos += size;
+    return true;
+}
+
 SerialBuf & SerialBuf::operator << ( lUInt8 n )
 {
 	if ( check(1) )
@@ -628,6 +628,201 @@ bool LVCssSelector::check(const ldomNode* node) const
     return true;
 }
 
+/// bloom filter bit of element id or class hash
+static inline lUInt64 cssFilterBit(lUInt32 hash)
+{
+    return (lUInt64) 1 << ((hash * 2654435761U) >> 26);
+}
+
+static lUInt64 cssNodeFilterBits(const ldomNode* node)
+{
+    lUInt64 bits = cssFilterBit(node->getNodeId());
+    const lString16& cls = node->getAttributeValue(attr_class);
+    if (!cls.empty()) {
+        lString16 val = cls;
+        val.lowercase();
+        bits |= cssFilterBit(getHash(val));
+    }
+    return bits;
+}
+
+int LVStyleSheet::addToBucket(int bucket, LVCssIndexItem& item)
+{
+    if (bucket < 0) {
+        bucket = _buckets.length();
+        _buckets.add(new LVArray<LVCssIndexItem>());
+    }
+    // Chains are walked one after another, keep bucket sorted by cascade order
+    LVArray<LVCssIndexItem>* list = _buckets[bucket];
+    int pos = list->length();
+    while (pos > 0 && (*list)[pos - 1].order > item.order) {
+        pos--;
+    }
+    list->insert(pos, item);
+    return bucket;
+}
+
+void LVStyleSheet::updateIndex()
+{
+    _buckets.clear();
+    _elementBuckets.clear();
+    _classBuckets.clear();
+    _idBuckets.clear();
+    _siblingSensitive.clear();
+    for (int i = 0; i < _selectors.length(); i++) {
+        _elementBuckets.add(-1);
+        _siblingSensitive.add(0);
+    }
+    for (int id = 0; id < _selectors.length(); id++) {
+        int pos = 0;
+        for (LVCssSelector* sel = _selectors[id]; sel; sel = sel->getNext(), pos++) {
+            // Same order as merge of universal and element chains: on equal specificity element chain goes first
+            LVCssIndexItem item;
+            item.order = ((lUInt64) sel->getSpecificity() << 32) | ((lUInt64) (id == 0 ? 1 : 0) << 31) | (lUInt64) pos;
+            item.selector = sel;
+            // Rules go right to left, the ones before first combinator belong to the subject
+            bool subject = true;
+            LVCssSelectorRule* idRule = NULL;
+            LVCssSelectorRule* classRule = NULL;
+            for (LVCssSelectorRule* rule = sel->getRules(); rule; rule = rule->getNext()) {
+                switch (rule->getType()) {
+                case cssrt_parent:
+                case cssrt_ancessor:
+                    if (rule->getId() != 0) {
+                        item.ancestors |= cssFilterBit(rule->getId());
+                    }
+                    subject = false;
+                    break;
+                case cssrt_parent_class:
+                    item.ancestors |= cssFilterBit(::getHash(rule->getValue()));
+                    subject = false;
+                    break;
+                case cssrt_predecessor:
+                    _siblingSensitive[id] = 1;
+                    subject = false;
+                    break;
+                case cssrt_id:
+                    if (subject && !idRule) {
+                        idRule = rule;
+                    }
+                    break;
+                case cssrt_class:
+                    if (subject && !classRule) {
+                        classRule = rule;
+                    }
+                    break;
+                case cssrt_attrset:
+                case cssrt_attreq:
+                case cssrt_attrhas:
+                case cssrt_attrstarts:
+                    if (subject && rule->getAttrId() != attr_class && rule->getAttrId() != attr_id) {
+                        _siblingSensitive[id] = 1;
+                    }
+                    break;
+                default:
+                    break;
+                }
+            }
+            if (idRule) {
+                int bucket = -1;
+                _idBuckets.get(idRule->getValue(), bucket);
+                _idBuckets.set(idRule->getValue(), addToBucket(bucket, item));
+            } else if (classRule) {
+                int bucket = -1;
+                _classBuckets.get(classRule->getValue(), bucket);
+                _classBuckets.set(classRule->getValue(), addToBucket(bucket, item));
+            } else {
+                _elementBuckets[id] = addToBucket(_elementBuckets[id], item);
+            }
+        }
+    }
+    _indexGeneration = _generation;
+}
+
+LVCssAncestor* LVStyleSheet::getParentEntry(const ldomNode* node)
+{
+    if (_ancestorDepth == 0) {
+        return NULL;
+    }
+    ldomNode* parent = node->getParentNode();
+    if (parent->isNull()) {
+        return NULL;
+    }
+    LVCssAncestor* entry = &_ancestors[_ancestorDepth - 1];
+    return entry->dataIndex == (lUInt32) parent->getDataIndex() ? entry : NULL;
+}
+
+void LVStyleSheet::pushAncestor(const ldomNode* node)
+{
+    LVCssAncestor* parent = getParentEntry(node);
+    lUInt64 filter = 0;
+    if (parent) {
+        filter = parent->filter | cssNodeFilterBits(node);
+    } else {
+        for (const ldomNode* n = node; !n->isNull(); n = n->getParentNode()) {
+            filter |= cssNodeFilterBits(n);
+        }
+    }
+    if (_ancestorDepth == _ancestors.length()) {
+        _ancestors.add(LVCssAncestor());
+    }
+    LVCssAncestor& entry = _ancestors[_ancestorDepth++];
+    entry.dataIndex = node->getDataIndex();
+    entry.filter = filter;
+    entry.childGeneration = -1;
+}
+
+void LVStyleSheet::popAncestor()
+{
+    if (_ancestorDepth == 0) {
+        return;
+    }
+    LVCssAncestor& entry = _ancestors[--_ancestorDepth];
+    entry.childStyle.Clear();
+    entry.childParentStyle.Clear();
+    entry.childGeneration = -1;
+}
+
+css_style_ref_t LVStyleSheet::getSharedStyle(const ldomNode* node, css_style_ref_t& parent_style)
+{
+    css_style_ref_t res;
+    LVCssAncestor* parent = getParentEntry(node);
+    if (!parent
+            || parent->childGeneration != _generation
+            || parent->childId != node->getNodeId()
+            || parent->childParentStyle.get() != parent_style.get()) {
+        return res;
+    }
+    if (parent->childClass != node->getAttributeValue(attr_class)
+            || parent->childIdAttr != node->getAttributeValue(attr_id)) {
+        return res;
+    }
+    res = parent->childStyle;
+    return res;
+}
+
+void LVStyleSheet::setSharedStyle(const ldomNode* node, css_style_ref_t& parent_style, css_style_ref_t& style)
+{
+    LVCssAncestor* parent = getParentEntry(node);
+    if (!parent) {
+        return;
+    }
+    if (_indexGeneration != _generation) {
+        updateIndex();
+    }
+    lUInt16 id = node->getNodeId();
+    if ((_siblingSensitive.length() > 0 && _siblingSensitive[0])
+            || (id < _siblingSensitive.length() && _siblingSensitive[id])) {
+        return;
+    }
+    parent->childId = id;
+    parent->childClass = node->getAttributeValue(attr_class);
+    parent->childIdAttr = node->getAttributeValue(attr_id);
+    parent->childStyle = style;
+    parent->childParentStyle = parent_style;
+    parent->childGeneration = _generation;
+}
+
 void LVStyleSheet::applyCss(const ldomNode* node, css_style_rec_t* style)
 {
     if (!_selectors.length()) {
@@ -636,46 +831,66 @@ void LVStyleSheet::applyCss(const ldomNode* node, css_style_rec_t* style)
 #endif
         return;
     }
-    bool applied = false;
+    if (_indexGeneration != _generation) {
+        updateIndex();
+    }
     lUInt16 id = node->getNodeId();
-    LVCssSelector* selector = _selectors[0];
-    LVCssSelector* selector_id = id > 0 && id < _selectors.length() ? _selectors[id] : NULL;
 #ifdef DEBUG_CSS
     if (id == 0) {
         CRLog::info("LVStyleSheet::applyCss[%s]: node id==0", LCSTR(GetNodeDesc(node)));
-    } else if (!selector_id) {
-        CRLog::trace("LVStyleSheet::applyCss[%s]: !selector_id", LCSTR(GetNodeDesc(node)));
     } else {
         CRLog::trace("LVStyleSheet::applyCss[%s]", LCSTR(GetNodeDesc(node)));
     }
 #endif
+    // Candidates: universal and element selectors, selectors of node class and of node id
+    LVArray<LVCssIndexItem>* lists[4];
+    int count = 0;
+    if (_elementBuckets[0] >= 0) {
+        lists[count++] = _buckets[_elementBuckets[0]];
+    }
+    if (id > 0 && id < _elementBuckets.length() && _elementBuckets[id] >= 0) {
+        lists[count++] = _buckets[_elementBuckets[id]];
+    }
+    int bucket;
+    if (_classBuckets.length()) {
+        const lString16& cls = node->getAttributeValue(attr_class);
+        if (!cls.empty()) {
+            lString16 val = cls;
+            val.lowercase();
+            if (_classBuckets.get(val, bucket)) {
+                lists[count++] = _buckets[bucket];
+            }
+        }
+    }
+    if (_idBuckets.length()) {
+        const lString16& val = node->getAttributeValue(attr_id);
+        if (!val.empty() && _idBuckets.get(val, bucket)) {
+            lists[count++] = _buckets[bucket];
+        }
+    }
+    // Ancestors known from the recursive style update reject descendant rules early
+    LVCssAncestor* parent = getParentEntry(node);
+    lUInt64 filter = parent ? parent->filter : 0;
+    int pos[4] = { 0, 0, 0, 0 };
     for (;;) {
-        LVCssSelector* sel = NULL;
-        if (selector != NULL) {
-            if (selector_id == NULL || selector->getSpecificity() < selector_id->getSpecificity()) {
-                sel = selector;
-                selector = selector->getNext();
-            } else {
-                sel = selector_id;
-                selector_id = selector_id->getNext();
+        int best = -1;
+        for (int i = 0; i < count; i++) {
+            if (pos[i] < lists[i]->length()
+                    && (best < 0 || (*lists[i])[pos[i]].order < (*lists[best])[pos[best]].order)) {
+                best = i;
             }
-        } else if (selector_id != NULL) {
-            sel = selector_id;
-            selector_id = selector_id->getNext();
         }
-        if (!sel) {
+        if (best < 0) {
             break;
         }
-        if (sel->check(node)) {
-            sel->applyCss(node, style);
-            applied = true;
+        LVCssIndexItem& item = (*lists[best])[pos[best]++];
+        if (parent && (item.ancestors & filter) != item.ancestors) {
+            continue;
+        }
+        if (item.selector->check(node)) {
+            item.selector->applyCss(node, style);
         }
     }
-#ifdef DEBUG_CSS
-    if (!applied) {
-        //CRLog::debug("    selectors miss");
-    }
-#endif
 }
 
 inline bool css_is_alpha(char ch)
@@ -1506,6 +1721,7 @@ bool LVStyleSheet::parse(const char* str)
             }
         }
     }
+    _generation++;
 #if 0
     for (int i = 0; i < _selectors.length(); i++) {
         if (_selectors[i]) {
@@ -1633,6 +1849,7 @@ LVCssSelector::LVCssSelector(LVCssSelector& v)
 void LVStyleSheet::set(LVPtrVector<LVCssSelector>& v)
 {
     _selectors.clear();
+    _generation++;
     if (!v.size()) {
         return;
     }
@@ -1647,7 +1864,13 @@ void LVStyleSheet::set(LVPtrVector<LVCssSelector>& v)
     }
 }
 
-LVStyleSheet::LVStyleSheet(LVStyleSheet& sheet) : _doc(sheet._doc)
+LVStyleSheet::LVStyleSheet(LVStyleSheet& sheet)
+        : _doc(sheet._doc),
+          _generation(0),
+          _indexGeneration(-1),
+          _classBuckets(32),
+          _idBuckets(32),
+          _ancestorDepth(0)
 {
     set(sheet._selectors);
 }
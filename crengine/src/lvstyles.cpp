@@ -106,6 +106,87 @@ bool operator == (const css_style_rec_t& r1, const css_style_rec_t& r2)
            r1.font_family == r2.font_family;
 }
 
+static const char * style_magic = "STYLE";
+
+#define ST_PUT_ENUM(v) buf << (lUInt8)v
+#define ST_GET_ENUM(t,v) { lUInt8 tmp = 0; buf >> tmp; v = (t)tmp; }
+#define ST_PUT_LEN(v) buf << (lUInt8)v.type << (lInt32)v.value
+#define ST_GET_LEN(v) { lUInt8 t = 0; lInt32 val = 0; buf >> t >> val; v.type = (css_value_type_t)t; v.value = val; }
+
+bool css_style_rec_tag::serialize( SerialBuf & buf )
+{
+    if ( buf.error() )
+        return false;
+    buf.putMagic( style_magic );
+    ST_PUT_ENUM(display);
+    ST_PUT_ENUM(white_space);
+    ST_PUT_ENUM(text_align);
+    ST_PUT_ENUM(text_align_last);
+    ST_PUT_ENUM(text_decoration);
+    ST_PUT_ENUM(vertical_align);
+    ST_PUT_ENUM(font_family);
+    buf << font_name;
+    ST_PUT_LEN(font_size);
+    ST_PUT_ENUM(font_style);
+    ST_PUT_ENUM(font_weight);
+    ST_PUT_LEN(text_indent);
+    ST_PUT_LEN(line_height);
+    ST_PUT_LEN(width);
+    ST_PUT_LEN(height);
+    for ( int i=0; i<4; i++ )
+        ST_PUT_LEN(margin[i]);
+    for ( int i=0; i<4; i++ )
+        ST_PUT_LEN(padding[i]);
+    ST_PUT_LEN(color);
+    ST_PUT_LEN(background_color);
+    ST_PUT_LEN(letter_spacing);
+    ST_PUT_ENUM(page_break_before);
+    ST_PUT_ENUM(page_break_after);
+    ST_PUT_ENUM(page_break_inside);
+    ST_PUT_ENUM(hyphenate);
+    ST_PUT_ENUM(list_style_type);
+    ST_PUT_ENUM(list_style_position);
+    return !buf.error();
+}
+
+bool css_style_rec_tag::deserialize( SerialBuf & buf )
+{
+    if ( buf.error() )
+        return false;
+    if ( !buf.checkMagic( style_magic ) )
+        return false;
+    ST_GET_ENUM(css_display_t, display);
+    ST_GET_ENUM(css_white_space_t, white_space);
+    ST_GET_ENUM(css_text_align_t, text_align);
+    ST_GET_ENUM(css_text_align_t, text_align_last);
+    ST_GET_ENUM(css_text_decoration_t, text_decoration);
+    ST_GET_ENUM(css_vertical_align_t, vertical_align);
+    ST_GET_ENUM(css_font_family_t, font_family);
+    buf >> font_name;
+    ST_GET_LEN(font_size);
+    ST_GET_ENUM(css_font_style_t, font_style);
+    ST_GET_ENUM(css_font_weight_t, font_weight);
+    ST_GET_LEN(text_indent);
+    ST_GET_LEN(line_height);
+    ST_GET_LEN(width);
+    ST_GET_LEN(height);
+    for ( int i=0; i<4; i++ )
+        ST_GET_LEN(margin[i]);
+    for ( int i=0; i<4; i++ )
+        ST_GET_LEN(padding[i]);
+    ST_GET_LEN(color);
+    ST_GET_LEN(background_color);
+    ST_GET_LEN(letter_spacing);
+    ST_GET_ENUM(css_page_break_t, page_break_before);
+    ST_GET_ENUM(css_page_break_t, page_break_after);
+    ST_GET_ENUM(css_page_break_t, page_break_inside);
+    ST_GET_ENUM(css_hyphenate_t, hyphenate);
+    ST_GET_ENUM(css_list_style_type_t, list_style_type);
+    ST_GET_ENUM(css_list_style_position_t, list_style_position);
+    hash = 0;
+    return !buf.error();
+}
+
 /// splits string like "Arial", Times New Roman, Courier; into list
 /// returns number of characters processed
 int splitPropertyValueList(const char* str, lString8Collection& list)
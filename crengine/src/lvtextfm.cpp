@@ -328,11 +328,11 @@ public:
             m_staticBufs = false;
         } else {
             // static buffer space
-            static lChar16 m_static_text[STATIC_BUFS_SIZE];
-            static lUInt8 m_static_flags[STATIC_BUFS_SIZE];
-            static src_text_fragment_t * m_static_srcs[STATIC_BUFS_SIZE];
-            static lUInt16 m_static_charindex[STATIC_BUFS_SIZE];
-            static int m_static_widths[STATIC_BUFS_SIZE];
+            static CR_THREAD_LOCAL lChar16 m_static_text[STATIC_BUFS_SIZE];
+            static CR_THREAD_LOCAL lUInt8 m_static_flags[STATIC_BUFS_SIZE];
+            static CR_THREAD_LOCAL src_text_fragment_t * m_static_srcs[STATIC_BUFS_SIZE];
+            static CR_THREAD_LOCAL lUInt16 m_static_charindex[STATIC_BUFS_SIZE];
+            static CR_THREAD_LOCAL int m_static_widths[STATIC_BUFS_SIZE];
             m_text = m_static_text;
             m_flags = m_static_flags;
             m_charindex = m_static_charindex;
@@ -488,8 +488,8 @@ public:
         int start = 0;
         int lastWidth = 0;
 #define MAX_TEXT_CHUNK_SIZE 4096
-        static lUInt16 widths[MAX_TEXT_CHUNK_SIZE+1];
-        static lUInt8 flags[MAX_TEXT_CHUNK_SIZE+1];
+        static CR_THREAD_LOCAL lUInt16 widths[MAX_TEXT_CHUNK_SIZE+1];
+        static CR_THREAD_LOCAL lUInt8 flags[MAX_TEXT_CHUNK_SIZE+1];
         int tabIndex = -1;
         for ( i=0; i<=m_length; i++ ) {
             LVFont * newFont = NULL;
@@ -1040,7 +1040,7 @@ public:
                     if ( len > MAX_WORD_SIZE )
                         len = MAX_WORD_SIZE;
                     lUInt8 * flags = m_flags + start;
-                    static lUInt16 widths[MAX_WORD_SIZE];
+                    lUInt16 widths[MAX_WORD_SIZE];
                     int wordStart_w = start>0 ? m_widths[start-1] : 0;
                     for ( int i=0; i<len; i++ ) {
                         widths[i] = m_widths[start+i] - wordStart_w;
@@ -1187,6 +1187,24 @@ static void freeFrmLines( formatted_text_fragment_t * m_pbuffer )
     m_pbuffer->frmlinecount = 0;
 }
 
+int LFormattedText::GetMemorySize()
+{
+    int size = sizeof(LFormattedText) + sizeof(formatted_text_fragment_t);
+    size += m_pbuffer->srctextlen * sizeof(src_text_fragment_t);
+    for (int i=0; i<m_pbuffer->srctextlen; i++)
+    {
+        src_text_fragment_t * src = &m_pbuffer->srctext[i];
+        if ( (src->flags & LTEXT_FLAG_OWNTEXT) && !(src->flags & LTEXT_SRC_IS_OBJECT) )
+            size += src->t.len * sizeof(lChar16);
+    }
+    for (int i=0; i<m_pbuffer->frmlinecount; i++)
+    {
+        size += sizeof(formatted_line_t *) + sizeof(formatted_line_t)
+            + m_pbuffer->frmlines[i]->word_count * sizeof(formatted_word_t);
+    }
+    return size;
+}
+
 // experimental formatter
 lUInt32 LFormattedText::Format(lUInt16 width, lUInt16 page_height)
 {
@@ -1374,7 +1392,7 @@ void LFormattedText::Draw( LVDrawBuf * buf, int x, int y, ldomMarkedRangeList *
                 {
                     srcline = &m_pbuffer->srctext[word->src_text_index];
                     ldomNode * node = (ldomNode *) srcline->object;
-                    LVImageSourceRef img = node->getObjectImageSource();
+                    LVImageSourceRef img = node->getScaledObjectImageSource( word->width, word->o.height );
                     if ( img.isNull() )
                         img = LVCreateDummyImageSource( node, word->width, word->o.height );
                     int xx = x + frmline->x + word->x;
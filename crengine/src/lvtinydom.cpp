@@ -11,6 +11,11 @@
 
 #include <stdlib.h>
 #include <zlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 #include "include/lvstring.h"
 #include "include/lvtinydom.h"
 #include "include/fb2def.h"
@@ -29,14 +34,22 @@
 #define DOC_BUFFER_SIZE 0x1000000
 #endif
 
-#define TEXT_CACHE_UNPACKED_SPACE (25*DOC_BUFFER_SIZE/100)
+// shares of DOC_BUFFER_SIZE or of CrDomBase::setStorageBufferSize() value
+#define TEXT_CACHE_UNPACKED_PERCENT 25
+#define ELEM_CACHE_UNPACKED_PERCENT 45
+#define RECT_CACHE_UNPACKED_PERCENT 15
+#define STYLE_CACHE_UNPACKED_PERCENT 10
+
+#define TEXT_CACHE_UNPACKED_SPACE (TEXT_CACHE_UNPACKED_PERCENT*DOC_BUFFER_SIZE/100)
 #define TEXT_CACHE_CHUNK_SIZE     0x008000 // 32K
-#define ELEM_CACHE_UNPACKED_SPACE (45*DOC_BUFFER_SIZE/100)
+#define ELEM_CACHE_UNPACKED_SPACE (ELEM_CACHE_UNPACKED_PERCENT*DOC_BUFFER_SIZE/100)
 #define ELEM_CACHE_CHUNK_SIZE     0x004000 // 16K
-#define RECT_CACHE_UNPACKED_SPACE (15*DOC_BUFFER_SIZE/100)
+#define RECT_CACHE_UNPACKED_SPACE (RECT_CACHE_UNPACKED_PERCENT*DOC_BUFFER_SIZE/100)
 #define RECT_CACHE_CHUNK_SIZE     0x008000 // 32K
-#define STYLE_CACHE_UNPACKED_SPACE (10*DOC_BUFFER_SIZE/100)
+#define STYLE_CACHE_UNPACKED_SPACE (STYLE_CACHE_UNPACKED_PERCENT*DOC_BUFFER_SIZE/100)
 #define STYLE_CACHE_CHUNK_SIZE    0x00C000 // 48K
+// several chunks stay unpacked whatever the budget, pointers into recently used ones remain valid
+#define MIN_CACHE_UNPACKED_SPACE  0x080000
 
 //#define TRACE_AUTOBOX
 #define RECT_DATA_CHUNK_ITEMS_SHIFT 11
@@ -54,6 +67,10 @@
 #define STYLE_DATA_CHUNK_MASK (STYLE_DATA_CHUNK_ITEMS-1)
 
 #define STYLE_HASH_TABLE_SIZE     512
+// formatted paragraphs kept for drawing, approximate bytes
+#define RENDERED_BLOCK_CACHE_SIZE 0x200000
+// byte budget of images decoded at displayed size
+#define SCALED_IMAGE_CACHE_SIZE 0x1000000
 #define FONT_HASH_TABLE_SIZE      256
 
 static int NextDomIndex = 0;
@@ -233,6 +250,44 @@ LVStreamRef ldomBlobCache::getBlob( lString16 name )
     return LVStreamRef();
 }
 
+static const char * blob_cache_magic = "BLOBS";
+
+bool ldomBlobCache::serialize( SerialBuf & buf )
+{
+    if ( buf.error() )
+        return false;
+    buf.putMagic( blob_cache_magic );
+    buf << (lUInt32)_list.length();
+    for ( int i=0; i<_list.length(); i++ ) {
+        ldomBlobItem * item = _list[i];
+        lInt32 size = item->getData() ? item->getSize() : 0;
+        buf << item->getName() << size;
+        buf.putBytes( item->getData(), size );
+    }
+    return !buf.error();
+}
+
+bool ldomBlobCache::deserialize( SerialBuf & buf )
+{
+    if ( !buf.checkMagic( blob_cache_magic ) )
+        return false;
+    lUInt32 count = 0;
+    buf >> count;
+    for ( lUInt32 i=0; i<count && !buf.error(); i++ ) {
+        lString16 name;
+        lInt32 size = 0;
+        buf >> name >> size;
+        if ( buf.error() || size<0 || size>buf.space() ) {
+            buf.seterror();
+            break;
+        }
+        addBlob( buf.buf() + buf.pos(), size, name );
+        buf.setPos( buf.pos() + size );
+    }
+    _changed = false;
+    return !buf.error();
+}
+
 //#define DEBUG_RENDER_RECT_ACCESS
 #ifdef DEBUG_RENDER_RECT_ACCESS
   static signed char render_rect_flags[200000]={0};
@@ -478,10 +533,13 @@ CrDomBase::CrDomBase()
 		, _fonts(FONT_HASH_TABLE_SIZE)
 		, _tinyElementCount(0)
 		, _itemCount(0)
-		, _renderedBlockCache( 32 )
+		, _renderedBlockCache( RENDERED_BLOCK_CACHE_SIZE )
+		, _scaledImageCache( SCALED_IMAGE_CACHE_SIZE )
 		, _mapped(false)
 		, _maperror(false)
 		, _mapSavingStage(0)
+		, _mapBuf(NULL)
+		, _mapSize(0)
 		, _minSpaceCondensingPercent(DEF_MIN_SPACE_CONDENSING_PERCENT)
 		 // persistent text node data storage
 		, _textStorage(this, 't', TEXT_CACHE_UNPACKED_SPACE, TEXT_CACHE_CHUNK_SIZE )
@@ -662,6 +720,17 @@ void CrDomBase::recycleTinyNode( lUInt32 index )
 }
 
 CrDomBase::~CrDomBase()
+{
+    freeNodes();
+    if ( _mapBuf ) {
+        // chunks do not own mapped buffers, so it is safe to unmap before they are destroyed
+        munmap( _mapBuf, _mapSize );
+        _mapBuf = NULL;
+    }
+    ldomNode::unregisterDom((CrDom*)this);
+}
+
+void CrDomBase::freeNodes()
 {
     // clear all elem parts
     for ( int partindex = 0; partindex<=(_elemCount>>TNC_PART_SHIFT); partindex++ ) {
@@ -685,7 +754,11 @@ CrDomBase::~CrDomBase()
             _textList[partindex] = NULL;
         }
     }
-    ldomNode::unregisterDom((CrDom*)this);
+    _textCount = 0;
+    _textNextFree = 0;
+    _elemCount = 0;
+    _elemNextFree = 0;
+    _itemCount = 0;
 }
 
 /// get chunk pointer and update usage data
@@ -702,6 +775,10 @@ ldomTextStorageChunk * ldomDataStorageManager::getChunk( lUInt32 address )
             _recentChunk->_prevRecent = chunk;
         _recentChunk = chunk;
     }
+    if ( !chunk->_buf && chunk->_compbuf ) {
+        chunk->unpack();
+        compact(0);
+    }
     return chunk;
 }
 
@@ -889,17 +966,27 @@ void ldomDataStorageManager::compact(int reservedSpace)
         // do compacting
         int sumsize = reservedSpace;
         for (ldomTextStorageChunk* p = _recentChunk; p; p = p->_nextRecent) {
-            if (p->_bufsize >= 0) {
-                if ((int) p->_bufsize + sumsize < _maxUncompressedSize
-                    || (p == _activeChunk && reservedSpace < 0xFFFFFFF)) {
-                    // fits
-                    sumsize += p->_bufsize;
-                }
+            // mapped chunks are backed by cache file, not by heap
+            if (!p->_buf || p->_mapped)
+                continue;
+            if ((int) p->_bufsize + sumsize < _maxUncompressedSize
+                || p == _recentChunk
+                || (p == _activeChunk && reservedSpace < 0xFFFFFFF)) {
+                // fits
+                sumsize += p->_bufsize;
+            } else if (!p->pack()) {
+                sumsize += p->_bufsize;
             }
         }
     }
 }
 
+void ldomDataStorageManager::setMaxUncompressedSize(int size)
+{
+    _maxUncompressedSize = size > MIN_CACHE_UNPACKED_SPACE ? size : MIN_CACHE_UNPACKED_SPACE;
+    compact(0);
+}
+
 ldomDataStorageManager::ldomDataStorageManager(
         CrDomBase* owner, char type, int maxUnpackedSize, int chunkSize)
         : _owner(owner),
@@ -908,12 +995,77 @@ ldomDataStorageManager::ldomDataStorageManager(
           _uncompressedSize(0),
           _maxUncompressedSize(maxUnpackedSize),
           _chunkSize(chunkSize),
-          _type(type)
+          _type(type),
+          _codec(CHUNK_CODEC_ZLIB)
 {
 }
 
 ldomDataStorageManager::~ldomDataStorageManager() { }
 
+#define CACHE_DATA_ALIGN(n) (((n) + 15) & ~15)
+
+lUInt32 ldomDataStorageManager::serializeChunks( SerialBuf & buf, lUInt32 offset )
+{
+    buf << (lUInt8)_type << (lUInt32)_chunks.length();
+    for ( int i=0; i<_chunks.length(); i++ ) {
+        ldomTextStorageChunk * chunk = _chunks[i];
+        // free space at the end of text and element chunks is not stored
+        lUInt32 size = chunk->_buf || chunk->_compbuf ? chunk->_bufpos : 0;
+        buf << offset << size;
+        offset += CACHE_DATA_ALIGN(size);
+    }
+    return offset;
+}
+
+bool ldomDataStorageManager::writeChunks( LVStreamRef stream )
+{
+    static const lUInt8 padding[16] = { 0 };
+    for ( int i=0; i<_chunks.length(); i++ ) {
+        ldomTextStorageChunk * chunk = _chunks[i];
+        lUInt32 size = chunk->_buf || chunk->_compbuf ? chunk->_bufpos : 0;
+        if ( size==0 )
+            continue;
+        chunk = getChunk( i << 16 );
+        lvsize_t written = 0;
+        if ( stream->Write( chunk->_buf, size, &written )!=LVERR_OK || written!=size )
+            return false;
+        lUInt32 pad = CACHE_DATA_ALIGN(size) - size;
+        if ( pad && ( stream->Write( padding, pad, &written )!=LVERR_OK || written!=pad ) )
+            return false;
+    }
+    return true;
+}
+
+bool ldomDataStorageManager::deserializeChunks( SerialBuf & buf, lUInt8 * data, lUInt32 size )
+{
+    clearChunks();
+    lUInt8 type = 0;
+    lUInt32 count = 0;
+    buf >> type >> count;
+    if ( buf.error() || type!=(lUInt8)_type || count>0xFFFF )
+        return false;
+    for ( lUInt32 i=0; i<count; i++ ) {
+        lUInt32 offset = 0;
+        lUInt32 chunkSize = 0;
+        buf >> offset >> chunkSize;
+        if ( buf.error() || (offset & 15) || offset>size || chunkSize>size-offset )
+            return false;
+        ldomTextStorageChunk * chunk = new ldomTextStorageChunk( this, (lUInt16)i );
+        _chunks.add( chunk );
+        if ( chunkSize )
+            chunk->setmapped( data + offset, chunkSize );
+    }
+    return true;
+}
+
+void ldomDataStorageManager::clearChunks()
+{
+    _chunks.clear();
+    _activeChunk = NULL;
+    _recentChunk = NULL;
+    _uncompressedSize = 0;
+}
+
 ldomTextStorageChunk::ldomTextStorageChunk(
         int preAllocSize,
         ldomDataStorageManager * manager,
@@ -930,6 +1082,10 @@ ldomTextStorageChunk::ldomTextStorageChunk(
         /// ? index of chunk in storage
 	, _index(index)
 	, _type( manager->_type )
+	, _mapped(false)
+	, _compbuf(NULL)
+	, _compsize(0)
+	, _codec(0)
 {
     _buf = (lUInt8*)malloc(preAllocSize);
     memset(_buf, 0, preAllocSize);
@@ -945,6 +1101,10 @@ ldomTextStorageChunk::ldomTextStorageChunk(ldomDataStorageManager * manager, lUI
 	, _bufpos(0)     /// _buf (uncompressed) data write position (for appending of new data)
 	, _index(index)      /// ? index of chunk in storage
 	, _type( manager->_type )
+	, _mapped(false)
+	, _compbuf(NULL)
+	, _compsize(0)
+	, _codec(0)
 {
 }
 
@@ -1175,13 +1335,275 @@ bool ldomUnpack( const lUInt8 * compbuf, int compsize, lUInt8 * &dstbuf, lUInt32
     return true;
 }
 
+/// compression method of storage chunks, packed size is returned, unpacked size is known to caller
+class ldomChunkCodec
+{
+public:
+    virtual ~ldomChunkCodec() { }
+    /// returns malloc'ed buffer in dstbuf
+    virtual bool pack( const lUInt8 * buf, int bufsize, lUInt8 * &dstbuf, lUInt32 & dstsize ) = 0;
+    /// unpacks exactly dstsize bytes to dstbuf
+    virtual bool unpack( const lUInt8 * compbuf, int compsize, lUInt8 * dstbuf, int dstsize ) = 0;
+};
+
+class ldomZlibChunkCodec : public ldomChunkCodec
+{
+public:
+    virtual bool pack( const lUInt8 * buf, int bufsize, lUInt8 * &dstbuf, lUInt32 & dstsize )
+    {
+        z_stream z;
+        memset( &z, 0, sizeof(z) );
+        if ( deflateInit( &z, DOC_DATA_COMPRESSION_LEVEL ) != Z_OK )
+            return false;
+        int bound = deflateBound( &z, bufsize );
+        lUInt8 * dst = (lUInt8 *)malloc( bound );
+        z.avail_in = bufsize;
+        z.next_in = (unsigned char *)buf;
+        z.avail_out = bound;
+        z.next_out = dst;
+        int ret = deflate( &z, Z_FINISH );
+        int have = bound - z.avail_out;
+        deflateEnd( &z );
+        if ( ret != Z_STREAM_END || z.avail_in != 0 ) {
+            free( dst );
+            return false;
+        }
+        dstbuf = dst;
+        dstsize = have;
+        return true;
+    }
+    virtual bool unpack( const lUInt8 * compbuf, int compsize, lUInt8 * dstbuf, int dstsize )
+    {
+        z_stream z;
+        memset( &z, 0, sizeof(z) );
+        if ( inflateInit( &z ) != Z_OK )
+            return false;
+        z.avail_in = compsize;
+        z.next_in = (unsigned char *)compbuf;
+        z.avail_out = dstsize;
+        z.next_out = dstbuf;
+        int ret = inflate( &z, Z_FINISH );
+        inflateEnd( &z );
+        return ret == Z_STREAM_END && z.avail_out == 0;
+    }
+};
+
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 0xFFFF
+// as in LZ4 block format, last match starts 12 bytes before the end and last 5 bytes are literals
+#define LZ_MF_LIMIT 12
+#define LZ_LAST_LITERALS 5
+
+/// greedy LZ77 packing to LZ4 block format: token, literals, 16 bit offset, match length
+class ldomFastChunkCodec : public ldomChunkCodec
+{
+    static inline lUInt32 read32( const lUInt8 * p )
+    {
+        lUInt32 v;
+        memcpy( &v, p, 4 );
+        return v;
+    }
+    static inline int hash( lUInt32 v )
+    {
+        return (int)((v * 2654435761U) >> (32 - LZ_HASH_BITS));
+    }
+    static inline lUInt8 * putLength( lUInt8 * op, int len )
+    {
+        while ( len >= 255 ) {
+            *op++ = 255;
+            len -= 255;
+        }
+        *op++ = (lUInt8)len;
+        return op;
+    }
+    static lUInt8 * putSequence( lUInt8 * op, const lUInt8 * lit, int litlen, int offset, int matchlen )
+    {
+        lUInt8 * token = op++;
+        *token = (lUInt8)((litlen >= 15 ? 15 : litlen) << 4);
+        if ( litlen >= 15 )
+            op = putLength( op, litlen - 15 );
+        memcpy( op, lit, litlen );
+        op += litlen;
+        if ( !matchlen )
+            return op;
+        *op++ = (lUInt8)(offset & 255);
+        *op++ = (lUInt8)(offset >> 8);
+        matchlen -= LZ_MIN_MATCH;
+        *token |= (lUInt8)(matchlen >= 15 ? 15 : matchlen);
+        if ( matchlen >= 15 )
+            op = putLength( op, matchlen - 15 );
+        return op;
+    }
+public:
+    virtual bool pack( const lUInt8 * buf, int bufsize, lUInt8 * &dstbuf, lUInt32 & dstsize )
+    {
+        // worst case of incompressible data: one literal run
+        lUInt8 * dst = (lUInt8 *)malloc( bufsize + bufsize / 255 + 16 );
+        lUInt8 * op = dst;
+        lUInt32 table[1 << LZ_HASH_BITS];
+        memset( table, 0, sizeof(table) );
+        int anchor = 0;
+        int ip = 1;
+        int mflimit = bufsize - LZ_MF_LIMIT;
+        int matchlimit = bufsize - LZ_LAST_LITERALS;
+        while ( ip < mflimit ) {
+            lUInt32 seq = read32( buf + ip );
+            int h = hash( seq );
+            int ref = (int)table[h];
+            table[h] = ip;
+            if ( ip - ref > LZ_MAX_OFFSET || read32( buf + ref ) != seq ) {
+                ip++;
+                continue;
+            }
+            int len = LZ_MIN_MATCH;
+            while ( ip + len < matchlimit && buf[ref + len] == buf[ip + len] )
+                len++;
+            op = putSequence( op, buf + anchor, ip - anchor, ip - ref, len );
+            ip += len;
+            anchor = ip;
+        }
+        op = putSequence( op, buf + anchor, bufsize - anchor, 0, 0 );
+        dstbuf = dst;
+        dstsize = (lUInt32)(op - dst);
+        return true;
+    }
+    virtual bool unpack( const lUInt8 * compbuf, int compsize, lUInt8 * dstbuf, int dstsize )
+    {
+        const lUInt8 * ip = compbuf;
+        const lUInt8 * iend = compbuf + compsize;
+        lUInt8 * op = dstbuf;
+        lUInt8 * oend = dstbuf + dstsize;
+        while ( ip < iend ) {
+            int token = *ip++;
+            int litlen = token >> 4;
+            if ( litlen == 15 ) {
+                int b;
+                do {
+                    if ( ip >= iend )
+                        return false;
+                    b = *ip++;
+                    litlen += b;
+                } while ( b == 255 );
+            }
+            if ( litlen > iend - ip || litlen > oend - op )
+                return false;
+            memcpy( op, ip, litlen );
+            ip += litlen;
+            op += litlen;
+            if ( ip == iend )
+                break; // last sequence has literals only
+            if ( iend - ip < 2 )
+                return false;
+            int offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+            if ( offset == 0 || offset > op - dstbuf )
+                return false;
+            int matchlen = token & 15;
+            if ( matchlen == 15 ) {
+                int b;
+                do {
+                    if ( ip >= iend )
+                        return false;
+                    b = *ip++;
+                    matchlen += b;
+                } while ( b == 255 );
+            }
+            matchlen += LZ_MIN_MATCH;
+            if ( matchlen > oend - op )
+                return false;
+            // may overlap, byte by byte
+            const lUInt8 * ref = op - offset;
+            for ( int i = 0; i < matchlen; i++ )
+                op[i] = ref[i];
+            op += matchlen;
+        }
+        return op == oend;
+    }
+};
+
+static ldomChunkCodec * getChunkCodec( int codec )
+{
+    static ldomZlibChunkCodec zlibCodec;
+    static ldomFastChunkCodec fastCodec;
+    if ( codec == CHUNK_CODEC_FAST )
+        return &fastCodec;
+    return &zlibCodec;
+}
+
+static lUInt64 chunkTimeMicros()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (lUInt64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool ldomTextStorageChunk::pack()
+{
+    if ( !_buf || _mapped || _compbuf || !_bufpos )
+        return false;
+    ldomChunkCodecStats & stats = _manager->_stats;
+    lUInt64 start = chunkTimeMicros();
+    lUInt8 * dst = NULL;
+    lUInt32 dstsize = 0;
+    bool res = getChunkCodec( _manager->_codec )->pack( _buf, _bufpos, dst, dstsize );
+    stats.packTime += chunkTimeMicros() - start;
+    if ( !res )
+        return false;
+    if ( dstsize >= _bufpos ) {
+        // incompressible, keep as is
+        free( dst );
+        return false;
+    }
+    stats.packCount++;
+    stats.packedBytes += _bufpos;
+    stats.compressedBytes += dstsize;
+    // shrink to packed size, malloc'ed for the worst case
+    _compbuf = (lUInt8 *)realloc( dst, dstsize );
+    if ( !_compbuf )
+        _compbuf = dst;
+    _compsize = dstsize;
+    _codec = (lUInt8)_manager->_codec;
+    _manager->_uncompressedSize -= _bufsize;
+    free( _buf );
+    _buf = NULL;
+    return true;
+}
+
+void ldomTextStorageChunk::unpack()
+{
+    ldomChunkCodecStats & stats = _manager->_stats;
+    lUInt64 start = chunkTimeMicros();
+    lUInt8 * buf = (lUInt8 *)malloc( _bufsize );
+    if ( !getChunkCodec( _codec )->unpack( _compbuf, _compsize, buf, _bufpos ) ) {
+        CRLog::error("Cannot unpack storage chunk %c%d", _type, _index);
+        crFatalError(1003, "Storage chunk unpacking error");
+    }
+    memset( buf + _bufpos, 0, _bufsize - _bufpos );
+    stats.unpackTime += chunkTimeMicros() - start;
+    stats.unpackCount++;
+    free( _compbuf );
+    _compbuf = NULL;
+    _compsize = 0;
+    _buf = buf;
+    _manager->_uncompressedSize += _bufsize;
+}
+
 void ldomTextStorageChunk::setunpacked( const lUInt8 * buf, int bufsize )
 {
+    if ( _compbuf ) {
+        free(_compbuf);
+        _compbuf = NULL;
+        _compsize = 0;
+    }
     if ( _buf ) {
-        _manager->_uncompressedSize -= _bufsize;
-        free(_buf);
+        if ( !_mapped ) {
+            _manager->_uncompressedSize -= _bufsize;
+            free(_buf);
+        }
         _buf = NULL;
         _bufsize = 0;
+        _mapped = false;
     }
     if ( buf && bufsize ) {
         _bufsize = bufsize;
@@ -1192,6 +1614,15 @@ void ldomTextStorageChunk::setunpacked( const lUInt8 * buf, int bufsize )
     }
 }
 
+void ldomTextStorageChunk::setmapped( lUInt8 * buf, int bufsize )
+{
+    setunpacked( NULL, 0 );
+    _buf = buf;
+    _bufsize = bufsize;
+    _bufpos = bufsize;
+    _mapped = true;
+}
+
 /// fastDOM, moved to .cpp to hide implementation
 class ldomAttributeCollection
 {
@@ -1391,6 +1822,10 @@ CrDom::CrDom()
 , _page_width(0)
 , _rendered(false)
 , lists(100)
+, _cacheChanged(false)
+, _layoutThreads(1)
+, _renderStylesheetHash(0)
+, _renderCallback(NULL)
 {
     allocTinyElement(NULL, 0, 0);
     //new ldomElement( this, NULL, 0, 0, 0 );
@@ -1783,11 +2218,17 @@ void CrDom::updateRenderContext()
 /// returns false if render is necessary
 bool CrDom::checkRenderContext()
 {
-    bool res = true;
+    return getRenderContextChanges() == 0;
+}
+
+/// returns RENDER_CONTEXT_* flags of formatting parameters changed since updateRenderContext()
+int CrDom::getRenderContextChanges()
+{
+    int res = 0;
     ldomNode* node = getRootNode();
     if (node != NULL && node->getFont().isNull()) {
         CRLog::trace("checkRenderContext: Style is not set for root node");
-        res = false;
+        res |= RENDER_CONTEXT_STYLES;
     }
     lUInt32 styleHash = calcStyleHash();
     lUInt32 stylesheetHash = (((stylesheet_.getHash() * 31) + calcHash(_def_style)) * 31
@@ -1796,23 +2237,32 @@ bool CrDom::checkRenderContext()
     if ( styleHash != _hdr.render_style_hash ) {
         CRLog::trace("checkRenderContext: Style hash doesn't match %x!=%x",
                 styleHash, _hdr.render_style_hash);
-        res = false;
-    } else if (stylesheetHash != _hdr.stylesheet_hash) {
+        res |= RENDER_CONTEXT_STYLES;
+    }
+    if (stylesheetHash != _hdr.stylesheet_hash) {
         CRLog::trace("checkRenderContext: Stylesheet hash doesn't match %x!=%x",
                 stylesheetHash, _hdr.stylesheet_hash);
-        res = false;
-    } else if (_docFlags != _hdr.render_docflags) {
+        // Only default font and interline space changed if render methods were set for this stylesheet
+        if (_renderStylesheetHash != 0 && _renderStylesheetHash == stylesheet_.getHash()) {
+            res |= RENDER_CONTEXT_FONTS;
+        } else {
+            res |= RENDER_CONTEXT_STYLES;
+        }
+    }
+    if (_docFlags != _hdr.render_docflags) {
         CRLog::trace("checkRenderContext: Doc flags don't match %x!=%x",
                 _docFlags, _hdr.render_docflags);
-        res = false;
-    } else if (_page_width != (int)_hdr.render_dx) {
+        res |= RENDER_CONTEXT_STYLES;
+    }
+    if (_page_width != (int)_hdr.render_dx) {
         CRLog::trace("checkRenderContext: Width doesn't match %x!=%x",
                 _page_width, (int)_hdr.render_dx);
-        res = false;
-    } else if (_page_height != (int)_hdr.render_dy) {
+        res |= RENDER_CONTEXT_LAYOUT;
+    }
+    if (_page_height != (int)_hdr.render_dy) {
         CRLog::trace("checkRenderContext: Page height doesn't match %x!=%x",
                 _page_height, (int)_hdr.render_dy);
-        res = false;
+        res |= RENDER_CONTEXT_LAYOUT;
     }
     return res;
 }
@@ -1838,8 +2288,9 @@ int CrDom::render(LVRendPageList* pages,
     //} else {
     //    CRLog::trace("reusing existing format data...");
     //}
-    if (!checkRenderContext()) {
-        CRLog::info("CrDom::checkRenderContext FORMATTING");
+    int changes = getRenderContextChanges();
+    if (changes & (RENDER_CONTEXT_STYLES | RENDER_CONTEXT_FONTS)) {
+        CRLog::info("CrDom::checkRenderContext FORMATTING, changes=%x", changes);
         dropStyles();
         CRLog::trace("stylesheet_.push()");
         stylesheet_.push();
@@ -1848,14 +2299,23 @@ int CrDom::render(LVRendPageList* pages,
         getRootNode()->initNodeStyleRecursive();
         CRLog::trace("stylesheet_.pop()");
         stylesheet_.pop();
-        CRLog::trace("Init render method");
-        getRootNode()->initNodeRendMethodRecursive();
+        // Display and white-space don't depend on the default font,
+        // render methods and autoboxing are kept when only it or interline space changed
+        if (changes & RENDER_CONTEXT_STYLES) {
+            CRLog::trace("Init render method");
+            getRootNode()->initNodeRendMethodRecursive();
+            _renderStylesheetHash = stylesheet_.getHash();
+        }
         //getRootNode()->setFont(_def_font);
         //getRootNode()->setStyle(_def_style);
         updateRenderContext();
         //lUInt32 styleHash = calcStyleHash();
         //styleHash = styleHash * 31 + calcGlobalSettingsHash();
         _rendered = false;
+    } else if (changes & RENDER_CONTEXT_LAYOUT) {
+        // Styles are valid, only text is formatted and paginated again
+        CRLog::info("CrDom::checkRenderContext LAYOUT");
+        _rendered = false;
     }
     if (!_rendered) {
         pages->clear();
@@ -1865,15 +2325,25 @@ int CrDom::render(LVRendPageList* pages,
         LVRendPageContext context(pages, _page_height);
         int numFinalBlocks = calcFinalBlocks();
         CRLog::trace("Final block count: %d", numFinalBlocks);
+        context.setCallback(numFinalBlocks, _renderCallback);
         //updateStyles();
         int height = renderBlockElement( context, getRootNode(), 0, y0, width ) + y0;
+        if (context.isAborted()) {
+            // Layout is incomplete, the next render starts over
+            CRLog::info("CrDom::render aborted");
+            pages->clear();
+            _renderedBlockCache.clear();
+            return 0;
+        }
         _rendered = true;
+        _cacheChanged = true;
         gc();
         CRLog::trace("finalizing... fonts.length=%d", _fonts.length());
         context.Finalize();
         updateRenderContext();
         _pagesData.reset();
         pages->serialize( _pagesData );
+        dumpStatistics();
         return height;
     } else {
         CRLog::trace("rendering context is not changed, no render");
@@ -1886,6 +2356,341 @@ int CrDom::render(LVRendPageList* pages,
     }
 }
 
+/// document cache file: header, metadata (node tables, styles, TOC, pages...) and storage chunks
+static const char * cache_file_magic = "CR3 DOM CACHE\n";
+static const char * cache_meta_magic = "DOMMETA";
+/// increment on any change of cached structures, including ldomNode and storage item layouts
+#define CACHE_FILE_VERSION 2
+#define CACHE_HEADER_SIZE 128
+/// chunk data starts at page boundary so that chunks can be mapped
+#define CACHE_DATA_PAGE 4096
+#define CACHE_META_INITIAL_SIZE 0x40000
+
+bool CrDom::persistNodes()
+{
+    bool res = true;
+    for (int i = 1; i <= _elemCount; i++) {
+        ldomNode* node = &_elemList[i >> TNC_PART_SHIFT][i & TNC_PART_MASK];
+        if (!node->isNull() && !node->isPersistent()) {
+            node->persist();
+            res = res && node->isPersistent();
+        }
+    }
+    for (int i = 1; i <= _textCount; i++) {
+        ldomNode* node = &_textList[i >> TNC_PART_SHIFT][i & TNC_PART_MASK];
+        if (!node->isNull() && !node->isPersistent()) {
+            node->persist();
+            res = res && node->isPersistent();
+        }
+    }
+    return res;
+}
+
+static void serializeNodeParts(SerialBuf& buf, ldomNode** list, int count)
+{
+    if (count == 0) {
+        return;
+    }
+    for (int i = 0; i <= (count >> TNC_PART_SHIFT); i++) {
+        buf.putBytes((const lUInt8*) list[i], sizeof(ldomNode) * TNC_PART_LEN);
+    }
+}
+
+bool CrDomBase::deserializeNodeParts(SerialBuf& buf, ldomNode** list, int count, int docIndex)
+{
+    if (count == 0) {
+        return true;
+    }
+    for (int i = 0; i <= (count >> TNC_PART_SHIFT); i++) {
+        ldomNode* part = (ldomNode*) malloc(sizeof(ldomNode) * TNC_PART_LEN);
+        list[i] = part;
+        if (!buf.getBytes((lUInt8*) part, sizeof(ldomNode) * TNC_PART_LEN)) {
+            memset(part, 0, sizeof(ldomNode) * TNC_PART_LEN);
+            return false;
+        }
+        for (int j = 0; j < TNC_PART_LEN; j++) {
+            // mutable nodes keep pointers, they are never written
+            if (!part[j].isNull() && !part[j].isPersistent()) {
+                memset(part, 0, sizeof(ldomNode) * TNC_PART_LEN);
+                return false;
+            }
+            part[j].setDocumentIndex(docIndex);
+        }
+    }
+    return true;
+}
+
+bool CrDom::saveCacheFile(const lString16& fileName, const ldomCacheKey& key)
+{
+    if (!_rendered || !_pagesData.pos()) {
+        return false;
+    }
+    if (!persistNodes()) {
+        CRLog::error("saveCacheFile: mutable nodes found");
+        return false;
+    }
+    SerialBuf meta(CACHE_META_INITIAL_SIZE);
+    meta.putMagic(cache_meta_magic);
+    // node tables
+    meta << (lUInt32) _textCount << _textNextFree << (lUInt32) _elemCount << _elemNextFree
+         << (lUInt32) _itemCount;
+    serializeNodeParts(meta, _elemList, _elemCount);
+    serializeNodeParts(meta, _textList, _textCount);
+    // names and values added while parsing
+    _elementNameTable.serialize(meta, UNKNOWN_ELEMENT_TYPE_ID);
+    _attrNameTable.serialize(meta, UNKNOWN_ATTRIBUTE_TYPE_ID);
+    _nsNameTable.serialize(meta, UNKNOWN_NAMESPACE_TYPE_ID);
+    meta << _nextUnknownElementId << _nextUnknownAttrId << _nextUnknownNsId;
+    _attrValueTable.serialize(meta);
+    meta << (lUInt32) _idNodeMap.length();
+    LVHashTable<lUInt16, lInt32>::iterator ids = _idNodeMap.forwardIterator();
+    for (LVHashTable<lUInt16, lInt32>::pair* p = ids.next(); p; p = ids.next()) {
+        meta << p->key << p->value;
+    }
+    // styles, node style info refers them by index
+    LVArray<css_style_ref_t>* styles = _styles.getIndex();
+    meta << (lUInt32) styles->length();
+    for (int i = 0; i < styles->length(); i++) {
+        css_style_ref_t style = styles->get(i);
+        meta << (bool) !style.isNull();
+        if (!style.isNull()) {
+            style->serialize(meta);
+        }
+    }
+    delete styles;
+    // storage chunk tables, data follows metadata
+    lUInt32 dataSize = 0;
+    dataSize = _textStorage.serializeChunks(meta, dataSize);
+    dataSize = _elemStorage.serializeChunks(meta, dataSize);
+    dataSize = _rectStorage.serializeChunks(meta, dataSize);
+    dataSize = _styleStorage.serializeChunks(meta, dataSize);
+    // document
+    m_toc.serialize(meta);
+    _fontList.serialize(meta);
+    _blobCache.serialize(meta);
+    meta << stylesheet_file_name_;
+    meta << (lUInt32) _docProps->getCount();
+    for (int i = 0; i < _docProps->getCount(); i++) {
+        meta << lString8(_docProps->getName(i)) << _docProps->getValue(i);
+    }
+    // render context and pages, reused by render() when settings match
+    meta << _hdr.render_dx << _hdr.render_dy << _hdr.render_docflags
+         << _hdr.render_style_hash << _hdr.stylesheet_hash;
+    meta << (lUInt32) _pagesData.pos();
+    meta.putBytes(_pagesData.buf(), _pagesData.pos());
+    meta.putMagic(cache_meta_magic);
+    if (meta.error()) {
+        CRLog::error("saveCacheFile: cannot serialize document");
+        return false;
+    }
+
+    lUInt32 metaOffset = CACHE_HEADER_SIZE;
+    lUInt32 metaSize = meta.pos();
+    lUInt32 dataOffset = (metaOffset + metaSize + CACHE_DATA_PAGE - 1) & ~(CACHE_DATA_PAGE - 1);
+    SerialBuf hdr(CACHE_HEADER_SIZE, false);
+    hdr.putMagic(cache_file_magic);
+    hdr << (lUInt32) CACHE_FILE_VERSION << (lUInt32) sizeof(ldomNode)
+        << (lUInt32) key.docSize << (lUInt32) (key.docSize >> 32) << key.docCrc << key.options
+        << metaOffset << metaSize << meta.getCRC() << dataOffset << dataSize;
+    hdr.putCRC(hdr.pos());
+    if (hdr.error()) {
+        return false;
+    }
+
+    // written under temporary name, so that a partially written file is never opened
+    lString16 tmpName = fileName + ".tmp";
+    LVStreamRef stream = LVOpenFileStream(tmpName.c_str(), LVOM_WRITE);
+    if (stream.isNull()) {
+        CRLog::error("saveCacheFile: cannot create %s", LCSTR(tmpName));
+        return false;
+    }
+    lUInt8* padding = (lUInt8*) calloc(1, CACHE_DATA_PAGE);
+    lvsize_t written = 0;
+    bool res = stream->Write(hdr.buf(), CACHE_HEADER_SIZE, &written) == LVERR_OK
+            && written == CACHE_HEADER_SIZE
+            && stream->Write(meta.buf(), metaSize, &written) == LVERR_OK
+            && written == metaSize
+            && stream->Write(padding, dataOffset - metaOffset - metaSize, &written) == LVERR_OK
+            && written == dataOffset - metaOffset - metaSize
+            && _textStorage.writeChunks(stream)
+            && _elemStorage.writeChunks(stream)
+            && _rectStorage.writeChunks(stream)
+            && _styleStorage.writeChunks(stream);
+    free(padding);
+    stream.Clear();
+    if (!res || !LVRenameFile(tmpName, fileName)) {
+        CRLog::error("saveCacheFile: cannot write %s", LCSTR(fileName));
+        LVDeleteFile(tmpName);
+        return false;
+    }
+    _cacheChanged = false;
+    CRLog::info("saveCacheFile: %s, %d bytes", LCSTR(fileName), dataOffset + dataSize);
+    return true;
+}
+
+bool CrDom::openCacheFile(const lString16& fileName, const ldomCacheKey& key)
+{
+    int fd = open(UnicodeToUtf8(fileName).c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+    struct stat st;
+    lUInt8* map = NULL;
+    lUInt32 mapSize = 0;
+    if (fstat(fd, &st) == 0 && st.st_size >= CACHE_HEADER_SIZE && st.st_size < 0x7FFFFFFF) {
+        mapSize = (lUInt32) st.st_size;
+        // private writable mapping: chunks modified by restyling are copied on write
+        map = (lUInt8*) mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            map = NULL;
+        }
+    }
+    close(fd);
+    if (map == NULL) {
+        CRLog::error("openCacheFile: cannot map %s", LCSTR(fileName));
+        return false;
+    }
+
+    SerialBuf hdr(map, CACHE_HEADER_SIZE);
+    lUInt32 version = 0, nodeSize = 0, sizeLow = 0, sizeHigh = 0, docCrc = 0, options = 0;
+    lUInt32 metaOffset = 0, metaSize = 0, metaCrc = 0, dataOffset = 0, dataSize = 0;
+    hdr.checkMagic(cache_file_magic);
+    hdr >> version >> nodeSize >> sizeLow >> sizeHigh >> docCrc >> options
+        >> metaOffset >> metaSize >> metaCrc >> dataOffset >> dataSize;
+    hdr.checkCRC(hdr.pos());
+    // file name is a short hash of the key, so the whole key is compared
+    ldomCacheKey fileKey(((lUInt64) sizeHigh << 32) | sizeLow, docCrc, options);
+    if (hdr.error() || version != CACHE_FILE_VERSION || nodeSize != sizeof(ldomNode)
+            || !(fileKey == key) || metaOffset > mapSize || metaSize > mapSize - metaOffset
+            || dataOffset > mapSize || dataSize > mapSize - dataOffset
+            || lStr_crc32(0, map + metaOffset, metaSize) != metaCrc) {
+        CRLog::info("openCacheFile: %s is outdated or broken", LCSTR(fileName));
+        munmap(map, mapSize);
+        return false;
+    }
+
+    // drop contents of the empty document
+    freeNodes();
+    _styles.clear(-1);
+    _fonts.clear(-1);
+    _textStorage.clearChunks();
+    _elemStorage.clearChunks();
+    _rectStorage.clearChunks();
+    _styleStorage.clearChunks();
+    if (_mapBuf) {
+        munmap(_mapBuf, _mapSize);
+    }
+    _mapBuf = map;
+    _mapSize = mapSize;
+    _mapped = true;
+
+    SerialBuf meta(map + metaOffset, metaSize);
+    meta.checkMagic(cache_meta_magic);
+    lUInt32 textCount = 0, elemCount = 0, itemCount = 0;
+    meta >> textCount >> _textNextFree >> elemCount >> _elemNextFree >> itemCount;
+    if (meta.error() || textCount >= TNC_PART_COUNT * TNC_PART_LEN
+            || elemCount >= TNC_PART_COUNT * TNC_PART_LEN) {
+        return false;
+    }
+    _textCount = textCount;
+    _elemCount = elemCount;
+    _itemCount = itemCount;
+    if (!deserializeNodeParts(meta, _elemList, _elemCount, _docIndex)
+            || !deserializeNodeParts(meta, _textList, _textCount, _docIndex)) {
+        CRLog::error("openCacheFile: bad node tables");
+        return false;
+    }
+    _elementNameTable.deserialize(meta);
+    _attrNameTable.deserialize(meta);
+    _nsNameTable.deserialize(meta);
+    meta >> _nextUnknownElementId >> _nextUnknownAttrId >> _nextUnknownNsId;
+    _attrValueTable.deserialize(meta);
+    _idNodeMap.clear();
+    lUInt32 idCount = 0;
+    meta >> idCount;
+    for (lUInt32 i = 0; i < idCount && !meta.error(); i++) {
+        lUInt16 key = 0;
+        lInt32 value = 0;
+        meta >> key >> value;
+        _idNodeMap.set(key, value);
+    }
+    lUInt32 styleCount = 0;
+    meta >> styleCount;
+    if (meta.error() || styleCount > 0xFFFF) {
+        return false;
+    }
+    LVArray<css_style_ref_t> styles(styleCount, css_style_ref_t());
+    for (lUInt32 i = 0; i < styleCount && !meta.error(); i++) {
+        bool present = false;
+        meta >> present;
+        if (present) {
+            css_style_ref_t style(new css_style_rec_t);
+            style->deserialize(meta);
+            styles[i] = style;
+        }
+    }
+    if (!_textStorage.deserializeChunks(meta, map + dataOffset, dataSize)
+            || !_elemStorage.deserializeChunks(meta, map + dataOffset, dataSize)
+            || !_rectStorage.deserializeChunks(meta, map + dataOffset, dataSize)
+            || !_styleStorage.deserializeChunks(meta, map + dataOffset, dataSize)) {
+        CRLog::error("openCacheFile: bad chunk tables");
+        return false;
+    }
+    m_toc.clear();
+    m_toc.deserialize(meta);
+    _fontList.clear();
+    _fontList.deserialize(meta);
+    _blobCache.deserialize(meta);
+    meta >> stylesheet_file_name_;
+    lUInt32 propCount = 0;
+    meta >> propCount;
+    for (lUInt32 i = 0; i < propCount && !meta.error(); i++) {
+        lString8 name;
+        lString16 value;
+        meta >> name >> value;
+        _docProps->setString(name.c_str(), value);
+    }
+    meta >> _hdr.render_dx >> _hdr.render_dy >> _hdr.render_docflags
+         >> _hdr.render_style_hash >> _hdr.stylesheet_hash;
+    lUInt32 pagesSize = 0;
+    meta >> pagesSize;
+    if (!meta.error() && pagesSize <= (lUInt32) meta.space()) {
+        lUInt8* pages = (lUInt8*) malloc(pagesSize);
+        meta.getBytes(pages, pagesSize);
+        _pagesData.set(pages, pagesSize);
+    } else {
+        meta.seterror();
+    }
+    meta.checkMagic(cache_meta_magic);
+    if (meta.error()) {
+        CRLog::error("openCacheFile: bad metadata");
+        return false;
+    }
+
+    // style cache gets one reference per node, the same as after initNodeStyleRecursive()
+    _styles.setIndex(styles);
+    for (int i = 1; i <= _elemCount; i++) {
+        ldomNode* node = &_elemList[i >> TNC_PART_SHIFT][i & TNC_PART_MASK];
+        if (node->isElement()) {
+            lUInt16 index = getNodeStyleIndex(node->getDataIndex());
+            if (index) {
+                _styles.addIndexRef(index);
+            }
+        }
+    }
+    for (lUInt32 i = 1; i < styleCount; i++) {
+        if (!styles[i].isNull()) {
+            _styles.release((int) i);
+        }
+    }
+    registerEmbeddedFonts();
+    updateLoadedStyles(true);
+    _rendered = _pagesData.pos() > 0;
+    _cacheChanged = false;
+    CRLog::info("openCacheFile: %s, %d nodes", LCSTR(fileName), _itemCount);
+    return true;
+}
+
 void CrDomXml::setNodeTypes( const elem_def_t * node_scheme )
 {
     if (!node_scheme)
@@ -6257,7 +7062,9 @@ void CrDom::clear()
 {
     clearRendBlockCache();
     _rendered = false;
+    _renderStylesheetHash = 0;
     _urlImageMap.clear();
+    _scaledImageCache.clear();
     _fontList.clear();
     fontMan->UnregisterDocumentFonts(_docIndex);
     //TODO: implement clear
@@ -6581,9 +7388,12 @@ void ldomNode::destroy()
         break;
     case NT_PELEMENT:   // immutable (persistent) element node
         {
-            ElementDataStorageItem * me = getCrDom()->_elemStorage.getElem( _data._pelem_addr );
-            for ( int i=0; i<me->childCount; i++ )
-                getCrDom()->getTinyNode( me->children[i] )->destroy();
+            // destroying a child may unpack another chunk and pack this one, so the item is fetched each time
+            int childCount = getCrDom()->_elemStorage.getElem( _data._pelem_addr )->childCount;
+            for ( int i=0; i<childCount; i++ ) {
+                lUInt32 child = getCrDom()->_elemStorage.getElem( _data._pelem_addr )->children[i];
+                getCrDom()->getTinyNode( child )->destroy();
+            }
             getCrDom()->clearNodeStyle( _handle._dataIndex );
 //            getCrDom()->_styles.release( _data._pelem._styleIndex );
 //            getCrDom()->_fonts.release( _data._pelem._fontIndex );
@@ -7343,12 +8153,15 @@ static void updateStyleDataRecursive(ldomNode* node)
     }
     node->initNodeStyle();
     int n = node->getChildCount();
+    LVStyleSheet* sheet = node->getCrDom()->getStylesheet();
+    sheet->pushAncestor(node);
     for (int i = 0; i < n; i++) {
         ldomNode* child = node->getChildNode(i);
         if (child->isElement()) {
             updateStyleDataRecursive(child);
         }
     }
+    sheet->popAncestor();
     if (styleSheetChanged) {
         node->getCrDom()->getStylesheet()->pop();
     }
@@ -8080,6 +8893,13 @@ public:
             return false;
         return img->Decode(callback);
     }
+    virtual bool   DecodeScaled( LVImageDecoderCallback * callback, int dx, int dy )
+    {
+        LVImageSourceRef img = _node->getCrDom()->getObjectImageSource(_refName);
+        if ( img.isNull() )
+            return false;
+        return img->DecodeScaled(callback, dx, dy);
+    }
     virtual ~NodeImageProxy()
     {
 
@@ -8160,6 +8980,25 @@ LVImageSourceRef ldomNode::getObjectImageSource()
     return ref;
 }
 
+/// returns object image decoded at dx x dy, cached per node and size
+LVImageSourceRef ldomNode::getScaledObjectImageSource( int dx, int dy )
+{
+    CrDom * doc = getCrDom();
+    lUInt64 key = ((lUInt64)getDataIndex() << 32) | ((lUInt64)(dx & 0xFFFF) << 16) | (lUInt64)(dy & 0xFFFF);
+    LVImageSourceRef ref;
+    if ( doc->_scaledImageCache.get(key, ref) )
+        return ref;
+    ref = getObjectImageSource();
+    if ( ref.isNull() || dx<=0 || dy<=0 )
+        return ref;
+    int size = dx * dy * 4;
+    if ( size > SCALED_IMAGE_CACHE_SIZE / 4 )
+        return ref; // would push out everything else, stretch while drawing
+    ref = LVCreateScaledImageSource(ref, dx, dy);
+    doc->_scaledImageCache.set(key, ref, size);
+    return ref;
+}
+
 /// register embedded document fonts in font manager, if any exist in document
 void CrDom::registerEmbeddedFonts()
 {
@@ -8297,9 +9136,8 @@ int ldomNode::renderFinalBlock(  LFormattedTextRef & frmtext, RenderRectAccessor
         frmtext = f;
         if ( rm != erm_final && rm != erm_list_item && rm != erm_table_caption )
             return 0;
-        //RenderRectAccessor fmt( this );
         //CRLog::trace("Found existing formatted object for node #%08X", (lUInt32)this);
-        return fmt->getHeight();
+        return f->GetHeight();
     }
     f = getCrDom()->createFormattedText();
     if ( (rm != erm_final && rm != erm_list_item && rm != erm_table_caption) )
@@ -8309,8 +9147,8 @@ int ldomNode::renderFinalBlock(  LFormattedTextRef & frmtext, RenderRectAccessor
     int flags = styleToTextFmtFlags( getStyle(), 0 );
     ::renderFinalBlock( this, f.get(), fmt, flags, 0, 16 );
     int page_h = getCrDom()->getPageHeight();
-    cache.set( this, f );
     int h = f->Format((lUInt16)width, (lUInt16)page_h);
+    cache.set( this, f, f->GetMemorySize() );
     frmtext = f;
     //CRLog::trace("Created new formatted object for node #%08X", (lUInt32)this);
     return h;
@@ -8376,8 +9214,8 @@ ldomNode* ldomNode::persist()
     } else {
         // TEXT->PTEXT
         lString8 utf8 = _data._text_ptr->getText();
-        delete _data._text_ptr;
         lUInt32 parentIndex = _data._text_ptr->getParentIndex();
+        delete _data._text_ptr;
         _handle._dataIndex = (_handle._dataIndex & ~0xF) | NT_PTEXT;
         _data._ptext_addr = getCrDom()->_textStorage.allocText(
                 _handle._dataIndex,
@@ -8395,9 +9233,11 @@ ldomNode* ldomNode::modify()
     if (isPersistent()) {
         if (isElement()) {
             // PELEM->ELEM
+            // parent is looked up first, no other storage access may happen while data is held
+            ldomNode* parent = getParentNode();
             ElementDataStorageItem* data = getCrDom()->_elemStorage.getElem(_data._pelem_addr);
             tinyElement* elem = new tinyElement(getCrDom(),
-                    getParentNode(),
+                    parent,
                     data->nsid,
                     data->id);
             for (int i = 0; i < data->childCount; i++) {
@@ -8431,7 +9271,7 @@ void CrDomBase::dumpStatistics() {
     			"    elements: %d, textNodes: %d\n"
                 "    ptext: %d (uncomp.), ptelems: %d (uncomp.)\n"
                 "    rects: %d (uncomp.), nodestyles: %d (uncomp.), styles: %d\n"
-    			"    fonts: %d, renderedNodes: %d\n"
+    			"    fonts: %d, renderedNodes: %d (%d kB, %u hits, %u misses)\n"
                 "    mutableElements: %d (~%d kB)",
                 _itemCount,
                 _itemCount*16/1024,
@@ -8444,6 +9284,9 @@ void CrDomBase::dumpStatistics() {
                 _styles.length(),
                 _fonts.length(),
                 ((CrDom*)this)->_renderedBlockCache.length(),
+                ((CrDom*)this)->_renderedBlockCache.getSize() / 1024,
+                ((CrDom*)this)->_renderedBlockCache.getHits(),
+                ((CrDom*)this)->_renderedBlockCache.getMisses(),
                 _tinyElementCount,
                 _tinyElementCount * (sizeof(tinyElement) + 8 * 4) / 1024);
     CRLog::trace("Document memory usage:"
@@ -8469,4 +9312,59 @@ void CrDomBase::dumpStatistics() {
                 _tinyElementCount,
                 _tinyElementCount * (sizeof(tinyElement) + 8 * 4) / 1024);
 #endif //TINYNODECOLLECTION_DUMPSTATISTICS
+    dumpStorageStatistics("text", _textStorage);
+    dumpStorageStatistics("elem", _elemStorage);
+    dumpStorageStatistics("rect", _rectStorage);
+    dumpStorageStatistics("style", _styleStorage);
+}
+
+void CrDomBase::dumpStorageStatistics(const char * name, ldomDataStorageManager & storage)
+{
+    const ldomChunkCodecStats & stats = storage.getStats();
+    if (!stats.packCount && !stats.unpackCount)
+        return;
+    CRLog::debug("Storage %s: unpacked %d of %d kB, packed %u chunks (%u kB -> %u kB, ratio %d%%) in %u ms,"
+                " unpacked %u chunks in %u ms",
+                name,
+                storage.getUncompressedSize() / 1024,
+                storage.getMaxUncompressedSize() / 1024,
+                stats.packCount,
+                (lUInt32)(stats.packedBytes / 1024),
+                (lUInt32)(stats.compressedBytes / 1024),
+                stats.packedBytes ? (int)(stats.compressedBytes * 100 / stats.packedBytes) : 0,
+                (lUInt32)(stats.packTime / 1000),
+                stats.unpackCount,
+                (lUInt32)(stats.unpackTime / 1000));
+}
+
+const ldomChunkCodecStats & CrDomBase::getStorageStats(int index)
+{
+    switch (index) {
+    case 0:
+        return _textStorage.getStats();
+    case 1:
+        return _elemStorage.getStats();
+    case 2:
+        return _rectStorage.getStats();
+    default:
+        return _styleStorage.getStats();
+    }
+}
+
+void CrDomBase::setStorageBufferSize(int size)
+{
+    if (size <= 0)
+        size = DOC_BUFFER_SIZE;
+    _textStorage.setMaxUncompressedSize(TEXT_CACHE_UNPACKED_PERCENT * (size / 100));
+    _elemStorage.setMaxUncompressedSize(ELEM_CACHE_UNPACKED_PERCENT * (size / 100));
+    _rectStorage.setMaxUncompressedSize(RECT_CACHE_UNPACKED_PERCENT * (size / 100));
+    _styleStorage.setMaxUncompressedSize(STYLE_CACHE_UNPACKED_PERCENT * (size / 100));
+}
+
+void CrDomBase::setStorageCodec(int codec)
+{
+    _textStorage.setCodec(codec);
+    _elemStorage.setCodec(codec);
+    _rectStorage.setCodec(codec);
+    _styleStorage.setCodec(codec);
 }
\ No newline at end of file
@@ -28,3 +28,36 @@ int LvTocItem::getY()
 {
     return getXPointer().toPoint().y;
 }
+
+static const char * toc_magic = "TOC";
+
+bool LvTocItem::serialize(SerialBuf& buf)
+{
+    if (buf.error()) {
+        return false;
+    }
+    buf.putMagic(toc_magic);
+    buf << (lUInt32) _page << _name << getPath() << (lUInt32) _children.length();
+    for (int i = 0; i < _children.length(); i++) {
+        _children[i]->serialize(buf);
+    }
+    return !buf.error();
+}
+
+bool LvTocItem::deserialize(SerialBuf& buf)
+{
+    if (!buf.checkMagic(toc_magic)) {
+        return false;
+    }
+    lUInt32 page = 0;
+    lUInt32 count = 0;
+    buf >> page >> _name >> _path >> count;
+    _page = page;
+    _position = ldomXPointer();
+    for (lUInt32 i = 0; i < count && !buf.error(); i++) {
+        LvTocItem* item = new LvTocItem(ldomXPointer(), lString16::empty_str, lString16::empty_str);
+        addChild(item);
+        item->deserialize(buf);
+    }
+    return !buf.error();
+}
@@ -15,6 +15,7 @@
  */
 
 #include <stdlib.h>
+#include <algorithm>
 
 #include "StLog.h"
 #include "StProtocol.h"
@@ -29,6 +30,9 @@
 
 #define RES_DJVU_FAIL       255
 
+// Size of thumbnails DjVuLibre computes, larger ones are rendered from subsampled pages
+#define DJVU_THUMBNAIL_SIZE 128
+
 
 DjvuBridge::DjvuBridge() : StBridge("DjvuBridge")
 {
@@ -38,6 +42,14 @@ DjvuBridge::DjvuBridge() : StBridge("DjvuBridge")
     pages = NULL;
     info = NULL;
     outline = NULL;
+
+    prefetchPages = 2;
+    prefetchMemory = 32 * 1024 * 1024;
+    prefetchFrom = 0;
+    prefetchIndex = 0;
+    prefetching = NULL;
+    prefetchNo = 0;
+    pthread_mutex_init(&prefetchlock, NULL);
 }
 
 DjvuBridge::~DjvuBridge()
@@ -85,6 +97,8 @@ DjvuBridge::~DjvuBridge()
         ddjvu_context_release(context);
         context = NULL;
     }
+
+    pthread_mutex_destroy(&prefetchlock);
 }
 
 void DjvuBridge::process(CmdRequest& request, CmdResponse& response)
@@ -110,12 +124,30 @@ void DjvuBridge::process(CmdRequest& request, CmdResponse& response)
     case CMD_REQ_PAGE_RENDER:
         processPageRender(request, response);
         break;
+    case CMD_REQ_PAGE_TILE:
+        processPageTile(request, response);
+        break;
+    case CMD_REQ_THUMBNAILS:
+        processThumbnails(request, response);
+        break;
     case CMD_REQ_PAGE_FREE:
         processPageFree(request, response);
         break;
     case CMD_REQ_SMART_CROP:
         processSmartCrop(request, response);
         break;
+    case CMD_REQ_SET_CONFIG:
+        processConfig(request, response);
+        break;
+    case CMD_REQ_SEARCH:
+        processSearch(request, response, textIndex, pageCount);
+        break;
+    case CMD_REQ_CACHE_STATS:
+        processCacheStats(request, response);
+        break;
+    case CMD_REQ_SHARED_MEMORY:
+        processSharedMemory(request, response);
+        break;
     case CMD_REQ_PAGE_TEXT:
         processPageText(request, response);
         break;
@@ -294,6 +326,8 @@ void DjvuBridge::processPage(CmdRequest& request, CmdResponse& response)
         return;
     }
 
+    prefetchAround(pageNumber);
+
     ddjvu_pageinfo_t* i = getPageInfo(pageNumber);
     ddjvu_page_t* p = getPage(pageNumber, false);
 
@@ -335,11 +369,7 @@ void DjvuBridge::processPageFree(CmdRequest& request, CmdResponse& response)
         response.result = RES_BAD_REQ_DATA;
         return;
     }
-    if (pages[pageNumber])
-    {
-        ddjvu_page_release(pages[pageNumber]);
-        pages[pageNumber] = NULL;
-    }
+    releasePage(pageNumber);
 }
 
 void DjvuBridge::processPageRender(CmdRequest& request, CmdResponse& response)
@@ -379,7 +409,14 @@ void DjvuBridge::processPageRender(CmdRequest& request, CmdResponse& response)
     float pageSliceWidth = temp_config[2];
     float pageSliceHeight = temp_config[3];
 
+    prefetchAround(pageNumber);
+
     ddjvu_page_t* p = getPage(pageNumber, true);
+    if (p == NULL)
+    {
+        response.result = RES_DJVU_FAIL;
+        return;
+    }
 
     ddjvu_rect_t pageRect;
     pageRect.x = 0;
@@ -398,9 +435,15 @@ void DjvuBridge::processPageRender(CmdRequest& request, CmdResponse& response)
     ddjvu_format_set_row_order(pixelFormat, TRUE);
     ddjvu_format_set_y_direction(pixelFormat, TRUE);
 
-    int size = targetRect.w * targetRect.h * 4;
-    CmdData* resp = new CmdData();
-    char* pixels = (char*)resp->newByteArray(size);
+    StRenderTarget target;
+    char* pixels = (char*) target.allocate(shared, iter, targetWidth, targetHeight);
+    if (pixels == NULL)
+    {
+        ERROR_L(LCTX, "Bad render target");
+        ddjvu_format_release(pixelFormat);
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
 
     int result = ddjvu_page_render(
             pages[pageNumber],
@@ -414,14 +457,128 @@ void DjvuBridge::processPageRender(CmdRequest& request, CmdResponse& response)
     if (!result)
     {
         response.result = RES_DJVU_FAIL;
-        delete resp;
     }
     else
     {
-        response.addData(resp);
+        target.commit(response);
     }
 }
 
+void DjvuBridge::processPageTile(CmdRequest& request, CmdResponse& response)
+{
+    response.cmd = CMD_RES_PAGE_TILE;
+    if (request.dataCount == 0)
+    {
+        ERROR_L(LCTX, "No request data found");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+
+    uint32_t pageNumber, tileX, tileY, tileSize;
+    float zoom;
+
+    CmdDataIterator iter(request.first);
+    iter.getInt(&pageNumber)
+            .getFloat(&zoom)
+            .getInt(&tileX)
+            .getInt(&tileY)
+            .getInt(&tileSize);
+
+    if (!iter.isValid() || zoom <= 0 || tileSize < TILE_MIN_SIZE || tileSize > TILE_MAX_SIZE)
+    {
+        ERROR_L(LCTX, "Bad request data");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+    if (doc == NULL || pages == NULL)
+    {
+        ERROR_L(LCTX, "Document not yet opened");
+        response.result = RES_DUP_OPEN;
+        return;
+    }
+    if (pageNumber >= pageCount)
+    {
+        ERROR_L(LCTX, "Bad page index: %d", pageNumber);
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+
+    StRenderTarget target;
+    char* pixels = (char*) target.allocate(shared, iter, tileSize, tileSize);
+    if (pixels == NULL)
+    {
+        ERROR_L(LCTX, "Bad render target");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+
+    prefetchAround(pageNumber);
+
+    StTileKey key = StTileCache::key(pageNumber, zoom, tileX, tileY, tileSize);
+    uint32_t bytes = tileSize * tileSize * 4;
+    if (tiles.get(key, (uint8_t*) pixels, bytes))
+    {
+        target.commit(response);
+        return;
+    }
+
+    ddjvu_pageinfo_t* i = getPageInfo(pageNumber);
+    ddjvu_page_t* p = getPage(pageNumber, true);
+    if (i == NULL || p == NULL)
+    {
+        response.result = RES_DJVU_FAIL;
+        return;
+    }
+
+    // Tiles beyond the page edge are left white
+    memset(pixels, 0xFF, bytes);
+
+    int pageWidth = (int) (i->width * zoom);
+    int pageHeight = (int) (i->height * zoom);
+    int left = tileX * tileSize;
+    int top = tileY * tileSize;
+    if (left >= pageWidth || top >= pageHeight)
+    {
+        target.commit(response);
+        return;
+    }
+
+    ddjvu_rect_t pageRect;
+    pageRect.x = 0;
+    pageRect.y = 0;
+    pageRect.w = pageWidth;
+    pageRect.h = pageHeight;
+    ddjvu_rect_t targetRect;
+    targetRect.x = left;
+    targetRect.y = top;
+    targetRect.w = std::min((int) tileSize, pageWidth - left);
+    targetRect.h = std::min((int) tileSize, pageHeight - top);
+
+    unsigned int masks[] = { 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000 };
+    ddjvu_format_t* pixelFormat = ddjvu_format_create(DDJVU_FORMAT_RGBMASK32, 4, masks);
+
+    ddjvu_format_set_row_order(pixelFormat, TRUE);
+    ddjvu_format_set_y_direction(pixelFormat, TRUE);
+
+    int result = ddjvu_page_render(
+            p,
+            (ddjvu_render_mode_t) HARDCONFIG_DJVU_RENDERING_MODE,
+            &pageRect,
+            &targetRect,
+            pixelFormat, tileSize * 4, pixels);
+
+    ddjvu_format_release(pixelFormat);
+
+    if (!result)
+    {
+        response.result = RES_DJVU_FAIL;
+        return;
+    }
+
+    tiles.put(key, (uint8_t*) pixels, bytes);
+    target.commit(response);
+}
+
 void DjvuBridge::processOutline(CmdRequest& request, CmdResponse& response)
 {
     response.cmd = CMD_RES_OUTLINE;
@@ -469,6 +626,141 @@ void DjvuBridge::processPageText(CmdRequest& request, CmdResponse& response)
     processText((int) pageNo, (const char*) pattern, response);
 }
 
+void DjvuBridge::processThumbnails(CmdRequest& request, CmdResponse& response)
+{
+    response.cmd = CMD_RES_THUMBNAILS;
+    if (request.dataCount == 0)
+    {
+        ERROR_L(LCTX, "No request data found");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+
+    uint32_t first, count, maxWidth, maxHeight;
+
+    CmdDataIterator iter(request.first);
+    iter.getInt(&first)
+            .getInt(&count)
+            .getInt(&maxWidth)
+            .getInt(&maxHeight);
+
+    if (!iter.isValid() || count == 0 || count > THUMBNAILS_MAX_PAGES
+            || maxWidth == 0 || maxWidth > THUMBNAILS_MAX_SIZE
+            || maxHeight == 0 || maxHeight > THUMBNAILS_MAX_SIZE)
+    {
+        ERROR_L(LCTX, "Bad request data");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+    if (doc == NULL || pages == NULL)
+    {
+        ERROR_L(LCTX, "Document not yet opened");
+        response.result = RES_DUP_OPEN;
+        return;
+    }
+    if (first >= pageCount)
+    {
+        ERROR_L(LCTX, "Bad page index: %d", first);
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+    count = std::min(count, pageCount - first);
+
+    StBatchTarget batch;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ddjvu_pageinfo_t* info = getPageInfo(first + i);
+        uint32_t width, height;
+        fitThumbnail(info ? info->width : 0, info ? info->height : 0, maxWidth, maxHeight, &width, &height);
+        batch.add(first + i, width, height);
+    }
+
+    char* pixels = (char*) batch.allocate(shared, iter);
+    if (pixels == NULL)
+    {
+        ERROR_L(LCTX, "Bad render target");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+
+    unsigned int masks[] = { 0x000000FF, 0x0000FF00, 0x00FF0000, 0xFF000000 };
+    ddjvu_format_t* pixelFormat = ddjvu_format_create(DDJVU_FORMAT_RGBMASK32, 4, masks);
+
+    ddjvu_format_set_row_order(pixelFormat, TRUE);
+    ddjvu_format_set_y_direction(pixelFormat, TRUE);
+
+    bool stopped = false;
+    for (int i = 0; i < batch.getCount() && !stopped; i++)
+    {
+        if (info[batch.getPage(i)] == NULL
+                || !renderThumbnail(batch.getPage(i), batch.getWidth(i), batch.getHeight(i),
+                    (char*) batch.getPixels(i), pixelFormat))
+        {
+            batch.fail(i);
+        }
+        stopped = cancelled;
+    }
+
+    ddjvu_format_release(pixelFormat);
+
+    if (stopped)
+    {
+        // Stopped by CMD_REQ_CANCEL, the remaining thumbnails were not drawn
+        response.result = RES_CANCELLED;
+        return;
+    }
+    batch.commit(response);
+}
+
+bool DjvuBridge::renderThumbnail(uint32_t pageNo, uint32_t width, uint32_t height, char* pixels, ddjvu_format_t* format)
+{
+    memset(pixels, 0xFF, width * height * 4);
+
+    bool decoded = pages[pageNo] != NULL && ddjvu_page_decoding_status(pages[pageNo]) == DDJVU_JOB_OK;
+    if (!decoded && width <= DJVU_THUMBNAIL_SIZE && height <= DJVU_THUMBNAIL_SIZE)
+    {
+        // Embedded thumbnails, or ones DjVuLibre computes from a reduced decoding of the page
+        ddjvu_status_t r;
+        while ((r = ddjvu_thumbnail_status(doc, pageNo, TRUE)) < DDJVU_JOB_OK && !cancelled)
+        {
+            waitAndHandleMessages();
+        }
+        int w = width;
+        int h = height;
+        if (r == DDJVU_JOB_OK && ddjvu_thumbnail_render(doc, pageNo, &w, &h, format, width * 4, pixels))
+        {
+            return true;
+        }
+    }
+
+    // Subsampled rendering of the whole page, pages decoded just for that are released
+    bool loaded = pages[pageNo] != NULL;
+    ddjvu_page_t* p = getPage(pageNo, true);
+    if (p == NULL || ddjvu_page_decoding_status(p) != DDJVU_JOB_OK)
+    {
+        return false;
+    }
+
+    ddjvu_rect_t pageRect;
+    pageRect.x = 0;
+    pageRect.y = 0;
+    pageRect.w = width;
+    pageRect.h = height;
+
+    int result = ddjvu_page_render(
+            p,
+            (ddjvu_render_mode_t) HARDCONFIG_DJVU_RENDERING_MODE,
+            &pageRect,
+            &pageRect,
+            format, width * 4, pixels);
+
+    if (!loaded)
+    {
+        releasePage(pageNo);
+    }
+    return result != 0;
+}
+
 ddjvu_pageinfo_t* DjvuBridge::getPageInfo(uint32_t pageNo)
 {
     if (info[pageNo] == NULL)
@@ -494,6 +786,19 @@ ddjvu_pageinfo_t* DjvuBridge::getPageInfo(uint32_t pageNo)
 
 ddjvu_page_t* DjvuBridge::getPage(uint32_t pageNo, bool decode)
 {
+    if (pages[pageNo] != NULL && ddjvu_page_decoding_status(pages[pageNo]) == DDJVU_JOB_STOPPED)
+    {
+        // Background decoding was interrupted, start over
+        releasePage(pageNo);
+    }
+    if (pages[pageNo] != NULL && (!decode || ddjvu_page_decoding_status(pages[pageNo]) == DDJVU_JOB_OK))
+    {
+        pageCache.recordHit();
+    }
+    else
+    {
+        pageCache.recordMiss();
+    }
     if (pages[pageNo] == NULL)
     {
         pages[pageNo] = ddjvu_page_create_by_pageno(doc, pageNo);
@@ -506,14 +811,246 @@ ddjvu_page_t* DjvuBridge::getPage(uint32_t pageNo, bool decode)
         {
             waitAndHandleMessages();
         }
+        if (r == DDJVU_JOB_STOPPED)
+        {
+            // Prefetch of this page was preempted before the request, decode it again
+            releasePage(pageNo);
+            pages[pageNo] = ddjvu_page_create_by_pageno(doc, pageNo);
+            if (pages[pageNo] == NULL)
+            {
+                return NULL;
+            }
+            while ((r = ddjvu_page_decoding_status(pages[pageNo])) < DDJVU_JOB_OK)
+            {
+                waitAndHandleMessages();
+            }
+        }
         if (r != DDJVU_JOB_OK)
         {
             ERROR_L(LCTX, "Cannot decode page: %d %d", pageNo, r);
+            releasePage(pageNo);
+            return NULL;
+        }
+        // A prefetch kept running for this request is done, idle() must not requeue it as old
+        pthread_mutex_lock(&prefetchlock);
+        if (prefetching == pages[pageNo])
+        {
+            prefetching = NULL;
         }
+        pthread_mutex_unlock(&prefetchlock);
     }
+
+    pageCache.put(pageNo, pageMemory(pages[pageNo]));
+    trimPages(pageNo);
+
     return pages[pageNo];
 }
 
+size_t DjvuBridge::pageMemory(ddjvu_page_t* page)
+{
+    if (page == NULL || ddjvu_page_decoding_status(page) != DDJVU_JOB_OK)
+    {
+        return 0;
+    }
+    // Rough estimate: one byte per pixel covers JB2 masks plus IW44 coefficients of typical scans
+    return (size_t) ddjvu_page_get_width(page) * ddjvu_page_get_height(page);
+}
+
+void DjvuBridge::trimPages(uint32_t keepNo)
+{
+    uint32_t pageNo;
+    while (pageCache.evict(keepNo, &pageNo))
+    {
+        DEBUG_L(L_DEBUG, LCTX, "Evict page: %d", pageNo);
+        releasePage(pageNo);
+    }
+}
+
+void DjvuBridge::releasePage(uint32_t pageNo)
+{
+    if (pages[pageNo] == NULL)
+    {
+        return;
+    }
+    pthread_mutex_lock(&prefetchlock);
+    if (prefetching == pages[pageNo])
+    {
+        prefetching = NULL;
+    }
+    pthread_mutex_unlock(&prefetchlock);
+
+    ddjvu_page_release(pages[pageNo]);
+    pages[pageNo] = NULL;
+    pageCache.remove(pageNo);
+}
+
+void DjvuBridge::processConfig(CmdRequest& request, CmdResponse& response)
+{
+    response.cmd = CMD_RES_SET_CONFIG;
+    CmdDataIterator iter(request.first);
+
+    while (iter.hasNext())
+    {
+        uint32_t key;
+        uint8_t* temp_val;
+        iter.getInt(&key).getByteArray(&temp_val);
+        if (!iter.isValid())
+        {
+            response.result = RES_BAD_REQ_DATA;
+            return;
+        }
+        const char* val = reinterpret_cast<const char*>(temp_val);
+
+        if (key == CONFIG_PREFETCH_PAGES)
+        {
+            int int_val = atoi(val);
+            prefetchPages = int_val < 0 ? 0 : int_val > PREFETCH_PAGES_MAX ? PREFETCH_PAGES_MAX : int_val;
+        }
+        else if (key == CONFIG_PREFETCH_MEMORY)
+        {
+            int int_val = atoi(val);
+            prefetchMemory = (size_t) (int_val < 0 ? 0 : int_val) * 1024 * 1024;
+        }
+        else if (key == CONFIG_PAGE_CACHE_MEMORY)
+        {
+            pageCache.setBudget((size_t) atoi(val) * 1024 * 1024);
+        }
+        else
+        {
+            ERROR_L(LCTX, "processConfig unknown key: key=%d, val=%s", key, val);
+        }
+    }
+    response.addInt(pageCount);
+}
+
+void DjvuBridge::processCacheStats(CmdRequest& request, CmdResponse& response)
+{
+    response.cmd = CMD_RES_CACHE_STATS;
+
+    // Page cache counters first, then tile cache used bytes, hits, misses and evictions
+    pageCache.addStats(response);
+    response.addInt(tiles.getUsed());
+    response.addInt(tiles.getHits());
+    response.addInt(tiles.getMisses());
+    response.addInt(tiles.getEvictions());
+}
+
+void DjvuBridge::prefetchAround(uint32_t pageNo)
+{
+    pageCache.pin(pageNo);
+    prefetchFrom = pageNo;
+    prefetchIndex = 0;
+}
+
+bool DjvuBridge::idle()
+{
+    if (doc == NULL || pages == NULL)
+    {
+        return false;
+    }
+
+    if (prefetching != NULL)
+    {
+        // Decoding runs on the ddjvu thread, here we only pump messages until it settles
+        if (ddjvu_page_decoding_status(prefetching) < DDJVU_JOB_OK)
+        {
+            waitAndHandleMessages();
+            return true;
+        }
+
+        if (ddjvu_page_decoding_status(prefetching) == DDJVU_JOB_STOPPED)
+        {
+            // Preempted by a request, the page is unusable and is decoded again on demand
+            releasePage(prefetchNo);
+            return true;
+        }
+
+        pageCache.put(prefetchNo, pageMemory(prefetching), false);
+
+        pthread_mutex_lock(&prefetchlock);
+        prefetching = NULL;
+        pthread_mutex_unlock(&prefetchlock);
+
+        trimPages(prefetchNo);
+        return true;
+    }
+
+    // Neighbours are visited nearest first: N+1, N-1, N+2, N-2, ...
+    while (prefetchIndex < 2 * prefetchPages)
+    {
+        uint32_t distance = prefetchIndex / 2 + 1;
+        int64_t pageNo = (prefetchIndex % 2) == 0 ? (int64_t) prefetchFrom + distance : (int64_t) prefetchFrom - distance;
+        prefetchIndex++;
+
+        if (pageNo < 0 || pageNo >= pageCount || pages[pageNo] != NULL)
+        {
+            continue;
+        }
+        if (pageCache.getUsed() >= prefetchMemory)
+        {
+            return false;
+        }
+
+        DEBUG_L(L_DEBUG, LCTX, "Prefetch page: %d", (int) pageNo);
+
+        ddjvu_page_t* page = ddjvu_page_create_by_pageno(doc, (uint32_t) pageNo);
+        if (page == NULL)
+        {
+            continue;
+        }
+        pages[pageNo] = page;
+        pageCache.put((uint32_t) pageNo, 0, false);
+        pthread_mutex_lock(&prefetchlock);
+        prefetching = page;
+        prefetchNo = (uint32_t) pageNo;
+        pthread_mutex_unlock(&prefetchlock);
+        return true;
+    }
+    return false;
+}
+
+void DjvuBridge::preemptIdle(const CmdRequest& request)
+{
+    // Prefetch decodes on the ddjvu thread, only requests waiting for that thread are slowed down
+    switch (request.cmd)
+    {
+    case CMD_REQ_ALIVE:
+    case CMD_REQ_SET_CONFIG:
+    case CMD_REQ_CACHE_STATS:
+    case CMD_REQ_SHARED_MEMORY:
+    case CMD_REQ_PAGE_FREE:
+    case CMD_REQ_PROTOCOL:
+        return;
+    default:
+        break;
+    }
+
+    // The page being prefetched is usually the one requested next, its decoding is kept
+    bool samePage = false;
+    uint32_t pageNo = 0;
+    switch (request.cmd)
+    {
+    case CMD_REQ_PAGE_INFO:
+    case CMD_REQ_PAGE:
+    case CMD_REQ_LINKS:
+    case CMD_REQ_PAGE_RENDER:
+    case CMD_REQ_PAGE_TILE:
+    case CMD_REQ_SMART_CROP:
+    case CMD_REQ_PAGE_TEXT:
+        samePage = CmdDataIterator(request.first).getInt(&pageNo).isValid();
+        break;
+    default:
+        break;
+    }
+
+    pthread_mutex_lock(&prefetchlock);
+    if (prefetching != NULL && !(samePage && pageNo == prefetchNo))
+    {
+        ddjvu_job_stop(ddjvu_page_job(prefetching));
+    }
+    pthread_mutex_unlock(&prefetchlock);
+}
+
 void DjvuBridge::waitAndHandleMessages()
 {
 // Wait for first message
@@ -609,6 +1146,10 @@ void DjvuBridge::processSmartCrop(CmdRequest& request, CmdResponse& response)
     float slice_h = slice_b - slice_t;
 
     ddjvu_page_t* p = getPage(page_index, true);
+    if (p == NULL) {
+        response.result = RES_DJVU_FAIL;
+        return;
+    }
 
     ddjvu_rect_t pageRect;
     pageRect.x = 0;
@@ -22,6 +22,10 @@
 #include "DjvuOutline.h"
 
 #include "StBridge.h"
+#include "StTileCache.h"
+#include "StPageCache.h"
+
+struct TextSink;
 
 class DjvuBridge : public StBridge
 {
@@ -35,6 +39,23 @@ private:
 
     DjvuOutline* outline;
 
+    StTileCache tiles;
+    StPageCache pageCache;
+    StTextIndex textIndex;
+
+    uint32_t prefetchPages;
+    size_t prefetchMemory;
+    uint32_t prefetchFrom;
+    uint32_t prefetchIndex;
+
+    /**
+     * Page being decoded in the background, guarded by prefetchlock
+     * as it is stopped from the request reader thread.
+     */
+    ddjvu_page_t* prefetching;
+    uint32_t prefetchNo;
+    pthread_mutex_t prefetchlock;
+
 public:
     DjvuBridge();
     ~DjvuBridge();
@@ -48,19 +69,33 @@ protected:
     void processPage(CmdRequest& request, CmdResponse& response);
     void processPageLinks(CmdRequest& request, CmdResponse& response);
     void processPageRender(CmdRequest& request, CmdResponse& response);
+    void processPageTile(CmdRequest& request, CmdResponse& response);
+    void processThumbnails(CmdRequest& request, CmdResponse& response);
     void processSmartCrop(CmdRequest& request, CmdResponse& response);
     void processPageFree(CmdRequest& request, CmdResponse& response);
     void processOutline(CmdRequest& request, CmdResponse& response);
     void processPageText(CmdRequest& request, CmdResponse& response);
+    void processConfig(CmdRequest& request, CmdResponse& response);
+    void processCacheStats(CmdRequest& request, CmdResponse& response);
 
     ddjvu_pageinfo_t* getPageInfo(uint32_t pageNo);
     ddjvu_page_t* getPage(uint32_t pageNo, bool decode);
+    void releasePage(uint32_t pageNo);
+    void trimPages(uint32_t keepNo);
+    size_t pageMemory(ddjvu_page_t* page);
+    bool renderThumbnail(uint32_t pageNo, uint32_t width, uint32_t height, char* pixels, ddjvu_format_t* format);
 
     void processLinks(int pageNo, CmdResponse& response);
     void processText(int pageNo, const char* pattern, CmdResponse& response);
+    void extractText(int pageNo, TextSink& sink);
+    void indexText(uint32_t pageNo, StTextIndex& index);
 
     void waitAndHandleMessages();
     void handleMessages();
+
+    void prefetchAround(uint32_t pageNo);
+    bool idle();
+    void preemptIdle(const CmdRequest& request);
 };
 
 #endif
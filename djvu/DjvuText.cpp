@@ -24,7 +24,17 @@
 #define LCTX "EBookDroid.DJVU.Decoder.Search"
 #define L_DEBUG_TEXT false
 
-void djvu_get_djvu_words(miniexp_t expr, const char* pattern, ddjvu_pageinfo_t *pi, CmdResponse& response)
+/**
+ * Destination of extracted words: the page text response or the search index.
+ */
+struct TextSink
+{
+    CmdResponse* response;
+    StTextIndex* index;
+    uint32_t page;
+};
+
+void djvu_get_djvu_words(miniexp_t expr, ddjvu_pageinfo_t *pi, TextSink& sink)
 {
     if (!miniexp_consp(expr))
     {
@@ -68,15 +78,22 @@ void djvu_get_djvu_words(miniexp_t expr, const char* pattern, ddjvu_pageinfo_t *
 
             float t = 1.0 - coords[1] / height;
             float b = 1.0 - coords[3] / height;
-            response.addFloat(coords[0] / width);
-            response.addFloat(t < b ? t : b);
-            response.addFloat(coords[2] / width);
-            response.addFloat(t > b ? t : b);
-            response.addIpcString(text, true);
+            if (sink.index != NULL)
+            {
+                sink.index->addWord(sink.page, text, coords[0] / width, t < b ? t : b, coords[2] / width, t > b ? t : b);
+            }
+            else
+            {
+                sink.response->addFloat(coords[0] / width);
+                sink.response->addFloat(t < b ? t : b);
+                sink.response->addFloat(coords[2] / width);
+                sink.response->addFloat(t > b ? t : b);
+                sink.response->addIpcString(text, true);
+            }
         }
         else if (miniexp_consp(head))
         {
-            djvu_get_djvu_words(head, pattern, pi, response);
+            djvu_get_djvu_words(head, pi, sink);
         }
 
         expr = miniexp_cdr(expr);
@@ -84,6 +101,22 @@ void djvu_get_djvu_words(miniexp_t expr, const char* pattern, ddjvu_pageinfo_t *
 }
 
 void DjvuBridge::processText(int pageNo, const char* pattern, CmdResponse& response)
+{
+    TextSink sink = { &response, NULL, 0 };
+    extractText(pageNo, sink);
+}
+
+void DjvuBridge::indexText(uint32_t pageNo, StTextIndex& index)
+{
+    if (pageNo >= pageCount)
+    {
+        return;
+    }
+    TextSink sink = { NULL, &index, pageNo };
+    extractText(pageNo, sink);
+}
+
+void DjvuBridge::extractText(int pageNo, TextSink& sink)
 {
     ddjvu_pageinfo_t *pi = getPageInfo(pageNo);
     if (pi == NULL)
@@ -107,7 +140,7 @@ void DjvuBridge::processText(int pageNo, const char* pattern, CmdResponse& respo
 
     DEBUG_L(L_DEBUG_TEXT, LCTX, "processText: text found on page %d", pageNo);
 
-    djvu_get_djvu_words(r, pattern, pi, response);
+    djvu_get_djvu_words(r, pi, sink);
 
     ddjvu_miniexp_release(doc, r);
 }
@@ -638,6 +638,13 @@ private:
 
    GMonitor		chunk_mon, finish_mon;
 
+   // EBD: concurrent JB2 mask decoding >>>
+      // Sjbz mask being decoded on its own thread
+   class MaskJob;
+   GP<MaskJob>		mask_job;
+   void		finish_mask_job(bool rethrow);
+   // EBD: concurrent JB2 mask decoding <<<
+
       // Functions called when the decoding thread starts
    static void	static_decode_func(void *);
    void	decode_func(void);
@@ -260,6 +260,11 @@ DjVuFile::~DjVuFile(void)
   // which will be very-very bad as we're being destroyed
   get_portcaster()->del_port(this);
   
+  // EBD: concurrent JB2 mask decoding >>>
+  // The mask thread uses this object: wait for one left behind
+  finish_mask_job(false);
+  // EBD: concurrent JB2 mask decoding <<<
+  
   // Unregister the trigger (we don't want it to be called and attempt
   // to access the destroyed object)
   if (data_pool)
@@ -838,6 +843,78 @@ is_meta(const GUTF8String &chkid)
 }
 
 
+// EBD: concurrent JB2 mask decoding >>>
+// The Sjbz mask does not depend on the IW44 layers, so it is decoded
+// on its own thread while the decoding thread carries on with the
+// BG44/FG44 chunks.  decode() joins it before the page is complete.
+class DjVuFile::MaskJob : public GPEnabled
+{
+public:
+  MaskJob(void) : file(0), desc_pos(0), failed(false), done(false) {}
+  static void run(void *arg);
+
+  DjVuFile *file;
+  GP<ByteStream> gbs;
+  GP<JB2Image> fgjb;
+  int desc_pos;
+  GException ex;
+  bool failed;
+  bool done;
+  GMonitor mon;
+  GThread thread;
+};
+
+void
+DjVuFile::MaskJob::run(void *arg)
+{
+  // Hold a reference until the monitor has been released
+  GP<MaskJob> job = (MaskJob*)arg;
+  G_TRY
+  {
+    job->fgjb->decode(job->gbs, static_get_fgjd, (void*)job->file);
+  }
+  G_CATCH(exc)
+  {
+    job->ex = exc;
+    job->failed = true;
+  }
+  G_ENDCATCH;
+  job->gbs = 0;
+  GMonitorLock lock(&job->mon);
+  job->done = true;
+  job->mon.broadcast();
+}
+
+void
+DjVuFile::finish_mask_job(bool rethrow)
+{
+  GP<MaskJob> job = mask_job;
+  if (! job)
+    return;
+  {
+    GMonitorLock lock(&job->mon);
+    while (! job->done)
+      job->mon.wait();
+  }
+  mask_job = 0;
+  if (job->failed)
+  {
+    if (rethrow)
+      throw GException(job->ex);
+    return;
+  }
+  GP<JB2Image> fgjb = job->fgjb;
+  this->fgjb = fgjb;
+  GUTF8String desc;
+  desc.format( ERR_MSG("DjVuFile.fg_mask") "\t%d\t%d\t%d",
+    fgjb->get_width(), fgjb->get_height(),
+    get_dpi(fgjb->get_width(), fgjb->get_height()));
+  description = description.substr(0, job->desc_pos) + desc
+    + description.substr(job->desc_pos, description.length() - job->desc_pos);
+  get_portcaster()->notify_chunk_done(this, "Sjbz");
+}
+// EBD: concurrent JB2 mask decoding <<<
+
 GUTF8String
 DjVuFile::decode_chunk( const GUTF8String &id, const GP<ByteStream> &gbs,
   bool djvi, bool djvu, bool iw44)
@@ -922,14 +999,28 @@ DjVuFile::decode_chunk( const GUTF8String &id, const GP<ByteStream> &gbs,
   // Sjbz (JB2 encoded mask)
   else if (chkid=="Sjbz" && (djvu || djvi))
   {
-    if (this->fgjb)
+    if (this->fgjb || mask_job)
       G_THROW( ERR_MSG("DjVuFile.dupl_Sxxx") );
     GP<JB2Image> fgjb=JB2Image::create();
     // ---- begin hack
     if (info && info->version <=18)
       fgjb->reproduce_old_bug = true;
     // ---- end hack
-    fgjb->decode(gbs, static_get_fgjd, (void*)this);
+    // EBD: concurrent JB2 mask decoding >>>
+    // The chunk is copied since the IFF stream moves on to the next chunks
+    GP<MaskJob> job = new MaskJob();
+    job->file = this;
+    job->fgjb = fgjb;
+    job->gbs = ByteStream::create();
+    job->gbs->copy(*gbs);
+    job->gbs->seek(0);
+    job->desc_pos = description.length();
+    mask_job = job;
+    if (job->thread.create(MaskJob::run, (void*)(MaskJob*)job) == 0)
+      return GUTF8String();
+    mask_job = 0;
+    fgjb->decode(job->gbs, static_get_fgjd, (void*)this);
+    // EBD: concurrent JB2 mask decoding <<<
     this->fgjb = fgjb;
     desc.format( ERR_MSG("DjVuFile.fg_mask") "\t%d\t%d\t%d",
       fgjb->get_width(), fgjb->get_height(),
@@ -939,7 +1030,7 @@ DjVuFile::decode_chunk( const GUTF8String &id, const GP<ByteStream> &gbs,
   // Smmr (MMR-G4 encoded mask)
   else if (chkid=="Smmr" && (djvu || djvi))
   {
-    if (this->fgjb)
+    if (this->fgjb || mask_job)
       G_THROW( ERR_MSG("DjVuFile.dupl_Sxxx") );
     set_can_compress(true);
     this->fgjb = MMRDecoder::decode(gbs);
@@ -1259,16 +1350,27 @@ DjVuFile::decode(const GP<ByteStream> &gbs)
       // Append the whole thing to the growing file description
       description = description + str + desc + "\n";
 
-      pcaster->notify_chunk_done(this, chkid);
+      // EBD: concurrent JB2 mask decoding >>>
+      // A mask still being decoded is announced by finish_mask_job()
+      if (chkid != "Sjbz" || ! mask_job)
+        pcaster->notify_chunk_done(this, chkid);
+      // EBD: concurrent JB2 mask decoding <<<
       // Close chunk
       iff.seek_close_chunk();
       // Record file size
       size_so_far=iff.tell();
     }
+    // EBD: concurrent JB2 mask decoding >>>
+    finish_mask_job(true);
+    // EBD: concurrent JB2 mask decoding <<<
     if (chunks_number < 0) chunks_number=last_chunk;
   }
   G_CATCH(ex)
   {
+    // EBD: concurrent JB2 mask decoding >>>
+    // Never leave the mask thread running past decode()
+    finish_mask_job(false);
+    // EBD: concurrent JB2 mask decoding <<<
     if(!ex.cmp_cause(ByteStream::EndOfFile))
     {
       if (chunks_number < 0)
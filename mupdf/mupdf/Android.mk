@@ -31,7 +31,8 @@ LOCAL_SRC_FILES := \
 	MuPdfLinks.cpp \
 	MuPdfOutline.cpp \
 	MuPdfText.cpp \
-	MuPdfFonts.cpp
+	MuPdfFonts.cpp \
+	MuPdfRenderPool.cpp
 	
 LOCAL_SRC_FILES += \
 	pdf/js/pdf-js-none.c \
@@ -170,6 +171,13 @@ LOCAL_SRC_FILES += \
 	fitz/ucdn.c \
 	fitz/unzip.c \
 	fitz/xml.c
+
+# Span painters pick NEON at runtime, so armeabi-v7a builds this file with -mfpu=neon
+ifneq ($(filter armeabi-v7a%,$(TARGET_ARCH_ABI)),)
+LOCAL_SRC_FILES += fitz/draw-simd.c.neon
+else
+LOCAL_SRC_FILES += fitz/draw-simd.c
+endif # TARGET_ARCH_ABI == armeabi-v7a
 	
 LOCAL_STATIC_LIBRARIES := thornyreader thornyhelper freetype jpeg-turbo jbig2dec openjpeg
 
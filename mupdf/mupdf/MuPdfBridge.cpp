@@ -51,10 +51,40 @@ void sig_handler(int signo)
     exit(-1);
 }
 
+/**
+ * Opens document on a stream of the mapped file, the document keeps its own stream reference.
+ */
+static fz_document* openDocument(fz_context* ctx, fz_file_mapping* mapping, int format)
+{
+    fz_document* doc = NULL;
+    fz_stream* stream = fz_open_file_mapping(ctx, mapping);
+    fz_try(ctx)
+    {
+        if (format == FORMAT_XPS)
+        {
+            doc = (fz_document*) xps_open_document_with_stream(ctx, stream);
+        }
+        else
+        {
+            doc = (fz_document*) pdf_open_document_with_stream(ctx, stream);
+        }
+    }
+    fz_always(ctx)
+    {
+        fz_drop_stream(ctx, stream);
+    }
+    fz_catch(ctx)
+    {
+        fz_rethrow(ctx);
+    }
+    return doc;
+}
+
 MuPdfBridge::MuPdfBridge() : StBridge("MuPdfBridge")
 {
     fd = -1;
     password = NULL;
+    mapping = NULL;
     ctx = NULL;
     document = NULL;
     outline = NULL;
@@ -64,6 +94,12 @@ MuPdfBridge::MuPdfBridge() : StBridge("MuPdfBridge")
     storememory = 64 * 1024 * 1024;
     format = 0;
     layersmask = -1;
+    memset(&cookie, 0, sizeof(cookie));
+    memset(&idleCookie, 0, sizeof(idleCookie));
+    prefetchPages = 2;
+    prefetchMemory = 16 * 1024 * 1024;
+    prefetchFrom = 0;
+    prefetchIndex = 0;
     resetFonts();
 
     // if ((defaultHandler = signal(SIGSEGV, sig_handler)) == SIG_ERR)
@@ -82,6 +118,12 @@ MuPdfBridge::~MuPdfBridge()
 
     release();
 
+    if (mapping)
+    {
+        fz_drop_file_mapping(NULL, mapping);
+        mapping = NULL;
+    }
+
     if (password)
     {
         free(password);
@@ -113,6 +155,12 @@ void MuPdfBridge::process(CmdRequest& request, CmdResponse& response)
     case CMD_REQ_PAGE_RENDER:
         processPageRender(request, response);
         break;
+    case CMD_REQ_PAGE_TILE:
+        processPageTile(request, response);
+        break;
+    case CMD_REQ_THUMBNAILS:
+        processThumbnails(request, response);
+        break;
     case CMD_REQ_PAGE_FREE:
         processPageFree(request, response);
         break;
@@ -149,6 +197,15 @@ void MuPdfBridge::process(CmdRequest& request, CmdResponse& response)
     case CMD_REQ_SMART_CROP:
         processSmartCrop(request, response);
         break;
+    case CMD_REQ_SEARCH:
+        processSearch(request, response, textIndex, pageCount);
+        break;
+    case CMD_REQ_CACHE_STATS:
+        processCacheStats(request, response);
+        break;
+    case CMD_REQ_SHARED_MEMORY:
+        processSharedMemory(request, response);
+        break;
     case CMD_REQ_ALIVE:
         response.cmd = CMD_RES_ALIVE;
         break;
@@ -282,7 +339,7 @@ void MuPdfBridge::processOpen(CmdRequest& request, CmdResponse& response)
     if (ctx == NULL)
     {
         DEBUG_L(L_DEBUG, LCTX, "Creating context: storememory = %d", storememory);
-        ctx = fz_new_context(NULL, NULL, storememory);
+        ctx = fz_new_context(NULL, MuPdfRenderPool::locks(), storememory);
         if (!ctx)
         {
             ERROR_L(LCTX, "Out of Memory");
@@ -292,6 +349,8 @@ void MuPdfBridge::processOpen(CmdRequest& request, CmdResponse& response)
         ctx->ebookdroid_linearized_load = 0;
         ctx->ebookdroid_ignore_most_errors = 1;
         ctx->ebookdroid_hasPassword = (this->password && strlen(this->password));
+
+        pool.start(ctx);
     }
 
     if (document == NULL)
@@ -301,14 +360,13 @@ void MuPdfBridge::processOpen(CmdRequest& request, CmdResponse& response)
         INFO_L(LCTX, ctx->ebookdroid_hasPassword ? "Password present" : "No password");
         fz_try(ctx)
                 {
-                    if (format == FORMAT_XPS)
+                    if (mapping)
                     {
-                        document = (fz_document*) xps_open_document_with_stream(ctx, fz_open_fd(ctx, dup(fd)));
-                    }
-                    else
-                    {
-                        document = (fz_document*) pdf_open_document_with_stream(ctx, fz_open_fd(ctx, dup(fd)));
+                        fz_drop_file_mapping(ctx, mapping);
+                        mapping = NULL;
                     }
+                    mapping = fz_new_file_mapping(ctx, dup(fd));
+                    document = openDocument(ctx, mapping, format);
                 }fz_catch(ctx)
         {
             const char* msg = fz_caught_message(ctx);
@@ -476,6 +534,8 @@ void MuPdfBridge::processPage(CmdRequest& request, CmdResponse& response)
     }
 #endif
 
+    prefetchAround(pageNumber);
+
     fz_page* p = getPage(pageNumber, true);
     if (p == NULL)
     {
@@ -522,29 +582,7 @@ void MuPdfBridge::processPageFree(CmdRequest& request, CmdResponse& response)
     }
 #endif
 
-    if (pageLists[pageNumber]) {
-        fz_try(ctx)
-        {
-        	fz_drop_display_list(ctx, pageLists[pageNumber]);
-        }fz_catch(ctx)
-        {
-            const char* msg = fz_caught_message(ctx);
-            ERROR_L(LCTX, "%s", msg);
-        }
-    	pageLists[pageNumber] = NULL;
-    }
-
-    if (pages[pageNumber]) {
-        fz_try(ctx)
-        {
-        	fz_drop_page(ctx, pages[pageNumber]);
-        }fz_catch(ctx)
-        {
-            const char* msg = fz_caught_message(ctx);
-            ERROR_L(LCTX, "%s", msg);
-        }
-    	pages[pageNumber] = NULL;
-    }
+    releasePage(pageNumber);
 }
 
 /*
@@ -610,6 +648,8 @@ void MuPdfBridge::processPageRender(CmdRequest& request, CmdResponse& response)
     }
 #endif
 
+    prefetchAround(page_index);
+
     fz_page* page = getPage(page_index, true);
 
     if (!page || !pageLists[page_index])
@@ -626,17 +666,267 @@ void MuPdfBridge::processPageRender(CmdRequest& request, CmdResponse& response)
     ctm.e = matrix[4];
     ctm.f = matrix[5];
 
-    fz_rect viewbox;
-    viewbox.x0 = 0;
-    viewbox.y0 = 0;
-    viewbox.x1 = width;
-    viewbox.y1 = height;
+    StRenderTarget target;
+    unsigned char* pixels = target.allocate(shared, iter, width, height);
+    if (pixels == NULL)
+    {
+        ERROR_L(LCTX, "Bad render target");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+
+    if (renderList(pageLists[page_index], ctm, width, height, pixels))
+    {
+        if (cookie.abort)
+        {
+            // Drawing stopped by CMD_REQ_CANCEL, the bitmap is incomplete
+            response.result = RES_CANCELLED;
+            return;
+        }
+        target.commit(response);
+    }
+    else
+    {
+        response.result = RES_MUPDF_FAIL;
+    }
+}
+
+void MuPdfBridge::processPageTile(CmdRequest& request, CmdResponse& response)
+{
+    response.cmd = CMD_RES_PAGE_TILE;
+    if (request.dataCount == 0)
+    {
+        ERROR_L(LCTX, "No request data found");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+    if (document == NULL || pages == NULL)
+    {
+        ERROR_L(LCTX, "Document not yet opened");
+        response.result = RES_DUP_OPEN;
+        return;
+    }
+
+    uint32_t page_index;
+    float zoom;
+    uint32_t tile_x;
+    uint32_t tile_y;
+    uint32_t tile_size;
+
+    CmdDataIterator iter(request.first);
+    iter.getInt(&page_index).getFloat(&zoom).getInt(&tile_x).getInt(&tile_y).getInt(&tile_size);
+
+    if (!iter.isValid() || zoom <= 0 || tile_size < TILE_MIN_SIZE || tile_size > TILE_MAX_SIZE)
+    {
+        ERROR_L(LCTX, "Bad request data");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+    if (page_index >= pageCount)
+    {
+        ERROR_L(LCTX, "Bad page index: %d", page_index);
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+
+    StRenderTarget target;
+    unsigned char* pixels = target.allocate(shared, iter, tile_size, tile_size);
+    if (pixels == NULL)
+    {
+        ERROR_L(LCTX, "Bad render target");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+
+    prefetchAround(page_index);
+
+    StTileKey key = StTileCache::key(page_index, zoom, tile_x, tile_y, tile_size);
+    uint32_t bytes = tile_size * tile_size * 4;
+    if (tiles.get(key, pixels, bytes))
+    {
+        target.commit(response);
+        return;
+    }
+
+    fz_page* page = getPage(page_index, true);
+    if (!page || !pageLists[page_index])
+    {
+        response.result = RES_MUPDF_PAGE_CAN_NOT_BE_RENDERED;
+        return;
+    }
+
+    fz_rect bounds = fz_empty_rect;
+    fz_try(ctx)
+    {
+        fz_bound_page(ctx, page, &bounds);
+    }
+    fz_catch(ctx)
+    {
+        ERROR_L(LCTX, "%s", fz_caught_message(ctx));
+        response.result = RES_MUPDF_FAIL;
+        return;
+    }
+
+    // Page origin to (0, 0), zoom, then shift the tile origin to (0, 0)
+    fz_matrix ctm;
+    fz_matrix scale;
+    fz_translate(&ctm, -bounds.x0, -bounds.y0);
+    fz_concat(&ctm, &ctm, fz_scale(&scale, zoom, zoom));
+    ctm.e -= (float) tile_x * tile_size;
+    ctm.f -= (float) tile_y * tile_size;
+
+    if (renderList(pageLists[page_index], ctm, tile_size, tile_size, pixels))
+    {
+        if (cookie.abort)
+        {
+            // Drawing stopped by CMD_REQ_CANCEL, the tile is incomplete and isn't cached
+            response.result = RES_CANCELLED;
+            return;
+        }
+        tiles.put(key, pixels, bytes);
+        target.commit(response);
+    }
+    else
+    {
+        response.result = RES_MUPDF_FAIL;
+    }
+}
+
+void MuPdfBridge::processThumbnails(CmdRequest& request, CmdResponse& response)
+{
+    response.cmd = CMD_RES_THUMBNAILS;
+    if (request.dataCount == 0)
+    {
+        ERROR_L(LCTX, "No request data found");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+    if (document == NULL || pages == NULL)
+    {
+        ERROR_L(LCTX, "Document not yet opened");
+        response.result = RES_DUP_OPEN;
+        return;
+    }
+
+    uint32_t first;
+    uint32_t count;
+    uint32_t max_width;
+    uint32_t max_height;
+
+    CmdDataIterator iter(request.first);
+    iter.getInt(&first).getInt(&count).getInt(&max_width).getInt(&max_height);
+
+    if (!iter.isValid() || first >= pageCount || count == 0 || count > THUMBNAILS_MAX_PAGES
+            || max_width == 0 || max_width > THUMBNAILS_MAX_SIZE
+            || max_height == 0 || max_height > THUMBNAILS_MAX_SIZE)
+    {
+        ERROR_L(LCTX, "Bad request data");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+    if (count > pageCount - first)
+    {
+        count = pageCount - first;
+    }
+
+    // Pages loaded just for thumbnails are released, their display lists are never built
+    std::vector<bool> loaded(count);
+    std::vector<fz_rect> bounds(count, fz_empty_rect);
+    StBatchTarget batch;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t pageNo = first + i;
+        loaded[i] = pages[pageNo] != NULL;
+        fz_page* page = getPage(pageNo, false);
+        if (page != NULL)
+        {
+            fz_try(ctx)
+            {
+                fz_bound_page(ctx, page, &bounds[i]);
+            }
+            fz_catch(ctx)
+            {
+                ERROR_L(LCTX, "%s", fz_caught_message(ctx));
+            }
+        }
+        uint32_t width, height;
+        fitThumbnail(bounds[i].x1 - bounds[i].x0, bounds[i].y1 - bounds[i].y0, max_width, max_height, &width, &height);
+        batch.add(pageNo, width, height);
+    }
+
+    if (batch.allocate(shared, iter) == NULL)
+    {
+        ERROR_L(LCTX, "Bad render target");
+        response.result = RES_BAD_REQ_DATA;
+    }
+    else
+    {
+        bool stopped = false;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t pageNo = first + i;
+            uint32_t width = batch.getWidth(i);
+            uint32_t height = batch.getHeight(i);
+            if (cancelled)
+            {
+                stopped = true;
+                break;
+            }
+            if (fz_is_empty_rect(&bounds[i]))
+            {
+                batch.fail(i);
+                continue;
+            }
+            // Page cache may have evicted it while the others were loaded
+            fz_page* page = pages[pageNo] != NULL ? pages[pageNo] : getPage(pageNo, false);
+            if (page == NULL)
+            {
+                batch.fail(i);
+                continue;
+            }
 
-    int size = (width) * (height) * 4;
+            fz_matrix ctm;
+            fz_matrix scale;
+            fz_translate(&ctm, -bounds[i].x0, -bounds[i].y0);
+            fz_concat(&ctm, &ctm, fz_scale(&scale,
+                width / (bounds[i].x1 - bounds[i].x0), height / (bounds[i].y1 - bounds[i].y0)));
+
+            // Already decoded pages are drawn from their display lists
+            bool ok = pageLists[pageNo] != NULL
+                ? renderList(pageLists[pageNo], ctm, width, height, batch.getPixels(i))
+                : renderPage(page, ctm, width, height, batch.getPixels(i));
+            if (cookie.abort)
+            {
+                stopped = true;
+                break;
+            }
+            if (!ok)
+            {
+                batch.fail(i);
+            }
+        }
+        if (stopped)
+        {
+            // Stopped by CMD_REQ_CANCEL, the remaining thumbnails were not drawn
+            response.result = RES_CANCELLED;
+        }
+        else
+        {
+            batch.commit(response);
+        }
+    }
 
-    CmdData* resp = new CmdData();
-    unsigned char* pixels = resp->newByteArray(size);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!loaded[i])
+        {
+            releasePage(first + i);
+        }
+    }
+}
 
+void MuPdfBridge::prepareRender()
+{
     //add check for night mode and set global variable accordingly
     ctx->ebookdroid_nightmode = config_invert_images;
 
@@ -646,20 +936,69 @@ void MuPdfBridge::processPageRender(CmdRequest& request, CmdResponse& response)
     // clear counter
     ctx->ebookdroid_setcolor_per_page = 0;
 
+    // The request reader thread raises the cancelled flag before touching the cookie
+    memset(&cookie, 0, sizeof(cookie));
+    cookie.abort = cancelled;
+}
+
+bool MuPdfBridge::renderPage(fz_page* page, const fz_matrix& ctm, int width, int height, unsigned char* pixels)
+{
+    prepareRender();
+
     fz_device *dev = NULL;
     fz_pixmap *pixmap = NULL;
+    bool ok = true;
 
     fz_try(ctx)
             {
-		pixmap = fz_new_pixmap_with_data(ctx, fz_device_rgb(ctx), width, height, pixels);
+                pixmap = fz_new_pixmap_with_data(ctx, fz_device_rgb(ctx), width, height, pixels);
 
                 fz_clear_pixmap_with_value(ctx, pixmap, 0xff);
 
                 dev = fz_new_draw_device(ctx, pixmap);
 
-                fz_run_display_list(ctx, pageLists[page_index], dev, &ctm, &viewbox, NULL);
+                fz_run_page(ctx, page, dev, &ctm, &cookie);
+            }fz_always(ctx)
+            {
+                fz_drop_device(ctx, dev);
+                fz_drop_pixmap(ctx, pixmap);
+            }fz_catch(ctx)
+    {
+        const char* msg = fz_caught_message(ctx);
+        ERROR_L(LCTX, "%s", msg);
+        ok = false;
+    }
+    return ok;
+}
+
+bool MuPdfBridge::renderList(fz_display_list* list, const fz_matrix& ctm, int width, int height, unsigned char* pixels)
+{
+    fz_rect viewbox;
+    viewbox.x0 = 0;
+    viewbox.y0 = 0;
+    viewbox.x1 = width;
+    viewbox.y1 = height;
 
-                response.addData(resp);
+    prepareRender();
+
+    if (pool.canRender(width, height))
+    {
+        return pool.render(ctx, list, &ctm, width, height, pixels, &cookie);
+    }
+
+    fz_device *dev = NULL;
+    fz_pixmap *pixmap = NULL;
+    bool ok = true;
+
+    fz_try(ctx)
+            {
+		pixmap = fz_new_pixmap_with_data(ctx, fz_device_rgb(ctx), width, height, pixels);
+
+                fz_clear_pixmap_with_value(ctx, pixmap, 0xff);
+
+                dev = fz_new_draw_device(ctx, pixmap);
+
+                fz_run_display_list(ctx, list, dev, &ctm, &viewbox, &cookie);
             }fz_always(ctx)
             {
                 fz_drop_device(ctx, dev);
@@ -668,9 +1007,9 @@ void MuPdfBridge::processPageRender(CmdRequest& request, CmdResponse& response)
     {
         const char* msg = fz_caught_message(ctx);
         ERROR_L(LCTX, "%s", msg);
-        response.result = RES_MUPDF_FAIL;
-        delete resp;
+        ok = false;
     }
+    return ok;
 }
 
 void MuPdfBridge::processOutline(CmdRequest& request, CmdResponse& response)
@@ -728,13 +1067,25 @@ void MuPdfBridge::processPageText(CmdRequest& request, CmdResponse& response)
     processText((int) pageNo, (const char*) pattern, response);
 }
 
-fz_page* MuPdfBridge::getPage(uint32_t pageNo, bool decode)
+fz_page* MuPdfBridge::getPage(uint32_t pageNo, bool decode, fz_cookie* cookie)
 {
 	if (pageNo >= pageCount || pageNo < 0)
 	{
 		ERROR_L(LCTX, "Invalid page number: %d from %d", pageNo, pageCount);
 		return NULL;
 	}
+    if (cookie == NULL)
+    {
+        // Prefetching does not count towards the hit ratio
+        if (pages[pageNo] != NULL && (!decode || pageLists[pageNo] != NULL))
+        {
+            pageCache.recordHit();
+        }
+        else
+        {
+            pageCache.recordMiss();
+        }
+    }
     if (pages[pageNo] == NULL)
     {
         fz_try(ctx)
@@ -748,7 +1099,7 @@ fz_page* MuPdfBridge::getPage(uint32_t pageNo, bool decode)
             	ERROR_L(LCTX, "Try to reopen in non-linearized mode");
             	ctx->ebookdroid_linearized_load = 0;
             	restart();
-            	return getPage(pageNo, decode);
+            	return getPage(pageNo, decode, cookie);
             }
             return NULL;
         }
@@ -762,7 +1113,7 @@ fz_page* MuPdfBridge::getPage(uint32_t pageNo, bool decode)
                     pageLists[pageNo] = fz_new_display_list(ctx);
                     dev = fz_new_list_device(ctx, pageLists[pageNo]);
                     fz_matrix m = fz_identity;
-                    fz_run_page(ctx, pages[pageNo], dev, &m, NULL);
+                    fz_run_page(ctx, pages[pageNo], dev, &m, cookie);
                 }fz_always(ctx)
                 {
                     fz_drop_device(ctx, dev);
@@ -774,24 +1125,135 @@ fz_page* MuPdfBridge::getPage(uint32_t pageNo, bool decode)
             	ERROR_L(LCTX, "Try to reopen in non-linearized mode");
             	ctx->ebookdroid_linearized_load = 0;
             	restart();
-            	return getPage(pageNo, decode);
+            	return getPage(pageNo, decode, cookie);
             } else
             {
             	fz_drop_display_list(ctx, pageLists[pageNo]);
             	pageLists[pageNo] = NULL;
             }
         }
+        if (pageLists[pageNo] != NULL)
+        {
+            if (cookie != NULL && cookie->abort)
+            {
+                // Interrupted list is incomplete, it is rebuilt on demand
+                fz_drop_display_list(ctx, pageLists[pageNo]);
+                pageLists[pageNo] = NULL;
+            }
+        }
     }
 
+    // Only idle prefetch passes its cookie, neighbours decoded ahead are not recently used
+    pageCache.put(pageNo, fz_display_list_size(ctx, pageLists[pageNo]), cookie != &idleCookie);
+    trimPages(pageNo);
+
     return pages[pageNo];
 }
 
+void MuPdfBridge::trimPages(uint32_t keepNo)
+{
+    uint32_t pageNo;
+    while (pageCache.evict(keepNo, &pageNo))
+    {
+        DEBUG_L(L_DEBUG, LCTX, "Evict page: %d", pageNo);
+        releasePage(pageNo);
+    }
+}
+
+void MuPdfBridge::releasePage(uint32_t pageNo)
+{
+    dropPageList(pageNo);
+
+    if (pages[pageNo]) {
+        fz_try(ctx)
+        {
+        	fz_drop_page(ctx, pages[pageNo]);
+        }fz_catch(ctx)
+        {
+            const char* msg = fz_caught_message(ctx);
+            ERROR_L(LCTX, "%s", msg);
+        }
+    	pages[pageNo] = NULL;
+    }
+    pageCache.remove(pageNo);
+}
+
+void MuPdfBridge::dropPageList(uint32_t pageNo)
+{
+    if (pageLists[pageNo] == NULL)
+    {
+        return;
+    }
+    fz_try(ctx)
+    {
+        fz_drop_display_list(ctx, pageLists[pageNo]);
+    }fz_catch(ctx)
+    {
+        const char* msg = fz_caught_message(ctx);
+        ERROR_L(LCTX, "%s", msg);
+    }
+    pageLists[pageNo] = NULL;
+}
+
+void MuPdfBridge::prefetchAround(uint32_t pageNo)
+{
+    pageCache.pin(pageNo);
+    prefetchFrom = pageNo;
+    prefetchIndex = 0;
+}
+
+bool MuPdfBridge::idle()
+{
+    if (document == NULL || pageLists == NULL)
+    {
+        return false;
+    }
+
+    // Neighbours are visited nearest first: N+1, N-1, N+2, N-2, ...
+    while (prefetchIndex < 2 * prefetchPages)
+    {
+        uint32_t distance = prefetchIndex / 2 + 1;
+        int64_t pageNo = (prefetchIndex % 2) == 0 ? (int64_t) prefetchFrom + distance : (int64_t) prefetchFrom - distance;
+        prefetchIndex++;
+
+        if (pageNo < 0 || pageNo >= pageCount || pageLists[pageNo] != NULL)
+        {
+            continue;
+        }
+        if (pageCache.getUsed() >= prefetchMemory)
+        {
+            return false;
+        }
+
+        DEBUG_L(L_DEBUG, LCTX, "Prefetch page: %d", (int) pageNo);
+
+        memset(&idleCookie, 0, sizeof(idleCookie));
+        idleCookie.abort = hasPendingRequests();
+        getPage((uint32_t) pageNo, true, &idleCookie);
+        if (idleCookie.abort)
+        {
+            // Preempted by a request, retry the same page on the next idle run
+            prefetchIndex--;
+            return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+void MuPdfBridge::preemptIdle(const CmdRequest& request)
+{
+    // Idle rendering runs on the request thread, so any request has to wait for it
+    idleCookie.abort = 1;
+}
+
 bool MuPdfBridge::restart()
 {
     release();
+    tiles.clear();
 
     DEBUG_L(L_DEBUG, LCTX, "Creating context: storememory = %d", storememory);
-    ctx = fz_new_context(NULL, NULL, storememory);
+    ctx = fz_new_context(NULL, MuPdfRenderPool::locks(), storememory);
     if (!ctx)
     {
         return false;
@@ -799,16 +1261,16 @@ bool MuPdfBridge::restart()
 
     ctx->ebookdroid_ignore_most_errors = 1;
 
+    pool.start(ctx);
+
     fz_try(ctx)
             {
-                if (format == FORMAT_XPS)
-                {
-                    document = (fz_document*) xps_open_document_with_stream(ctx, fz_open_fd(ctx, dup(fd)));
-                }
-                else
+                // File is already mapped, only the context is new
+                if (mapping == NULL)
                 {
-                    document = (fz_document*) pdf_open_document_with_stream(ctx, fz_open_fd(ctx, dup(fd)));
+                    mapping = fz_new_file_mapping(ctx, dup(fd));
                 }
+                document = openDocument(ctx, mapping, format);
 
                 DEBUG_L(L_DEBUG, LCTX, "Document pages: %d", pageCount);
 
@@ -853,10 +1315,7 @@ void MuPdfBridge::release()
         int i;
         for (i = 0; i < pageCount; i++)
         {
-            if (pageLists[i] != NULL)
-            {
-            	fz_drop_display_list(ctx, pageLists[i]);
-            }
+            dropPageList(i);
         }
         free(pageLists);
         pageLists = NULL;
@@ -874,11 +1333,13 @@ void MuPdfBridge::release()
         free(pages);
         pages = NULL;
     }
+    pageCache.clear();
     if (document)
     {
         fz_drop_document(ctx, document);
         document = NULL;
     }
+    pool.stop();
     if (ctx)
     {
         fz_flush_warnings(ctx);
@@ -887,6 +1348,11 @@ void MuPdfBridge::release()
     }
 }
 
+void MuPdfBridge::cancelRunning()
+{
+    cookie.abort = 1;
+}
+
 void MuPdfBridge::applyLayersMask()
 {
 	if (document && format == FORMAT_PDF)
@@ -989,7 +1455,18 @@ void MuPdfBridge::processConfig(CmdRequest& request, CmdResponse& response)
 
         if (key == CONFIG_MUPDF_INVERT_IMAGES) {
             int int_val = atoi(val);
+            if (config_invert_images != int_val) {
+                tiles.clear();
+            }
             config_invert_images = int_val;
+        } else if (key == CONFIG_PREFETCH_PAGES) {
+            int int_val = atoi(val);
+            prefetchPages = int_val < 0 ? 0 : int_val > PREFETCH_PAGES_MAX ? PREFETCH_PAGES_MAX : int_val;
+        } else if (key == CONFIG_PREFETCH_MEMORY) {
+            int int_val = atoi(val);
+            prefetchMemory = (size_t) (int_val < 0 ? 0 : int_val) * 1024 * 1024;
+        } else if (key == CONFIG_PAGE_CACHE_MEMORY) {
+            pageCache.setBudget((size_t) atoi(val) * 1024 * 1024);
         } else {
             ERROR_L(LCTX, "processConfig unknown key: key=%d, val=%s", key, val);
         }
@@ -997,6 +1474,18 @@ void MuPdfBridge::processConfig(CmdRequest& request, CmdResponse& response)
     response.addInt(pageCount);
 }
 
+void MuPdfBridge::processCacheStats(CmdRequest& request, CmdResponse& response)
+{
+    response.cmd = CMD_RES_CACHE_STATS;
+
+    // Page cache counters first, then tile cache used bytes, hits, misses and evictions
+    pageCache.addStats(response);
+    response.addInt(tiles.getUsed());
+    response.addInt(tiles.getHits());
+    response.addInt(tiles.getMisses());
+    response.addInt(tiles.getEvictions());
+}
+
 void MuPdfBridge::processSmartCrop(CmdRequest& request, CmdResponse& response)
 {
     DEBUG_L(L_DEBUG, LCTX, "processSmartCrop");
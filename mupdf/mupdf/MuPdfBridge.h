@@ -35,6 +35,11 @@ extern "C" {
 #define RES_MUPDF_FAIL      					254
 
 #include "StBridge.h"
+#include "StTileCache.h"
+#include "StPageCache.h"
+#include "MuPdfRenderPool.h"
+
+struct TextSink;
 
 class MuPdfBridge : public StBridge
 {
@@ -42,6 +47,11 @@ private:
 	int fd;
     char* password;
 
+    /**
+     * Mapping of the document file, kept while contexts are recreated by restart()
+     */
+    fz_file_mapping* mapping;
+
     fz_context *ctx;
     fz_document *document;
     fz_outline *outline;
@@ -56,6 +66,19 @@ private:
 
     std::set<std::string> fonts;
 
+    fz_cookie cookie;
+    fz_cookie idleCookie;
+
+    uint32_t prefetchPages;
+    size_t prefetchMemory;
+    uint32_t prefetchFrom;
+    uint32_t prefetchIndex;
+
+    MuPdfRenderPool pool;
+    StTileCache tiles;
+    StPageCache pageCache;
+    StTextIndex textIndex;
+
 public:
     MuPdfBridge();
     ~MuPdfBridge();
@@ -69,6 +92,8 @@ protected:
     void processPage(CmdRequest& request, CmdResponse& response);
 	void processPageLinks(CmdRequest& request, CmdResponse& response);
     void processPageRender(CmdRequest& request, CmdResponse& response);
+    void processPageTile(CmdRequest& request, CmdResponse& response);
+    void processThumbnails(CmdRequest& request, CmdResponse& response);
     void processPageFree(CmdRequest& request, CmdResponse& response);
     void processOutline(CmdRequest& request, CmdResponse& response);
     void processPageText(CmdRequest& request, CmdResponse& response);
@@ -80,8 +105,15 @@ protected:
     void processSetLayersMask(CmdRequest& request, CmdResponse& response);
 	void processSmartCrop(CmdRequest& request, CmdResponse& response);
 	void processConfig(CmdRequest& request, CmdResponse& response);
+    void processCacheStats(CmdRequest& request, CmdResponse& response);
 
-    fz_page* getPage(uint32_t pageNo, bool decode);
+    fz_page* getPage(uint32_t pageNo, bool decode, fz_cookie* cookie = NULL);
+    void dropPageList(uint32_t pageNo);
+    void releasePage(uint32_t pageNo);
+    void trimPages(uint32_t keepNo);
+    bool renderList(fz_display_list* list, const fz_matrix& ctm, int width, int height, unsigned char* pixels);
+    bool renderPage(fz_page* page, const fz_matrix& ctm, int width, int height, unsigned char* pixels);
+    void prepareRender();
 
     bool restart();
     void release();
@@ -92,8 +124,16 @@ protected:
     void processLinks(int pageNo, CmdResponse& response);
     void processOutline(fz_outline *outline, int level, int index, CmdResponse& response);
     void processText(int pageNo, const char* pattern, CmdResponse& response);
+    bool extractText(int pageNo, TextSink& sink);
+    void indexText(uint32_t pageNo, StTextIndex& index);
 
     void applyLayersMask();
+
+    void cancelRunning();
+
+    void prefetchAround(uint32_t pageNo);
+    bool idle();
+    void preemptIdle(const CmdRequest& request);
 };
 
 #endif
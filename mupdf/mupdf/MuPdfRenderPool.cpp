@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2013 The MuPDF CLI viewer interface Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "StLog.h"
+
+#include "MuPdfRenderPool.h"
+
+#define LCTX "MuPdfRenderPool"
+#define L_DEBUG false
+
+static pthread_mutex_t fz_mutexes[FZ_LOCK_MAX];
+static pthread_once_t fz_mutexes_once = PTHREAD_ONCE_INIT;
+
+static void fz_mutexes_init()
+{
+    for (int i = 0; i < FZ_LOCK_MAX; i++)
+    {
+        pthread_mutex_init(&fz_mutexes[i], NULL);
+    }
+}
+
+static void fz_lock_mutex(void* user, int lock)
+{
+    pthread_mutex_lock(&fz_mutexes[lock]);
+}
+
+static void fz_unlock_mutex(void* user, int lock)
+{
+    pthread_mutex_unlock(&fz_mutexes[lock]);
+}
+
+static fz_locks_context fz_locks_mutex = { NULL, fz_lock_mutex, fz_unlock_mutex };
+
+fz_locks_context* MuPdfRenderPool::locks()
+{
+    pthread_once(&fz_mutexes_once, fz_mutexes_init);
+    return &fz_locks_mutex;
+}
+
+MuPdfRenderPool::MuPdfRenderPool()
+{
+    threads = 0;
+    remaining = 0;
+    stopping = false;
+
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&taskcond, NULL);
+    pthread_cond_init(&donecond, NULL);
+}
+
+MuPdfRenderPool::~MuPdfRenderPool()
+{
+    stop();
+
+    pthread_mutex_destroy(&lock);
+    pthread_cond_destroy(&taskcond);
+    pthread_cond_destroy(&donecond);
+}
+
+bool MuPdfRenderPool::start(fz_context* ctx)
+{
+    stop();
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int count = cores < 2 ? 0 : cores > RENDER_POOL_MAX_THREADS ? RENDER_POOL_MAX_THREADS : (int) cores;
+
+    stopping = false;
+    for (int i = 0; i < count; i++)
+    {
+        MuPdfRenderWorker* worker = &workers[threads];
+        worker->pool = this;
+        worker->ctx = fz_clone_context(ctx);
+        if (worker->ctx == NULL)
+        {
+            ERROR_L(LCTX, "Context cannot be cloned");
+            break;
+        }
+        if (pthread_create(&worker->thread, NULL, workerThread, worker) != 0)
+        {
+            ERROR_L(LCTX, "Worker cannot be started");
+            fz_drop_context(worker->ctx);
+            worker->ctx = NULL;
+            break;
+        }
+        threads++;
+    }
+
+    DEBUG_L(L_DEBUG, LCTX, "Render workers: %d", threads);
+    return threads > 0;
+}
+
+void MuPdfRenderPool::stop()
+{
+    if (threads == 0)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&taskcond);
+    pthread_mutex_unlock(&lock);
+
+    for (int i = 0; i < threads; i++)
+    {
+        pthread_join(workers[i].thread, NULL);
+        fz_drop_context(workers[i].ctx);
+        workers[i].ctx = NULL;
+    }
+    threads = 0;
+}
+
+bool MuPdfRenderPool::render(fz_context* ctx, fz_display_list* list, const fz_matrix* ctm,
+        int width, int height, unsigned char* pixels, fz_cookie* cookie)
+{
+    if (!canRender(width, height))
+    {
+        return false;
+    }
+
+    int bands = threads;
+    int bandHeight = (height + bands - 1) / bands;
+
+    MuPdfRenderTask band[RENDER_POOL_MAX_THREADS];
+    int count = 0;
+    for (int y = 0; y < height; y += bandHeight)
+    {
+        MuPdfRenderTask* task = &band[count++];
+        task->list = list;
+        task->ctm = *ctm;
+        task->bbox.x0 = 0;
+        task->bbox.y0 = y;
+        task->bbox.x1 = width;
+        task->bbox.y1 = y + bandHeight < height ? y + bandHeight : height;
+        task->samples = pixels + (size_t) y * width * 4;
+        task->cookie = cookie;
+        task->nightmode = ctx->ebookdroid_nightmode;
+        task->slowcmyk = ctx->ebookdroid_slowcmyk;
+        task->failed = false;
+    }
+
+    pthread_mutex_lock(&lock);
+    for (int i = 0; i < count; i++)
+    {
+        tasks.push_back(&band[i]);
+    }
+    remaining = count;
+    pthread_cond_broadcast(&taskcond);
+    while (remaining > 0)
+    {
+        pthread_cond_wait(&donecond, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+
+    bool ok = true;
+    for (int i = 0; i < count; i++)
+    {
+        ok &= !band[i].failed;
+    }
+    return ok;
+}
+
+void* MuPdfRenderPool::workerThread(void* arg)
+{
+    MuPdfRenderWorker* worker = (MuPdfRenderWorker*) arg;
+    worker->pool->run(worker);
+    return NULL;
+}
+
+void MuPdfRenderPool::run(MuPdfRenderWorker* worker)
+{
+    pthread_mutex_lock(&lock);
+    while (true)
+    {
+        while (tasks.empty() && !stopping)
+        {
+            pthread_cond_wait(&taskcond, &lock);
+        }
+        if (stopping)
+        {
+            break;
+        }
+
+        MuPdfRenderTask* task = tasks.front();
+        tasks.pop_front();
+        pthread_mutex_unlock(&lock);
+
+        renderTask(worker->ctx, task);
+
+        pthread_mutex_lock(&lock);
+        if (--remaining == 0)
+        {
+            pthread_cond_signal(&donecond);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void MuPdfRenderPool::renderTask(fz_context* ctx, MuPdfRenderTask* task)
+{
+    ctx->ebookdroid_nightmode = task->nightmode;
+    ctx->ebookdroid_slowcmyk = task->slowcmyk;
+    ctx->ebookdroid_ignore_most_errors = 1;
+    ctx->ebookdroid_setcolor_per_page = 0;
+
+    fz_rect scissor;
+    fz_rect_from_irect(&scissor, &task->bbox);
+
+    fz_device *dev = NULL;
+    fz_pixmap *pixmap = NULL;
+
+    fz_try(ctx)
+    {
+        pixmap = fz_new_pixmap_with_bbox_and_data(ctx, fz_device_rgb(ctx), &task->bbox, task->samples);
+        fz_clear_pixmap_with_value(ctx, pixmap, 0xff);
+        dev = fz_new_draw_device(ctx, pixmap);
+        fz_run_display_list(ctx, task->list, dev, &task->ctm, &scissor, task->cookie);
+    }
+    fz_always(ctx)
+    {
+        fz_drop_device(ctx, dev);
+        fz_drop_pixmap(ctx, pixmap);
+    }
+    fz_catch(ctx)
+    {
+        ERROR_L(LCTX, "%s", fz_caught_message(ctx));
+        task->failed = true;
+    }
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2013 The MuPDF CLI viewer interface Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __MUPDF_RENDER_POOL_H__
+#define __MUPDF_RENDER_POOL_H__
+
+#include <stdint.h>
+#include <pthread.h>
+#include <deque>
+
+extern "C" {
+#include <mupdf/fitz.h>
+};
+
+#define RENDER_POOL_MAX_THREADS     4
+// Smaller viewports are rendered on the request thread, splitting them costs more than it gains
+#define RENDER_POOL_MIN_PIXELS      (512 * 512)
+
+class MuPdfRenderPool;
+
+/**
+ * One horizontal band of a page viewport.
+ */
+struct MuPdfRenderTask
+{
+    fz_display_list* list;
+    fz_matrix ctm;
+    fz_irect bbox;
+    unsigned char* samples;
+    fz_cookie* cookie;
+    int nightmode;
+    int slowcmyk;
+    bool failed;
+};
+
+struct MuPdfRenderWorker
+{
+    MuPdfRenderPool* pool;
+    fz_context* ctx;
+    pthread_t thread;
+};
+
+/**
+ * Renders cached display lists on worker threads.
+ * Every worker owns a clone of the bridge context, so the resource store, glyph cache and
+ * fonts are shared and guarded by the locks returned from MuPdfRenderPool::locks().
+ * Display lists are read only while being run, so the same list can be replayed by all
+ * workers at once. Document access (loading pages, building lists) stays on the request thread.
+ */
+class MuPdfRenderPool
+{
+private:
+    MuPdfRenderWorker workers[RENDER_POOL_MAX_THREADS];
+    int threads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t taskcond;
+    pthread_cond_t donecond;
+    std::deque<MuPdfRenderTask*> tasks;
+    int remaining;
+    bool stopping;
+
+public:
+    MuPdfRenderPool();
+    ~MuPdfRenderPool();
+
+    static fz_locks_context* locks();
+
+    bool start(fz_context* ctx);
+    void stop();
+
+    int getThreads() const { return threads; }
+
+    bool canRender(int width, int height) const { return threads > 1 && (int64_t) width * height >= RENDER_POOL_MIN_PIXELS; }
+
+    /**
+     * Splits the viewport into bands and renders them concurrently into the given RGBA buffer.
+     * Returns false if any band failed.
+     */
+    bool render(fz_context* ctx, fz_display_list* list, const fz_matrix* ctm,
+            int width, int height, unsigned char* pixels, fz_cookie* cookie);
+
+private:
+    static void* workerThread(void* arg);
+    void run(MuPdfRenderWorker* worker);
+    void renderTask(fz_context* ctx, MuPdfRenderTask* task);
+};
+
+#endif
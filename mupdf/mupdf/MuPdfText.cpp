@@ -27,7 +27,17 @@
 
 char utf8[32 * 1024];
 
-void toResponse(CmdResponse& response, fz_rect& bounds, fz_irect* rr, const char* str, int len)
+/**
+ * Destination of extracted words: the page text response or the search index.
+ */
+struct TextSink
+{
+    CmdResponse* response;
+    StTextIndex* index;
+    uint32_t page;
+};
+
+void toResponse(TextSink& sink, fz_rect& bounds, fz_irect* rr, const char* str, int len)
 {
     float width = bounds.x1 - bounds.x0;
     float height = bounds.y1 - bounds.y0;
@@ -40,14 +50,20 @@ void toResponse(CmdResponse& response, fz_rect& bounds, fz_irect* rr, const char
 
     DEBUG_L(L_DEBUG_TEXT, LCTX, "processText: add word: %d %f %f %f %f %s", len, left, top, right, bottom, utf8);
 
-    response.addFloat(left);
-    response.addFloat(top);
-    response.addFloat(right);
-    response.addFloat(bottom);
-    response.addIpcString(utf8, true);
+    if (sink.index != NULL)
+    {
+        sink.index->addWord(sink.page, utf8, left, top, right, bottom);
+        return;
+    }
+
+    sink.response->addFloat(left);
+    sink.response->addFloat(top);
+    sink.response->addFloat(right);
+    sink.response->addFloat(bottom);
+    sink.response->addIpcString(utf8, true);
 }
 
-void processLine(CmdResponse& response, fz_context *ctx, fz_rect& bounds, fz_text_line& line)
+void processLine(TextSink& sink, fz_context *ctx, fz_rect& bounds, fz_text_line& line)
 {
     int index = 0;
     fz_rect rr = fz_empty_rect;
@@ -86,7 +102,7 @@ void processLine(CmdResponse& response, fz_context *ctx, fz_rect& bounds, fz_tex
                 {
                     if (index > 0)
                     {
-                        toResponse(response, bounds, fz_round_rect(&box, &rr), utf8, index);
+                        toResponse(sink, bounds, fz_round_rect(&box, &rr), utf8, index);
                         index = 0;
                     }
                     rr = fz_empty_rect;
@@ -100,17 +116,44 @@ void processLine(CmdResponse& response, fz_context *ctx, fz_rect& bounds, fz_tex
     if (index > 0)
     {
         DEBUG_L(L_DEBUG_TEXT, LCTX, "processText: tail processing: %d", index);
-        toResponse(response, bounds, fz_round_rect(&box, &rr), utf8, index);
+        toResponse(sink, bounds, fz_round_rect(&box, &rr), utf8, index);
     }
 }
 
 void MuPdfBridge::processText(int pageNo, const char* pattern, CmdResponse& response)
+{
+    TextSink sink = { &response, NULL, 0 };
+    if (!extractText(pageNo, sink))
+    {
+        response.result = RES_MUPDF_FAIL;
+    }
+}
+
+void MuPdfBridge::indexText(uint32_t pageNo, StTextIndex& index)
+{
+    if (pageNo >= pageCount)
+    {
+        return;
+    }
+    // Pages loaded just for indexing are released, a search walks the whole document
+    bool loaded = pages[pageNo] != NULL;
+
+    TextSink sink = { NULL, &index, pageNo };
+    extractText(pageNo, sink);
+
+    if (!loaded)
+    {
+        releasePage(pageNo);
+    }
+}
+
+bool MuPdfBridge::extractText(int pageNo, TextSink& sink)
 {
     fz_page *page = getPage(pageNo, false);
     if (page == NULL)
     {
         DEBUG_L(L_DEBUG_TEXT, LCTX, "processText: no page %d", pageNo);
-        return;
+        return true;
     }
 
     fz_text_sheet *sheet = NULL;
@@ -159,7 +202,7 @@ void MuPdfBridge::processText(int pageNo, const char* pattern, CmdResponse& resp
                                 {
                                     DEBUG_L(L_DEBUG_TEXT, LCTX,
                                         "processText: line processing: %d", lineIndex);
-                                    processLine(response, ctx, bounds, line);
+                                    processLine(sink, ctx, bounds, line);
                                 }
                             }
                         }
@@ -192,9 +235,10 @@ void MuPdfBridge::processText(int pageNo, const char* pattern, CmdResponse& resp
     {
         const char* msg = fz_caught_message(ctx);
         ERROR_L(LCTX, "%s", msg);
-        response.result = RES_MUPDF_FAIL;
+        return false;
     }
 
     DEBUG_L(L_DEBUG_TEXT, LCTX, "processText: end");
+    return true;
 }
 
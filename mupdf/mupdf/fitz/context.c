@@ -1,4 +1,7 @@
 #include "mupdf/fitz.h"
+// EBD: vector kernels >>>
+#include "draw-imp.h"
+// EBD: vector kernels <<<
 
 struct fz_id_context_s
 {
@@ -135,6 +138,11 @@ fz_new_context_imp(fz_alloc_context *alloc, fz_locks_context *locks, unsigned in
 	if (!ctx)
 		return NULL;
 
+// EBD: vector kernels >>>
+	/* Contexts are created before any rendering thread, so kernel selection never races */
+	fz_init_draw_simd();
+// EBD: vector kernels <<<
+
 	/* Now initialise sections that are shared */
 	fz_try(ctx)
 	{
@@ -709,7 +709,14 @@ fz_paint_affine_lerp(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, i
 		{
 		case 1: fz_paint_affine_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 1, hp); break;
 		case 2: fz_paint_affine_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 2, hp); break;
-		case 4: fz_paint_affine_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 4, hp); break;
+		case 4:
+// EBD: vector kernels >>>
+			if (fz_draw_simd_kernels.paint_affine_lerp_4)
+				fz_draw_simd_kernels.paint_affine_lerp_4(dp, sp, sw, sh, u, v, fa, fb, w, 255, hp);
+			else
+// EBD: vector kernels <<<
+			fz_paint_affine_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 4, hp);
+			break;
 		default: fz_paint_affine_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, n, hp); break;
 		}
 	}
@@ -719,7 +726,14 @@ fz_paint_affine_lerp(byte *dp, byte *sp, int sw, int sh, int u, int v, int fa, i
 		{
 		case 1: fz_paint_affine_alpha_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 1, alpha, hp); break;
 		case 2: fz_paint_affine_alpha_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 2, alpha, hp); break;
-		case 4: fz_paint_affine_alpha_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 4, alpha, hp); break;
+		case 4:
+// EBD: vector kernels >>>
+			if (fz_draw_simd_kernels.paint_affine_lerp_4)
+				fz_draw_simd_kernels.paint_affine_lerp_4(dp, sp, sw, sh, u, v, fa, fb, w, alpha, hp);
+			else
+// EBD: vector kernels <<<
+			fz_paint_affine_alpha_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, 4, alpha, hp);
+			break;
 		default: fz_paint_affine_alpha_N_lerp(dp, sp, sw, sh, u, v, fa, fb, w, n, alpha, hp); break;
 		}
 	}
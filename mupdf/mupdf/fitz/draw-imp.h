@@ -47,4 +47,26 @@ void fz_blend_pixel(unsigned char dp[3], unsigned char bp[3], unsigned char sp[3
 
 void fz_paint_glyph(unsigned char *colorbv, fz_pixmap *dst, unsigned char *dp, fz_glyph *glyph, int w, int h, int skip_x, int skip_y);
 
+// EBD: vector kernels for the n == 4 plotters >>>
+/*
+ * Filled in by fz_init_draw_simd for the instruction set found at runtime,
+ * a NULL entry leaves the plain C code in charge. Span kernels paint a
+ * prefix of whole vectors and return its length in pixels. sa is the
+ * color alpha already passed through FZ_EXPAND.
+ */
+typedef struct fz_draw_simd_s
+{
+	int (*paint_solid_color_4)(unsigned char * restrict dp, int w, int sa, const unsigned char *color);
+	int (*paint_span_4)(unsigned char * restrict dp, const unsigned char * restrict sp, int w);
+	int (*paint_span_4_with_alpha)(unsigned char * restrict dp, const unsigned char * restrict sp, int w, int alpha);
+	int (*paint_span_with_mask_4)(unsigned char * restrict dp, const unsigned char * restrict sp, const unsigned char * restrict mp, int w);
+	int (*paint_span_with_color_4)(unsigned char * restrict dp, const unsigned char * restrict mp, int w, int sa, const unsigned char *color);
+	void (*paint_affine_lerp_4)(unsigned char *dp, const unsigned char *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int alpha, unsigned char *hp);
+} fz_draw_simd;
+
+extern fz_draw_simd fz_draw_simd_kernels;
+
+void fz_init_draw_simd(void);
+// EBD: vector kernels for the n == 4 plotters <<<
+
 #endif
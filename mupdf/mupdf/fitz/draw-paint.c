@@ -142,6 +142,14 @@ fz_paint_solid_color_4(byte * restrict dp, int w, byte *color)
 		unsigned int mask = 0xFF00FF00;
 		unsigned int rb = rgba & (mask>>8);
 		unsigned int ga = (rgba & mask)>>8;
+// EBD: vector kernels >>>
+		if (fz_draw_simd_kernels.paint_solid_color_4)
+		{
+			int done = fz_draw_simd_kernels.paint_solid_color_4(dp, w, sa, color);
+			dp += done * 4;
+			w -= done;
+		}
+// EBD: vector kernels <<<
 		while (w--)
 		{
 			unsigned int RGBA = *(unsigned int *)dp;
@@ -262,6 +270,15 @@ fz_paint_span_with_color_4(byte * restrict dp, byte * restrict mp, int w, byte *
 	mask = 0xFF00FF00;
 	rb = rgba & (mask>>8);
 	ga = (rgba & mask)>>8;
+// EBD: vector kernels >>>
+	if (fz_draw_simd_kernels.paint_span_with_color_4)
+	{
+		int done = fz_draw_simd_kernels.paint_span_with_color_4(dp, mp, w, sa, color);
+		dp += done * 4;
+		mp += done;
+		w -= done;
+	}
+// EBD: vector kernels <<<
 	if (sa == 256)
 	{
 		while (w--)
@@ -418,6 +435,16 @@ fz_paint_span_with_mask_2(byte * restrict dp, byte * restrict sp, byte * restric
 static inline void
 fz_paint_span_with_mask_4(byte * restrict dp, byte * restrict sp, byte * restrict mp, int w)
 {
+// EBD: vector kernels >>>
+	if (fz_draw_simd_kernels.paint_span_with_mask_4)
+	{
+		int done = fz_draw_simd_kernels.paint_span_with_mask_4(dp, sp, mp, w);
+		dp += done * 4;
+		sp += done * 4;
+		mp += done;
+		w -= done;
+	}
+// EBD: vector kernels <<<
 	while (w--)
 	{
 		int masa;
@@ -545,6 +572,15 @@ fz_paint_span_2_with_alpha(byte * restrict dp, byte * restrict sp, int w, int al
 static inline void
 fz_paint_span_4_with_alpha(byte * restrict dp, byte * restrict sp, int w, int alpha)
 {
+// EBD: vector kernels >>>
+	if (fz_draw_simd_kernels.paint_span_4_with_alpha)
+	{
+		int done = fz_draw_simd_kernels.paint_span_4_with_alpha(dp, sp, w, alpha);
+		dp += done * 4;
+		sp += done * 4;
+		w -= done;
+	}
+// EBD: vector kernels <<<
 	alpha = FZ_EXPAND(alpha);
 	while (w--)
 	{
@@ -621,6 +657,15 @@ fz_paint_span_2(byte * restrict dp, byte * restrict sp, int w)
 static inline void
 fz_paint_span_4(byte * restrict dp, byte * restrict sp, int w)
 {
+// EBD: vector kernels >>>
+	if (fz_draw_simd_kernels.paint_span_4)
+	{
+		int done = fz_draw_simd_kernels.paint_span_4(dp, sp, w);
+		dp += done * 4;
+		sp += done * 4;
+		w -= done;
+	}
+// EBD: vector kernels <<<
 	while (w--)
 	{
 		int t = FZ_EXPAND(sp[3]);
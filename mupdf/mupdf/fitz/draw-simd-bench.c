@@ -0,0 +1,302 @@
+// EBD: vector kernels for the n == 4 plotters >>>
+/*
+	Host tool, not part of the library: checks that every vector kernel of
+	draw-simd.c paints bit for bit what the plain C plotters paint, then
+	times both on spans of 1024 pixels.
+
+	Build and run from this directory:
+
+		make -f draw-simd-bench.mk run
+
+	The plotters, the kernels and this file form a single translation unit,
+	so that the static kernels of each instruction set can be tested one by
+	one. Exits with 1 if any kernel differs from the scalar code.
+*/
+
+#include "draw-paint.c"
+#include "draw-affine.c"
+#include "draw-simd.c"
+
+#include <stdio.h>
+#include <time.h>
+
+/* Referenced by the pixmap and image painters, never called here */
+fz_irect *fz_pixmap_bbox_no_ctx(fz_pixmap *p, fz_irect *b) { return b; }
+fz_irect *fz_intersect_irect(fz_irect *restrict a, const fz_irect *restrict b) { return a; }
+const fz_rect fz_unit_rect = { 0, 0, 1, 1 };
+fz_matrix *fz_pre_scale(fz_matrix *m, float sx, float sy) { return m; }
+fz_matrix *fz_invert_matrix(fz_matrix *inverse, const fz_matrix *matrix) { return inverse; }
+int fz_is_rectilinear(const fz_matrix *m) { return 0; }
+fz_irect *fz_irect_from_rect(fz_irect *restrict bbox, const fz_rect *restrict rect) { return bbox; }
+fz_rect *fz_transform_rect(fz_rect *restrict rect, const fz_matrix *restrict transform) { return rect; }
+int __android_log_print(int prio, const char *tag, const char *fmt, ...) { return 0; }
+
+enum
+{
+	CHECK_RUNS = 20000,
+	CHECK_W = 1237,
+	BENCH_W = 1024,
+	BENCH_REPS = 20000
+};
+
+static unsigned int rnd_state = 12345;
+
+static unsigned int
+rnd(void)
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return rnd_state >> 8;
+}
+
+/* Opaque, clear and partial alpha; colors above alpha when not premultiplied */
+static void
+fill_pixels(byte *p, int w, int premultiplied)
+{
+	int i, k;
+	for (i = 0; i < w; i++)
+	{
+		int a = rnd() % 4 == 0 ? 255 : rnd() % 4 == 0 ? 0 : rnd() & 255;
+		p[4 * i + 3] = a;
+		for (k = 0; k < 3; k++)
+			p[4 * i + k] = premultiplied ? (a ? rnd() % (a + 1) : 0) : rnd() & 255;
+	}
+}
+
+static void
+fill_mask(byte *m, int w)
+{
+	int i;
+	for (i = 0; i < w; i++)
+	{
+		int r = rnd() % 4;
+		m[i] = r == 0 ? 0 : r == 1 ? 255 : rnd() & 255;
+	}
+}
+
+enum
+{
+	OP_SPAN,
+	OP_SPAN_ALPHA,
+	OP_SPAN_MASK,
+	OP_SPAN_COLOR,
+	OP_SOLID_COLOR,
+	OP_AFFINE_LERP,
+	OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] =
+{
+	"span", "span alpha", "span mask", "span color", "solid color", "affine lerp"
+};
+
+typedef struct
+{
+	byte *sp, *mp, *hp;
+	byte color[4];
+	int w, alpha;
+	int sw, sh, u, v, fa, fb;
+} bench_args;
+
+static void
+run_op(int op, byte *dp, bench_args *a)
+{
+	switch (op)
+	{
+	case OP_SPAN: fz_paint_span(dp, a->sp, 4, a->w, 255); break;
+	case OP_SPAN_ALPHA: fz_paint_span(dp, a->sp, 4, a->w, a->alpha); break;
+	case OP_SPAN_MASK: fz_paint_span_with_mask(dp, a->sp, a->mp, 4, a->w); break;
+	case OP_SPAN_COLOR: fz_paint_span_with_color(dp, a->mp, 4, a->w, a->color); break;
+	case OP_SOLID_COLOR: fz_paint_solid_color(dp, 4, a->w, a->color); break;
+	case OP_AFFINE_LERP:
+		fz_paint_affine_lerp(dp, a->sp, a->sw, a->sh, a->u, a->v, a->fa, a->fb, a->w, 4, a->alpha, NULL, a->hp);
+		break;
+	}
+}
+
+/* Paints the same random spans with the kernels and with plain C, returns the number of differences */
+static int
+check_kernels(const char *name, const fz_draw_simd *kernels)
+{
+	static byte sp[CHECK_W * 4], mp[CHECK_W], d0[CHECK_W * 4], d1[CHECK_W * 4], d2[CHECK_W * 4];
+	static byte h0[CHECK_W], h1[CHECK_W], h2[CHECK_W];
+	int bad[OP_COUNT] = { 0 };
+	int run, op, total = 0;
+	bench_args a;
+
+	rnd_state = 12345;
+	for (run = 0; run < CHECK_RUNS; run++)
+	{
+		int premultiplied = run & 1;
+
+		a.w = 1 + rnd() % CHECK_W;
+		a.alpha = run % 3 == 0 ? 255 : rnd() & 255;
+		fill_pixels(sp, CHECK_W, premultiplied);
+		fill_pixels(d0, CHECK_W, 1);
+		fill_mask(mp, CHECK_W);
+		fill_mask(h0, CHECK_W);
+		for (op = 0; op < 4; op++)
+			a.color[op] = rnd() & 255;
+		if (run % 3 == 0)
+			a.color[3] = 255;
+		a.mp = mp;
+		a.sp = sp;
+
+		/* Source image of up to 30x30 pixels, sampled partly outside its edges */
+		a.sw = 1 + rnd() % 30;
+		a.sh = 1 + rnd() % 30;
+		a.u = (int)(rnd() % (a.sw << 16)) - (2 << 16);
+		a.v = (int)(rnd() % (a.sh << 16)) - (2 << 16);
+		a.fa = (int)(rnd() % 131072) - 65536;
+		a.fb = (int)(rnd() % 131072) - 65536;
+
+		for (op = 0; op < OP_COUNT; op++)
+		{
+			int w = a.w;
+			if (op == OP_AFFINE_LERP)
+				a.w = fz_mini(a.w, 200);
+
+			memcpy(d1, d0, a.w * 4);
+			memcpy(h1, h0, a.w);
+			a.hp = h1;
+			fz_draw_simd_kernels = *kernels;
+			run_op(op, d1, &a);
+
+			memcpy(d2, d0, a.w * 4);
+			memcpy(h2, h0, a.w);
+			a.hp = h2;
+			memset(&fz_draw_simd_kernels, 0, sizeof fz_draw_simd_kernels);
+			run_op(op, d2, &a);
+
+			if (memcmp(d1, d2, a.w * 4) || memcmp(h1, h2, a.w))
+				bad[op]++;
+			a.w = w;
+		}
+	}
+
+	for (op = 0; op < OP_COUNT; op++)
+	{
+		if (bad[op])
+			printf("%-6s %-12s %d of %d spans differ\n", name, op_names[op], bad[op], CHECK_RUNS);
+		total += bad[op];
+	}
+	if (!total)
+		printf("%-6s all kernels match the scalar code on %d spans\n", name, CHECK_RUNS);
+	return total;
+}
+
+static double
+now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static double
+time_op(int op, bench_args *a, byte *dp)
+{
+	double t0 = now();
+	int i;
+	for (i = 0; i < BENCH_REPS; i++)
+		run_op(op, dp, a);
+	return (now() - t0) * 1e9 / BENCH_REPS;
+}
+
+static void
+bench_kernels(const char *name, const fz_draw_simd *kernels)
+{
+	static byte sp[BENCH_W * 4], mp[BENCH_W], dp[BENCH_W * 4];
+	bench_args a;
+	int op;
+
+	rnd_state = 7;
+	fill_pixels(sp, BENCH_W, 1);
+	fill_pixels(dp, BENCH_W, 1);
+	fill_mask(mp, BENCH_W);
+	a.sp = sp;
+	a.mp = mp;
+	a.hp = NULL;
+	a.w = BENCH_W;
+	a.alpha = 200;
+	a.color[0] = 10;
+	a.color[1] = 200;
+	a.color[2] = 30;
+	a.color[3] = 255;
+	a.sw = 32;
+	a.sh = 32;
+	a.u = 3 << 16;
+	a.v = 5 << 16;
+	a.fa = 23000;
+	a.fb = -1700;
+
+	for (op = 0; op < OP_COUNT; op++)
+	{
+		double scalar, simd;
+		int w = a.w;
+		if (op == OP_AFFINE_LERP)
+			a.w = BENCH_W / 4;
+		memset(&fz_draw_simd_kernels, 0, sizeof fz_draw_simd_kernels);
+		scalar = time_op(op, &a, dp);
+		fz_draw_simd_kernels = *kernels;
+		simd = time_op(op, &a, dp);
+		printf("%-6s %-12s scalar %8.1f ns  simd %8.1f ns  x%.2f\n", name, op_names[op], scalar, simd, scalar / simd);
+		a.w = w;
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	int support = fz_detect_draw_simd();
+	int bad = 0;
+	fz_draw_simd k;
+
+	(void)argc;
+	(void)argv;
+
+#ifdef FZ_DRAW_NEON
+	if (support & FZ_DRAW_SIMD_NEON)
+	{
+		memset(&k, 0, sizeof k);
+		k.paint_solid_color_4 = paint_solid_color_4_neon;
+		k.paint_span_4 = paint_span_4_neon;
+		k.paint_span_4_with_alpha = paint_span_4_with_alpha_neon;
+		k.paint_span_with_mask_4 = paint_span_with_mask_4_neon;
+		k.paint_span_with_color_4 = paint_span_with_color_4_neon;
+		k.paint_affine_lerp_4 = paint_affine_lerp_4_neon;
+		bad += check_kernels("neon", &k);
+		bench_kernels("neon", &k);
+	}
+#endif
+#ifdef FZ_DRAW_SSE2
+	if (support & FZ_DRAW_SIMD_SSE2)
+	{
+		memset(&k, 0, sizeof k);
+		k.paint_solid_color_4 = paint_solid_color_4_sse2;
+		k.paint_span_4 = paint_span_4_sse2;
+		k.paint_span_4_with_alpha = paint_span_4_with_alpha_sse2;
+		k.paint_span_with_mask_4 = paint_span_with_mask_4_sse2;
+		k.paint_span_with_color_4 = paint_span_with_color_4_sse2;
+		k.paint_affine_lerp_4 = paint_affine_lerp_4_sse2;
+		bad += check_kernels("sse2", &k);
+		bench_kernels("sse2", &k);
+	}
+#endif
+#ifdef FZ_DRAW_AVX2
+	if (support & FZ_DRAW_SIMD_AVX2)
+	{
+		k.paint_solid_color_4 = paint_solid_color_4_avx2;
+		k.paint_span_4 = paint_span_4_avx2;
+		k.paint_span_4_with_alpha = paint_span_4_with_alpha_avx2;
+		k.paint_span_with_mask_4 = paint_span_with_mask_4_avx2;
+		k.paint_span_with_color_4 = paint_span_with_color_4_avx2;
+		bad += check_kernels("avx2", &k);
+		bench_kernels("avx2", &k);
+	}
+#endif
+	if (support == FZ_DRAW_SIMD_NONE)
+		printf("no vector kernels on this machine\n");
+
+	return bad ? 1 : 0;
+}
+// EBD: vector kernels for the n == 4 plotters <<<
@@ -0,0 +1,28 @@
+# EBD: vector kernels for the n == 4 plotters >>>
+# Host build of draw-simd-bench.c: make -f draw-simd-bench.mk run
+# The Android log header is replaced by an empty declaration, nothing else is needed.
+
+CC ?= cc
+CFLAGS ?= -O2
+OUT ?= build-simd-bench
+
+BENCH = $(OUT)/draw-simd-bench
+
+all: $(BENCH)
+
+$(OUT)/android/log.h:
+	mkdir -p $(OUT)/android
+	printf '%s\n' 'enum { ANDROID_LOG_INFO = 4, ANDROID_LOG_WARN = 5, ANDROID_LOG_ERROR = 6 };' \
+		'int __android_log_print(int prio, const char *tag, const char *fmt, ...);' > $@
+
+$(BENCH): draw-simd-bench.c draw-simd.c draw-paint.c draw-affine.c draw-imp.h $(OUT)/android/log.h
+	$(CC) $(CFLAGS) -I../include -I. -I$(OUT) -o $@ draw-simd-bench.c -lm
+
+run: $(BENCH)
+	$(BENCH)
+
+clean:
+	rm -rf $(OUT)
+
+.PHONY: all run clean
+# EBD: vector kernels for the n == 4 plotters <<<
@@ -0,0 +1,830 @@
+// EBD: vector kernels for the n == 4 plotters >>>
+
+#include "mupdf/fitz.h"
+#include "draw-imp.h"
+
+/*
+	Every kernel here gives bit for bit the result of the scalar code in
+	draw-paint.c and draw-affine.c. The 8 bit channels are widened to 16 bit
+	lanes, where all the intermediate products of the scalar formulas fit:
+
+	over:		d' = s + (d * (256 - EXPAND(sa)) >> 8)
+	with alpha:	masa = sa * EXPAND(alpha) >> 8
+			d' = (s * masa + d * (256 - masa)) >> 8
+	with mask:	ma = EXPAND(m), masa = EXPAND(255 - (sa * ma >> 8))
+			d' = (s * ma >> 8) + (d * masa >> 8)
+	with color:	d' = (d * (256 - ma) + c * ma) >> 8
+
+	Results are truncated to 8 bits as the scalar stores do, so that even
+	sources which are not properly premultiplied paint the same. The span
+	kernels only paint whole vectors and return the number of pixels done,
+	the scalar code paints the remainder.
+*/
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FZ_DRAW_NEON
+#include <arm_neon.h>
+#if !defined(__aarch64__)
+#include <sys/auxv.h>
+#ifndef HWCAP_NEON
+#define HWCAP_NEON (1 << 12)
+#endif
+#endif
+#endif
+
+#if defined(__SSE2__) || defined(__x86_64__)
+#define FZ_DRAW_SSE2
+#include <emmintrin.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FZ_DRAW_AVX2
+#include <immintrin.h>
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+typedef unsigned char byte;
+
+enum
+{
+	FZ_DRAW_SIMD_NONE = 0,
+	FZ_DRAW_SIMD_SSE2 = 1,
+	FZ_DRAW_SIMD_AVX2 = 2,
+	FZ_DRAW_SIMD_NEON = 4
+};
+
+fz_draw_simd fz_draw_simd_kernels;
+
+static int fz_draw_simd_support = -1;
+
+static inline unsigned int
+load_u32(const byte *p)
+{
+	unsigned int v;
+	memcpy(&v, p, 4);
+	return v;
+}
+
+static inline void
+store_u32(byte *p, unsigned int v)
+{
+	memcpy(p, &v, 4);
+}
+
+#ifdef FZ_DRAW_SSE2
+
+/* Replicates the alpha lane of each of the two pixels over the pixel */
+static inline __m128i
+alpha_sse2(__m128i x)
+{
+	x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static inline __m128i
+expand_sse2(__m128i x)
+{
+	return _mm_add_epi16(x, _mm_srli_epi16(x, 7));
+}
+
+/* 4 mask bytes as 32 bit lanes holding the mask in both halves */
+static inline __m128i
+mask_sse2(const byte *mp)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i x = _mm_cvtsi32_si128((int)load_u32(mp));
+	x = _mm_unpacklo_epi16(_mm_unpacklo_epi8(x, zero), zero);
+	return _mm_or_si128(x, _mm_slli_epi32(x, 16));
+}
+
+static inline __m128i
+mul255_sse2(__m128i a, __m128i b)
+{
+	__m128i x = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(128));
+	x = _mm_add_epi16(x, _mm_srli_epi16(x, 8));
+	return _mm_srli_epi16(x, 8);
+}
+
+/* a + ((b - a) * t >> 16) for t in 0..65535, the top bit of t is folded back by hand */
+static inline __m128i
+lerp_sse2(__m128i a, __m128i b, int t)
+{
+	__m128i vt = _mm_set1_epi16((short)t);
+	__m128i d = _mm_sub_epi16(b, a);
+	__m128i r = _mm_add_epi16(a, _mm_mulhi_epi16(d, vt));
+	return _mm_add_epi16(r, _mm_and_si128(d, _mm_srai_epi16(vt, 15)));
+}
+
+static inline __m128i
+over_sse2(__m128i s, __m128i d)
+{
+	__m128i sa = alpha_sse2(s);
+	__m128i t = _mm_sub_epi16(_mm_set1_epi16(256), expand_sse2(sa));
+	__m128i r = _mm_add_epi16(s, _mm_srli_epi16(_mm_mullo_epi16(d, t), 8));
+	__m128i keep = _mm_cmpeq_epi16(sa, _mm_setzero_si128());
+	r = _mm_and_si128(r, _mm_set1_epi16(0xff));
+	return _mm_or_si128(_mm_and_si128(keep, d), _mm_andnot_si128(keep, r));
+}
+
+static int
+paint_span_4_sse2(byte * restrict dp, const byte * restrict sp, int w)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i amask = _mm_set1_epi32(0xFF000000);
+	int i;
+
+	for (i = 0; i + 4 <= w; i += 4, sp += 16, dp += 16)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i *)sp);
+		__m128i d, a = _mm_and_si128(s, amask);
+		int opaque = _mm_movemask_epi8(_mm_cmpeq_epi32(a, amask));
+		if (opaque == 0xFFFF)
+		{
+			_mm_storeu_si128((__m128i *)dp, s);
+			continue;
+		}
+		if (opaque == 0 && _mm_movemask_epi8(_mm_cmpeq_epi32(a, zero)) == 0xFFFF)
+			continue;
+		d = _mm_loadu_si128((const __m128i *)dp);
+		d = _mm_packus_epi16(
+			over_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero)),
+			over_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero)));
+		_mm_storeu_si128((__m128i *)dp, d);
+	}
+	return i;
+}
+
+static inline __m128i
+over_alpha_sse2(__m128i s, __m128i d, __m128i alpha)
+{
+	__m128i masa = _mm_srli_epi16(_mm_mullo_epi16(alpha_sse2(s), alpha), 8);
+	__m128i r = _mm_add_epi16(_mm_mullo_epi16(s, masa),
+		_mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(256), masa)));
+	return _mm_srli_epi16(r, 8);
+}
+
+static int
+paint_span_4_with_alpha_sse2(byte * restrict dp, const byte * restrict sp, int w, int alpha)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i va = _mm_set1_epi16(FZ_EXPAND(alpha));
+	int i;
+
+	for (i = 0; i + 4 <= w; i += 4, sp += 16, dp += 16)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i *)sp);
+		__m128i d = _mm_loadu_si128((const __m128i *)dp);
+		d = _mm_packus_epi16(
+			over_alpha_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), va),
+			over_alpha_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), va));
+		_mm_storeu_si128((__m128i *)dp, d);
+	}
+	return i;
+}
+
+static inline __m128i
+in_over_sse2(__m128i s, __m128i d, __m128i ma)
+{
+	__m128i masa = _mm_srli_epi16(_mm_mullo_epi16(alpha_sse2(s), ma), 8);
+	masa = expand_sse2(_mm_sub_epi16(_mm_set1_epi16(255), masa));
+	s = _mm_srli_epi16(_mm_mullo_epi16(s, ma), 8);
+	d = _mm_srli_epi16(_mm_mullo_epi16(d, masa), 8);
+	return _mm_and_si128(_mm_add_epi16(s, d), _mm_set1_epi16(0xff));
+}
+
+static int
+paint_span_with_mask_4_sse2(byte * restrict dp, const byte * restrict sp, const byte * restrict mp, int w)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int i;
+
+	for (i = 0; i + 4 <= w; i += 4, sp += 16, dp += 16, mp += 4)
+	{
+		__m128i s, d, m;
+		if (load_u32(mp) == 0)
+			continue;
+		m = mask_sse2(mp);
+		s = _mm_loadu_si128((const __m128i *)sp);
+		d = _mm_loadu_si128((const __m128i *)dp);
+		d = _mm_packus_epi16(
+			in_over_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), expand_sse2(_mm_unpacklo_epi32(m, m))),
+			in_over_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), expand_sse2(_mm_unpackhi_epi32(m, m))));
+		_mm_storeu_si128((__m128i *)dp, d);
+	}
+	return i;
+}
+
+static inline __m128i
+color_over_sse2(__m128i c, __m128i d, __m128i ma)
+{
+	__m128i r = _mm_add_epi16(_mm_mullo_epi16(c, ma),
+		_mm_mullo_epi16(d, _mm_sub_epi16(_mm_set1_epi16(256), ma)));
+	return _mm_srli_epi16(r, 8);
+}
+
+static inline __m128i
+color_sse2(const byte *color)
+{
+	/* Painted alpha is always opaque, the color alpha only scales the coverage */
+	__m128i c = _mm_set1_epi32((int)(load_u32(color) | 0xFF000000));
+	return _mm_unpacklo_epi8(c, _mm_setzero_si128());
+}
+
+static int
+paint_solid_color_4_sse2(byte * restrict dp, int w, int sa, const byte *color)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c = color_sse2(color);
+	const __m128i ma = _mm_set1_epi16(sa);
+	int i;
+
+	for (i = 0; i + 4 <= w; i += 4, dp += 16)
+	{
+		__m128i d = _mm_loadu_si128((const __m128i *)dp);
+		d = _mm_packus_epi16(
+			color_over_sse2(c, _mm_unpacklo_epi8(d, zero), ma),
+			color_over_sse2(c, _mm_unpackhi_epi8(d, zero), ma));
+		_mm_storeu_si128((__m128i *)dp, d);
+	}
+	return i;
+}
+
+static int
+paint_span_with_color_4_sse2(byte * restrict dp, const byte * restrict mp, int w, int sa, const byte *color)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c = color_sse2(color);
+	const __m128i vsa = _mm_set1_epi16(sa);
+	const __m128i rgba = _mm_set1_epi32((int)(load_u32(color) | 0xFF000000));
+	int i;
+
+	for (i = 0; i + 4 <= w; i += 4, dp += 16, mp += 4)
+	{
+		__m128i d, m, lo, hi;
+		unsigned int m4 = load_u32(mp);
+		if (m4 == 0)
+			continue;
+		if (m4 == 0xFFFFFFFF && sa == 256)
+		{
+			_mm_storeu_si128((__m128i *)dp, rgba);
+			continue;
+		}
+		m = mask_sse2(mp);
+		lo = expand_sse2(_mm_unpacklo_epi32(m, m));
+		hi = expand_sse2(_mm_unpackhi_epi32(m, m));
+		if (sa != 256)
+		{
+			lo = _mm_srli_epi16(_mm_mullo_epi16(lo, vsa), 8);
+			hi = _mm_srli_epi16(_mm_mullo_epi16(hi, vsa), 8);
+		}
+		d = _mm_loadu_si128((const __m128i *)dp);
+		d = _mm_packus_epi16(
+			color_over_sse2(c, _mm_unpacklo_epi8(d, zero), lo),
+			color_over_sse2(c, _mm_unpackhi_epi8(d, zero), hi));
+		_mm_storeu_si128((__m128i *)dp, d);
+	}
+	return i;
+}
+
+static void
+paint_affine_lerp_4_sse2(byte *dp, const byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int alpha, byte *hp)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i c255 = _mm_set1_epi16(255);
+	const __m128i va = _mm_set1_epi16(alpha);
+	int stride = sw * 4;
+
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			const byte *s0 = sp + vi * stride + ui * 4;
+			int du = ui + 1 < sw ? 4 : 0;
+			int dv = vi + 1 < sh ? stride : 0;
+			__m128i ac = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, (int)load_u32(s0 + dv), (int)load_u32(s0)), zero);
+			__m128i bd = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, (int)load_u32(s0 + dv + du), (int)load_u32(s0 + du)), zero);
+			__m128i x = lerp_sse2(ac, bd, u & 0xffff);
+			__m128i t, d;
+			x = lerp_sse2(x, _mm_srli_si128(x, 8), v & 0xffff);
+			if (alpha != 255)
+				x = mul255_sse2(x, va);
+			t = _mm_sub_epi16(c255, _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)));
+			d = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)load_u32(dp)), zero);
+			/* Wraps like the scalar plotter instead of saturating in the pack */
+			d = _mm_and_si128(_mm_add_epi16(x, mul255_sse2(d, t)), _mm_set1_epi16(0xff));
+			store_u32(dp, (unsigned int)_mm_cvtsi128_si32(_mm_packus_epi16(d, d)));
+			if (hp)
+			{
+				int xa = _mm_extract_epi16(x, 3);
+				hp[0] = xa + fz_mul255(hp[0], 255 - xa);
+			}
+		}
+		dp += 4;
+		if (hp)
+			hp++;
+		u += fa;
+		v += fb;
+	}
+}
+
+#endif /* FZ_DRAW_SSE2 */
+
+#ifdef FZ_DRAW_AVX2
+
+/* The 256 bit forms work on two independent 128 bit halves, just like the SSE2 ones */
+
+static inline AVX2_TARGET __m256i
+alpha_avx2(__m256i x)
+{
+	x = _mm256_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm256_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+static inline AVX2_TARGET __m256i
+expand_avx2(__m256i x)
+{
+	return _mm256_add_epi16(x, _mm256_srli_epi16(x, 7));
+}
+
+static inline AVX2_TARGET __m256i
+mask_avx2(const byte *mp)
+{
+	__m256i x = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)mp));
+	return _mm256_or_si256(x, _mm256_slli_epi32(x, 16));
+}
+
+static inline AVX2_TARGET __m256i
+over_avx2(__m256i s, __m256i d)
+{
+	__m256i sa = alpha_avx2(s);
+	__m256i t = _mm256_sub_epi16(_mm256_set1_epi16(256), expand_avx2(sa));
+	__m256i r = _mm256_add_epi16(s, _mm256_srli_epi16(_mm256_mullo_epi16(d, t), 8));
+	__m256i keep = _mm256_cmpeq_epi16(sa, _mm256_setzero_si256());
+	r = _mm256_and_si256(r, _mm256_set1_epi16(0xff));
+	return _mm256_blendv_epi8(r, d, keep);
+}
+
+static AVX2_TARGET int
+paint_span_4_avx2(byte * restrict dp, const byte * restrict sp, int w)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i amask = _mm256_set1_epi32(0xFF000000);
+	int i;
+
+	for (i = 0; i + 8 <= w; i += 8, sp += 32, dp += 32)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i *)sp);
+		__m256i d, a = _mm256_and_si256(s, amask);
+		unsigned int opaque = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi32(a, amask));
+		if (opaque == 0xFFFFFFFF)
+		{
+			_mm256_storeu_si256((__m256i *)dp, s);
+			continue;
+		}
+		if (opaque == 0 && _mm256_testz_si256(a, a))
+			continue;
+		d = _mm256_loadu_si256((const __m256i *)dp);
+		d = _mm256_packus_epi16(
+			over_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero)),
+			over_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero)));
+		_mm256_storeu_si256((__m256i *)dp, d);
+	}
+	return i;
+}
+
+static inline AVX2_TARGET __m256i
+over_alpha_avx2(__m256i s, __m256i d, __m256i alpha)
+{
+	__m256i masa = _mm256_srli_epi16(_mm256_mullo_epi16(alpha_avx2(s), alpha), 8);
+	__m256i r = _mm256_add_epi16(_mm256_mullo_epi16(s, masa),
+		_mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(256), masa)));
+	return _mm256_srli_epi16(r, 8);
+}
+
+static AVX2_TARGET int
+paint_span_4_with_alpha_avx2(byte * restrict dp, const byte * restrict sp, int w, int alpha)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i va = _mm256_set1_epi16(FZ_EXPAND(alpha));
+	int i;
+
+	for (i = 0; i + 8 <= w; i += 8, sp += 32, dp += 32)
+	{
+		__m256i s = _mm256_loadu_si256((const __m256i *)sp);
+		__m256i d = _mm256_loadu_si256((const __m256i *)dp);
+		d = _mm256_packus_epi16(
+			over_alpha_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), va),
+			over_alpha_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), va));
+		_mm256_storeu_si256((__m256i *)dp, d);
+	}
+	return i;
+}
+
+static inline AVX2_TARGET __m256i
+in_over_avx2(__m256i s, __m256i d, __m256i ma)
+{
+	__m256i masa = _mm256_srli_epi16(_mm256_mullo_epi16(alpha_avx2(s), ma), 8);
+	masa = expand_avx2(_mm256_sub_epi16(_mm256_set1_epi16(255), masa));
+	s = _mm256_srli_epi16(_mm256_mullo_epi16(s, ma), 8);
+	d = _mm256_srli_epi16(_mm256_mullo_epi16(d, masa), 8);
+	return _mm256_and_si256(_mm256_add_epi16(s, d), _mm256_set1_epi16(0xff));
+}
+
+static AVX2_TARGET int
+paint_span_with_mask_4_avx2(byte * restrict dp, const byte * restrict sp, const byte * restrict mp, int w)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	int i;
+
+	for (i = 0; i + 8 <= w; i += 8, sp += 32, dp += 32, mp += 8)
+	{
+		__m256i s, d, m;
+		if ((load_u32(mp) | load_u32(mp + 4)) == 0)
+			continue;
+		m = mask_avx2(mp);
+		s = _mm256_loadu_si256((const __m256i *)sp);
+		d = _mm256_loadu_si256((const __m256i *)dp);
+		d = _mm256_packus_epi16(
+			in_over_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), expand_avx2(_mm256_unpacklo_epi32(m, m))),
+			in_over_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), expand_avx2(_mm256_unpackhi_epi32(m, m))));
+		_mm256_storeu_si256((__m256i *)dp, d);
+	}
+	return i;
+}
+
+static inline AVX2_TARGET __m256i
+color_over_avx2(__m256i c, __m256i d, __m256i ma)
+{
+	__m256i r = _mm256_add_epi16(_mm256_mullo_epi16(c, ma),
+		_mm256_mullo_epi16(d, _mm256_sub_epi16(_mm256_set1_epi16(256), ma)));
+	return _mm256_srli_epi16(r, 8);
+}
+
+static inline AVX2_TARGET __m256i
+color_avx2(const byte *color)
+{
+	__m256i c = _mm256_set1_epi32((int)(load_u32(color) | 0xFF000000));
+	return _mm256_unpacklo_epi8(c, _mm256_setzero_si256());
+}
+
+static AVX2_TARGET int
+paint_solid_color_4_avx2(byte * restrict dp, int w, int sa, const byte *color)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i c = color_avx2(color);
+	const __m256i ma = _mm256_set1_epi16(sa);
+	int i;
+
+	for (i = 0; i + 8 <= w; i += 8, dp += 32)
+	{
+		__m256i d = _mm256_loadu_si256((const __m256i *)dp);
+		d = _mm256_packus_epi16(
+			color_over_avx2(c, _mm256_unpacklo_epi8(d, zero), ma),
+			color_over_avx2(c, _mm256_unpackhi_epi8(d, zero), ma));
+		_mm256_storeu_si256((__m256i *)dp, d);
+	}
+	return i;
+}
+
+static AVX2_TARGET int
+paint_span_with_color_4_avx2(byte * restrict dp, const byte * restrict mp, int w, int sa, const byte *color)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i c = color_avx2(color);
+	const __m256i vsa = _mm256_set1_epi16(sa);
+	const __m256i rgba = _mm256_set1_epi32((int)(load_u32(color) | 0xFF000000));
+	int i;
+
+	for (i = 0; i + 8 <= w; i += 8, dp += 32, mp += 8)
+	{
+		__m256i d, m, lo, hi;
+		unsigned int m0 = load_u32(mp);
+		unsigned int m1 = load_u32(mp + 4);
+		if ((m0 | m1) == 0)
+			continue;
+		if ((m0 & m1) == 0xFFFFFFFF && sa == 256)
+		{
+			_mm256_storeu_si256((__m256i *)dp, rgba);
+			continue;
+		}
+		m = mask_avx2(mp);
+		lo = expand_avx2(_mm256_unpacklo_epi32(m, m));
+		hi = expand_avx2(_mm256_unpackhi_epi32(m, m));
+		if (sa != 256)
+		{
+			lo = _mm256_srli_epi16(_mm256_mullo_epi16(lo, vsa), 8);
+			hi = _mm256_srli_epi16(_mm256_mullo_epi16(hi, vsa), 8);
+		}
+		d = _mm256_loadu_si256((const __m256i *)dp);
+		d = _mm256_packus_epi16(
+			color_over_avx2(c, _mm256_unpacklo_epi8(d, zero), lo),
+			color_over_avx2(c, _mm256_unpackhi_epi8(d, zero), hi));
+		_mm256_storeu_si256((__m256i *)dp, d);
+	}
+	return i;
+}
+
+#endif /* FZ_DRAW_AVX2 */
+
+#ifdef FZ_DRAW_NEON
+
+/* NEON loads 8 pixels split into channel planes, so no lane shuffling is needed */
+
+static inline uint16x8_t
+expand_neon(uint16x8_t x)
+{
+	return vaddq_u16(x, vshrq_n_u16(x, 7));
+}
+
+static int
+paint_span_4_neon(byte * restrict dp, const byte * restrict sp, int w)
+{
+	const uint16x8_t c256 = vdupq_n_u16(256);
+	int i, k;
+
+	for (i = 0; i + 8 <= w; i += 8, sp += 32, dp += 32)
+	{
+		uint8x8x4_t s = vld4_u8(sp);
+		uint8x8x4_t d;
+		uint16x8_t sa, t;
+		uint8x8_t keep;
+		uint64_t a = vget_lane_u64(vreinterpret_u64_u8(s.val[3]), 0);
+		if (a == ~(uint64_t)0)
+		{
+			vst4_u8(dp, s);
+			continue;
+		}
+		if (a == 0)
+			continue;
+		d = vld4_u8(dp);
+		sa = vmovl_u8(s.val[3]);
+		t = vsubq_u16(c256, expand_neon(sa));
+		keep = vceq_u8(s.val[3], vdup_n_u8(0));
+		for (k = 0; k < 4; k++)
+		{
+			uint16x8_t r = vaddq_u16(vmovl_u8(s.val[k]), vshrq_n_u16(vmulq_u16(vmovl_u8(d.val[k]), t), 8));
+			d.val[k] = vbsl_u8(keep, d.val[k], vmovn_u16(r));
+		}
+		vst4_u8(dp, d);
+	}
+	return i;
+}
+
+static int
+paint_span_4_with_alpha_neon(byte * restrict dp, const byte * restrict sp, int w, int alpha)
+{
+	const uint16x8_t c256 = vdupq_n_u16(256);
+	const uint16x8_t va = vdupq_n_u16(FZ_EXPAND(alpha));
+	int i, k;
+
+	for (i = 0; i + 8 <= w; i += 8, sp += 32, dp += 32)
+	{
+		uint8x8x4_t s = vld4_u8(sp);
+		uint8x8x4_t d = vld4_u8(dp);
+		uint16x8_t masa = vshrq_n_u16(vmulq_u16(vmovl_u8(s.val[3]), va), 8);
+		uint16x8_t t = vsubq_u16(c256, masa);
+		for (k = 0; k < 4; k++)
+		{
+			uint16x8_t r = vmlaq_u16(vmulq_u16(vmovl_u8(s.val[k]), masa), vmovl_u8(d.val[k]), t);
+			d.val[k] = vshrn_n_u16(r, 8);
+		}
+		vst4_u8(dp, d);
+	}
+	return i;
+}
+
+static int
+paint_span_with_mask_4_neon(byte * restrict dp, const byte * restrict sp, const byte * restrict mp, int w)
+{
+	const uint16x8_t c255 = vdupq_n_u16(255);
+	int i, k;
+
+	for (i = 0; i + 8 <= w; i += 8, sp += 32, dp += 32, mp += 8)
+	{
+		uint8x8x4_t s, d;
+		uint16x8_t ma, masa;
+		uint8x8_t m = vld1_u8(mp);
+		if (vget_lane_u64(vreinterpret_u64_u8(m), 0) == 0)
+			continue;
+		s = vld4_u8(sp);
+		d = vld4_u8(dp);
+		ma = expand_neon(vmovl_u8(m));
+		masa = vshrq_n_u16(vmulq_u16(vmovl_u8(s.val[3]), ma), 8);
+		masa = expand_neon(vsubq_u16(c255, masa));
+		for (k = 0; k < 4; k++)
+		{
+			uint16x8_t r = vaddq_u16(
+				vshrq_n_u16(vmulq_u16(vmovl_u8(s.val[k]), ma), 8),
+				vshrq_n_u16(vmulq_u16(vmovl_u8(d.val[k]), masa), 8));
+			d.val[k] = vmovn_u16(r);
+		}
+		vst4_u8(dp, d);
+	}
+	return i;
+}
+
+static inline uint8x8_t
+color_over_neon(byte c, uint8x8_t d, uint16x8_t ma, uint16x8_t t)
+{
+	return vshrn_n_u16(vmlaq_u16(vmulq_u16(vdupq_n_u16(c), ma), vmovl_u8(d), t), 8);
+}
+
+static int
+paint_solid_color_4_neon(byte * restrict dp, int w, int sa, const byte *color)
+{
+	const uint16x8_t ma = vdupq_n_u16(sa);
+	const uint16x8_t t = vdupq_n_u16(256 - sa);
+	int i, k;
+
+	for (i = 0; i + 8 <= w; i += 8, dp += 32)
+	{
+		uint8x8x4_t d = vld4_u8(dp);
+		for (k = 0; k < 3; k++)
+			d.val[k] = color_over_neon(color[k], d.val[k], ma, t);
+		d.val[3] = color_over_neon(255, d.val[3], ma, t);
+		vst4_u8(dp, d);
+	}
+	return i;
+}
+
+static int
+paint_span_with_color_4_neon(byte * restrict dp, const byte * restrict mp, int w, int sa, const byte *color)
+{
+	const uint16x8_t c256 = vdupq_n_u16(256);
+	const uint16x8_t vsa = vdupq_n_u16(sa);
+	int i, k;
+
+	for (i = 0; i + 8 <= w; i += 8, dp += 32, mp += 8)
+	{
+		uint8x8x4_t d;
+		uint16x8_t ma, t;
+		uint8x8_t m = vld1_u8(mp);
+		uint64_t m8 = vget_lane_u64(vreinterpret_u64_u8(m), 0);
+		if (m8 == 0)
+			continue;
+		if (m8 == ~(uint64_t)0 && sa == 256)
+		{
+			for (k = 0; k < 3; k++)
+				d.val[k] = vdup_n_u8(color[k]);
+			d.val[3] = vdup_n_u8(255);
+			vst4_u8(dp, d);
+			continue;
+		}
+		d = vld4_u8(dp);
+		ma = expand_neon(vmovl_u8(m));
+		if (sa != 256)
+			ma = vshrq_n_u16(vmulq_u16(ma, vsa), 8);
+		t = vsubq_u16(c256, ma);
+		for (k = 0; k < 3; k++)
+			d.val[k] = color_over_neon(color[k], d.val[k], ma, t);
+		d.val[3] = color_over_neon(255, d.val[3], ma, t);
+		vst4_u8(dp, d);
+	}
+	return i;
+}
+
+/* a + ((b - a) * t >> 16), widened to 32 bits as t does not fit a signed 16 bit lane */
+static inline int16x8_t
+lerp_neon(int16x8_t a, int16x8_t b, int t)
+{
+	int16x8_t d = vsubq_s16(b, a);
+	int32x4_t lo = vshrq_n_s32(vmulq_n_s32(vmovl_s16(vget_low_s16(d)), t), 16);
+	int32x4_t hi = vshrq_n_s32(vmulq_n_s32(vmovl_s16(vget_high_s16(d)), t), 16);
+	return vaddq_s16(a, vcombine_s16(vmovn_s32(lo), vmovn_s32(hi)));
+}
+
+static inline uint16x4_t
+mul255_neon(uint16x4_t a, uint16x4_t b)
+{
+	uint16x4_t x = vadd_u16(vmul_u16(a, b), vdup_n_u16(128));
+	x = vadd_u16(x, vshr_n_u16(x, 8));
+	return vshr_n_u16(x, 8);
+}
+
+static void
+paint_affine_lerp_4_neon(byte *dp, const byte *sp, int sw, int sh, int u, int v, int fa, int fb, int w, int alpha, byte *hp)
+{
+	const uint16x4_t c255 = vdup_n_u16(255);
+	const uint16x4_t va = vdup_n_u16(alpha);
+	int stride = sw * 4;
+
+	while (w--)
+	{
+		int ui = u >> 16;
+		int vi = v >> 16;
+		if (ui >= 0 && ui < sw && vi >= 0 && vi < sh)
+		{
+			const byte *s0 = sp + vi * stride + ui * 4;
+			int du = ui + 1 < sw ? 4 : 0;
+			int dv = vi + 1 < sh ? stride : 0;
+			uint32x2_t ac = vset_lane_u32(load_u32(s0 + dv), vdup_n_u32(load_u32(s0)), 1);
+			uint32x2_t bd = vset_lane_u32(load_u32(s0 + dv + du), vdup_n_u32(load_u32(s0 + du)), 1);
+			int16x8_t h = lerp_neon(
+				vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(ac))),
+				vreinterpretq_s16_u16(vmovl_u8(vreinterpret_u8_u32(bd))), u & 0xffff);
+			int16x4_t y0 = vget_low_s16(h);
+			int16x4_t y1 = vget_high_s16(h);
+			int32x4_t y = vshrq_n_s32(vmulq_n_s32(vsubl_s16(y1, y0), v & 0xffff), 16);
+			uint16x4_t x = vreinterpret_u16_s16(vadd_s16(y0, vmovn_s32(y)));
+			uint16x4_t t, d;
+			int xa;
+			if (alpha != 255)
+				x = mul255_neon(x, va);
+			xa = vget_lane_u16(x, 3);
+			t = vsub_u16(c255, vdup_n_u16(xa));
+			d = vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(load_u32(dp)))));
+			d = vadd_u16(x, mul255_neon(d, t));
+			store_u32(dp, vget_lane_u32(vreinterpret_u32_u8(vmovn_u16(vcombine_u16(d, d))), 0));
+			if (hp)
+				hp[0] = xa + fz_mul255(hp[0], 255 - xa);
+		}
+		dp += 4;
+		if (hp)
+			hp++;
+		u += fa;
+		v += fb;
+	}
+}
+
+#endif /* FZ_DRAW_NEON */
+
+static int
+fz_detect_draw_simd(void)
+{
+	int support = FZ_DRAW_SIMD_NONE;
+	const char *env;
+
+#if defined(FZ_DRAW_NEON) && defined(__aarch64__)
+	support |= FZ_DRAW_SIMD_NEON;
+#elif defined(FZ_DRAW_NEON)
+	if (getauxval(AT_HWCAP) & HWCAP_NEON)
+		support |= FZ_DRAW_SIMD_NEON;
+#endif
+#ifdef FZ_DRAW_SSE2
+	support |= FZ_DRAW_SIMD_SSE2;
+#endif
+#ifdef FZ_DRAW_AVX2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		support |= FZ_DRAW_SIMD_AVX2;
+#endif
+
+	/* Same switch as the JPEG decoder uses to fall back to plain C */
+	env = getenv("JSIMD_FORCE_NO_SIMD");
+	if (env && !strcmp(env, "1"))
+		support = FZ_DRAW_SIMD_NONE;
+
+	return support;
+}
+
+void
+fz_init_draw_simd(void)
+{
+	int support;
+
+	if (fz_draw_simd_support >= 0)
+		return;
+
+	support = fz_detect_draw_simd();
+	memset(&fz_draw_simd_kernels, 0, sizeof fz_draw_simd_kernels);
+
+#ifdef FZ_DRAW_NEON
+	if (support & FZ_DRAW_SIMD_NEON)
+	{
+		fz_draw_simd_kernels.paint_solid_color_4 = paint_solid_color_4_neon;
+		fz_draw_simd_kernels.paint_span_4 = paint_span_4_neon;
+		fz_draw_simd_kernels.paint_span_4_with_alpha = paint_span_4_with_alpha_neon;
+		fz_draw_simd_kernels.paint_span_with_mask_4 = paint_span_with_mask_4_neon;
+		fz_draw_simd_kernels.paint_span_with_color_4 = paint_span_with_color_4_neon;
+		fz_draw_simd_kernels.paint_affine_lerp_4 = paint_affine_lerp_4_neon;
+	}
+#endif
+#ifdef FZ_DRAW_SSE2
+	if (support & FZ_DRAW_SIMD_SSE2)
+	{
+		fz_draw_simd_kernels.paint_solid_color_4 = paint_solid_color_4_sse2;
+		fz_draw_simd_kernels.paint_span_4 = paint_span_4_sse2;
+		fz_draw_simd_kernels.paint_span_4_with_alpha = paint_span_4_with_alpha_sse2;
+		fz_draw_simd_kernels.paint_span_with_mask_4 = paint_span_with_mask_4_sse2;
+		fz_draw_simd_kernels.paint_span_with_color_4 = paint_span_with_color_4_sse2;
+		fz_draw_simd_kernels.paint_affine_lerp_4 = paint_affine_lerp_4_sse2;
+	}
+#endif
+#ifdef FZ_DRAW_AVX2
+	/* Bilinear sampling is gather bound, it keeps the 128 bit kernel */
+	if (support & FZ_DRAW_SIMD_AVX2)
+	{
+		fz_draw_simd_kernels.paint_solid_color_4 = paint_solid_color_4_avx2;
+		fz_draw_simd_kernels.paint_span_4 = paint_span_4_avx2;
+		fz_draw_simd_kernels.paint_span_4_with_alpha = paint_span_4_with_alpha_avx2;
+		fz_draw_simd_kernels.paint_span_with_mask_4 = paint_span_with_mask_4_avx2;
+		fz_draw_simd_kernels.paint_span_with_color_4 = paint_span_with_color_4_avx2;
+	}
+#endif
+
+	fz_draw_simd_support = support;
+	LOGI("Draw SIMD support: %d", support);
+}
+
+// EBD: vector kernels for the n == 4 plotters <<<
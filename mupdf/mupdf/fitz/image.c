@@ -133,6 +133,125 @@ fz_unblend_masked_tile(fz_context *ctx, fz_pixmap *tile, fz_image *image)
 	fz_drop_pixmap(ctx, mask);
 }
 
+// EBD: banded subsampling >>>
+/* Average up to 1<<factor rows of a band into one row of the subsampled tile */
+static void
+fz_subsample_band(unsigned char *s, int w, int rows, int n, int factor, unsigned char *d)
+{
+	int f = 1<<factor;
+	int stride = w * n;
+	int x, xx, yy, k;
+
+	for (x = 0; x < w; x += f)
+	{
+		int cols = fz_mini(f, w - x);
+		int div = cols * rows;
+		for (k = 0; k < n; k++)
+		{
+			unsigned char *p = s + x * n + k;
+			int v = 0;
+			for (yy = 0; yy < rows; yy++, p += stride)
+				for (xx = 0; xx < cols; xx++)
+					v += p[xx * n];
+			*d++ = div == f * f ? v >> (factor * 2) : v / div;
+		}
+	}
+}
+
+/*
+	Decode the stream one band of 1<<factor rows at a time, so that
+	only the subsampled tile is held in memory instead of the whole image
+	followed by fz_subsample_pixmap.
+*/
+static fz_pixmap *
+fz_decomp_image_banded(fz_context *ctx, fz_stream *stm, fz_image *image, int indexed, int factor, int w, int h)
+{
+	fz_pixmap *tile = NULL;
+	fz_pixmap *band = NULL;
+	fz_pixmap *conv = NULL;
+	unsigned char *samples = NULL;
+	int f = 1<<factor;
+	int stride, len, rows, y, i;
+	int truncated = 0;
+
+	fz_var(tile);
+	fz_var(band);
+	fz_var(conv);
+	fz_var(samples);
+
+	fz_try(ctx)
+	{
+		stride = (w * image->n * image->bpc + 7) / 8;
+		samples = fz_malloc_array(ctx, f, stride);
+		band = fz_new_pixmap(ctx, image->colorspace, w, fz_mini(f, h));
+
+		for (y = 0; y < h; y += f)
+		{
+			fz_pixmap *src = band;
+
+			rows = fz_mini(f, h - y);
+			len = truncated ? 0 : fz_read(ctx, stm, samples, rows * stride);
+
+			/* Pad truncated images */
+			if (len < rows * stride)
+			{
+				if (!truncated)
+					fz_warn(ctx, "padding truncated image");
+				truncated = 1;
+				memset(samples + len, 0, rows * stride - len);
+			}
+
+			/* Invert 1-bit image masks */
+			if (image->imagemask)
+				for (i = 0; i < rows * stride; i++)
+					samples[i] = ~samples[i];
+
+			band->h = rows;
+			fz_unpack_tile(ctx, band, samples, image->n, image->bpc, stride, indexed);
+
+			/* color keyed transparency */
+			if (image->usecolorkey && !image->mask)
+				fz_mask_color_key(band, image->n, image->colorkey);
+
+			if (indexed)
+			{
+				fz_decode_indexed_tile(ctx, band, image->decode, (1 << image->bpc) - 1);
+				conv = fz_expand_indexed_pixmap(ctx, band);
+				src = conv;
+			}
+			else
+			{
+				fz_decode_tile(ctx, band, image->decode);
+			}
+
+			if (!tile)
+			{
+				tile = fz_new_pixmap(ctx, src->colorspace, (w + f-1) >> factor, (h + f-1) >> factor);
+				tile->interpolate = image->interpolate;
+			}
+			fz_subsample_band(src->samples, w, rows, src->n, factor, tile->samples + (y >> factor) * tile->w * tile->n);
+
+			fz_drop_pixmap(ctx, conv);
+			conv = NULL;
+		}
+	}
+	fz_always(ctx)
+	{
+		fz_drop_pixmap(ctx, conv);
+		fz_drop_pixmap(ctx, band);
+		fz_free(ctx, samples);
+		fz_drop_stream(ctx, stm);
+	}
+	fz_catch(ctx)
+	{
+		fz_drop_pixmap(ctx, tile);
+		fz_rethrow(ctx);
+	}
+
+	return tile;
+}
+// EBD: banded subsampling <<<
+
 fz_pixmap *
 fz_decomp_image_from_stream(fz_context *ctx, fz_stream *stm, fz_image *image, int indexed, int l2factor, int native_l2factor)
 {
@@ -143,6 +262,12 @@ fz_decomp_image_from_stream(fz_context *ctx, fz_stream *stm, fz_image *image, in
 	int w = (image->w + f-1) >> native_l2factor;
 	int h = (image->h + f-1) >> native_l2factor;
 
+	// EBD: banded subsampling >>>
+	/* /Matte unblending needs the mask at full image size, so such images keep the full path */
+	if (l2factor - native_l2factor > 0 && !(image->usecolorkey && image->mask))
+		return fz_decomp_image_banded(ctx, stm, image, indexed, fz_mini(l2factor - native_l2factor, 8), w, h);
+	// EBD: banded subsampling <<<
+
 	fz_var(tile);
 	fz_var(samples);
 
@@ -299,6 +424,18 @@ fz_image_get_pixmap(fz_context *ctx, fz_image *image, int w, int h)
 	case FZ_IMAGE_JXR:
 		tile = fz_load_jxr(ctx, image->buffer->buffer->data, image->buffer->buffer->len);
 		break;
+	// EBD: reduced resolution decoding >>>
+	case FZ_IMAGE_JPX:
+		native_l2factor = l2factor;
+		tile = fz_load_jpx_reduced(ctx, image->buffer->buffer->data, image->buffer->buffer->len, image->colorspace, 0, &native_l2factor);
+		if (tile->colorspace == image->colorspace)
+			fz_decode_tile(ctx, tile, image->decode);
+
+		/* Now apply any extra subsampling required */
+		if (l2factor - native_l2factor > 0)
+			fz_subsample_pixmap(ctx, tile, l2factor - native_l2factor);
+		break;
+	// EBD: reduced resolution decoding <<<
 	case FZ_IMAGE_JPEG:
 		/* Scan JPEG stream and patch missing height values in header */
 		{
@@ -1388,6 +1388,14 @@ fz_drop_display_list(fz_context *ctx, fz_display_list *list)
 	fz_drop_storable(ctx, &list->storable);
 }
 
+size_t
+fz_display_list_size(fz_context *ctx, fz_display_list *list)
+{
+	if (list == NULL)
+		return 0;
+	return sizeof(*list) + (size_t)list->max * sizeof(fz_display_node);
+}
+
 void
 fz_run_display_list(fz_context *ctx, fz_display_list *list, fz_device *dev, const fz_matrix *top_ctm, const fz_rect *scissor, fz_cookie *cookie)
 {
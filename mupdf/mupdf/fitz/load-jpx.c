@@ -79,8 +79,36 @@ static inline unsigned int read_value(const unsigned char *data, int bytes)
 	return value;
 }
 
+// EBD: reduced resolution decoding >>>
+/* Largest resolution reduction every component of the main header allows */
+static int
+fz_opj_max_reduce(opj_codec_t *codec, int wanted)
+{
+	opj_codestream_info_v2_t *info = opj_get_cstr_info(codec);
+	OPJ_UINT32 k;
+
+	if (!info)
+		return 0;
+	for (k = 0; k < info->nbcomps; k++)
+	{
+		int numres = info->m_default_tile_info.tccp_info[k].numresolutions;
+		if (wanted > numres - 1)
+			wanted = numres - 1;
+	}
+	opj_destroy_cstr_info(&info);
+
+	return wanted > 0 ? wanted : 0;
+}
+
 fz_pixmap *
 fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs, int indexed)
+{
+	return fz_load_jpx_reduced(ctx, data, size, defcs, indexed, NULL);
+}
+// EBD: reduced resolution decoding <<<
+
+fz_pixmap *
+fz_load_jpx_reduced(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs, int indexed, int *l2factor)
 {
 	fz_pixmap *img;
 	opj_dparameters_t params;
@@ -136,11 +164,31 @@ fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *defcs
 		fz_throw(ctx, FZ_ERROR_GENERIC, "Failed to read JPX header");
 	}
 
+	// EBD: reduced resolution decoding >>>
+	/* Skip the finest wavelet levels instead of decoding and then throwing them away */
+	if (l2factor)
+	{
+		int reduce = fz_opj_max_reduce(codec, *l2factor);
+		if (reduce > 0 && !opj_set_decoded_resolution_factor(codec, reduce))
+			reduce = 0;
+		*l2factor = reduce;
+	}
+	// EBD: reduced resolution decoding <<<
+
 	if (!opj_decode(codec, stream, jpx))
 	{
 		opj_stream_destroy(stream);
 		opj_destroy_codec(codec);
 		opj_image_destroy(jpx);
+		// EBD: reduced resolution decoding >>>
+		/* Tile headers may code fewer resolutions than the main header */
+		if (l2factor && *l2factor > 0)
+		{
+			fz_warn(ctx, "retrying JPX decode at full resolution");
+			*l2factor = 0;
+			return fz_load_jpx_reduced(ctx, data, size, defcs, indexed, NULL);
+		}
+		// EBD: reduced resolution decoding <<<
 		fz_throw(ctx, FZ_ERROR_GENERIC, "Failed to decode JPX image");
 	}
 
@@ -153,6 +153,228 @@ fz_open_fd(fz_context *ctx, int fd)
 	return stm;
 }
 
+/* Mapped file stream */
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define MAPPED_FILE_FALLBACK_BUFFER (256 << 10)
+
+/* Outlives contexts, so it is allocated with malloc and not with the context allocator */
+struct fz_file_mapping_s
+{
+	int refs;
+	int file;
+	unsigned char *data;
+	int len;
+};
+
+typedef struct fz_mapped_file_stream_s
+{
+	fz_file_mapping *map;
+	/* pread() fallback only: absolute file position of wp and buffer */
+	int filepos;
+	unsigned char *buffer;
+} fz_mapped_file_stream;
+
+fz_file_mapping *
+fz_new_file_mapping(fz_context *ctx, int fd)
+{
+	fz_file_mapping *map = calloc(1, sizeof(fz_file_mapping));
+	if (!map)
+	{
+		close(fd);
+		fz_throw(ctx, FZ_ERROR_GENERIC, "cannot allocate file mapping");
+	}
+	map->refs = 1;
+	map->file = fd;
+#if !defined(_WIN32) && !defined(_WIN64)
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0 && st.st_size <= INT_MAX)
+		{
+			void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+			if (data != MAP_FAILED)
+			{
+				map->data = data;
+				map->len = st.st_size;
+				/* xref, object and image streams are read at random offsets */
+				madvise(data, st.st_size, MADV_RANDOM);
+			}
+			else
+			{
+				fz_warn(ctx, "cannot map file, reading it instead: %s", strerror(errno));
+			}
+		}
+		if (!map->data)
+		{
+			int len = lseek(fd, 0, SEEK_END);
+			map->len = len > 0 ? len : 0;
+		}
+	}
+#endif
+	return map;
+}
+
+fz_file_mapping *
+fz_keep_file_mapping(fz_context *ctx, fz_file_mapping *map)
+{
+	if (map)
+		__sync_add_and_fetch(&map->refs, 1);
+	return map;
+}
+
+void
+fz_drop_file_mapping(fz_context *ctx, fz_file_mapping *map)
+{
+	if (!map || __sync_sub_and_fetch(&map->refs, 1) > 0)
+		return;
+#if !defined(_WIN32) && !defined(_WIN64)
+	if (map->data)
+		munmap(map->data, map->len);
+#endif
+	close(map->file);
+	free(map);
+}
+
+static int mapped_file_base(fz_context *ctx, fz_file_mapping *map)
+{
+	/// EBD: corrupted files with garbage on start >>>
+	int base = ctx->ebookdroid_file_stream_offset;
+	/// EBD: corrupted files with garbage on start <<<
+	if (base < 0)
+		return 0;
+	return base > map->len ? map->len : base;
+}
+
+/* Whole mapping is the stream buffer, so there is never anything more to read */
+static int next_mapped_file(fz_context *ctx, fz_stream *stm, int n)
+{
+	return EOF;
+}
+
+static void seek_mapped_file(fz_context *ctx, fz_stream *stm, int offset, int whence)
+{
+	fz_mapped_file_stream *state = stm->state;
+	fz_file_mapping *map = state->map;
+	int base = mapped_file_base(ctx, map);
+	if (whence == SEEK_SET)
+		offset += base;
+	else if (whence == SEEK_CUR)
+		offset += stm->rp - map->data;
+	else
+		offset += map->len;
+	if (offset < 0)
+		offset = 0;
+	if (offset > map->len)
+		offset = map->len;
+	stm->rp = map->data + offset;
+	stm->wp = map->data + map->len;
+	stm->pos = map->len - base;
+}
+
+static int next_pread_file(fz_context *ctx, fz_stream *stm, int n)
+{
+	fz_mapped_file_stream *state = stm->state;
+
+	/* n is only a hint, that we can safely ignore */
+	n = pread(state->map->file, state->buffer, MAPPED_FILE_FALLBACK_BUFFER, state->filepos);
+	if (n < 0)
+		fz_throw(ctx, FZ_ERROR_GENERIC, "read error: %s", strerror(errno));
+	stm->rp = state->buffer;
+	stm->wp = state->buffer + n;
+	stm->pos += n;
+	state->filepos += n;
+
+	if (n == 0)
+		return EOF;
+	return *stm->rp++;
+}
+
+static void seek_pread_file(fz_context *ctx, fz_stream *stm, int offset, int whence)
+{
+	fz_mapped_file_stream *state = stm->state;
+	int base = mapped_file_base(ctx, state->map);
+	if (whence == SEEK_SET)
+		offset += base;
+	else if (whence == SEEK_CUR)
+		offset += state->filepos - (stm->wp - stm->rp);
+	else
+		offset += state->map->len;
+	if (offset < 0)
+		fz_throw(ctx, FZ_ERROR_GENERIC, "cannot seek to negative offset");
+	state->filepos = offset;
+	stm->pos = offset - base;
+	stm->rp = state->buffer;
+	stm->wp = state->buffer;
+}
+
+static void close_mapped_file(fz_context *ctx, void *state_)
+{
+	fz_mapped_file_stream *state = state_;
+	fz_drop_file_mapping(ctx, state->map);
+	fz_free(ctx, state->buffer);
+	fz_free(ctx, state);
+}
+
+static int meta_mapped_file(fz_context *ctx, fz_stream *stm, int key, int size, void *ptr)
+{
+	fz_mapped_file_stream *state = stm->state;
+	switch(key)
+	{
+	case FZ_STREAM_META_PROGRESSIVE:
+		return 0;
+	case FZ_STREAM_META_LENGTH:
+		return state->map->len;
+	}
+	return -1;
+}
+
+fz_stream *
+fz_open_file_mapping(fz_context *ctx, fz_file_mapping *map)
+{
+	fz_stream *stm;
+	fz_mapped_file_stream *state;
+
+#if defined(_WIN32) || defined(_WIN64)
+	return fz_open_fd(ctx, dup(map->file));
+#endif
+
+	state = fz_malloc_struct(ctx, fz_mapped_file_stream);
+	if (!map->data)
+	{
+		fz_try(ctx)
+		{
+			state->buffer = fz_malloc(ctx, MAPPED_FILE_FALLBACK_BUFFER);
+		}
+		fz_catch(ctx)
+		{
+			fz_free(ctx, state);
+			fz_rethrow(ctx);
+		}
+	}
+	state->map = fz_keep_file_mapping(ctx, map);
+
+	/* state is closed by fz_new_stream on failure */
+	stm = fz_new_stream(ctx, state, map->data ? next_mapped_file : next_pread_file, close_mapped_file);
+	if (map->data)
+	{
+		stm->seek = seek_mapped_file;
+		stm->rp = map->data;
+		stm->wp = map->data + map->len;
+		stm->pos = map->len;
+	}
+	else
+	{
+		stm->seek = seek_pread_file;
+	}
+	stm->meta = meta_mapped_file;
+
+	return stm;
+}
+
 fz_stream *
 fz_open_file(fz_context *ctx, const char *name)
 {
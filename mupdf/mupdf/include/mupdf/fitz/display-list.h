@@ -88,4 +88,13 @@ fz_display_list *fz_keep_display_list(fz_context *ctx, fz_display_list *list);
 */
 void fz_drop_display_list(fz_context *ctx, fz_display_list *list);
 
+/*
+	fz_display_list_size: Return the number of bytes allocated for
+	the nodes of a display list. Fonts, images and shadings referenced
+	by the list are shared through the store and not counted.
+
+	Does not throw exceptions.
+*/
+size_t fz_display_list_size(fz_context *ctx, fz_display_list *list);
+
 #endif
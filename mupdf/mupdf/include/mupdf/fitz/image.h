@@ -81,6 +81,14 @@ struct fz_image_s
 };
 
 fz_pixmap *fz_load_jpx(fz_context *ctx, unsigned char *data, int size, fz_colorspace *cs, int indexed);
+// EBD: reduced resolution decoding >>>
+/*
+	fz_load_jpx_reduced: Decode a JPEG 2000 image with up to *l2factor
+	wavelet levels skipped. On return *l2factor holds the reduction
+	actually applied, each level halves the width and height.
+*/
+fz_pixmap *fz_load_jpx_reduced(fz_context *ctx, unsigned char *data, int size, fz_colorspace *cs, int indexed, int *l2factor);
+// EBD: reduced resolution decoding <<<
 fz_pixmap *fz_load_png(fz_context *ctx, unsigned char *data, int size);
 fz_pixmap *fz_load_tiff(fz_context *ctx, unsigned char *data, int size);
 fz_pixmap *fz_load_jxr(fz_context *ctx, unsigned char *data, int size);
@@ -52,6 +52,36 @@ fz_stream *fz_open_file_w(fz_context *ctx, const wchar_t *filename);
 */
 fz_stream *fz_open_fd(fz_context *ctx, int file);
 
+/*
+	fz_file_mapping: Read only memory mapping of a whole file,
+	shared by streams opened on it with fz_open_file_mapping.
+
+	Mappings are not bound to a context, so they may be kept
+	while contexts are dropped and created again.
+*/
+typedef struct fz_file_mapping_s fz_file_mapping;
+
+/*
+	fz_new_file_mapping: Map an open file descriptor.
+
+	file: An open file descriptor, the mapping takes ownership
+	of it and closes it when the last reference is dropped.
+	If the file cannot be mapped, streams read it with pread()
+	into large buffers instead.
+*/
+fz_file_mapping *fz_new_file_mapping(fz_context *ctx, int file);
+
+fz_file_mapping *fz_keep_file_mapping(fz_context *ctx, fz_file_mapping *map);
+
+void fz_drop_file_mapping(fz_context *ctx, fz_file_mapping *map);
+
+/*
+	fz_open_file_mapping: Open a stream serving data straight
+	from the mapping, with no copies and no system calls.
+	The stream keeps a reference to the mapping.
+*/
+fz_stream *fz_open_file_mapping(fz_context *ctx, fz_file_mapping *map);
+
 /*
 	fz_open_memory: Open a block of memory as a stream.
 
@@ -211,6 +211,9 @@ pdf_load_jpx(fz_context *ctx, pdf_document *doc, pdf_obj *dict, int forcemask)
 	int indexed = 0;
 	fz_image *mask = NULL;
 	fz_image *img = NULL;
+	// EBD: reduced resolution decoding >>>
+	int w, h;
+	// EBD: reduced resolution decoding <<<
 
 	fz_var(pix);
 	fz_var(buf);
@@ -229,8 +232,6 @@ pdf_load_jpx(fz_context *ctx, pdf_document *doc, pdf_obj *dict, int forcemask)
 			indexed = fz_colorspace_is_indexed(ctx, colorspace);
 		}
 
-		pix = fz_load_jpx(ctx, buf->data, buf->len, colorspace, indexed);
-
 		obj = pdf_dict_geta(ctx, dict, PDF_NAME_SMask, PDF_NAME_Mask);
 		if (pdf_is_dict(ctx, obj))
 		{
@@ -240,6 +241,41 @@ pdf_load_jpx(fz_context *ctx, pdf_document *doc, pdf_obj *dict, int forcemask)
 				mask = pdf_load_image_imp(ctx, doc, NULL, obj, NULL, 1);
 		}
 
+		// EBD: reduced resolution decoding >>>
+		/* Keep the codestream and decode it on demand at the displayed size.
+		 * Soft masks, palettes and images without colorspace need the decoded pixmap now. */
+		w = pdf_to_int(ctx, pdf_dict_geta(ctx, dict, PDF_NAME_Width, PDF_NAME_W));
+		h = pdf_to_int(ctx, pdf_dict_geta(ctx, dict, PDF_NAME_Height, PDF_NAME_H));
+		if (colorspace && !indexed && !forcemask && w > 0 && h > 0)
+		{
+			fz_compressed_buffer *bc;
+			float decode[FZ_MAX_COLORS * 2];
+			float *decodep = NULL;
+			int i;
+
+			obj = pdf_dict_geta(ctx, dict, PDF_NAME_Decode, PDF_NAME_D);
+			if (obj)
+			{
+				for (i = 0; i < colorspace->n * 2; i++)
+					decode[i] = pdf_to_real(ctx, pdf_array_get(ctx, obj, i));
+				decodep = decode;
+			}
+
+			bc = fz_malloc_struct(ctx, fz_compressed_buffer);
+			bc->buffer = fz_keep_buffer(ctx, buf);
+			bc->params.type = FZ_IMAGE_JPX;
+			bc->params.u.jpx.smask_in_data = pdf_to_int(ctx, pdf_dict_get(ctx, dict, PDF_NAME_SMaskInData));
+
+			/* fz_new_image takes over the colorspace, the buffer and the mask */
+			img = fz_new_image(ctx, w, h, 8, colorspace, 96, 96, 0, 0, decodep, NULL, bc, mask);
+			colorspace = NULL;
+			mask = NULL;
+			break; /* Out of fz_try */
+		}
+		// EBD: reduced resolution decoding <<<
+
+		pix = fz_load_jpx(ctx, buf->data, buf->len, colorspace, indexed);
+
 		obj = pdf_dict_geta(ctx, dict, PDF_NAME_Decode, PDF_NAME_D);
 		if (obj && !indexed)
 		{
@@ -62,7 +62,7 @@ LOCAL_MODULE := openjpeg-simd-sse
  
 LOCAL_MODULE_TAGS := release
 
-LOCAL_CFLAGS    := $(APP_CFLAGS)   -D__SSE__
+LOCAL_CFLAGS    := $(APP_CFLAGS)   -D__SSE__ -msse2
 LOCAL_CPPFLAGS  := $(APP_CPPFLAGS)
 
 LOCAL_C_INCLUDES := \
@@ -59,6 +59,7 @@ int opj_init_simd()
 
   simd_support = 0;
 
+  /* The NEON kernels are not yet checked against the scalar decoder, so they stay opt-in */
   char *env = getenv("JSIMD_FORCE_ARM_NEON");
   if ((env != NULL) && (strcmp(env, "1") == 0))
   {
@@ -59,6 +59,16 @@ int opj_init_simd()
 
   simd_support = 0;
 
+  /* SSE2 is part of the x86_64 baseline and of the Android x86 ABI */
+#if defined(__x86_64__) || defined(__SSE2__)
+  simd_support |= JSIMD_SSE | JSIMD_SSE2;
+#elif defined(__i386__)
+  if (__builtin_cpu_supports("sse2"))
+  {
+    simd_support |= JSIMD_SSE | JSIMD_SSE2;
+  }
+#endif
+
   /* Force different settings through environment variables */
   char *env = getenv("JSIMD_FORCESSE2");
 
@@ -39,13 +39,32 @@
  */
 
 
-#include <xmmintrin.h>
+#include <emmintrin.h>
 
 #include "opj_simd.h"
 
 void opj_mct_decode_simd(OPJ_INT32* restrict c0, OPJ_INT32* restrict c1, OPJ_INT32* restrict c2, OPJ_UINT32 n)
 {
     OPJ_UINT32 i;
+    for (i = 0; i < (n >> 2); ++i)
+    {
+        __m128i vy, vu, vv;
+        __m128i vr, vg, vb;
+
+        vy = _mm_loadu_si128((const __m128i*) c0);
+        vu = _mm_loadu_si128((const __m128i*) c1);
+        vv = _mm_loadu_si128((const __m128i*) c2);
+        vg = _mm_sub_epi32(vy, _mm_srai_epi32(_mm_add_epi32(vu, vv), 2));
+        vr = _mm_add_epi32(vv, vg);
+        vb = _mm_add_epi32(vu, vg);
+        _mm_storeu_si128((__m128i*) c0, vr);
+        _mm_storeu_si128((__m128i*) c1, vg);
+        _mm_storeu_si128((__m128i*) c2, vb);
+        c0 += 4;
+        c1 += 4;
+        c2 += 4;
+    }
+    n &= 3;
     for (i = 0; i < n; ++i)
     {
         OPJ_INT32 y = c0[i];
@@ -74,28 +93,28 @@ void opj_mct_decode_real_simd(OPJ_FLOAT32* restrict c0, OPJ_FLOAT32* restrict c1
         __m128 vy, vu, vv;
         __m128 vr, vg, vb;
 
-        vy = _mm_load_ps(c0);
-        vu = _mm_load_ps(c1);
-        vv = _mm_load_ps(c2);
+        vy = _mm_loadu_ps(c0);
+        vu = _mm_loadu_ps(c1);
+        vv = _mm_loadu_ps(c2);
         vr = _mm_add_ps(vy, _mm_mul_ps(vv, vrv));
         vg = _mm_sub_ps(_mm_sub_ps(vy, _mm_mul_ps(vu, vgu)), _mm_mul_ps(vv, vgv));
         vb = _mm_add_ps(vy, _mm_mul_ps(vu, vbu));
-        _mm_store_ps(c0, vr);
-        _mm_store_ps(c1, vg);
-        _mm_store_ps(c2, vb);
+        _mm_storeu_ps(c0, vr);
+        _mm_storeu_ps(c1, vg);
+        _mm_storeu_ps(c2, vb);
         c0 += 4;
         c1 += 4;
         c2 += 4;
 
-        vy = _mm_load_ps(c0);
-        vu = _mm_load_ps(c1);
-        vv = _mm_load_ps(c2);
+        vy = _mm_loadu_ps(c0);
+        vu = _mm_loadu_ps(c1);
+        vv = _mm_loadu_ps(c2);
         vr = _mm_add_ps(vy, _mm_mul_ps(vv, vrv));
         vg = _mm_sub_ps(_mm_sub_ps(vy, _mm_mul_ps(vu, vgu)), _mm_mul_ps(vv, vgv));
         vb = _mm_add_ps(vy, _mm_mul_ps(vu, vbu));
-        _mm_store_ps(c0, vr);
-        _mm_store_ps(c1, vg);
-        _mm_store_ps(c2, vb);
+        _mm_storeu_ps(c0, vr);
+        _mm_storeu_ps(c1, vg);
+        _mm_storeu_ps(c2, vb);
         c0 += 4;
         c1 += 4;
         c2 += 4;
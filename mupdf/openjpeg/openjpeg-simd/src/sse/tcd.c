@@ -39,7 +39,7 @@
  */
 
 
-#include <xmmintrin.h>
+#include <emmintrin.h>
 
 #include "opj_simd.h"
 
@@ -64,13 +64,31 @@ static INLINE OPJ_INT32 clamp(OPJ_INT32 a, OPJ_INT32 min, OPJ_INT32 max) {
     return a;
 }
 
+/* SSE2 has no 32-bit min/max, select through compare masks instead */
+static INLINE __m128i clamp_epi32(__m128i a, __m128i min, __m128i max) {
+    __m128i m = _mm_cmplt_epi32(a, min);
+    a = _mm_or_si128(_mm_and_si128(m, min), _mm_andnot_si128(m, a));
+    m = _mm_cmpgt_epi32(a, max);
+    return _mm_or_si128(_mm_and_si128(m, max), _mm_andnot_si128(m, a));
+}
+
 void opj_tcd_dc_lsc_simd(OPJ_INT32* l_current_ptr, OPJ_UINT32 l_height, OPJ_UINT32 l_width, OPJ_UINT32 l_stride,
                          OPJ_INT32 m_dc_level_shift, OPJ_INT32 l_min, OPJ_INT32 l_max)
 {
+    const __m128i shift = _mm_set1_epi32(m_dc_level_shift);
+    const __m128i lower = _mm_set1_epi32(l_min);
+    const __m128i higher = _mm_set1_epi32(l_max);
     OPJ_UINT32 i, j;
     for (j = 0; j < l_height; ++j)
     {
-        for (i = 0; i < l_width; ++i)
+        for (i = 0; i + 4 <= l_width; i += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*) l_current_ptr);
+            v = clamp_epi32(_mm_add_epi32(v, shift), lower, higher);
+            _mm_storeu_si128((__m128i*) l_current_ptr, v);
+            l_current_ptr += 4;
+        }
+        for (; i < l_width; ++i)
         {
             OPJ_INT32 l_value = *l_current_ptr;
             *l_current_ptr = clamp(l_value + m_dc_level_shift, l_min, l_max);
@@ -83,17 +101,27 @@ void opj_tcd_dc_lsc_simd(OPJ_INT32* l_current_ptr, OPJ_UINT32 l_height, OPJ_UINT
 void opj_tcd_dc_lsc_real_simd(OPJ_INT32* l_current_ptr, OPJ_UINT32 l_height, OPJ_UINT32 l_width, OPJ_UINT32 l_stride,
                               OPJ_INT32 m_dc_level_shift, OPJ_INT32 l_min, OPJ_INT32 l_max)
 {
-    OPJ_UINT32 i, j, n;
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i shift = _mm_set1_epi32(m_dc_level_shift);
+    const __m128i lower = _mm_set1_epi32(l_min);
+    const __m128i higher = _mm_set1_epi32(l_max);
+    OPJ_UINT32 i, j;
 
     for (j = 0; j < l_height; ++j)
     {
-        i = 0;
-        while (i < l_width)
+        for (i = 0; i + 4 <= l_width; i += 4)
+        {
+            /* Truncating conversion matches the (OPJ_INT32) (0.5f + value) cast of the scalar code */
+            __m128 f = _mm_add_ps(_mm_loadu_ps((const OPJ_FLOAT32*) l_current_ptr), half);
+            __m128i v = clamp_epi32(_mm_add_epi32(_mm_cvttps_epi32(f), shift), lower, higher);
+            _mm_storeu_si128((__m128i*) l_current_ptr, v);
+            l_current_ptr += 4;
+        }
+        for (; i < l_width; ++i)
         {
             OPJ_INT32 l_value = (OPJ_INT32) (0.5f + *((OPJ_FLOAT32 *) l_current_ptr));
             *l_current_ptr = clamp(l_value + m_dc_level_shift, l_min, l_max);
             ++l_current_ptr;
-            ++i;
         }
         l_current_ptr += l_stride;
     }
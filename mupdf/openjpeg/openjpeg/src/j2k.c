@@ -9460,6 +9460,19 @@ OPJ_BOOL opj_j2k_decode(opj_j2k_t * p_j2k,
         if (! (p_j2k->m_output_image)) {
                 return OPJ_FALSE;
         }
+
+        // !!! EBD: honour opj_set_decoded_resolution_factor() called after opj_read_header(),
+        // the caller image still has full-size components at this point
+        if (p_j2k->m_cp.m_specific_param.m_dec.m_reduce > 0 && p_j2k->m_private_image &&
+            p_j2k->m_private_image->numcomps > 0 &&
+            p_j2k->m_private_image->comps[0].factor == p_j2k->m_cp.m_specific_param.m_dec.m_reduce &&
+            p_image->numcomps > 0 && p_image->comps[0].factor == 0 && p_image->comps[0].data == NULL) {
+                for (compno = 0; compno < p_image->numcomps; compno++) {
+                        p_image->comps[compno].factor = p_j2k->m_cp.m_specific_param.m_dec.m_reduce;
+                }
+                opj_image_comp_header_update(p_image, &p_j2k->m_cp);
+        }
+
         opj_copy_image_header(p_image, p_j2k->m_output_image);
 
         /* customization of the decoding */
@@ -10,10 +10,14 @@ LOCAL_C_INCLUDES := \
 LOCAL_SRC_FILES := \
 	src/StBridge.cpp \
 	src/StProtocol.cpp \
+	src/StPageCache.cpp \
 	src/StQueue.cpp \
 	src/StRequestQueue.cpp \
 	src/StResponseQueue.cpp \
+	src/StSharedMemory.cpp \
 	src/StStringNaturalCompare.cpp \
+	src/StTextIndex.cpp \
+	src/StTileCache.cpp \
 	src/StSocket.cpp \
 	src/thornyreader.cpp
 
@@ -17,16 +17,46 @@
 #ifndef __ST_BRIDGE_H__
 #define __ST_BRIDGE_H__
 
+#include <pthread.h>
+#include <deque>
+
 #include "StProtocol.h"
+#include "StSharedMemory.h"
+#include "StTextIndex.h"
+
+class RequestQueue;
+class ResponseQueue;
 
 class StBridge
 {
 protected:
     const char* lctx;
+    StSharedMemory shared;
+
+    /**
+     * Set by the request reader thread when CMD_REQ_CANCEL targets the request being processed,
+     * only for commands without lasting effects (see isCancellable()). Long running operations
+     * should poll it and, when they actually stop early, set RES_CANCELLED as the result.
+     */
+    volatile bool cancelled;
+
+private:
+    RequestQueue* in;
+    ResponseQueue* out;
+
+    pthread_t reader;
+    pthread_mutex_t pendinglock;
+    pthread_cond_t pendingcond;
+    std::deque<CmdRequest*> pending;
+    bool eof;
+    bool barrier;
+    bool running;
+    uint32_t runningId;
+    uint8_t runningCmd;
 
 public:
-    StBridge(const char* lctx) { this->lctx = lctx; };
-    virtual ~StBridge() {};
+    StBridge(const char* lctx);
+    virtual ~StBridge();
 
 public:
     int main(int argc, char *argv[]);
@@ -36,6 +66,77 @@ public:
 protected:
 
     void renice();
+
+    void processSharedMemory(CmdRequest& request, CmdResponse& response);
+
+    /**
+     * Called on the request reader thread after the cancelled flag has been raised.
+     * Bridges may override it to abort native work in progress.
+     */
+    virtual void cancelRunning() {}
+
+    bool isCancelled() const { return cancelled; }
+
+    /**
+     * Runs one unit of background work while no request is pending.
+     * Returns false when nothing is left to do, the bridge then sleeps until the next request.
+     */
+    virtual bool idle() { return false; }
+
+    /**
+     * Called on the request reader thread when a request arrives, so that idle work
+     * in progress can stop early and give way to the client. The request is already queued
+     * and must not be modified.
+     */
+    virtual void preemptIdle(const CmdRequest& request) {}
+
+    bool hasPendingRequests();
+
+    /**
+     * True once the client negotiated PROTOCOL_VERSION_2, so responses may be partial or unprompted.
+     */
+    bool isTagged() const;
+
+    /**
+     * Writes an intermediate RES_PARTIAL response for the request being processed.
+     * Version 1 clients expect exactly one response per request: nothing is written then
+     * and false is returned, callers fold the data into the final response instead.
+     */
+    bool sendPartial(CmdResponse& response);
+
+    /**
+     * Writes a response not bound to any request, e.g. when idle work changes document state.
+     * Version 1 clients would take it for the response to their next request: nothing is
+     * written then and false is returned.
+     */
+    bool sendNotification(CmdResponse& response);
+
+    /**
+     * Handles CMD_REQ_SEARCH: walks pages starting from the requested one, indexing the ones
+     * not visited yet with indexText(), and streams hits of every page as a partial response.
+     */
+    void processSearch(CmdRequest& request, CmdResponse& response, StTextIndex& index, uint32_t pageCount);
+
+    /**
+     * Adds words of the page to the index. Called for pages not yet indexed.
+     */
+    virtual void indexText(uint32_t pageNo, StTextIndex& index) {}
+
+private:
+    static void* readerThread(void* arg);
+    void readRequests();
+
+    void pushRequest(CmdRequest* request);
+    CmdRequest* takeRequest();
+    void finishRequest(CmdRequest* request);
+
+    /**
+     * Render, tile, search and thumbnail requests only read the document and may be stopped.
+     */
+    static bool isCancellable(uint8_t cmd);
+
+    int processProtocol(CmdRequest& request, CmdResponse& response);
+    void processCancel(CmdRequest& request);
 };
 
 #endif
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2013 The Common CLI viewer interface Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ST_PAGE_CACHE_H__
+#define __ST_PAGE_CACHE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <list>
+#include <unordered_map>
+
+#define PAGE_CACHE_DEFAULT_BUDGET   (64 * 1024 * 1024)
+
+class CmdResponse;
+
+/**
+ * Recency and size bookkeeping for decoded pages held by a bridge.
+ * The cache does not own page objects: bridges record pages as they load them
+ * and release whatever evict() hands back until the byte budget is met.
+ */
+class StPageCache
+{
+private:
+    struct Entry
+    {
+        std::list<uint32_t>::iterator pos;
+        size_t bytes;
+    };
+
+    std::list<uint32_t> lru;
+    std::unordered_map<uint32_t, Entry> index;
+
+    size_t budget;
+    size_t used;
+    bool pinning;
+    uint32_t pinned;
+
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+
+public:
+    StPageCache();
+
+    StPageCache(StPageCache const&)            = delete;
+    StPageCache& operator=(StPageCache const&) = delete;
+
+public:
+    /**
+     * Marks the page as most recently used. Returns false if it is not cached.
+     */
+    bool touch(uint32_t page);
+
+    /**
+     * Hits and misses are counted by bridges, as only they know whether a cached page
+     * was complete enough for the request.
+     */
+    void recordHit() { hits++; }
+    void recordMiss() { misses++; }
+
+    /**
+     * Records a page or updates its size, marking it as most recently used.
+     * Pages decoded ahead of time are not recent: they are recorded as least recently used
+     * and an update leaves their position alone.
+     */
+    void put(uint32_t page, size_t bytes, bool recent = true);
+    void remove(uint32_t page);
+    void clear();
+
+    /**
+     * The page the client asked for last is never evicted, whatever is decoded around it.
+     */
+    void pin(uint32_t page);
+
+    /**
+     * Picks the least recently used page other than keep and the pinned one while over budget.
+     * The caller releases the page and calls remove(). Returns false when nothing has to go.
+     */
+    bool evict(uint32_t keep, uint32_t* page);
+
+    void setBudget(size_t budget) { this->budget = budget; }
+
+    size_t getBudget() const { return budget; }
+    size_t getUsed() const { return used; }
+    uint32_t getCount() const { return (uint32_t) index.size(); }
+    uint32_t getHits() const { return hits; }
+    uint32_t getMisses() const { return misses; }
+    uint32_t getEvictions() const { return evictions; }
+
+    /**
+     * Appends count, used bytes, budget, hits, misses and evictions to a CMD_RES_CACHE_STATS response.
+     */
+    void addStats(CmdResponse& response) const;
+};
+
+#endif
@@ -46,6 +46,7 @@
 #define CMD_RES_OUTLINE     17
 
 #define CMD_REQ_SET_CONFIG   			20
+// crengine sends estimated page count and percent done as RES_PARTIAL while paginating (version 2)
 #define CMD_RES_SET_CONFIG   			21
 #define CMD_REQ_SMART_CROP              22
 #define CMD_RES_SMART_CROP              23
@@ -59,6 +60,26 @@
 #define CMD_RES_ALIVE			        31
 #define CMD_REQ_LINKS   			    32
 #define CMD_RES_LINKS			        33
+#define CMD_REQ_SHARED_MEMORY           34
+#define CMD_RES_SHARED_MEMORY           35
+#define CMD_REQ_PROTOCOL                36
+#define CMD_RES_PROTOCOL                37
+#define CMD_REQ_CANCEL                  38
+#define CMD_RES_CANCEL                  39
+#define CMD_REQ_PAGE_TILE               40
+#define CMD_RES_PAGE_TILE               41
+#define CMD_REQ_CACHE_STATS             42
+// Same leading layout in every bridge: page cache count, used bytes, budget, hits, misses and
+// evictions, then bitmap cache used bytes, hits, misses and evictions. Engine counters follow.
+#define CMD_RES_CACHE_STATS             43
+#define CMD_REQ_SEARCH                  44
+// Hits of each page as RES_PARTIAL, the final response carries the total. Version 1 has no
+// partial responses: the final response lists page and rects pairs before the total.
+#define CMD_RES_SEARCH                  45
+// Sent without request, id is 0 (version 2 only)
+#define CMD_NOTIF_PAGE_COUNT            46
+#define CMD_REQ_THUMBNAILS              48
+#define CMD_RES_THUMBNAILS              49
 
 #define CMD_REQ_PDF_STORAGE 124
 #define CMD_RES_PDF_STORAGE 125
@@ -84,10 +105,21 @@
 #define RES_DUP_OPEN        4
 #define RES_NOT_OPENED      5
 #define RES_BAD_REQ_DATA    6
+#define RES_CANCELLED       7
+// Intermediate response, more responses with the same id follow
+#define RES_PARTIAL         8
 #define RES_MUPDF_PWD_WRONG 251
 #define RES_MUPDF_PWD_NEED  252
 #define RES_MUPDF_FAIL      254
 
+/**
+ * Version 1: strictly one request in, one response out.
+ * Version 2: every request and response header carries a request id after the command byte,
+ * several requests may be in flight and responses are matched by id.
+ */
+#define PROTOCOL_VERSION_1  1
+#define PROTOCOL_VERSION_2  2
+
 #define TYPE_NONE           0
 #define TYPE_FIX_WORDS      2
 #define TYPE_FIX_INT        3
@@ -194,6 +226,7 @@ class CmdRequest: public CmdDataList
 {
 public:
     uint8_t cmd;
+    uint32_t id;
 
 public:
     CmdRequest();
@@ -210,6 +243,7 @@ class CmdResponse: public CmdDataList
 public:
     uint8_t cmd;
     uint8_t result;
+    uint32_t id;
 
 public:
     CmdResponse();
@@ -24,6 +24,7 @@ class Queue
 protected:
     int fp;
     const char* lctx;
+    int version;
     pthread_mutex_t readlock;
     pthread_mutex_t writelock;
 
@@ -31,6 +32,10 @@ protected:
     Queue(const char* fname, int mode, const char* lctx);
     ~Queue();
 
+public:
+    void setVersion(int version) { this->version = version; }
+    int getVersion() const { return version; }
+
 protected:
     int readBuffer(int size, uint8_t* buf);
     int readByte(uint8_t* buf);
@@ -40,7 +45,7 @@ protected:
     void writeData(CmdData* data);
 };
 
-class RequestQueue : Queue
+class RequestQueue : public Queue
 {
 public:
     RequestQueue(const char* fname, int mode, const char* lctx);
@@ -51,7 +56,7 @@ public:
 
 };
 
-class ResponseQueue : Queue
+class ResponseQueue : public Queue
 {
 public:
     ResponseQueue(const char* fname, int mode, const char* lctx);
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2013 The Common CLI viewer interface Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ST_SHARED_MEMORY_H__
+#define __ST_SHARED_MEMORY_H__
+
+#include <stdint.h>
+#include <vector>
+
+#include "StProtocol.h"
+
+#define THUMBNAILS_MAX_PAGES        64
+#define THUMBNAILS_MAX_SIZE         512
+
+/**
+ * Anonymous shared memory block (memfd or ashmem) mapped into the bridge process.
+ * The descriptor is handed over to the client once, after that page bitmaps are
+ * rendered straight into the mapping and only their offset and stride are sent back.
+ */
+class StSharedMemory
+{
+private:
+    const char* lctx;
+    int fd;
+    uint8_t* data;
+    uint32_t size;
+
+public:
+    StSharedMemory(const char* lctx);
+    ~StSharedMemory();
+
+    StSharedMemory(StSharedMemory const&)            = delete;
+    StSharedMemory& operator=(StSharedMemory const&) = delete;
+
+public:
+    bool isValid() const { return data != NULL; }
+    int getFd() const { return fd; }
+    uint8_t* getData() const { return data; }
+    uint32_t getSize() const { return size; }
+
+    bool create(uint32_t size);
+    void release();
+};
+
+/**
+ * Pixel buffer of a single render reply.
+ * If the request carries an optional shared memory offset the pixels are drawn into
+ * the shared block, otherwise a byte array is allocated and streamed through the queue.
+ */
+class StRenderTarget
+{
+private:
+    CmdData* data;
+    uint8_t* pixels;
+    uint32_t offset;
+    uint32_t stride;
+
+public:
+    StRenderTarget();
+    ~StRenderTarget();
+
+    StRenderTarget(StRenderTarget const&)            = delete;
+    StRenderTarget& operator=(StRenderTarget const&) = delete;
+
+public:
+    uint8_t* allocate(StSharedMemory& shared, CmdDataIterator& iter, uint32_t width, uint32_t height);
+    /**
+     * Buffer of several packed bitmaps, committed with zero stride.
+     */
+    uint8_t* allocate(StSharedMemory& shared, CmdDataIterator& iter, uint32_t size);
+    void commit(CmdResponse& response);
+
+    uint8_t* getPixels() const { return pixels; }
+    uint32_t getStride() const { return stride; }
+};
+
+/**
+ * Pixel buffer of a batch render reply: bitmaps of several pages packed one after another,
+ * each with stride width * 4.
+ * The reply is an int array of (page, width, height, offset) entries, offsets are relative to
+ * the first bitmap, followed by a byte array with all bitmaps or by the shared memory offset.
+ * Pages that can't be rendered are reported with zero width and height.
+ */
+class StBatchTarget
+{
+private:
+    std::vector<int> entries;
+    uint32_t size;
+    StRenderTarget target;
+    uint8_t* pixels;
+
+public:
+    StBatchTarget();
+
+public:
+    /**
+     * Reserves place for a page bitmap, should be called for all pages before allocate().
+     */
+    void add(uint32_t pageNo, uint32_t width, uint32_t height);
+    uint8_t* allocate(StSharedMemory& shared, CmdDataIterator& iter);
+    void commit(CmdResponse& response);
+
+    int getCount() const { return entries.size() / 4; }
+    uint32_t getPage(int index) const { return entries[index * 4]; }
+    uint32_t getWidth(int index) const { return entries[index * 4 + 1]; }
+    uint32_t getHeight(int index) const { return entries[index * 4 + 2]; }
+    uint8_t* getPixels(int index) const { return pixels + entries[index * 4 + 3]; }
+    void fail(int index);
+};
+
+/**
+ * Fits page of the given size into the box keeping its aspect ratio, the result is never empty.
+ */
+void fitThumbnail(float pageWidth, float pageHeight, uint32_t maxWidth, uint32_t maxHeight,
+    uint32_t* width, uint32_t* height);
+
+#endif
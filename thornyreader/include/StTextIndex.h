@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2013 The Common CLI viewer interface Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ST_TEXT_INDEX_H__
+#define __ST_TEXT_INDEX_H__
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#define TEXT_INDEX_MAX_TERMS    16
+
+/**
+ * Word of a page: vocabulary token and its box in page relative coordinates.
+ */
+struct StTextWord
+{
+    uint32_t token;
+    float rect[4];
+};
+
+/**
+ * In-memory inverted index of document words, filled page by page as searches visit them.
+ * Tokens are case folded and stripped of surrounding punctuation. Every token keeps the list
+ * of pages it occurs on, so pages indexed by earlier searches are skipped unless they can match.
+ */
+class StTextIndex
+{
+private:
+    uint32_t pageCount;
+    std::vector<bool> indexed;
+    std::vector<std::vector<StTextWord> > words;
+
+    std::unordered_map<std::string, uint32_t> vocabulary;
+    std::vector<std::string> tokens;
+    std::vector<std::vector<uint32_t> > postings;
+
+    std::vector<std::string> terms;
+    // Per term and token: -1 not evaluated yet, 0 no match, 1 match
+    std::vector<std::vector<int8_t> > matches;
+    std::vector<bool> candidates;
+
+public:
+    StTextIndex();
+
+    StTextIndex(StTextIndex const&)            = delete;
+    StTextIndex& operator=(StTextIndex const&) = delete;
+
+public:
+    void reset(uint32_t pageCount);
+    uint32_t getPageCount() const { return pageCount; }
+
+    bool isIndexed(uint32_t page) const { return page < pageCount && indexed[page]; }
+
+    void addWord(uint32_t page, const char* text, float left, float top, float right, float bottom);
+    /**
+     * Marks page as complete, pages without text are marked too so that they are not extracted again.
+     */
+    void setIndexed(uint32_t page);
+
+    /**
+     * Splits pattern into terms. A single term matches anywhere inside a word, a phrase matches
+     * consecutive words where the first term ends a word, the last one starts a word and the
+     * others match whole words. Returns false if the pattern has no terms.
+     */
+    bool setQuery(const char* pattern);
+
+    /**
+     * Returns false if the page was indexed before setQuery() and cannot contain the query.
+     */
+    bool mayContain(uint32_t page) const;
+
+    /**
+     * Appends boxes of matched words of the page to rects, 4 floats each. Returns the number of hits.
+     */
+    uint32_t find(uint32_t page, std::vector<float>& rects);
+
+    static std::string fold(const char* text);
+
+private:
+    bool matchTerm(uint32_t term, uint32_t token);
+};
+
+#endif
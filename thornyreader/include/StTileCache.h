@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2013 The Common CLI viewer interface Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __ST_TILE_CACHE_H__
+#define __ST_TILE_CACHE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <list>
+#include <unordered_map>
+
+#define TILE_CACHE_DEFAULT_BUDGET   (32 * 1024 * 1024)
+#define TILE_MIN_SIZE               64
+#define TILE_MAX_SIZE               1024
+
+/**
+ * Tile of a page rendered at a given zoom. Zoom is kept in thousandths,
+ * so that float noise from the client does not produce distinct keys.
+ */
+struct StTileKey
+{
+    uint32_t page;
+    uint32_t zoom;
+    uint32_t x;
+    uint32_t y;
+    uint32_t size;
+
+    bool operator==(const StTileKey& other) const
+    {
+        return page == other.page && zoom == other.zoom
+                && x == other.x && y == other.y && size == other.size;
+    }
+};
+
+struct StTileKeyHash
+{
+    size_t operator()(const StTileKey& key) const
+    {
+        size_t h = key.page;
+        h = h * 31 + key.zoom;
+        h = h * 31 + key.x;
+        h = h * 31 + key.y;
+        h = h * 31 + key.size;
+        return h;
+    }
+};
+
+/**
+ * LRU cache of rendered RGBA tiles limited by a byte budget.
+ */
+class StTileCache
+{
+private:
+    struct Entry
+    {
+        StTileKey key;
+        uint8_t* pixels;
+        uint32_t bytes;
+    };
+
+    typedef std::list<Entry> EntryList;
+
+    EntryList lru;
+    std::unordered_map<StTileKey, EntryList::iterator, StTileKeyHash> index;
+
+    uint32_t budget;
+    uint32_t used;
+
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+
+public:
+    StTileCache();
+    ~StTileCache();
+
+    StTileCache(StTileCache const&)            = delete;
+    StTileCache& operator=(StTileCache const&) = delete;
+
+public:
+    static StTileKey key(uint32_t page, float zoom, uint32_t x, uint32_t y, uint32_t size);
+
+    /**
+     * Copies cached tile pixels into the given buffer. Returns false on miss.
+     */
+    bool get(const StTileKey& key, uint8_t* pixels, uint32_t bytes);
+    void put(const StTileKey& key, const uint8_t* pixels, uint32_t bytes);
+
+    void removePage(uint32_t page);
+    void clear();
+
+    void setBudget(uint32_t budget);
+
+    uint32_t getUsed() const { return used; }
+    uint32_t getHits() const { return hits; }
+    uint32_t getMisses() const { return misses; }
+    uint32_t getEvictions() const { return evictions; }
+
+private:
+    void trim(uint32_t limit);
+};
+
+#endif
@@ -70,9 +70,48 @@ void ThornyReaderStart(const char* name);
 #define CONFIG_CRE_MARGIN_RIGHT       			116
 #define CONFIG_CRE_VIEWPORT_WIDTH        		117
 #define CONFIG_CRE_VIEWPORT_HEIGHT     		118
+/**
+ * Directory for parsed and rendered documents, reopened without parsing when unchanged.
+ * Empty value disables the cache, the client is responsible for trimming the directory.
+ */
+#define CONFIG_CRE_CACHE_DIR           		119
+/**
+ * 1 to show EPUB starting from the chapter of the open request xpath before the whole book is parsed.
+ * The open response then carries a provisional page count, the final one is sent by CMD_NOTIF_PAGE_COUNT.
+ */
+#define CONFIG_CRE_LAZY_LOADING        		120
+/**
+ * Number of threads formatting paragraphs when the document is paginated, 1..9.
+ * Default 1 formats them on the decoder thread, the result does not depend on the value.
+ */
+#define CONFIG_CRE_LAYOUT_THREADS      		121
+/**
+ * Memory in MB parsed document data may occupy unpacked, 1..256, default 16.
+ * Least recently used storage chunks above it are kept compressed.
+ */
+#define CONFIG_CRE_STORAGE_MEMORY      		122
+/**
+ * Compression of document storage chunks: 0 zlib, default, smaller; 1 LZ4 style, faster
+ */
+#define CONFIG_CRE_STORAGE_CODEC       		123
 
 #define CONFIG_MUPDF_INVERT_IMAGES 		            202
 
+/**
+ * Number of pages before and after the last requested one that are decoded while idle,
+ * clamped to 0..PREFETCH_PAGES_MAX
+ */
+#define CONFIG_PREFETCH_PAGES                       300
+#define PREFETCH_PAGES_MAX                          16
+/**
+ * Memory in MB the decoded pages may occupy before idle prefetching stops
+ */
+#define CONFIG_PREFETCH_MEMORY                      301
+/**
+ * Memory in MB decoded pages may occupy before least recently used ones are released
+ */
+#define CONFIG_PAGE_CACHE_MEMORY                    302
+
 #define HARDCONFIG_DJVU_RENDERING_MODE              0
 #define HARDCONFIG_MUPDF_SLOW_CMYK                  0
 
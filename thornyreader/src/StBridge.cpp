@@ -22,10 +22,40 @@
 #include "StLog.h"
 #include "StProtocol.h"
 #include "StQueue.h"
+#include "StSocket.h"
 #include "StBridge.h"
 
 #define L_DEBUG false
 
+StBridge::StBridge(const char* lctx)
+    : shared(lctx)
+{
+    this->lctx = lctx;
+    this->cancelled = false;
+    this->in = NULL;
+    this->out = NULL;
+    this->eof = false;
+    this->barrier = false;
+    this->running = false;
+    this->runningId = 0;
+    this->runningCmd = CMD_UNKNOWN;
+
+    pthread_mutex_init(&pendinglock, NULL);
+    pthread_cond_init(&pendingcond, NULL);
+}
+
+StBridge::~StBridge()
+{
+    while (!pending.empty())
+    {
+        delete pending.front();
+        pending.pop_front();
+    }
+
+    pthread_mutex_destroy(&pendinglock);
+    pthread_cond_destroy(&pendingcond);
+}
+
 void StBridge::renice()
 {
     const char *env = getenv("ST_NICE_LEVEL");
@@ -62,6 +92,358 @@ void StBridge::renice()
     INFO_L(lctx, "Process nice level should not be changed");
 }
 
+void StBridge::processSharedMemory(CmdRequest& request, CmdResponse& response)
+{
+    response.cmd = CMD_RES_SHARED_MEMORY;
+    if (request.dataCount == 0)
+    {
+        ERROR_L(lctx, "No request data found");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+
+    uint8_t* socketName = NULL;
+    uint32_t size = 0;
+
+    CmdDataIterator iter(request.first);
+    iter.getByteArray(&socketName).getInt(&size);
+    if (!iter.isValid())
+    {
+        ERROR_L(lctx, "Bad request data");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+
+    if (size == 0)
+    {
+        DEBUG_L(L_DEBUG, lctx, "Shared memory released");
+        shared.release();
+        response.addInt(0);
+        return;
+    }
+
+    if (!shared.create(size))
+    {
+        response.result = RES_NO_CONTEXT;
+        return;
+    }
+
+    DEBUG_L(L_DEBUG, lctx, "Socket name: %s", socketName);
+    StSocketConnection connection((const char*) socketName);
+    if (!connection.isValid() || !connection.sendFileDescriptor(shared.getFd()))
+    {
+        shared.release();
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+
+    response.addInt(shared.getSize());
+}
+
+void* StBridge::readerThread(void* arg)
+{
+    ((StBridge*) arg)->readRequests();
+    return NULL;
+}
+
+void StBridge::readRequests()
+{
+    bool run = true;
+    while (run)
+    {
+        CmdRequest* request = new CmdRequest();
+
+        DEBUG_L(L_DEBUG, lctx, "Waiting for request...");
+        int res = in->readRequest(*request);
+        if (res == 0)
+        {
+            ERROR_L(lctx, "No data received");
+            delete request;
+
+            pthread_mutex_lock(&pendinglock);
+            eof = true;
+            pthread_cond_broadcast(&pendingcond);
+            pthread_mutex_unlock(&pendinglock);
+            return;
+        }
+
+        if (request->cmd == CMD_REQ_CANCEL)
+        {
+            processCancel(*request);
+            delete request;
+            continue;
+        }
+
+        run = request->cmd != CMD_REQ_QUIT;
+
+        pthread_mutex_lock(&pendinglock);
+        pending.push_back(request);
+        pthread_cond_broadcast(&pendingcond);
+        preemptIdle(*request);
+        // Following requests cannot be read until the new framing is applied
+        barrier = request->cmd == CMD_REQ_PROTOCOL;
+        while (barrier)
+        {
+            pthread_cond_wait(&pendingcond, &pendinglock);
+        }
+        pthread_mutex_unlock(&pendinglock);
+    }
+}
+
+CmdRequest* StBridge::takeRequest()
+{
+    CmdRequest* request = NULL;
+
+    pthread_mutex_lock(&pendinglock);
+    bool busy = true;
+    while (pending.empty() && !eof)
+    {
+        if (busy)
+        {
+            pthread_mutex_unlock(&pendinglock);
+            busy = idle();
+            pthread_mutex_lock(&pendinglock);
+        }
+        else
+        {
+            pthread_cond_wait(&pendingcond, &pendinglock);
+        }
+    }
+    if (!pending.empty())
+    {
+        request = pending.front();
+        pending.pop_front();
+        running = true;
+        runningId = request->id;
+        runningCmd = request->cmd;
+        cancelled = false;
+    }
+    pthread_mutex_unlock(&pendinglock);
+
+    return request;
+}
+
+bool StBridge::hasPendingRequests()
+{
+    pthread_mutex_lock(&pendinglock);
+    bool res = !pending.empty();
+    pthread_mutex_unlock(&pendinglock);
+    return res;
+}
+
+bool StBridge::isTagged() const
+{
+    return out->getVersion() >= PROTOCOL_VERSION_2;
+}
+
+bool StBridge::sendPartial(CmdResponse& response)
+{
+    if (!isTagged())
+    {
+        return false;
+    }
+    response.id = runningId;
+    response.result = RES_PARTIAL;
+    out->writeResponse(response);
+    return true;
+}
+
+bool StBridge::sendNotification(CmdResponse& response)
+{
+    if (!isTagged())
+    {
+        return false;
+    }
+    response.id = 0;
+    out->writeResponse(response);
+    return true;
+}
+
+void StBridge::processSearch(CmdRequest& request, CmdResponse& response, StTextIndex& index, uint32_t pageCount)
+{
+    response.cmd = CMD_RES_SEARCH;
+
+    uint8_t* pattern = NULL;
+    uint32_t startPage = 0;
+
+    CmdDataIterator iter(request.first);
+    iter.getByteArray(&pattern);
+    if (!iter.isValid())
+    {
+        ERROR_L(lctx, "Bad request data");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+    if (iter.hasNext() && !iter.getInt(&startPage).isValid())
+    {
+        ERROR_L(lctx, "Bad request data");
+        response.result = RES_BAD_REQ_DATA;
+        return;
+    }
+    if (pageCount == 0)
+    {
+        ERROR_L(lctx, "Document not yet opened");
+        response.result = RES_NOT_OPENED;
+        return;
+    }
+    if (startPage >= pageCount)
+    {
+        startPage = 0;
+    }
+    if (index.getPageCount() != pageCount)
+    {
+        index.reset(pageCount);
+    }
+    if (!index.setQuery((const char*) pattern))
+    {
+        response.addInt(0);
+        return;
+    }
+
+    uint32_t total = 0;
+    std::vector<float> rects;
+    uint32_t i = 0;
+    for (; i < pageCount && !cancelled; i++)
+    {
+        uint32_t pageNo = (startPage + i) % pageCount;
+        if (!index.mayContain(pageNo))
+        {
+            continue;
+        }
+        if (!index.isIndexed(pageNo))
+        {
+            indexText(pageNo, index);
+            index.setIndexed(pageNo);
+        }
+
+        rects.clear();
+        uint32_t hits = index.find(pageNo, rects);
+        if (hits == 0)
+        {
+            continue;
+        }
+        total += hits;
+
+        CmdResponse partial(CMD_RES_SEARCH);
+        partial.addInt(pageNo);
+        partial.addFloatArray(rects.size(), &rects[0], true);
+        if (!sendPartial(partial))
+        {
+            response.addInt(pageNo);
+            response.addFloatArray(rects.size(), &rects[0], true);
+        }
+    }
+
+    if (i < pageCount)
+    {
+        // Stopped by CMD_REQ_CANCEL before all pages were searched
+        response.result = RES_CANCELLED;
+        return;
+    }
+
+    DEBUG_L(L_DEBUG, lctx, "Search hits: %u", total);
+    response.addInt(total);
+}
+
+void StBridge::finishRequest(CmdRequest* request)
+{
+    pthread_mutex_lock(&pendinglock);
+    running = false;
+    cancelled = false;
+    if (request->cmd == CMD_REQ_PROTOCOL)
+    {
+        barrier = false;
+        pthread_cond_broadcast(&pendingcond);
+    }
+    pthread_mutex_unlock(&pendinglock);
+
+    delete request;
+}
+
+bool StBridge::isCancellable(uint8_t cmd)
+{
+    switch (cmd)
+    {
+    case CMD_REQ_PAGE_RENDER:
+    case CMD_REQ_PAGE_TILE:
+    case CMD_REQ_SEARCH:
+    case CMD_REQ_THUMBNAILS:
+        return true;
+    default:
+        return false;
+    }
+}
+
+int StBridge::processProtocol(CmdRequest& request, CmdResponse& response)
+{
+    response.cmd = CMD_RES_PROTOCOL;
+
+    uint32_t version = 0;
+    if (!CmdDataIterator(request.first).getInt(&version).isValid()
+            || version < PROTOCOL_VERSION_1 || version > PROTOCOL_VERSION_2)
+    {
+        ERROR_L(lctx, "Unsupported protocol version: %u", version);
+        response.result = RES_BAD_REQ_DATA;
+        response.addInt(out->getVersion());
+        return 0;
+    }
+
+    INFO_L(lctx, "Protocol version: %u", version);
+    response.addInt(version);
+    return version;
+}
+
+void StBridge::processCancel(CmdRequest& request)
+{
+    CmdResponse response(CMD_RES_CANCEL);
+    response.id = request.id;
+
+    uint32_t targetId = 0;
+    if (!CmdDataIterator(request.first).getInt(&targetId).isValid())
+    {
+        ERROR_L(lctx, "Bad request data");
+        response.result = RES_BAD_REQ_DATA;
+        out->writeResponse(response);
+        return;
+    }
+
+    CmdRequest* dropped = NULL;
+    bool stopped = false;
+
+    pthread_mutex_lock(&pendinglock);
+    for (std::deque<CmdRequest*>::iterator it = pending.begin(); it != pending.end(); ++it)
+    {
+        CmdRequest* r = *it;
+        if (r->id == targetId && r->cmd != CMD_REQ_QUIT && r->cmd != CMD_REQ_PROTOCOL)
+        {
+            dropped = r;
+            pending.erase(it);
+            break;
+        }
+    }
+    if (dropped == NULL && running && runningId == targetId && isCancellable(runningCmd))
+    {
+        cancelled = true;
+        cancelRunning();
+        stopped = true;
+    }
+    pthread_mutex_unlock(&pendinglock);
+
+    DEBUG_L(L_DEBUG, lctx, "Cancel request %u: queued=%d running=%d", targetId, dropped != NULL, stopped);
+
+    if (dropped != NULL)
+    {
+        CmdResponse droppedResponse(dropped->cmd + 1);
+        droppedResponse.id = dropped->id;
+        droppedResponse.result = RES_CANCELLED;
+        out->writeResponse(droppedResponse);
+        delete dropped;
+    }
+
+    response.addInt(dropped != NULL || stopped ? 1 : 0);
+    out->writeResponse(response);
+}
+
 int StBridge::main(int argc, char *argv[])
 {
     if (argc < 3)
@@ -75,40 +457,80 @@ int StBridge::main(int argc, char *argv[])
     DEBUG_L(L_DEBUG, lctx, "Output file: %s", argv[2]);
 
     ResponseQueue out(argv[2], O_WRONLY, lctx);
+    this->out = &out;
 
     INFO_L(lctx, "Sending ready notification...");
     out.sendReadyNotification();
 
     DEBUG_L(L_DEBUG, lctx, "Input  file: %s", argv[1]);
     RequestQueue in(argv[1], O_RDONLY, lctx);
+    this->in = &in;
 
-    CmdRequest request;
-    CmdResponse response;
+    if (pthread_create(&reader, NULL, readerThread, this) != 0)
+    {
+        ERROR_L(lctx, "Request reader cannot be started");
+        return -1;
+    }
 
+    int res = 0;
     bool run = true;
     while (run)
     {
-        DEBUG_L(L_DEBUG, lctx, "Waiting for request...");
-        int res = in.readRequest(request);
-        if (res == 0)
+        CmdRequest* request = takeRequest();
+        if (request == NULL)
         {
-            ERROR_L(lctx, "No data received");
-            return -1;
+            res = -1;
+            break;
         }
 
+        CmdResponse response;
+        int version = 0;
+
         DEBUG_L(L_DEBUG, lctx, "Processing request...");
-        process(request, response);
+        if (request->cmd == CMD_REQ_PROTOCOL)
+        {
+            version = processProtocol(*request, response);
+        }
+        else
+        {
+            process(*request, response);
+        }
+
+        pthread_mutex_lock(&pendinglock);
+        // The work is done, a cancel arriving from now on can't undo it
+        running = false;
+        pthread_mutex_unlock(&pendinglock);
+
+        if (response.result == RES_CANCELLED)
+        {
+            // Data of stopped work is incomplete
+            uint8_t cmd = response.cmd;
+            response.reset();
+            response.cmd = cmd;
+            response.result = RES_CANCELLED;
+        }
+        response.id = request->id;
 
         DEBUG_L(L_DEBUG, lctx, "Sending response...");
         out.writeResponse(response);
 
+        if (version != 0)
+        {
+            in.setVersion(version);
+            out.setVersion(version);
+        }
+
         run = response.cmd != CMD_RES_QUIT;
 
-        request.reset();
-        response.reset();
+        finishRequest(request);
     }
 
+    pthread_join(reader, NULL);
+
+    this->in = NULL;
+    this->out = NULL;
+
     INFO_L(lctx, "Exit");
 
-    return 0;
+    return res;
 }
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2013 The Common CLI viewer interface Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StProtocol.h"
+#include "StPageCache.h"
+
+StPageCache::StPageCache()
+{
+    budget = PAGE_CACHE_DEFAULT_BUDGET;
+    used = 0;
+    pinning = false;
+    pinned = 0;
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+}
+
+bool StPageCache::touch(uint32_t page)
+{
+    auto it = index.find(page);
+    if (it == index.end())
+    {
+        return false;
+    }
+    lru.splice(lru.end(), lru, it->second.pos);
+    return true;
+}
+
+void StPageCache::put(uint32_t page, size_t bytes, bool recent)
+{
+    auto it = index.find(page);
+    if (it != index.end())
+    {
+        used -= it->second.bytes;
+        it->second.bytes = bytes;
+        if (recent)
+        {
+            lru.splice(lru.end(), lru, it->second.pos);
+        }
+    }
+    else
+    {
+        Entry entry;
+        entry.pos = lru.insert(recent ? lru.end() : lru.begin(), page);
+        entry.bytes = bytes;
+        index[page] = entry;
+    }
+    used += bytes;
+}
+
+void StPageCache::remove(uint32_t page)
+{
+    auto it = index.find(page);
+    if (it == index.end())
+    {
+        return;
+    }
+    used -= it->second.bytes;
+    lru.erase(it->second.pos);
+    index.erase(it);
+}
+
+void StPageCache::clear()
+{
+    lru.clear();
+    index.clear();
+    used = 0;
+    pinning = false;
+}
+
+void StPageCache::pin(uint32_t page)
+{
+    pinning = true;
+    pinned = page;
+}
+
+bool StPageCache::evict(uint32_t keep, uint32_t* page)
+{
+    if (used <= budget)
+    {
+        return false;
+    }
+    for (std::list<uint32_t>::iterator it = lru.begin(); it != lru.end(); ++it)
+    {
+        if (*it != keep && !(pinning && *it == pinned))
+        {
+            *page = *it;
+            evictions++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void StPageCache::addStats(CmdResponse& response) const
+{
+    response.addInt(getCount());
+    response.addInt((uint32_t) used);
+    response.addInt((uint32_t) budget);
+    response.addInt(hits);
+    response.addInt(misses);
+    response.addInt(evictions);
+}
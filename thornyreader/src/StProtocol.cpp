@@ -230,10 +230,12 @@ CmdDataList& CmdDataList::addIpcString(const char* data, bool owned)
 CmdRequest::CmdRequest()
 {
     cmd = CMD_UNKNOWN;
+    id = 0;
 }
 CmdRequest::CmdRequest(uint8_t c)
 {
     cmd = c;
+    id = 0;
 }
 CmdRequest::~CmdRequest()
 {
@@ -247,13 +249,14 @@ void CmdRequest::reset()
         delete first;
     }
     cmd = CMD_UNKNOWN;
+    id = 0;
     dataCount = 0;
     first = last = NULL;
 }
 
 void CmdRequest::print(const char* lctx)
 {
-    DEBUG_L(L_PRINT_CMD, lctx, "Request: %u", this->cmd);
+    DEBUG_L(L_PRINT_CMD, lctx, "Request: %u %u", this->cmd, this->id);
     CmdData* data;
     for (data = this->first; data != NULL; data = data->nextData)
     {
@@ -265,12 +268,14 @@ CmdResponse::CmdResponse()
 {
     cmd = CMD_UNKNOWN;
     result = RES_OK;
+    id = 0;
 }
 
 CmdResponse::CmdResponse(uint8_t c)
 {
     cmd = c;
     result = RES_OK;
+    id = 0;
 }
 
 CmdResponse::~CmdResponse()
@@ -286,13 +291,14 @@ void CmdResponse::reset()
     }
     cmd = CMD_UNKNOWN;
     result = RES_OK;
+    id = 0;
+    dataCount = 0;
     first = last = NULL;
-
 }
 
 void CmdResponse::print(const char* lctx)
 {
-    DEBUG_L(L_PRINT_CMD, lctx, "Response: %u %u", this->cmd, this->result);
+    DEBUG_L(L_PRINT_CMD, lctx, "Response: %u %u %u", this->cmd, this->result, this->id);
     CmdData* data;
     for (data = this->first; data != NULL; data = data->nextData)
     {
@@ -37,6 +37,7 @@
 Queue::Queue(const char* fname, int mode, const char* lctx)
 {
     this->lctx = lctx;
+    this->version = PROTOCOL_VERSION_1;
     fp = open(fname, mode);
 
     pthread_mutex_init(&readlock, NULL);
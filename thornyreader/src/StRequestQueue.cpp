@@ -41,6 +41,12 @@ void RequestQueue::writeRequest(CmdRequest& request)
     DEBUG_L(L_DEBUG_REQ, lctx, "Writing request cmd: %02x", cmd);
     write(fp, &(cmd), sizeof(cmd));
 
+    if (version >= PROTOCOL_VERSION_2)
+    {
+        DEBUG_L(L_DEBUG_REQ, lctx, "Writing request id: %u", request.id);
+        write(fp, &(request.id), sizeof(request.id));
+    }
+
     CmdData* data = request.first;
     while (data != NULL)
     {
@@ -73,6 +79,17 @@ int RequestQueue::readRequest(CmdRequest& request)
     uint8_t hasData = cmd & CMD_MASK_HAS_DATA;
     DEBUG_L(L_DEBUG_REQ, lctx, "Request cmd: %d, has data: %d", request.cmd, hasData);
 
+    if (version >= PROTOCOL_VERSION_2)
+    {
+        if (readInt(&(request.id)) == 0)
+        {
+            DEBUG_L(L_DEBUG_REQ, lctx, "No request id received");
+            pthread_mutex_unlock(&readlock);
+            return 0;
+        }
+        DEBUG_L(L_DEBUG_REQ, lctx, "Request id: %u", request.id);
+    }
+
     CmdData* data = request.first;
     while (hasData)
     {
@@ -50,6 +50,12 @@ void ResponseQueue::writeResponse(CmdResponse& response)
     DEBUG_L(L_DEBUG_RES, lctx, "Writing response result: %d", response.result);
     write(fp, &(response.result), sizeof(response.result));
 
+    if (version >= PROTOCOL_VERSION_2)
+    {
+        DEBUG_L(L_DEBUG_RES, lctx, "Writing response id: %u", response.id);
+        write(fp, &(response.id), sizeof(response.id));
+    }
+
     CmdData* data = response.first;
     while (data != NULL)
     {
@@ -89,6 +95,16 @@ int ResponseQueue::readResponse(CmdResponse& response)
     }
     DEBUG_L(L_DEBUG_RES, lctx, "Response result: %d", response.result);
 
+    if (version >= PROTOCOL_VERSION_2)
+    {
+        if (readInt(&(response.id)) == 0)
+        {
+            pthread_mutex_unlock(&readlock);
+            return 0;
+        }
+        DEBUG_L(L_DEBUG_RES, lctx, "Response id: %u", response.id);
+    }
+
     CmdData* data = response.first;
     while (hasData)
     {
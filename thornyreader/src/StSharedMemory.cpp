@@ -0,0 +1,253 @@
+/*
+ * Copyright (C) 2013 The Common CLI viewer interface Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+#include "StLog.h"
+#include "StProtocol.h"
+#include "StSharedMemory.h"
+
+#define L_DEBUG false
+
+#define SHARED_MEMORY_NAME "thornyreader.pixels"
+
+#define ASHMEM_DEVICE       "/dev/ashmem"
+#define ASHMEM_NAME_LEN     256
+#define ASHMEM_IOC          0x77
+#define ASHMEM_SET_NAME     _IOW(ASHMEM_IOC, 1, char[ASHMEM_NAME_LEN])
+#define ASHMEM_SET_SIZE     _IOW(ASHMEM_IOC, 3, size_t)
+
+static int createMemfd(uint32_t size)
+{
+#ifdef __NR_memfd_create
+    int fd = syscall(__NR_memfd_create, SHARED_MEMORY_NAME, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    return -1;
+#endif
+}
+
+static int createAshmem(uint32_t size)
+{
+    int fd = open(ASHMEM_DEVICE, O_RDWR);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    char name[ASHMEM_NAME_LEN] = SHARED_MEMORY_NAME;
+    ioctl(fd, ASHMEM_SET_NAME, name);
+    if (ioctl(fd, ASHMEM_SET_SIZE, (size_t) size) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+StSharedMemory::StSharedMemory(const char* lctx)
+{
+    this->lctx = lctx;
+    fd = -1;
+    data = NULL;
+    size = 0;
+}
+
+StSharedMemory::~StSharedMemory()
+{
+    release();
+}
+
+bool StSharedMemory::create(uint32_t size)
+{
+    release();
+
+    if (size == 0)
+    {
+        return false;
+    }
+
+    // memfd is only available since Linux 3.17, older devices have ashmem only
+    fd = createMemfd(size);
+    if (fd < 0)
+    {
+        fd = createAshmem(size);
+    }
+    if (fd < 0)
+    {
+        ERROR_L(lctx, "Shared memory cannot be created: %d", errno);
+        return false;
+    }
+
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (ptr == MAP_FAILED)
+    {
+        ERROR_L(lctx, "Shared memory cannot be mapped: %d", errno);
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    this->data = (uint8_t*) ptr;
+    this->size = size;
+
+    DEBUG_L(L_DEBUG, lctx, "Shared memory created: %d %u", fd, size);
+    return true;
+}
+
+void StSharedMemory::release()
+{
+    if (data != NULL)
+    {
+        munmap(data, size);
+        data = NULL;
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    size = 0;
+}
+
+StRenderTarget::StRenderTarget()
+{
+    data = NULL;
+    pixels = NULL;
+    offset = 0;
+    stride = 0;
+}
+
+StRenderTarget::~StRenderTarget()
+{
+    if (data != NULL)
+    {
+        delete data;
+        data = NULL;
+    }
+}
+
+uint8_t* StRenderTarget::allocate(StSharedMemory& shared, CmdDataIterator& iter, uint32_t width, uint32_t height)
+{
+    uint8_t* res = allocate(shared, iter, width * 4 * height);
+    stride = width * 4;
+    return res;
+}
+
+uint8_t* StRenderTarget::allocate(StSharedMemory& shared, CmdDataIterator& iter, uint32_t size)
+{
+    stride = 0;
+    if (!iter.hasNext())
+    {
+        data = new CmdData();
+        pixels = data->newByteArray(size);
+        return pixels;
+    }
+
+    iter.getInt(&offset);
+    if (!iter.isValid() || !shared.isValid())
+    {
+        return NULL;
+    }
+    if (offset > shared.getSize() || shared.getSize() - offset < size)
+    {
+        return NULL;
+    }
+
+    pixels = shared.getData() + offset;
+    return pixels;
+}
+
+void StRenderTarget::commit(CmdResponse& response)
+{
+    if (data != NULL)
+    {
+        response.addData(data);
+        data = NULL;
+    }
+    else
+    {
+        response.addInt(offset).addInt(stride);
+    }
+}
+
+StBatchTarget::StBatchTarget()
+{
+    size = 0;
+    pixels = NULL;
+}
+
+void StBatchTarget::add(uint32_t pageNo, uint32_t width, uint32_t height)
+{
+    entries.push_back(pageNo);
+    entries.push_back(width);
+    entries.push_back(height);
+    entries.push_back(size);
+    size += width * height * 4;
+}
+
+uint8_t* StBatchTarget::allocate(StSharedMemory& shared, CmdDataIterator& iter)
+{
+    // Empty byte array can't be allocated
+    pixels = target.allocate(shared, iter, size > 0 ? size : 4);
+    return pixels;
+}
+
+void StBatchTarget::fail(int index)
+{
+    entries[index * 4 + 1] = 0;
+    entries[index * 4 + 2] = 0;
+}
+
+void StBatchTarget::commit(CmdResponse& response)
+{
+    response.addInt(getCount());
+    if (!entries.empty())
+    {
+        response.addIntArray(entries.size(), &entries[0], true);
+    }
+    target.commit(response);
+}
+
+void fitThumbnail(float pageWidth, float pageHeight, uint32_t maxWidth, uint32_t maxHeight,
+    uint32_t* width, uint32_t* height)
+{
+    float scale = 1.0f;
+    if (pageWidth > 0 && pageHeight > 0)
+    {
+        float sx = maxWidth / pageWidth;
+        float sy = maxHeight / pageHeight;
+        scale = sx < sy ? sx : sy;
+    }
+    *width = (uint32_t) (pageWidth * scale + 0.5f);
+    *height = (uint32_t) (pageHeight * scale + 0.5f);
+    *width = *width < 1 ? 1 : *width > maxWidth ? maxWidth : *width;
+    *height = *height < 1 ? 1 : *height > maxHeight ? maxHeight : *height;
+}
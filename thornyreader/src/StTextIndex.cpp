@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2013 The Common CLI viewer interface Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StTextIndex.h"
+
+static uint32_t decodeUtf8(const unsigned char*& p)
+{
+    uint32_t c = *p++;
+    int extra = 0;
+    if (c >= 0xF0)
+    {
+        c &= 0x07;
+        extra = 3;
+    }
+    else if (c >= 0xE0)
+    {
+        c &= 0x0F;
+        extra = 2;
+    }
+    else if (c >= 0xC0)
+    {
+        c &= 0x1F;
+        extra = 1;
+    }
+    for (; extra > 0 && (*p & 0xC0) == 0x80; extra--)
+    {
+        c = (c << 6) | (*p++ & 0x3F);
+    }
+    return c;
+}
+
+static void encodeUtf8(uint32_t c, std::string& out)
+{
+    if (c < 0x80)
+    {
+        out += (char) c;
+    }
+    else if (c < 0x800)
+    {
+        out += (char) (0xC0 | (c >> 6));
+        out += (char) (0x80 | (c & 0x3F));
+    }
+    else if (c < 0x10000)
+    {
+        out += (char) (0xE0 | (c >> 12));
+        out += (char) (0x80 | ((c >> 6) & 0x3F));
+        out += (char) (0x80 | (c & 0x3F));
+    }
+    else
+    {
+        out += (char) (0xF0 | (c >> 18));
+        out += (char) (0x80 | ((c >> 12) & 0x3F));
+        out += (char) (0x80 | ((c >> 6) & 0x3F));
+        out += (char) (0x80 | (c & 0x3F));
+    }
+}
+
+// Simple case folding for Latin, Greek and Cyrillic, enough for the scripts books are searched in
+static uint32_t lowerCase(uint32_t c)
+{
+    if ((c >= 'A' && c <= 'Z') || (c >= 0xC0 && c <= 0xDE && c != 0xD7))
+    {
+        return c + 0x20;
+    }
+    if (((c >= 0x100 && c <= 0x137) || (c >= 0x14A && c <= 0x177)) && (c & 1) == 0 && c != 0x130)
+    {
+        return c + 1;
+    }
+    if (c >= 0x139 && c <= 0x148 && (c & 1) == 1)
+    {
+        return c + 1;
+    }
+    if (c >= 0x391 && c <= 0x3AB && c != 0x3A2)
+    {
+        return c + 0x20;
+    }
+    if (c >= 0x410 && c <= 0x42F)
+    {
+        return c + 0x20;
+    }
+    if (c >= 0x400 && c <= 0x40F)
+    {
+        return c + 0x50;
+    }
+    return c;
+}
+
+static bool isPunctuation(uint32_t c)
+{
+    return (c >= 0x21 && c <= 0x2F) || (c >= 0x3A && c <= 0x40) || (c >= 0x5B && c <= 0x60)
+            || (c >= 0x7B && c <= 0x7E) || c == 0xAB || c == 0xBB || (c >= 0x2010 && c <= 0x201F) || c == 0x2026;
+}
+
+static bool isSpace(uint32_t c)
+{
+    return c == 0x20 || c == 0x09 || c == 0x0A || c == 0x0D || c == 0xA0;
+}
+
+StTextIndex::StTextIndex()
+{
+    pageCount = 0;
+}
+
+void StTextIndex::reset(uint32_t pageCount)
+{
+    this->pageCount = pageCount;
+    indexed.assign(pageCount, false);
+    words.clear();
+    words.resize(pageCount);
+    vocabulary.clear();
+    tokens.clear();
+    postings.clear();
+    terms.clear();
+    matches.clear();
+    candidates.clear();
+}
+
+std::string StTextIndex::fold(const char* text)
+{
+    std::string res;
+    std::string tail;
+    const unsigned char* p = (const unsigned char*) text;
+    while (*p)
+    {
+        uint32_t c = decodeUtf8(p);
+        if (isPunctuation(c))
+        {
+            // Leading punctuation is dropped, inner one is kept unless it ends the word
+            if (!res.empty())
+            {
+                encodeUtf8(c, tail);
+            }
+            continue;
+        }
+        res += tail;
+        tail.clear();
+        encodeUtf8(lowerCase(c), res);
+    }
+    return res;
+}
+
+void StTextIndex::addWord(uint32_t page, const char* text, float left, float top, float right, float bottom)
+{
+    if (page >= pageCount)
+    {
+        return;
+    }
+    std::string key = fold(text);
+    if (key.empty())
+    {
+        return;
+    }
+
+    uint32_t token;
+    auto it = vocabulary.find(key);
+    if (it != vocabulary.end())
+    {
+        token = it->second;
+    }
+    else
+    {
+        token = (uint32_t) tokens.size();
+        vocabulary[key] = token;
+        tokens.push_back(key);
+        postings.push_back(std::vector<uint32_t>());
+    }
+
+    std::vector<uint32_t>& pages = postings[token];
+    if (pages.empty() || pages.back() != page)
+    {
+        pages.push_back(page);
+    }
+
+    StTextWord word;
+    word.token = token;
+    word.rect[0] = left;
+    word.rect[1] = top;
+    word.rect[2] = right;
+    word.rect[3] = bottom;
+    words[page].push_back(word);
+}
+
+void StTextIndex::setIndexed(uint32_t page)
+{
+    if (page < pageCount)
+    {
+        indexed[page] = true;
+    }
+}
+
+bool StTextIndex::setQuery(const char* pattern)
+{
+    terms.clear();
+    matches.clear();
+    candidates.assign(pageCount, false);
+
+    std::string term;
+    const unsigned char* p = (const unsigned char*) pattern;
+    while (true)
+    {
+        const unsigned char* start = p;
+        uint32_t c = *p ? decodeUtf8(p) : 0;
+        if (c == 0 || isSpace(c))
+        {
+            std::string key = fold(term.c_str());
+            if (!key.empty() && terms.size() < TEXT_INDEX_MAX_TERMS)
+            {
+                terms.push_back(key);
+            }
+            term.clear();
+            if (c == 0)
+            {
+                break;
+            }
+        }
+        else
+        {
+            term.append((const char*) start, p - start);
+        }
+    }
+    if (terms.empty())
+    {
+        return false;
+    }
+
+    matches.resize(terms.size());
+    for (uint32_t t = 0; t < terms.size(); t++)
+    {
+        matches[t].assign(tokens.size(), -1);
+    }
+
+    // Vocabulary is much smaller than the text, so it is scanned instead of the pages
+    for (uint32_t token = 0; token < tokens.size(); token++)
+    {
+        if (matchTerm(0, token))
+        {
+            const std::vector<uint32_t>& pages = postings[token];
+            for (uint32_t i = 0; i < pages.size(); i++)
+            {
+                candidates[pages[i]] = true;
+            }
+        }
+    }
+    return true;
+}
+
+bool StTextIndex::mayContain(uint32_t page) const
+{
+    return page < pageCount && (!indexed[page] || candidates[page]);
+}
+
+bool StTextIndex::matchTerm(uint32_t term, uint32_t token)
+{
+    std::vector<int8_t>& cache = matches[term];
+    if (token >= cache.size())
+    {
+        cache.resize(tokens.size(), -1);
+    }
+    if (cache[token] >= 0)
+    {
+        return cache[token] != 0;
+    }
+
+    const std::string& word = tokens[token];
+    const std::string& t = terms[term];
+    bool res;
+    if (terms.size() == 1)
+    {
+        res = word.find(t) != std::string::npos;
+    }
+    else if (term == 0)
+    {
+        res = word.size() >= t.size() && word.compare(word.size() - t.size(), t.size(), t) == 0;
+    }
+    else if (term == terms.size() - 1)
+    {
+        res = word.compare(0, t.size(), t) == 0;
+    }
+    else
+    {
+        res = word == t;
+    }
+    cache[token] = res ? 1 : 0;
+    return res;
+}
+
+uint32_t StTextIndex::find(uint32_t page, std::vector<float>& rects)
+{
+    if (page >= pageCount || terms.empty())
+    {
+        return 0;
+    }
+
+    const std::vector<StTextWord>& list = words[page];
+    uint32_t count = terms.size();
+    uint32_t hits = 0;
+    for (uint32_t i = 0; i + count <= list.size();)
+    {
+        uint32_t t = 0;
+        while (t < count && matchTerm(t, list[i + t].token))
+        {
+            t++;
+        }
+        if (t < count)
+        {
+            i++;
+            continue;
+        }
+        for (t = 0; t < count; t++)
+        {
+            rects.insert(rects.end(), list[i + t].rect, list[i + t].rect + 4);
+        }
+        hits++;
+        i += count;
+    }
+    return hits;
+}
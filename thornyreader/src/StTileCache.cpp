@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2013 The Common CLI viewer interface Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "StTileCache.h"
+
+StTileCache::StTileCache()
+{
+    budget = TILE_CACHE_DEFAULT_BUDGET;
+    used = 0;
+    hits = 0;
+    misses = 0;
+    evictions = 0;
+}
+
+StTileCache::~StTileCache()
+{
+    clear();
+}
+
+StTileKey StTileCache::key(uint32_t page, float zoom, uint32_t x, uint32_t y, uint32_t size)
+{
+    StTileKey key;
+    key.page = page;
+    key.zoom = (uint32_t) (zoom * 1000 + 0.5f);
+    key.x = x;
+    key.y = y;
+    key.size = size;
+    return key;
+}
+
+bool StTileCache::get(const StTileKey& key, uint8_t* pixels, uint32_t bytes)
+{
+    auto it = index.find(key);
+    if (it == index.end() || it->second->bytes != bytes)
+    {
+        misses++;
+        return false;
+    }
+
+    // Move to the most recently used end
+    lru.splice(lru.end(), lru, it->second);
+    memcpy(pixels, it->second->pixels, bytes);
+    hits++;
+    return true;
+}
+
+void StTileCache::put(const StTileKey& key, const uint8_t* pixels, uint32_t bytes)
+{
+    if (bytes > budget)
+    {
+        return;
+    }
+
+    auto it = index.find(key);
+    if (it != index.end())
+    {
+        used -= it->second->bytes;
+        free(it->second->pixels);
+        lru.erase(it->second);
+        index.erase(it);
+    }
+
+    trim(budget - bytes);
+
+    uint8_t* copy = (uint8_t*) malloc(bytes);
+    if (copy == NULL)
+    {
+        return;
+    }
+    memcpy(copy, pixels, bytes);
+
+    Entry entry;
+    entry.key = key;
+    entry.pixels = copy;
+    entry.bytes = bytes;
+    index[key] = lru.insert(lru.end(), entry);
+    used += bytes;
+}
+
+void StTileCache::removePage(uint32_t page)
+{
+    for (EntryList::iterator it = lru.begin(); it != lru.end();)
+    {
+        if (it->key.page == page)
+        {
+            used -= it->bytes;
+            free(it->pixels);
+            index.erase(it->key);
+            it = lru.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void StTileCache::clear()
+{
+    for (EntryList::iterator it = lru.begin(); it != lru.end(); ++it)
+    {
+        free(it->pixels);
+    }
+    lru.clear();
+    index.clear();
+    used = 0;
+}
+
+void StTileCache::setBudget(uint32_t budget)
+{
+    this->budget = budget;
+    trim(budget);
+}
+
+void StTileCache::trim(uint32_t limit)
+{
+    while (used > limit && !lru.empty())
+    {
+        Entry& oldest = lru.front();
+        used -= oldest.bytes;
+        free(oldest.pixels);
+        index.erase(oldest.key);
+        lru.pop_front();
+        evictions++;
+    }
+}